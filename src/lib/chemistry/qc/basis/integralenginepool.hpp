@@ -29,7 +29,13 @@
 #define MPQC_CHEMISTRY_QC_BASIS_INTEGRALENGINEPOOL_HPP_
 
 #include <pthread.h>
-#include <mpqc/utility/mutex.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <chemistry/qc/basis/integral.h>
 #include <vector>
 #include <util/misc/scexception.h>
@@ -44,91 +50,148 @@ namespace mpqc {
      * and then clone it multiple times such that each thread has its own
      * integral engine.  This is necessary because the buffers in the
      * integral engines don't have thread-safe access.
+     *
+     * All engines are cloned when the pool is constructed, so that getting
+     * an engine needs no lock.  The number of engines can be bounded to
+     * save memory; borrow() then waits for an engine to become free.
      */
     template<typename RefEngType>
     class IntegralEnginePool {
-      /// The thread local storage key
-      pthread_key_t engine_key_;
-      RefEngType prototype_;
-      // Pointers to the TLS data which will allows us to manually delete them in the constructor.
-      std::vector<void*> tls_ptrs;
 
     public:
 
       typedef RefEngType engine_type;
 
+      /**
+       * An engine borrowed from the pool with borrow().  The engine is
+       * returned to the pool when the Borrowed object is destroyed.
+       */
+      class Borrowed {
+        IntegralEnginePool *pool_;
+        std::size_t slot_;
+      public:
+        Borrowed(IntegralEnginePool *pool, std::size_t slot) :
+                pool_(pool), slot_(slot) {}
+        Borrowed(Borrowed &&other) : pool_(other.pool_), slot_(other.slot_) {
+          other.pool_ = nullptr;
+        }
+        Borrowed(const Borrowed &) = delete;
+        Borrowed& operator=(const Borrowed &) = delete;
+        ~Borrowed() {
+          if (pool_) pool_->release(slot_);
+        }
+        /// The engine, which only the owner of this object may use.
+        const RefEngType &engine() const { return pool_->engines_[slot_]; }
+      };
+
+    private:
+      /// The thread local storage key for instance()
+      pthread_key_t engine_key_;
+      RefEngType prototype_;
+      /// The engines, with flags marking those in use
+      std::vector<RefEngType> engines_;
+      std::unique_ptr<std::atomic<bool>[]> in_use_;
+      /// Engines cloned by instance(), one per calling thread; these are
+      /// never handed out by borrow().  Their addresses must not change,
+      /// hence a list.
+      std::list<RefEngType> thread_engines_;
+      std::mutex thread_engines_mutex_;
+
+      static std::size_t default_nengine() {
+        const std::size_t nhw = std::thread::hardware_concurrency();
+        return std::max<std::size_t>(nhw, 1) + 1;
+      }
+
+      /// Marks slot i in use, if it is free.
+      bool try_acquire(std::size_t i) {
+        bool expected = false;
+        return in_use_[i].compare_exchange_strong(expected, true,
+                                                  std::memory_order_acquire);
+      }
+
+      /// Marks a free slot in use, starting at the preferred slot of this
+      /// thread, and returns its index or engines_.size() if all are in use.
+      std::size_t find_free() {
+        const std::size_t n = engines_.size();
+        const std::size_t first =
+                std::hash<std::thread::id>()(std::this_thread::get_id()) % n;
+        for (std::size_t k = 0; k < n; ++k) {
+          const std::size_t i = (first + k) % n;
+          if (!in_use_[i].load(std::memory_order_relaxed) && try_acquire(i))
+            return i;
+        }
+        return n;
+      }
+
+      void release(std::size_t i) {
+        in_use_[i].store(false, std::memory_order_release);
+      }
+
+    public:
+
       /**
        * IntegralEnginePool constructor it takes a sc::Ref<sc::IntegralEngine>
-       * and sets that as the prototype for all the thread local engines
+       * and sets that as the prototype for all the thread local engines.
+       * @param nengine is the number of engines; by default it is one more
+       * than the number of hardware threads.
        */
-      IntegralEnginePool(const RefEngType engine) :
-              prototype_(engine) {
-        if (pthread_key_create(&engine_key_, nullptr) != 0) // objects will be manually destroyed by the destructor
+      IntegralEnginePool(const RefEngType engine, std::size_t nengine = 0) :
+              prototype_(engine),
+              engines_(nengine ? nengine : default_nengine()),
+              in_use_(new std::atomic<bool>[engines_.size()]) {
+        if (pthread_key_create(&engine_key_, nullptr) != 0)
           throw sc::SystemException(
                   "IntegralEnginePool::IntegralEnginePool() "
                   "Unable to register thread local storage key. "
                   "Likely due to a limited number of keys.",
                   __FILE__, __LINE__);
+        for (std::size_t i = 0; i < engines_.size(); ++i) {
+          engines_[i] = prototype_->clone();
+          in_use_[i].store(false, std::memory_order_relaxed);
+        }
       }
 
-      /**
-       * Delete the Engines that we allocated for TLS
-       */
       ~IntegralEnginePool() {
-        /*
-         * The following loop manually calls delete for each TLS RefEngine pointer
-         * since they normally would not be deallocated until madness::Finalize()
-         * this is to avoid what is effectively a memory leak
-         */
-        for(void *ptr : tls_ptrs){ // For all TLS pointers
-          destroy_thread_object(ptr); // destory it
-        }
-
         pthread_key_delete(engine_key_);
+      }
+
+      /// The number of engines that borrow() hands out.
+      std::size_t nengine() const { return engines_.size(); }
 
+      /**
+       * Borrows an engine for the lifetime of the returned object.  If
+       * all engines are in use this waits until one is returned.
+       */
+      Borrowed borrow() {
+        std::size_t slot;
+        while ((slot = find_free()) == engines_.size())
+          std::this_thread::yield();
+        return Borrowed(this, slot);
       }
 
       /**
-       * Function that returns a clone of the prototype engine.  The clone
-       * exist for only one thread to use and so should not be written to or used
-       * by any other thread.
+       * Function that returns an engine that belongs to the calling thread
+       * for the lifetime of the pool.  The engine should not be written to or
+       * used by any other thread.  The first call from each thread makes
+       * a new clone, separate from the engines handed out by borrow().
        */
       RefEngType instance() {
 
-        // Declare a pointer to a sc::Ref<Engine>
         RefEngType *RefEngine =
                 reinterpret_cast<RefEngType*>(pthread_getspecific(engine_key_));
 
         if (RefEngine == nullptr) {
-          RefEngine = new RefEngType;
-
-          // Get clone of prototype, must lock to ensure nobody else
-          // clones at the same time. As long as number of threads isn't
-          // Super high this should be ok.
-          mutex::global::lock(); // <<< Begin Critical Section
-          *RefEngine = prototype_->clone();
-          mutex::global::unlock(); // <<< End Critical Section
-
-          // Asign RefEngine to its thread specific partner.
+          // Cloning must not race with other clones of the prototype.
+          std::lock_guard<std::mutex> lock(thread_engines_mutex_);
+          thread_engines_.push_back(prototype_->clone());
+          RefEngine = &thread_engines_.back();
           pthread_setspecific(engine_key_, RefEngine);
-
-          // copy the key so that we can manually delete it's data later
-          tls_ptrs.push_back(pthread_getspecific(engine_key_));
-
         }
 
         return *RefEngine;
 
       }
 
-    private:
-      /// Function to destroy the thread objects
-      static void destroy_thread_object(void* p) {
-        RefEngType* ptr = reinterpret_cast<RefEngType*>(p);
-        delete ptr;
-        ptr = nullptr;
-      }
-
       /**
        * Copy cosntruction and assignment are not allowed for
        * IntegralEnginePool.
@@ -30,6 +30,10 @@
 
 #include <tiledarray.h>
 #include <memory>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
 #include <chemistry/qc/basis/tiledbasisset.hpp>
 #include <mpqc/integrals/integrals.hpp>
 #include <chemistry/qc/basis/integral.h>
@@ -87,6 +91,112 @@ namespace mpqc {
         mpqc::integrals::evaluate(engine, s[0], s[1], s[2], s[3], tile_map);
       }
 
+      /// The shells of each tile of a TiledRange1.
+      inline std::vector<shell_range>
+      tile_shells(const ::TiledArray::TiledRange1 &trange1,
+                  const sc::Ref<sc::GaussianBasisSet> &basis) {
+        std::vector<shell_range> shells;
+        for (auto t = trange1.begin(); t != trange1.end(); ++t) {
+          shell_range r;
+          const int first_shell = basis->function_to_shell(t->first);
+          const int last_shell = basis->function_to_shell(t->second - 1);
+          for (int s = first_shell; s <= last_shell; ++s)
+            r.push_back(s);
+          shells.push_back(r);
+        }
+        return shells;
+      }
+
+      /*
+       * Computes bounds on the largest integral of each tile.  The
+       * primary template does no screening; the two-body engines
+       * are specialized below to use Schwarz bounds.
+       */
+      template<typename RefEngine>
+      struct TileBounds {
+        TileBounds(RefEngine &, const std::vector<std::vector<shell_range> > &) {}
+        double operator()(const std::vector<std::size_t> &) const {
+          return std::numeric_limits<double>::max();
+        }
+      };
+
+      // (ij|kl) <= sqrt((ij|ij)) sqrt((kl|kl)); all four centers must share
+      // one basis
+      template<>
+      struct TileBounds<sc::Ref<sc::TwoBodyInt> > {
+        std::vector<double> q01_, q23_;
+        std::size_t n1_, n3_;
+        TileBounds(sc::Ref<sc::TwoBodyInt> &engine,
+                   const std::vector<std::vector<shell_range> > &tiles) :
+            n1_(tiles[1].size()), n3_(tiles[3].size()) {
+          pair_bounds(engine, tiles[0], tiles[1], q01_);
+          pair_bounds(engine, tiles[2], tiles[3], q23_);
+        }
+        static void pair_bounds(sc::Ref<sc::TwoBodyInt> &engine,
+                                const std::vector<shell_range> &t0,
+                                const std::vector<shell_range> &t1,
+                                std::vector<double> &q) {
+          q.assign(t0.size() * t1.size(), 0.0);
+          for (std::size_t a = 0; a < t0.size(); ++a)
+            for (std::size_t b = 0; b < t1.size(); ++b) {
+              double &qab = q[a * t1.size() + b];
+              for (int i : t0[a])
+                for (int j : t1[b])
+                  qab = std::max(qab, std::sqrt(engine->shell_bound(i, j, i, j)));
+            }
+        }
+        double operator()(const std::vector<std::size_t> &t) const {
+          return q01_[t[0] * n1_ + t[1]] * q23_[t[2] * n3_ + t[3]];
+        }
+      };
+
+      // The bound of (ij|P) over all P for a given ij, and the bound
+      // over all ij for a given P; the integral is bounded by the smaller
+      // one.
+      template<>
+      struct TileBounds<sc::Ref<sc::TwoBodyThreeCenterInt> > {
+        std::vector<double> q01_, q2_;
+        std::size_t n1_;
+        TileBounds(sc::Ref<sc::TwoBodyThreeCenterInt> &engine,
+                   const std::vector<std::vector<shell_range> > &tiles) :
+            n1_(tiles[1].size()) {
+          q01_.assign(tiles[0].size() * n1_, 0.0);
+          for (std::size_t a = 0; a < tiles[0].size(); ++a)
+            for (std::size_t b = 0; b < n1_; ++b) {
+              double &qab = q01_[a * n1_ + b];
+              for (int i : tiles[0][a])
+                for (int j : tiles[1][b])
+                  qab = std::max(qab, engine->shell_bound(i, j, -1));
+            }
+          q2_.assign(tiles[2].size(), 0.0);
+          for (std::size_t c = 0; c < tiles[2].size(); ++c)
+            for (int k : tiles[2][c])
+              q2_[c] = std::max(q2_[c], engine->shell_bound(-1, -1, k));
+        }
+        double operator()(const std::vector<std::size_t> &t) const {
+          return std::min(q01_[t[0] * n1_ + t[1]], q2_[t[2]]);
+        }
+      };
+
+      // (P|Q) <= sqrt((P|P)) sqrt((Q|Q))
+      template<>
+      struct TileBounds<sc::Ref<sc::TwoBodyTwoCenterInt> > {
+        std::vector<double> q0_, q1_;
+        TileBounds(sc::Ref<sc::TwoBodyTwoCenterInt> &engine,
+                   const std::vector<std::vector<shell_range> > &tiles) {
+          for (std::size_t c = 0; c < 2; ++c) {
+            std::vector<double> &q = (c == 0 ? q0_ : q1_);
+            q.assign(tiles[c].size(), 0.0);
+            for (std::size_t a = 0; a < tiles[c].size(); ++a)
+              for (int i : tiles[c][a])
+                q[a] = std::max(q[a], std::sqrt(engine->shell_bound(i, i)));
+          }
+        }
+        double operator()(const std::vector<std::size_t> &t) const {
+          return q0_[t[0]] * q1_[t[1]];
+        }
+      };
+
     } // namespace int_details
 
     /*
@@ -131,67 +241,117 @@ namespace mpqc {
 
     }
 
-    template<typename ShrPtrPool, typename It, class A>
-    void make_integral_task(It first, It last, const A &array, ShrPtrPool pool);
-
     /*
-     * Splits work in into manageable chunks by creating tasks. And then fills
-     * each tile with integrals.
+     * Estimates the cost of computing the integrals of a tile.  The cost of
+     * a shell block grows with the number of functions and primitives of
+     * each shell and, through the recursions, with its angular momentum.
+     * Since the tile is a direct product of shell ranges, the estimate is
+     * the product over the dimensions of per-dimension sums.
      */
-    template<typename ShrPtrPool, typename It, class A>
-    void integral_task(It first, It last, A &array, ShrPtrPool &pool) {
-
-      // Divide work.   If the distance between the first and last pointer
-      // is greater than some number then split the range in half and send
-      // half of the work to another task.  Continue to do this until
-      // the distance between the pointers is small enough.
-      while (last - first > 10) {
-        It middle = first;
-        std::advance(middle, std::distance(first, last) / 2);
-        make_integral_task(middle, last, array, pool);
-        last = middle;
+    template<typename RefEngine>
+    double tile_cost(const ::TiledArray::Range &range, RefEngine &engine) {
+      constexpr std::size_t rank = EngineTypeTraits<RefEngine>::ncenters;
+      double cost = 1.0;
+      for (std::size_t i = 0; i < rank; ++i) {
+        const sc::Ref<sc::GaussianBasisSet> basis = engine->basis(i);
+        const int first_shell = basis->function_to_shell(range.start()[i]);
+        const int last_shell = basis->function_to_shell(range.finish()[i] - 1);
+        double dimcost = 0.0;
+        for (int s = first_shell; s <= last_shell; ++s) {
+          const sc::GaussianBasisSet::Shell &shell = basis->shell(s);
+          dimcost += double(shell.nfunction()) * shell.nprimitive()
+                  * (shell.max_angular_momentum() + 1);
+        }
+        cost *= dimcost;
       }
+      return cost;
+    }
 
-      // Once the pointer range is small enough unwrap the engine type
-      // and get a local instance
-      typename PoolPtrType<ShrPtrPool>::engine_type engine = pool->instance();
+    /*
+     * Fills the tiles with the given ordinal indices.
+     */
+    template<typename ShrPtrPool, class A>
+    void integral_task(const std::vector<std::size_t> &tiles,
+                       A &array, ShrPtrPool &pool) {
 
-      // Loop over the iterator range and  create tiles to populate the
+      // Unwrap the engine type and borrow an engine for this task
+      auto borrowed = pool->borrow();
+      typename PoolPtrType<ShrPtrPool>::engine_type engine = borrowed.engine();
+
+      // Loop over the tiles and create tiles to populate the
       // TiledArray. Fill the tiles with data in get_integrals
-      for (; first != last; ++first) {
-        typename A::value_type tile(array.trange().make_tile_range(*first));
+      for (std::size_t t : tiles) {
+        typename A::value_type tile(array.trange().make_tile_range(t));
         get_integrals(tile, engine);
 
-        array.set(*first, tile);
+        array.set(t, tile);
       }
     }
 
     /*
-     * Spawns tasks to fill tiles with integrals.
+     * Spawns a task to fill tiles with integrals.
      */
-    template<typename ShrPtrPool, typename It, class A>
-    void make_integral_task(It first, It last, const A &array, ShrPtrPool pool){
-      array.get_world().taskq.add(&integral_task<ShrPtrPool, It, A>, first, last,
+    template<typename ShrPtrPool, class A>
+    void make_integral_task(const std::vector<std::size_t> &tiles,
+                            const A &array, ShrPtrPool pool) {
+      array.get_world().taskq.add(&integral_task<ShrPtrPool, A>, tiles,
                                   array, pool);
     }
 
 #endif //DOXYGEN
     /**
      * Initial function called to fill a TiledArray with integrals.
+     *
+     * The local tiles that are not zero are grouped into tasks of about
+     * equal estimated cost, as given by tile_cost().  There are several
+     * tasks per thread so that the MADNESS task queue can even out errors
+     * in the estimate.
+     *
      * @param[in,out] array is a TiledArray::Array that will be filled with data
      * @param[in] pool is an IntegralEnginePool object to provide integrals.
      */
     template<typename ShrPtrPool, class A>
     void fill_tiles(A &array, const ShrPtrPool &pool) {
 
-      // get pointers
-      auto begin = array.get_pmap()->begin();
-      auto end = array.get_pmap()->end();
-
-      // Create tasks to fill tiles with data. Boost const reference is used
-      // because Integral Engine pool is not copyable, but when sent to the
-      // Madness task queue all objects are copied.
-      make_integral_task(begin, end, array, pool);
+      // Estimate the cost of the local tiles; the engine is returned to
+      // the pool before the tasks are spawned
+      std::vector<std::size_t> tiles;
+      std::vector<double> costs;
+      double total_cost = 0.0;
+      {
+        auto borrowed = pool->borrow();
+        typename PoolPtrType<ShrPtrPool>::engine_type engine = borrowed.engine();
+        for (auto it = array.get_pmap()->begin(); it != array.get_pmap()->end();
+             ++it) {
+          // Tiles that are zero according to the shape are not stored
+          if (array.is_zero(*it)) continue;
+          tiles.push_back(*it);
+          costs.push_back(tile_cost(
+                  array.trange().make_tile_range(*it), engine));
+          total_cost += costs.back();
+        }
+      }
+      if (tiles.empty()) return;
+
+      const std::size_t ntask = std::min(tiles.size(),
+              std::size_t(4 * (madness::ThreadPool::size() + 1)));
+      const double task_cost = total_cost / ntask;
+
+      // Create tasks to fill tiles with data.  Tiles are added to a task
+      // until its cost reaches the target; a tile is added only if that
+      // brings the task closer to the target.
+      std::vector<std::size_t> task_tiles;
+      double cost = 0.0;
+      for (std::size_t i = 0; i < tiles.size(); ++i) {
+        if (!task_tiles.empty() && cost + 0.5 * costs[i] > task_cost) {
+          make_integral_task(task_tiles, array, pool);
+          task_tiles.clear();
+          cost = 0.0;
+        }
+        task_tiles.push_back(tiles[i]);
+        cost += costs[i];
+      }
+      make_integral_task(task_tiles, array, pool);
     }
 
 /// @addtogroup ChemistryBasisIntegralTA
@@ -266,6 +426,198 @@ namespace mpqc {
       return array;
     }
 
+    /// The type of the block-sparse array that holds integrals.
+    template<std::size_t N>
+    using SparseIntegralArray = ::TiledArray::Array<double, N,
+            ::TiledArray::Tensor<double>, ::TiledArray::SparsePolicy>;
+
+#ifndef DOXYGEN
+    namespace int_details {
+      /*
+       * Computes the shape of an integral array from bounds on the
+       * integrals of each tile.  The Frobenius norm of a tile is bounded by
+       * the largest integral times the square root of its size.  Tiles whose
+       * bound is smaller than threshold are zero.
+       */
+      template<typename RefEngine>
+      ::TiledArray::SparseShape<float>
+      integral_shape(madness::World &world, RefEngine engine,
+                     const ::TiledArray::TiledRange &trange,
+                     double threshold) {
+        constexpr std::size_t N = EngineTypeTraits<RefEngine>::ncenters;
+        std::vector<std::vector<shell_range> > tiles(N);
+        for (std::size_t i = 0; i < N; ++i)
+          tiles[i] = tile_shells(trange.data()[i], engine->basis(i));
+
+        TileBounds<RefEngine> bounds(engine, tiles);
+
+        ::TiledArray::Tensor<float> norms(trange.tiles(), 0.0f);
+        std::size_t ord = 0;
+        for (auto it = trange.tiles().begin(); it != trange.tiles().end();
+             ++it, ++ord) {
+          const std::vector<std::size_t> t(it->begin(), it->end());
+          double volume = 1.0;
+          for (std::size_t i = 0; i < N; ++i) {
+            const auto &r = trange.data()[i].tile(t[i]);
+            volume *= r.second - r.first;
+          }
+          const double bound = bounds(t);
+          if (bound >= threshold)
+            norms[ord] = float(std::min(bound * std::sqrt(volume),
+                               double(std::numeric_limits<float>::max())));
+        }
+
+        // every process computed all of the norms, so they are not summed
+        return ::TiledArray::SparseShape<float>(norms, trange);
+      }
+    } // namespace int_details
+#endif // DOXYGEN
+
+    /**
+     * Computes integrals into a block-sparse array.  Tiles whose integrals
+     * are all smaller than threshold, as estimated from Schwarz bounds on
+     * the shell blocks of the TiledBasisSet, are neither allocated nor
+     * computed.  Only two-body engines are screened; with one-body engines
+     * every tile is computed.
+     */
+    template<typename ShrPtrPool>
+    SparseIntegralArray<
+            EngineTypeTraits<typename PoolPtrType<ShrPtrPool>::engine_type>::ncenters>
+    SparseIntegrals(
+            madness::World &world, const ShrPtrPool &pool,
+            const sc::Ref<mpqc::TA::TiledBasisSet> &tbasis,
+            double threshold = 1e-12) {
+
+      typedef typename PoolPtrType<ShrPtrPool>::engine_type engine_type;
+      constexpr size_t rank = EngineTypeTraits<engine_type>::ncenters;
+
+      std::array<TiledArray::TiledRange1, rank> blocking;
+      for (auto i = 0; i < rank; ++i) {
+        blocking[i] = tbasis->trange1();
+      }
+      ::TiledArray::TiledRange trange(blocking.begin(), blocking.end());
+
+      SparseIntegralArray<rank> array(world, trange,
+              int_details::integral_shape(world, pool->borrow().engine(), trange,
+                                          threshold));
+
+      fill_tiles(array, pool);
+
+      return array;
+    }
+
+    /**
+     * As above, but the last dimension uses dftbasis, as for the three
+     * center integrals of density fitting.
+     */
+    template<typename ShrPtrPool>
+    SparseIntegralArray<
+            EngineTypeTraits<typename PoolPtrType<ShrPtrPool>::engine_type>::ncenters>
+    SparseIntegrals(
+            madness::World &world, const ShrPtrPool &pool,
+            const sc::Ref<mpqc::TA::TiledBasisSet> &tbasis,
+            const sc::Ref<mpqc::TA::TiledBasisSet> &dftbasis,
+            double threshold = 1e-12) {
+
+      typedef typename PoolPtrType<ShrPtrPool>::engine_type engine_type;
+      constexpr size_t rank = EngineTypeTraits<engine_type>::ncenters;
+
+      std::array<TiledArray::TiledRange1, rank> blocking;
+      for (auto i = 0; i < (rank - 1); ++i) {
+        blocking[i] = tbasis->trange1();
+      }
+      blocking.back() = dftbasis->trange1();
+      ::TiledArray::TiledRange trange(blocking.begin(), blocking.end());
+
+      SparseIntegralArray<rank> array(world, trange,
+              int_details::integral_shape(world, pool->borrow().engine(), trange,
+                                          threshold));
+
+      fill_tiles(array, pool);
+
+      return array;
+    }
+
+    /**
+     * Copies a dense array into a block-sparse one.  The shape is computed
+     * from the norms of the tiles, so tiles that are zero are not stored.
+     * Collective.
+     */
+    template<std::size_t N>
+    SparseIntegralArray<N>
+    to_sparse(const ::TiledArray::Array<double, N> &dense) {
+      madness::World &world = dense.get_world();
+      const ::TiledArray::TiledRange &trange = dense.trange();
+
+      ::TiledArray::Tensor<float> norms(trange.tiles(), 0.0f);
+      for (auto it = dense.begin(); it != dense.end(); ++it)
+        norms[trange.tiles().ordinal(it.index())] = (*it).get().norm();
+      world.gop.sum(norms.data(), norms.size());
+
+      SparseIntegralArray<N> sparse(world, trange,
+              ::TiledArray::SparseShape<float>(norms, trange));
+      for (auto it = dense.begin(); it != dense.end(); ++it) {
+        if (!sparse.is_zero(it.index()))
+          sparse.set(it.index(), (*it).get());
+      }
+      return sparse;
+    }
+
+    /**
+     * Copies a dense array into a block-sparse one with a known shape, such
+     * as that of an earlier to_sparse(dense) of the same kind of array.  The
+     * tile norms are not gathered.  Returns false, and leaves sparse
+     * unchanged, if on some process a tile that is zero in shape is not
+     * negligible; the shape must then be recomputed.  Collective, but only
+     * a single integer is summed over the processes.
+     */
+    template<std::size_t N>
+    bool
+    to_sparse(const ::TiledArray::Array<double, N> &dense,
+              const ::TiledArray::SparseShape<float> &shape,
+              SparseIntegralArray<N> &sparse) {
+      madness::World &world = dense.get_world();
+
+      int nmissed = 0;
+      for (auto it = dense.begin(); it != dense.end(); ++it) {
+        if (!shape.is_zero(it.index())) continue;
+        const ::TiledArray::Tensor<double> &tile = (*it).get();
+        // SparseShape compares the norm per element with the threshold
+        if (tile.norm() >= ::TiledArray::SparseShape<float>::threshold()
+                           * tile.range().volume())
+          ++nmissed;
+      }
+      world.gop.sum(nmissed);
+      if (nmissed) return false;
+
+      sparse = SparseIntegralArray<N>(world, dense.trange(), shape);
+      for (auto it = dense.begin(); it != dense.end(); ++it) {
+        if (!sparse.is_zero(it.index()))
+          sparse.set(it.index(), (*it).get());
+      }
+      return true;
+    }
+
+    /**
+     * Copies a block-sparse array into a dense one; the zero tiles are
+     * filled with zeros.  Collective.
+     */
+    template<std::size_t N>
+    ::TiledArray::Array<double, N>
+    to_dense(const SparseIntegralArray<N> &sparse) {
+      ::TiledArray::Array<double, N> dense(sparse.get_world(), sparse.trange());
+      for (auto it = dense.get_pmap()->begin(); it != dense.get_pmap()->end();
+           ++it) {
+        const std::size_t ord = *it;
+        if (sparse.is_zero(ord))
+          dense.set(ord, ::TiledArray::Tensor<double>(
+                  dense.trange().make_tile_range(ord), 0.0));
+        else
+          dense.set(ord, sparse.find(ord));
+      }
+      return dense;
+    }
+
 /// @} // ChemistryBasisIntegralTA
 
   }// namespace TA
@@ -47,7 +47,7 @@ CCR12::CCR12(StateIn& s): SavableState(s), Wavefunction(s), ccr12_info_(0) {
 }
 
 
-CCR12::CCR12(const Ref<KeyVal>& keyval): Wavefunction(keyval), ccr12_info_(0) {
+CCR12::CCR12(const Ref<KeyVal>& keyval): Wavefunction(keyval), ccr12_info_(0), spin_adapted_(false) {
 
   reference_ << keyval->describedclassvalue("reference");
   if (reference_.null()) {
@@ -115,9 +115,15 @@ CCR12::CCR12(const Ref<KeyVal>& keyval): Wavefunction(keyval), ccr12_info_(0) {
   // get the memory sizes
   memorysize_ = keyval->longvalue("memory",   KeyValValuelong(200000000));
   ExEnv::out0() << indent << "Memory size per node: " << memorysize_ << endl;
+  // memory for the cache of tensor blocks; it is taken from memory
+  tilecachesize_ = keyval->longvalue("tile_cache", KeyValValuelong(memorysize_ / 10));
+  if (tilecachesize_ < 0 || tilecachesize_ >= memorysize_)
+    throw InputError("tile_cache must be nonnegative and smaller than memory",
+                     __FILE__, __LINE__, "tile_cache", 0, class_desc());
+  ExEnv::out0() << indent << "Tile cache per node: " << tilecachesize_ << endl;
   worksize_ = keyval->longvalue("workmemory",   KeyValValuelong(50000000));
 #ifdef DISK_BASED_SMITH
-  worksize_ = memorysize_; 
+  worksize_ = memorysize_ - tilecachesize_;
 #endif
   ExEnv::out0() << indent << "Work   size per node: " << worksize_   << endl;
   tilesize_forced_ = keyval->intvalue("force_tilesize",KeyValValueint(0));
@@ -137,10 +143,14 @@ void CCR12::compute(){
 
   // CCR12_Info will do integral evaluation, before MemoryGrp is used by Tensors
   if (ccr12_info_ != 0) delete ccr12_info_;
-  ccr12_info_=new CCR12_Info(r12world(),mem_,memorysize_,ref(),nfzc_,nfzv_,
-                  molecule()->point_group()->char_table().nirrep(),worksize_,memorysize_,mem_->n(),ndiis_,
-                  theory_,perturbative_,tilesize_forced_);
-
+  // the tile cache is not part of the MemoryGrp
+  const long tensor_memory = memorysize_ - tilecachesize_;
+  ccr12_info_=new CCR12_Info(r12world(),mem_,tensor_memory,ref(),nfzc_,nfzv_,
+                  molecule()->point_group()->char_table().nirrep(),worksize_,tensor_memory,mem_->n(),ndiis_,
+                  theory_,perturbative_,tilesize_forced_,spin_adapted_);
+
+  TensorTileCache::instance()->set_max_bytes(tilecachesize_);
+  TensorTileCache::instance()->reset_statistics();
 }
 
 
@@ -213,6 +223,14 @@ void CCR12::print_timing(double timing, std::string tag){
 }
 
 
+void CCR12::print_tile_cache_statistics(){
+  if (mem_->me()==0) {
+    TensorTileCache::instance()->print(ExEnv::out0());
+    ExEnv::out0() << endl;
+  }
+}
+
+
 void CCR12::print_correction(double corr, double base, string theory){
  if (mem_->me()==0) {
   ExEnv::out0() << endl;
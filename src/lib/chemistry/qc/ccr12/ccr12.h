@@ -55,12 +55,15 @@ class CCR12: public Wavefunction {
     int nfzc_, nfzv_;
     long worksize_;
     long memorysize_;
+    long tilecachesize_;
     bool rhf_;
     int maxiter_;
     int tilesize_forced_;
     Ref<RegionTimer> timer_;
     std::string theory_;
     std::string perturbative_;
+    /// if true, CCR12_Info does not build the spin-orbital v2, t1 and t2
+    bool spin_adapted_;
     double ccthresh_;
 
     int ndiis_;
@@ -98,6 +101,7 @@ class CCR12: public Wavefunction {
     void print_correction(double,double,std::string);
     void print(std::ostream&) const;
     void print_timing(double,std::string);
+    void print_tile_cache_statistics();
 
 };
 
@@ -44,12 +44,14 @@ CCR12_Info::CCR12_Info(const Ref<R12WavefunctionWorld>& r12world,
                        const Ref<MemoryGrp>& mem, size_t memorysize,
                        const Ref<SCF> reference, int nfc, int nfv, int nirr,
                        long workmem, long memsize, int nnode, int ndiis,
-                       string theory, string per, int tilef):
+                       string theory, string per, int tilef, bool spin_adapted):
 r12world_(r12world), mem_(mem), ref_(reference), nfzc_(nfc),
-nfzv_(nfv), nirrep_(nirr), workmemsize_(workmem), theory_(theory), perturbative_(per), maxtilesize_(tilef)
+nfzv_(nfv), nirrep_(nirr), workmemsize_(workmem), theory_(theory), perturbative_(per),
+spin_adapted_(spin_adapted), maxtilesize_(tilef)
 {
   MPQC_ASSERT(r12world_->r12tech()->corrfactor()->nfunctions() == 1);
   restricted_ = !ref()->spin_polarized();
+  thrgrp_ = ThreadGrp::get_default_threadgrp();
 
   needs();
 
@@ -116,11 +118,13 @@ nfzv_(nfv), nirrep_(nirr), workmemsize_(workmem), theory_(theory), perturbative_
   mem_->sync();
 
   // now need_w1 and need_w2 are treated within a single function
-  d_v2 = new Tensor("v2", mem_);
-  offset_v2();
-  static_size += d_v2->get_filesize() * sizeof(double);
-  mem_->sync();
-  fill_in_v2();
+  if (!spin_adapted_) {
+    d_v2 = new Tensor("v2", mem_);
+    offset_v2();
+    static_size += d_v2->get_filesize() * sizeof(double);
+    mem_->sync();
+    fill_in_v2();
+  }
 
   if (need_t1()) {
     d_t1 = new Tensor("t1",mem_);
@@ -289,7 +293,9 @@ nfzv_(nfv), nirrep_(nirr), workmemsize_(workmem), theory_(theory), perturbative_
 //  }
 
   // Making initial guess for t2.
-  if (!need_gt2() || (need_gt2() && (perturbative_ == "(T)R12" || perturbative_ == "(2)R12"))) {
+  if (!need_t2()) {
+    // the spin-adapted code keeps its own amplitudes
+  } else if (!need_gt2() || (need_gt2() && (perturbative_ == "(T)R12" || perturbative_ == "(2)R12"))) {
     guess_t2(d_t2);
   } else if (r12world_->r12tech()->ansatz()->amplitudes() != R12Technology::GeminalAmplitudeAnsatz_fullopt) {
     // assuming d_gt2 is already filled in.
@@ -417,6 +423,8 @@ void CCR12_Info::determine_maxtilesize(double memory){
     string t = theory_;
     // transform(t.begin(),t.end(),t.begin(),(int (*)(int))tolower);
     const double max_blocks = 7.0;
+    // every thread allocates its own work blocks
+    memory /= thrgrp_->nthread();
 
     if (t == "CCSD" || t == "CCSD(R12)" || t == "CCSD-R12"){
       maxtilesize_=static_cast<int>(::pow(memory / max_blocks, 0.25));
@@ -429,7 +437,10 @@ void CCR12_Info::determine_maxtilesize(double memory){
       throw ProgrammingError("CCR12_Info::tilesize -- not yet implemented", __FILE__, __LINE__);
     }
 
-    // Perturbative correction needs an additional memory area.
+    // Perturbative correction needs an additional memory area: each thread
+    // of CCSD_PT holds three triples blocks, four doubles blocks and up to a
+    // triples block of tiles kept between sextets, which fit into five
+    // triples blocks.
     // There is a room to let tilesize larger than this by calculating explicitly the memory demands...
     if (perturbative_ == "(T)" || perturbative_ == "(T)R12[DT]" || perturbative_ == "(T)R12"){
       const int p_maxtilesize = static_cast<int>(::pow(memory / 5.0, 1.0 / 6.0));
@@ -486,6 +497,13 @@ void CCR12_Info::needs(){
     throw ProgrammingError("CCR12_Info::needs", __FILE__, __LINE__);
   }
 
+  // the spin-adapted closed-shell CCSD has its own amplitudes
+  if (spin_adapted_) {
+    MPQC_ASSERT(theory_ == "CCSD" && (perturbative_ == "" || perturbative_ == "(T)"));
+    need_t1_ = false;
+    need_t2_ = false;
+  }
+
   // unscreened version
   if (perturbative_ == "(2)R12FULL" || perturbative_ == "(2)TQR12") {
     need_w1_ = true;
@@ -51,9 +51,13 @@ class CCR12_Info : virtual public RefCount {
   protected:
     const Ref<SCF> ref_;
     const Ref<MemoryGrp>& mem_;
+    /// used to run the SMITH kernels that use SmithTaskRunner
+    Ref<ThreadGrp> thrgrp_;
 
     const std::string theory_;
     const std::string perturbative_;
+    /// the spin-adapted closed-shell code reads the integrals from pppp_acc_
+    const bool spin_adapted_;
 
     // common tensors
     Ref<Tensor> d_f1;
@@ -193,7 +197,7 @@ class CCR12_Info : virtual public RefCount {
   public:
     CCR12_Info(const Ref<R12WavefunctionWorld>&,const Ref<MemoryGrp>&,size_t,
                const Ref<SCF>,int,int,int,long,long,int,int,
-               std::string,std::string,int);
+               std::string,std::string,int,bool spin_adapted = false);
     ~CCR12_Info();
 
     void print(std::ostream&);
@@ -265,6 +269,7 @@ class CCR12_Info : virtual public RefCount {
     Ref<Tensor> lambda3() const {return d_lambda3;};
 
     const Ref<MemoryGrp>& mem() const {return mem_;};
+    const Ref<ThreadGrp>& thrgrp() const {return thrgrp_;};
     long irrep_f() const {return irrep_f_;};
     long irrep_v() const {return irrep_v_;};
     long irrep_t() const {return irrep_t_;};
@@ -279,6 +284,9 @@ class CCR12_Info : virtual public RefCount {
                       long&, long&, long&, long&, long&, long&) const;
     void restricted_8(const long, const long, const long, const long, const long, const long, const long, const long,
                       long&, long&, long&, long&, long&, long&, long&, long&) const;
+    /// permute the indices of a tile: the (i,j,...) arguments give the index of the unsorted
+    /// tile that becomes the first, second, ... index of the sorted one. Scaled by factor;
+    /// the _acc versions accumulate into sorted.
     void sort_indices0(const double* a,double* b,const double facter) const {*b=facter*(*a);};
     void sort_indices2(const double*, double*, const long, const long,
                        const int, const int, const double) const;
@@ -393,6 +401,12 @@ class CCR12_Info : virtual public RefCount {
 
     // returns shared pointers of OrbitalSpace objects
     Ref<OrbitalSpace> corr_space() { return corr_space_; };  // full space
+    Ref<OrbitalSpace> aobs_space() { return aobs_space_; };  // alpha spin only, no CABS
+
+    /// source <pp|ERI|pp> integrals over aobs_space()
+    const Ref<DistArray4>& pppp_acc() const { return pppp_acc_[AlphaBeta]; };
+    /// true if the spin-orbital v2, t1 and t2 are not built
+    bool spin_adapted() const { return spin_adapted_; };
 
     // used in MP2-R12 updates etc.
     void denom_contraction(const Ref<Tensor>&, Ref<Tensor>&);
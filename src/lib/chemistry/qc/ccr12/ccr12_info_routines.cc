@@ -132,29 +132,114 @@ void CCR12_Info::restricted_8(const long inp1,const long inp2,const long inp3,co
 } 
 
 
+namespace {
+
+  // edge of the blocks of the blocked transposes; a block of the source
+  // and of the destination fit in the L1 cache together
+  const long sort_block = 16L;
+
+  template <bool Acc>
+  inline void sort_store(double& dest, const double value) {
+    if (Acc) dest += value;
+    else     dest  = value;
+  }
+
+  // the fastest indices of both arrays are the same: a contiguous run
+  template <bool Acc>
+  void sort_run(const double* unsorted, double* sorted, const long n, const double factor) {
+    if (!Acc && factor == 1.0) {
+      std::copy(unsorted, unsorted + n, sorted);
+      return;
+    }
+    for (long x = 0L; x < n; ++x) sort_store<Acc>(sorted[x], factor * unsorted[x]);
+  }
+
+  // x is the fastest index of unsorted, y the fastest index of sorted;
+  // the writes are contiguous and the strided reads stay within a block
+  template <bool Acc>
+  void sort_tile(const double* unsorted, double* sorted, const long nx, const long ny,
+                 const long ystride, const long xstride, const double factor) {
+    for (long y0 = 0L; y0 < ny; y0 += sort_block) {
+      const long y1 = std::min(ny, y0 + sort_block);
+      for (long x0 = 0L; x0 < nx; x0 += sort_block) {
+        const long x1 = std::min(nx, x0 + sort_block);
+        for (long x = x0; x < x1; ++x) {
+          const double* src = unsorted + x;
+          double* dest = sorted + x * xstride;
+          for (long y = y0; y < y1; ++y) sort_store<Acc>(dest[y], factor * src[y * ystride]);
+        }
+      }
+    }
+  }
+
+  // sorted[perm[0]][perm[1]]... (op)= factor * unsorted[0][1]...; the last index is the fastest.
+  // Indices that are adjacent and in the same order in both arrays are merged first,
+  // so that e.g. (0,1,3,2) becomes a two-index transpose with a single outer index.
+  template <bool Acc>
+  void sort_general(const double* unsorted, double* sorted, const int rank,
+                    const long* dims, const int* perm, const double factor) {
+    int pos[8];
+    for (int q = 0; q < rank; ++q) pos[perm[q]] = q;
+
+    int group[8];
+    long gdims[8];
+    int ng = 0;
+    for (int r = 0; r < rank; ++r) {
+      if (r > 0 && pos[r] == pos[r-1] + 1) gdims[ng-1] *= dims[r];
+      else gdims[ng++] = dims[r];
+      group[r] = ng - 1;
+    }
+    int gperm[8];
+    for (int q = 0, k = 0; q < rank; ++q) {
+      const int r = perm[q];
+      if (r == 0 || group[r] != group[r-1]) gperm[k++] = group[r];
+    }
+
+    long istride[8], ostride[8];
+    long size = 1L;
+    for (int r = ng - 1; r >= 0; --r) { istride[r] = size; size *= gdims[r]; }
+    if (size == 0L) return;
+    size = 1L;
+    for (int q = ng - 1; q >= 0; --q) { ostride[gperm[q]] = size; size *= gdims[gperm[q]]; }
+
+    const int x = ng - 1;
+    const int y = gperm[ng - 1];
+    int outer[8];
+    int nouter = 0;
+    for (int r = 0; r < ng; ++r)
+      if (r != x && r != y) outer[nouter++] = r;
+
+    long count[8] = {0L};
+    long ioffset = 0L, ooffset = 0L;
+    while (true) {
+      if (x == y) sort_run<Acc>(unsorted + ioffset, sorted + ooffset, gdims[x], factor);
+      else sort_tile<Acc>(unsorted + ioffset, sorted + ooffset, gdims[x], gdims[y],
+                          istride[y], ostride[x], factor);
+
+      int r = nouter - 1;
+      for (; r >= 0; --r) {
+        const int d = outer[r];
+        ioffset += istride[d];
+        ooffset += ostride[d];
+        if (++count[r] < gdims[d]) break;
+        ioffset -= istride[d] * gdims[d];
+        ooffset -= ostride[d] * gdims[d];
+        count[r] = 0L;
+      }
+      if (r < 0) break;
+    }
+  }
+
+}
+
+
 void CCR12_Info::sort_indices2(const double* unsorted,double* sorted,
                                const long a,const long b,
                                const int i,const int j,const double factor) const
 { 
-  // prototype
-  if (i==0) {
-    const int j0max=static_cast<int>(a*b);
-    for (int j0=0; j0<a*b; ++j0) sorted[j0]=unsorted[j0]*factor;
-  } else { 
-    long id[2];
-    long jd[2] = {a, b};
-    long iall=0;
-    for(int j0=0;j0<(int)a;++j0){
-      id[0]=j0;
-      for(int j1=0;j1<(int)b;++j1,++iall){
-        id[1]=j1;
-        long ib=id[j]+jd[j]*id[i];
-        sorted[ib]=unsorted[iall]*factor;
-      }
-    }
-  }
-  
-  // is there any good code for matrix transposition?
+  const long dims[2] = {a, b};
+  const int perm[2] = {i, j};
+  sort_general<false>(unsorted, sorted, 2, dims, perm, factor);
 } 
 
 
@@ -163,25 +248,9 @@ void CCR12_Info::sort_indices4(const double* unsorted,double* sorted,
                                const int i,const int j,const int k,const int l,
                                const double factor) const
 {
-  // prototype
-  long id[4];
-  long jd[4] = {a, b, c, d};
-
-  long iall=0;
-  for(int j0=0;j0<(int)a;++j0){
-    id[0]=j0;
-    for(int j1=0;j1<(int)b;++j1){
-      id[1]=j1;
-      for(int j2=0;j2<(int)c;++j2){
-        id[2]=j2;
-        for (int j3=0;j3<(int)d;++j3,++iall){
-          id[3]=j3;
-          long ib=id[l]+jd[l]*(id[k]+jd[k]*(id[j]+jd[j]*id[i]));
-          sorted[ib]=unsorted[iall]*factor;
-        }
-      }
-    } 
-  } 
+  const long dims[4] = {a, b, c, d};
+  const int perm[4] = {i, j, k, l};
+  sort_general<false>(unsorted, sorted, 4, dims, perm, factor);
 }
 
 
@@ -192,31 +261,9 @@ void CCR12_Info::sort_indices6(const double* unsorted,double* sorted,
                                const int l,const int m,const int n,
                                const double factor) const
 {
-  // prototype
-  long id[6];
-  long jd[6] = {a, b, c, d, e, f};
-
-  int iall=0;
-  for(int j0=0;j0<(int)a;++j0){
-   id[0]=j0;
-   for(int j1=0;j1<(int)b;++j1){
-    id[1]=j1;
-    for(int j2=0;j2<(int)c;++j2){
-     id[2]=j2;
-     for(int j3=0;j3<(int)d;++j3){
-      id[3]=j3;
-      for (int j4=0;j4<(int)e;++j4){
-       id[4]=j4;
-       for (int j5=0;j5<(int)f;++j5,++iall){
-        id[5]=j5;
-        long ib=id[n]+jd[n]*(id[m]+jd[m]*(id[l]+jd[l]*(id[k]+jd[k]*(id[j]+jd[j]*id[i]))));
-        sorted[ib]=unsorted[iall]*factor;
-       }
-      }
-     }
-    } 
-   }
-  } 
+  const long dims[6] = {a, b, c, d, e, f};
+  const int perm[6] = {i, j, k, l, m, n};
+  sort_general<false>(unsorted, sorted, 6, dims, perm, factor);
 }
 
 
@@ -227,37 +274,9 @@ void CCR12_Info::sort_indices8(const double* unsorted,double* sorted,
                                const int m,const int n,const int o,const int p,
                                const double factor) const
 {
-  // prototype
-  long id[8];
-  long jd[8] = {a, b, c, d, e, f, g, h};
-
-  int iall=0;
-  for(int j0=0;j0<(int)a;++j0){
-   id[0]=j0;
-   for(int j1=0;j1<(int)b;++j1){
-    id[1]=j1;
-    for(int j2=0;j2<(int)c;++j2){
-     id[2]=j2;
-     for(int j3=0;j3<(int)d;++j3){
-      id[3]=j3;
-      for(int j4=0;j4<(int)e;++j4){
-       id[4]=j4;
-       for(int j5=0;j5<(int)f;++j5){
-        id[5]=j5;
-        for(int j6=0;j6<(int)g;++j6){
-         id[6]=j6;
-         for(int j7=0;j7<(int)h;++j7,++iall){
-          id[7]=j7;
-          long ib=id[p]+jd[p]*(id[o]+jd[o]*(id[n]+jd[n]*(id[m]+jd[m]*(id[l]+jd[l]*(id[k]+jd[k]*(id[j]+jd[j]*id[i]))))));
-          sorted[ib]=unsorted[iall]*factor;
-         }
-        }
-       }
-      }
-     }
-    } 
-   }
-  } 
+  const long dims[8] = {a, b, c, d, e, f, g, h};
+  const int perm[8] = {i, j, k, l, m, n, o, p};
+  sort_general<false>(unsorted, sorted, 8, dims, perm, factor);
 }
 
 
@@ -268,31 +287,9 @@ void CCR12_Info::sort_indices_acc6(const double* unsorted,double* sorted,
                                    const int l,const int m,const int n,
                                    const double factor) const
 {
-  // prototype
-  long id[6];
-  long jd[6] = {a, b, c, d, e, f};
-
-  int iall=0;
-  for(int j0=0;j0<(int)a;++j0){
-   id[0]=j0;
-   for(int j1=0;j1<(int)b;++j1){
-    id[1]=j1;
-    for(int j2=0;j2<(int)c;++j2){
-     id[2]=j2;
-     for(int j3=0;j3<(int)d;++j3){
-      id[3]=j3;
-      for (int j4=0;j4<(int)e;++j4){
-       id[4]=j4;
-       for (int j5=0;j5<(int)f;++j5,++iall){
-        id[5]=j5;
-        long ib=id[n]+jd[n]*(id[m]+jd[m]*(id[l]+jd[l]*(id[k]+jd[k]*(id[j]+jd[j]*id[i]))));
-        sorted[ib]+=unsorted[iall]*factor;
-       }
-      }
-     }
-    } 
-   }
-  } 
+  const long dims[6] = {a, b, c, d, e, f};
+  const int perm[6] = {i, j, k, l, m, n};
+  sort_general<true>(unsorted, sorted, 6, dims, perm, factor);
 }
 
 
@@ -303,37 +300,9 @@ void CCR12_Info::sort_indices_acc8(const double* unsorted,double* sorted,
                                    const int m,const int n,const int o,const int p,
                                    const double factor) const
 {
-  // prototype
-  long id[8];
-  long jd[8] = {a, b, c, d, e, f, g, h};
-
-  int iall=0;
-  for(int j0=0;j0<(int)a;++j0){
-   id[0]=j0;
-   for(int j1=0;j1<(int)b;++j1){
-    id[1]=j1;
-    for(int j2=0;j2<(int)c;++j2){
-     id[2]=j2;
-     for(int j3=0;j3<(int)d;++j3){
-      id[3]=j3;
-      for(int j4=0;j4<(int)e;++j4){
-       id[4]=j4;
-       for(int j5=0;j5<(int)f;++j5){
-        id[5]=j5;
-        for(int j6=0;j6<(int)g;++j6){
-         id[6]=j6;
-         for(int j7=0;j7<(int)h;++j7,++iall){
-          id[7]=j7;
-          long ib=id[p]+jd[p]*(id[o]+jd[o]*(id[n]+jd[n]*(id[m]+jd[m]*(id[l]+jd[l]*(id[k]+jd[k]*(id[j]+jd[j]*id[i]))))));
-          sorted[ib]+=unsorted[iall]*factor;
-         }
-        }
-       }
-      }
-     }
-    } 
-   }
-  } 
+  const long dims[8] = {a, b, c, d, e, f, g, h};
+  const int perm[8] = {i, j, k, l, m, n, o, p};
+  sort_general<true>(unsorted, sorted, 8, dims, perm, factor);
 }
 
 
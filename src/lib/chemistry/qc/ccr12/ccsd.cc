@@ -31,6 +31,7 @@
 #include <chemistry/qc/ccr12/ccsd_e.h>
 #include <chemistry/qc/ccr12/ccsd_t1.h>
 #include <chemistry/qc/ccr12/ccsd_t2.h>
+#include <chemistry/qc/ccr12/ccsd_cs.h>
 #include <chemistry/qc/ccr12/ccsd_pt.h>
 #include <chemistry/qc/ccr12/ccsd_pt_left.h>
 #include <chemistry/qc/ccr12/ccsd_pt_right.h>
@@ -80,6 +81,14 @@ CCSD::CCSD(const Ref<KeyVal>& keyval): CCR12(keyval){
       throw FeatureNotImplemented("diagonal ansatz for perturbative R12 corrections in SMITH-based code (use Psi-based code)",
                                   __FILE__, __LINE__, this->class_desc());
   }
+
+  spin_adapted_ = keyval->booleanvalue("spin_adapted", KeyValValueboolean(false));
+  if (spin_adapted_ && !rhf_)
+    throw InputError("spin-adapted CCSD requires a closed-shell reference",
+                     __FILE__, __LINE__, "spin_adapted", "true", this->class_desc());
+  if (spin_adapted_ && perturbative_ != "" && perturbative_ != "(T)")
+    throw InputError("spin-adapted CCSD is only implemented with perturbative = (T)",
+                     __FILE__, __LINE__, "perturbative", perturbative_.c_str(), this->class_desc());
 }
 
 
@@ -91,6 +100,11 @@ void CCSD::compute(){
 
   CCR12::compute();
 
+  if (spin_adapted_) {
+    compute_spin_adapted();
+    return;
+  }
+
   Ref<Tensor> e0 = new Tensor("e", mem_);
   ccr12_info_->offset_e(e0);
 
@@ -123,10 +137,17 @@ void CCSD::compute(){
     r1->zero();
     r2->zero();
 
+    // the amplitudes and integrals are read-only while the residuals are
+    // computed, so their blocks can be cached
+    Ref<Tensor> inputs[4] = {info()->f1(), info()->v2(), info()->t1(), info()->t2()};
+    for (int i = 0; i < 4; ++i) inputs[i]->set_cached(true);
+
     ccsd_t1->compute_amp(r1);
     ccsd_t2->compute_amp(r2);
     ccsd_e->compute_amp(e0);
 
+    for (int i = 0; i < 4; ++i) inputs[i]->set_cached(false);
+
     energy = ccr12_info_->get_e(e0) + ccr12_info_->t1()->ddot(r1) + ccr12_info_->energy_lagrangian_r2(r2);
 
     // compute new amplitudes from the residuals
@@ -347,6 +368,69 @@ void CCSD::compute(){
   } // end of do_lambda
 
   set_energy(energy + this->ref()->energy());
+  print_tile_cache_statistics();
   mem_->sync();
 }
 
+
+void CCSD::compute_spin_adapted(){
+
+  Ref<CCSD_CS> ccsd_cs = new CCSD_CS(info());
+
+  string theory_ = "CCSD (spin-adapted)";
+  print_iteration_header(theory_);
+
+  timer_->enter("CC iterations");
+  double iter_start = 0.0;
+  double iter_end   = timer_->get_wall_time();
+  double energy;
+
+  Ref<DIIS> t1diis = new DIIS(diis_start_, ndiis_, 0.005, 3, 1, 0.0);
+  Ref<DIIS> t2diis = new DIIS(diis_start_, ndiis_, 0.005, 3, 1, 0.0);
+
+  for (int iter = 0; iter < maxiter_; ++iter){
+    iter_start = iter_end;
+
+    Ref<Tensor> t1_old = ccsd_cs->t1()->copy();
+    Ref<Tensor> t2_old = ccsd_cs->t2()->copy();
+    energy = ccsd_cs->compute_amp();
+    // compute errors
+    Ref<Tensor> t1_err = t1_old;
+    Ref<Tensor> t2_err = t2_old;
+    t1_err->daxpy(ccsd_cs->t1(), -1.0);
+    t2_err->daxpy(ccsd_cs->t2(), -1.0);
+
+    const double r1norm = RMS(*t1_err);
+    const double r2norm = RMS(*t2_err);
+    const double rnorm = std::sqrt(r1norm * r1norm + r2norm * r2norm);
+
+    iter_end = timer_->get_wall_time();
+    print_iteration(iter, energy, rnorm, iter_start, iter_end);
+
+    // done? break free
+    if (rnorm < ccthresh_) break;
+
+    // extrapolate
+    t1diis->extrapolate(info()->edata(ccsd_cs->t1()), info()->eerr(t1_err));
+    t2diis->extrapolate(info()->edata(ccsd_cs->t2()), info()->eerr(t2_err));
+  }
+  timer_->exit("CC iterations");
+
+  print_iteration_footer();
+
+  if (perturbative_ == "(T)") {
+    timer_->enter("(T) correction");
+    iter_start = timer_->get_wall_time();
+
+    const double ccsd_pt_correction = ccsd_cs->compute_pt();
+    print_correction(ccsd_pt_correction, energy, "CCSD(T)");
+
+    print_timing(timer_->get_wall_time() - iter_start, "(T) correction");
+    timer_->exit("(T) correction");
+    energy += ccsd_pt_correction;
+  }
+
+  set_energy(energy + this->ref()->energy());
+  print_tile_cache_statistics();
+  mem_->sync();
+}
@@ -33,6 +33,10 @@
 
 namespace sc {
 
+/** CCSD computes the CCSD energy and, depending on the perturbative keyword,
+    corrections to it.  With spin_adapted = true and a closed-shell reference,
+    CCSD and CCSD(T) are computed in spatial orbitals by CCSD_CS instead of
+    by the spin-orbital code. */
 class CCSD: public CCR12 {
 
   public:
@@ -42,6 +46,8 @@ class CCSD: public CCR12 {
 
   protected:
     void compute();
+    /// the spin-adapted closed-shell CCSD and CCSD(T)
+    void compute_spin_adapted();
 
 };
 
@@ -0,0 +1,746 @@
+//
+// ccsd_cs.cc --- spin-adapted closed-shell CCSD and CCSD(T)
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#include <algorithm>
+#include <util/misc/formio.h>
+#include <math/scmat/blas.h>
+#include <util/misc/consumableresources.h>
+#include <util/misc/scexception.h>
+#include <chemistry/qc/ccr12/ccsd_cs.h>
+
+using namespace std;
+using namespace sc;
+
+
+CCSD_CS::CCSD_CS(CCR12_Info* info) : z(info), msg_(MessageGrp::get_default_messagegrp()) {
+  if (!z->restricted())
+    throw ProgrammingError("CCSD_CS::CCSD_CS -- closed-shell reference required", __FILE__, __LINE__);
+  if (!z->spin_adapted())
+    throw ProgrammingError("CCSD_CS::CCSD_CS -- CCR12_Info must be constructed with spin_adapted = true",
+                           __FILE__, __LINE__);
+
+  // in the restricted case get_alpha maps a beta tile to the alpha tile of the same orbitals
+  beta_.resize(z->noab() + z->nvab(), -1L);
+  for (long t = 0L; t < z->noab() + z->nvab(); ++t)
+    if (z->get_spin(t) == 2L) beta_[z->get_alpha(t)] = t;
+
+  no_ = 0L;
+  for (long t = 0L; t < z->noab(); ++t) {
+    if (z->get_spin(t) != 1L) continue;
+    otiles_.push_back(t);
+    ostart_.push_back(no_);
+    no_ += z->get_range(t);
+  }
+  nv_ = 0L;
+  for (long t = z->noab(); t < z->noab() + z->nvab(); ++t) {
+    if (z->get_spin(t) != 1L) continue;
+    vtiles_.push_back(t);
+    vstart_.push_back(nv_);
+    nv_ += z->get_range(t);
+  }
+
+  // the source integrals are indexed by the orbitals of aobs_space()
+  const vector<int> amap = sc::map(*z->aobs_space(), *z->corr_space(), false);
+  for (size_t i = 0; i < otiles_.size(); ++i)
+    for (long k = 0L; k < z->get_range(otiles_[i]); ++k)
+      omap_.push_back(amap[z->get_offset(otiles_[i]) + k]);
+  for (size_t i = 0; i < vtiles_.size(); ++i)
+    for (long k = 0L; k < z->get_range(vtiles_[i]); ++k)
+      vmap_.push_back(amap[z->get_offset(vtiles_[i]) + k]);
+
+  const long o = no_;
+  const long v = nv_;
+  const double incore = 8.0 * (2.0 * o * o * o * o + 3.0 * o * o * o * v + 14.0 * o * o * v * v + (o + 1.0) * v * v * v);
+  ExEnv::out0() << indent << "Spin-adapted closed-shell CCSD: " << o << " occupied and "
+                << v << " virtual spatial orbitals" << endl;
+  ExEnv::out0() << indent << "in-core integrals and intermediates per process: "
+                << scprintf("%10.1f", incore / 1.0e6) << " MB" << endl << endl;
+
+  // the integrals and amplitudes are replicated on every process, hence
+  // every process must have room for all of them
+  incore_ = static_cast<size_t>(incore);
+  try {
+    ConsumableResources::get_default_instance()->consume_memory(incore_);
+  }
+  catch (LimitExceeded<size_t>& e) {
+    throw LimitExceeded<size_t>("CCSD_CS::CCSD_CS -- not enough memory for the in-core integrals "
+                                "and intermediates of the spin-adapted CCSD; use spin_adapted = false",
+                                __FILE__, __LINE__, e.tolerance(), e.value());
+  }
+
+  fill_in();
+
+  t1_ = new Tensor("t1cs", z->mem());
+  t1_->input_offset(0L, 0L);
+  t1_->set_filesize(o * v);
+  t1_->createfile();
+  t2_ = new Tensor("t2cs", z->mem());
+  t2_->input_offset(0L, 0L);
+  t2_->set_filesize(o * o * v * v);
+  t2_->createfile();
+
+  // t1 = 0 and the MP2 t2 as the initial guess
+  t1_->zero();
+  t2_->zero();
+  if (z->mem()->me() == 0) {
+    vector<double> t2(o * o * v * v);
+    for (long i = 0L, ijab = 0L; i < o; ++i)
+      for (long j = 0L; j < o; ++j)
+        for (long a = 0L; a < v; ++a)
+          for (long b = 0L; b < v; ++b, ++ijab)
+            t2[ijab] = ovov_[((i * v + a) * o + j) * v + b] / (eo_[i] + eo_[j] - ev_[a] - ev_[b]);
+    t2_->put_block(0L, &t2[0]);
+  }
+  t1_->sync();
+  t2_->sync();
+}
+
+
+CCSD_CS::~CCSD_CS() {
+  ConsumableResources::get_default_instance()->release_memory(incore_);
+}
+
+
+void CCSD_CS::sum(double* data, size_t n) const {
+  // MessageGrp::sum takes an int count
+  const size_t chunk = 1UL << 27;
+  for (size_t i = 0; i < n; i += chunk)
+    msg_->sum(data + i, static_cast<int>(std::min(chunk, n - i)));
+}
+
+
+void CCSD_CS::spatial_v2(const char* cls, vector<double>& out) const {
+  const vector<int>* map[4];
+  long n[4];
+  for (int k = 0; k < 4; ++k) {
+    const bool occ = cls[k] == 'o';
+    map[k] = occ ? &omap_ : &vmap_;
+    n[k] = occ ? no_ : nv_;
+  }
+  out.assign(n[0] * n[1] * n[2] * n[3], 0.0);
+
+  // the pair blocks (p,q) of <pq|rs> are split among the tasks with access to the integrals
+  const Ref<DistArray4>& acc = z->pppp_acc();
+  const int me = msg_->me();
+  if (acc->has_access(me)) {
+    vector<int> twa_map;
+    const int ntask = acc->tasks_with_access(twa_map);
+    const long ny = acc->ny();
+    for (long p = 0L; p < n[0]; ++p) {
+      for (long q = 0L; q < n[1]; ++q) {
+        const long pq = p * n[1] + q;
+        if (pq % ntask != twa_map[me]) continue;
+        const double* blk = acc->retrieve_pair_block((*map[0])[p], (*map[1])[q], 0);
+        double* outpq = &out[pq * n[2] * n[3]];
+        for (long r = 0L; r < n[2]; ++r)
+          for (long ss = 0L; ss < n[3]; ++ss)
+            outpq[r * n[3] + ss] = blk[(*map[2])[r] * ny + (*map[3])[ss]];
+        acc->release_pair_block((*map[0])[p], (*map[1])[q], 0);
+      }
+    }
+  }
+  sum(&out[0], out.size());
+}
+
+
+void CCSD_CS::fill_in() {
+  const long o = no_;
+  const long v = nv_;
+
+  // Fock matrix from the alpha blocks of f1
+  foo_.assign(o * o, 0.0);
+  fov_.assign(o * v, 0.0);
+  fvv_.assign(v * v, 0.0);
+  const long maxtile = z->maxtilesize();
+  vector<double> blk(maxtile * maxtile);
+  const long nab = z->nab();
+  for (int c1 = 0; c1 < 2; ++c1) {
+    const vector<long>& tiles1 = c1 == 0 ? otiles_ : vtiles_;
+    const vector<long>& start1 = c1 == 0 ? ostart_ : vstart_;
+    for (int c2 = c1; c2 < 2; ++c2) {
+      const vector<long>& tiles2 = c2 == 0 ? otiles_ : vtiles_;
+      const vector<long>& start2 = c2 == 0 ? ostart_ : vstart_;
+      vector<double>& f = c1 == 0 ? (c2 == 0 ? foo_ : fov_) : fvv_;
+      const long n2 = c2 == 0 ? o : v;
+      for (size_t i1 = 0; i1 < tiles1.size(); ++i1) {
+        for (size_t i2 = 0; i2 < tiles2.size(); ++i2) {
+          const long g1b = tiles1[i1];
+          const long g2b = tiles2[i2];
+          const long tag = g2b + nab * g1b;
+          if (!z->f1()->exists(tag)) continue;
+          z->f1()->get_block(tag, &blk[0]);
+          long iall = 0L;
+          for (long p = 0L; p < z->get_range(g1b); ++p)
+            for (long q = 0L; q < z->get_range(g2b); ++q, ++iall)
+              f[(start1[i1] + p) * n2 + start2[i2] + q] = blk[iall];
+        }
+      }
+    }
+  }
+  eo_.resize(o);
+  ev_.resize(v);
+  for (long i = 0L; i < o; ++i) eo_[i] = foo_[i * o + i];
+  for (long a = 0L; a < v; ++a) ev_[a] = fvv_[a * v + a];
+
+  // the two-electron integrals (pq|rs) = <pr|qs>
+  vector<double> tmp;
+  spatial_v2("oovv", tmp);
+  ovov_.resize(tmp.size());
+  for (long i = 0L, iall = 0L; i < o; ++i)
+    for (long j = 0L; j < o; ++j)
+      for (long a = 0L; a < v; ++a)
+        for (long b = 0L; b < v; ++b, ++iall)
+          ovov_[((i * v + a) * o + j) * v + b] = tmp[iall];
+
+  spatial_v2("ovov", tmp);
+  oovv_.resize(tmp.size());
+  for (long i = 0L, iall = 0L; i < o; ++i)
+    for (long a = 0L; a < v; ++a)
+      for (long j = 0L; j < o; ++j)
+        for (long b = 0L; b < v; ++b, ++iall)
+          oovv_[((i * o + j) * v + a) * v + b] = tmp[iall];
+
+  spatial_v2("oovo", tmp);
+  ovoo_.resize(tmp.size());
+  for (long i = 0L, iall = 0L; i < o; ++i)
+    for (long j = 0L; j < o; ++j)
+      for (long a = 0L; a < v; ++a)
+        for (long k = 0L; k < o; ++k, ++iall)
+          ovoo_[((i * v + a) * o + j) * o + k] = tmp[iall];
+
+  spatial_v2("oooo", tmp);
+  oooo_.resize(tmp.size());
+  for (long i = 0L, iall = 0L; i < o; ++i)
+    for (long k = 0L; k < o; ++k)
+      for (long j = 0L; j < o; ++j)
+        for (long l = 0L; l < o; ++l, ++iall)
+          oooo_[((i * o + j) * o + k) * o + l] = tmp[iall];
+
+  spatial_v2("ovvv", tmp);
+  ovvv_.resize(tmp.size());
+  for (long i = 0L, iall = 0L; i < o; ++i)
+    for (long b = 0L; b < v; ++b)
+      for (long a = 0L; a < v; ++a)
+        for (long c = 0L; c < v; ++c, ++iall)
+          ovvv_[((i * v + a) * v + b) * v + c] = tmp[iall];
+}
+
+
+void CCSD_CS::vvvv_contract(const double* tau, double* out) const {
+  const long oo = no_ * no_;
+  const long v = nv_;
+  const long vv = v * v;
+  const Ref<DistArray4>& acc = z->pppp_acc();
+  const int me = msg_->me();
+  if (!acc->has_access(me)) return;
+  vector<int> twa_map;
+  const int ntask = acc->tasks_with_access(twa_map);
+  const long ny = acc->ny();
+
+  vector<double> va(v * vv);
+  vector<double> res(oo * v);
+  // (ac|bd) = <ab|cd> is read from the pair blocks (a,b); the first virtual index is
+  // split among the tasks with access to the integrals
+  for (long a = 0L; a < v; ++a) {
+    if (a % ntask != twa_map[me]) continue;
+    for (long b = 0L; b < v; ++b) {
+      const double* blk = acc->retrieve_pair_block(vmap_[a], vmap_[b], 0);
+      for (long c = 0L, bcd = b * vv; c < v; ++c)
+        for (long d = 0L; d < v; ++d, ++bcd)
+          va[bcd] = blk[vmap_[c] * ny + vmap_[d]];
+      acc->release_pair_block(vmap_[a], vmap_[b], 0);
+    }
+    C_DGEMM('n', 't', oo, v, vv, 1.0, tau, vv, &va[0], vv, 0.0, &res[0], v);
+    for (long ij = 0L; ij < oo; ++ij)
+      for (long b = 0L; b < v; ++b)
+        out[(ij * v + a) * v + b] += res[ij * v + b];
+  }
+}
+
+
+double CCSD_CS::energy(const double* t1, const double* t2) const {
+  const long o = no_;
+  const long v = nv_;
+  double e = 0.0;
+  for (long ia = 0L; ia < o * v; ++ia)
+    e += 2.0 * fov_[ia] * t1[ia];
+  for (long i = 0L, ijab = 0L; i < o; ++i)
+    for (long j = 0L; j < o; ++j)
+      for (long a = 0L; a < v; ++a)
+        for (long b = 0L; b < v; ++b, ++ijab)
+          e += (t2[ijab] + t1[i * v + a] * t1[j * v + b])
+             * (2.0 * ovov_[((i * v + a) * o + j) * v + b] - ovov_[((i * v + b) * o + j) * v + a]);
+  return e;
+}
+
+
+void CCSD_CS::update_amp(const double* t1, const double* t2, double* t1new, double* t2new) const {
+  const long o = no_;
+  const long v = nv_;
+  const long ov = o * v;
+  const long oo = o * o;
+  const long vv = v * v;
+  const long oovv = oo * vv;
+
+  // this process computes the residuals for the occupied indices i0 <= i < i1
+  const int nproc = msg_->n();
+  const int me = msg_->me();
+  const long i0 = o * me / nproc;
+  const long i1 = o * (me + 1) / nproc;
+  const long ni = i1 - i0;
+
+  vector<double> tau(oovv);
+  for (long i = 0L, ijab = 0L; i < o; ++i)
+    for (long j = 0L; j < o; ++j)
+      for (long a = 0L; a < v; ++a)
+        for (long b = 0L; b < v; ++b, ++ijab)
+          tau[ijab] = t2[ijab] + t1[i * v + a] * t1[j * v + b];
+
+  // g(k,l,c,d) = (kc|ld) and l2(k,l,c,d) = 2 (kc|ld) - (kd|lc)
+  vector<double> g(oovv);
+  vector<double> l2(oovv);
+  for (long k = 0L, klcd = 0L; k < o; ++k)
+    for (long l = 0L; l < o; ++l)
+      for (long c = 0L; c < v; ++c)
+        for (long d = 0L; d < v; ++d, ++klcd) {
+          g[klcd] = ovov_[((k * v + c) * o + l) * v + d];
+          l2[klcd] = 2.0 * g[klcd] - ovov_[((k * v + d) * o + l) * v + c];
+        }
+
+  // one-particle intermediates
+  vector<double> Foo(foo_);
+  vector<double> Fvv(vv, 0.0);
+  vector<double> Fov(fov_);
+  C_DGEMM('n', 't', o, o, o * vv, 1.0, &l2[0], o * vv, &tau[0], o * vv, 1.0, &Foo[0], o);
+  for (long kl = i0 * o; kl < i1 * o; ++kl)
+    C_DGEMM('n', 't', v, v, v, -1.0, &tau[kl * vv], v, &l2[kl * vv], v, 1.0, &Fvv[0], v);
+  sum(&Fvv[0], vv);
+  for (long ac = 0L; ac < vv; ++ac)
+    Fvv[ac] += fvv_[ac];
+  for (long k = 0L; k < o; ++k)
+    for (long l = 0L; l < o; ++l)
+      for (long c = 0L; c < v; ++c)
+        for (long d = 0L; d < v; ++d)
+          Fov[k * v + c] += l2[((k * o + l) * v + c) * v + d] * t1[l * v + d];
+
+  // vt1(a,c) = sum_kd [2 (kd|ac) - (kc|ad)] t1(k,d) and
+  // ot1(k,i) = sum_lc [2 (lc|ki) - (kc|li)] t1(l,c)
+  vector<double> vt1(vv, 0.0);
+  for (long k = 0L; k < o; ++k)
+    for (long d = 0L; d < v; ++d) {
+      const double t = t1[k * v + d];
+      for (long a = 0L; a < v; ++a)
+        for (long c = 0L; c < v; ++c)
+          vt1[a * v + c] += t * (2.0 * ovvv_[((k * v + d) * v + a) * v + c] - ovvv_[((k * v + c) * v + a) * v + d]);
+    }
+  vector<double> ot1(oo, 0.0);
+  for (long k = 0L; k < o; ++k)
+    for (long i = 0L; i < o; ++i)
+      for (long l = 0L; l < o; ++l)
+        for (long c = 0L; c < v; ++c)
+          ot1[k * o + i] += t1[l * v + c]
+                          * (2.0 * ovoo_[((l * v + c) * o + k) * o + i] - ovoo_[((k * v + c) * o + l) * o + i]);
+
+  vector<double> Loo(Foo);
+  vector<double> Lvv(Fvv);
+  for (long k = 0L; k < o; ++k)
+    for (long i = 0L; i < o; ++i) {
+      for (long c = 0L; c < v; ++c)
+        Loo[k * o + i] += fov_[k * v + c] * t1[i * v + c];
+      Loo[k * o + i] += ot1[k * o + i];
+    }
+  for (long a = 0L; a < v; ++a)
+    for (long c = 0L; c < v; ++c) {
+      for (long k = 0L; k < o; ++k)
+        Lvv[a * v + c] -= fov_[k * v + c] * t1[k * v + a];
+      Lvv[a * v + c] += vt1[a * v + c];
+    }
+
+  // the diagonal is moved to the left-hand side
+  for (long i = 0L; i < o; ++i) {
+    Foo[i * o + i] -= eo_[i];
+    Loo[i * o + i] -= eo_[i];
+  }
+  for (long a = 0L; a < v; ++a) {
+    Fvv[a * v + a] -= ev_[a];
+    Lvv[a * v + a] -= ev_[a];
+  }
+
+  // T1 equation
+  for (long i = i0; i < i1; ++i) {
+    for (long a = 0L; a < v; ++a) {
+      double r = fov_[i * v + a];
+      for (long c = 0L; c < v; ++c)
+        r += (Fvv[a * v + c] + vt1[a * v + c]) * t1[i * v + c];
+      for (long k = 0L; k < o; ++k)
+        r -= (Foo[k * o + i] + ot1[k * o + i]) * t1[k * v + a];
+      for (long k = 0L; k < o; ++k)
+        for (long c = 0L; c < v; ++c)
+          r += Fov[k * v + c] * (2.0 * t2[((k * o + i) * v + c) * v + a] - t2[((i * o + k) * v + c) * v + a]
+                                 + t1[i * v + c] * t1[k * v + a])
+             - 2.0 * fov_[k * v + c] * t1[k * v + a] * t1[i * v + c]
+             + t1[k * v + c] * (2.0 * ovov_[((k * v + c) * o + i) * v + a] - oovv_[((k * o + i) * v + a) * v + c]);
+      for (long k = 0L; k < o; ++k)
+        for (long l = 0L; l < o; ++l)
+          for (long c = 0L; c < v; ++c)
+            r += (ovoo_[((k * v + c) * o + l) * o + i] - 2.0 * ovoo_[((l * v + c) * o + k) * o + i])
+               * t2[((k * o + l) * v + a) * v + c];
+      t1new[i * v + a] = r;
+    }
+  }
+
+  // the (kd|ac) terms of T1, and x(i,j,k,a) = sum_cd (kd|ac) tau(i,j,c,d) for the
+  // t1 part of the particle-particle ladder; one occupied index at a time
+  vector<double> x(ni * o * ov);
+  {
+    vector<double> rk(v * vv);
+    vector<double> lk(v * vv);
+    for (long k = 0L; k < o; ++k) {
+      for (long a = 0L, acd = 0L; a < v; ++a)
+        for (long c = 0L; c < v; ++c)
+          for (long d = 0L; d < v; ++d, ++acd) {
+            rk[acd] = ovvv_[((k * v + d) * v + a) * v + c];
+            lk[acd] = 2.0 * rk[acd] - ovvv_[((k * v + c) * v + a) * v + d];
+          }
+      C_DGEMM('n', 't', ni, v, vv, 1.0, t2 + (i0 * o + k) * vv, o * vv, &lk[0], vv, 1.0, t1new + i0 * v, v);
+      C_DGEMM('n', 't', ni * o, v, vv, 1.0, &tau[i0 * o * vv], vv, &rk[0], vv, 0.0, &x[k * v], ov);
+    }
+  }
+
+  // T2 equation; r collects the terms that are added together with their (ia)<->(jb) transpose
+  // and is summed over the processes before the transpose is taken
+  vector<double> r(oovv, 0.0);
+
+  // [(ia|cb) - sum_k (ki|bc) t1(k,a)] t1(j,c)
+  for (long i = i0; i < i1; ++i)
+    for (long a = 0L; a < v; ++a)
+      C_DGEMM('n', 'n', o, v, v, 1.0, t1, v, &ovvv_[(i * v + a) * vv], v, 1.0, &r[i * o * vv + a * v], vv);
+  {
+    vector<double> s(oo * ov);  // s(k,i,b,j) = sum_c (ki|bc) t1(j,c)
+    C_DGEMM('n', 't', oo * v, o, v, 1.0, &oovv_[0], v, t1, v, 0.0, &s[0], o);
+    for (long i = i0, ijab = i0 * o * vv; i < i1; ++i)
+      for (long j = 0L; j < o; ++j)
+        for (long a = 0L; a < v; ++a)
+          for (long b = 0L; b < v; ++b, ++ijab)
+            for (long k = 0L; k < o; ++k)
+              r[ijab] -= t1[k * v + a] * s[((k * o + i) * v + b) * o + j];
+  }
+
+  // -[(kc|ai) t1(j,c) + (ia|jk)] t1(k,b)
+  {
+    vector<double> q(ni * o * ov);  // q(i,j,a,k)
+    for (long i = i0, ijak = 0L; i < i1; ++i)
+      for (long j = 0L; j < o; ++j)
+        for (long a = 0L; a < v; ++a)
+          for (long k = 0L; k < o; ++k, ++ijak) {
+            double tmp = ovoo_[((i * v + a) * o + j) * o + k];
+            for (long c = 0L; c < v; ++c)
+              tmp += ovov_[((k * v + c) * o + i) * v + a] * t1[j * v + c];
+            q[ijak] = tmp;
+          }
+    C_DGEMM('n', 'n', ni * o * v, v, o, -1.0, &q[0], o, t1, v, 1.0, &r[i0 * o * vv], v);
+  }
+
+  // Lvv(a,c) t2(i,j,c,b) - Loo(k,i) t2(k,j,a,b)
+  for (long ij = i0 * o; ij < i1 * o; ++ij)
+    C_DGEMM('n', 'n', v, v, v, 1.0, &Lvv[0], v, t2 + ij * vv, v, 1.0, &r[ij * vv], v);
+  C_DGEMM('t', 'n', ni, o * vv, o, -1.0, &Loo[i0], o, t2, o * vv, 1.0, &r[i0 * o * vv], o * vv);
+
+  // the t1 part of the particle-particle ladder: -sum_k t1(k,b) x(i,j,k,a)
+  for (long ij = 0L; ij < ni * o; ++ij)
+    C_DGEMM('t', 'n', v, v, o, -1.0, &x[ij * ov], v, t1, v, 1.0, &r[(i0 * o + ij) * vv], v);
+  x.clear();
+
+  // ring terms with wa((i,a),(k,c)) = W(a,k,i,c) and wb((i,a),(k,c)) = W(a,k,c,i)
+  {
+    // wa, wb, u and rr hold the rows (i,a) of this process only
+    const long niv = ni * v;
+    vector<double> wa(niv * ov);
+    vector<double> wb(niv * ov);
+    for (long i = i0, iakc = 0L; i < i1; ++i)
+      for (long a = 0L; a < v; ++a)
+        for (long k = 0L; k < o; ++k)
+          for (long c = 0L; c < v; ++c, ++iakc) {
+            double tmpa = ovov_[((k * v + c) * o + i) * v + a];
+            double tmpb = oovv_[((k * o + i) * v + a) * v + c];
+            for (long l = 0L; l < o; ++l) {
+              tmpa -= ovoo_[((k * v + c) * o + l) * o + i] * t1[l * v + a];
+              tmpb -= ovoo_[((l * v + c) * o + k) * o + i] * t1[l * v + a];
+            }
+            wa[iakc] = tmpa;
+            wb[iakc] = tmpb;
+          }
+    {
+      vector<double> y(ni * vv);
+      for (long k = 0L; k < o; ++k) {
+        // y(i,c,a) = sum_d (kc|ad) t1(i,d)
+        C_DGEMM('n', 't', ni, vv, v, 1.0, t1 + i0 * v, v, &ovvv_[k * v * vv], v, 0.0, &y[0], vv);
+        for (long i = 0L; i < ni; ++i)
+          for (long a = 0L; a < v; ++a)
+            for (long c = 0L; c < v; ++c)
+              wa[((i * v + a) * o + k) * v + c] += y[(i * v + c) * v + a];
+        // y(i,a,c) = sum_d (kd|ac) t1(i,d)
+        C_DGEMM('n', 'n', ni, vv, v, 1.0, t1 + i0 * v, v, &ovvv_[k * v * vv], vv, 0.0, &y[0], vv);
+        for (long i = 0L; i < ni; ++i)
+          for (long a = 0L; a < v; ++a)
+            for (long c = 0L; c < v; ++c)
+              wb[((i * v + a) * o + k) * v + c] += y[(i * v + a) * v + c];
+      }
+    }
+
+    vector<double> u(niv * ov);
+    vector<double> m(ov * ov);
+    // (ld|kc) [t2(i,l,a,d) - t2(i,l,d,a)/2 - t1(i,d) t1(l,a)]
+    for (long i = i0, iald = 0L; i < i1; ++i)
+      for (long a = 0L; a < v; ++a)
+        for (long l = 0L; l < o; ++l)
+          for (long d = 0L; d < v; ++d, ++iald)
+            u[iald] = t2[((i * o + l) * v + a) * v + d] - 0.5 * t2[((i * o + l) * v + d) * v + a]
+                    - t1[i * v + d] * t1[l * v + a];
+    C_DGEMM('n', 'n', niv, ov, ov, 1.0, &u[0], ov, &ovov_[0], ov, 1.0, &wa[0], ov);
+    // m((l,d),(k,c)) = (lc|kd)
+    for (long l = 0L, ldkc = 0L; l < o; ++l)
+      for (long d = 0L; d < v; ++d)
+        for (long k = 0L; k < o; ++k)
+          for (long c = 0L; c < v; ++c, ++ldkc)
+            m[ldkc] = ovov_[((l * v + c) * o + k) * v + d];
+    for (long i = i0, iald = 0L; i < i1; ++i)
+      for (long a = 0L; a < v; ++a)
+        for (long l = 0L; l < o; ++l)
+          for (long d = 0L; d < v; ++d, ++iald)
+            u[iald] = t2[((i * o + l) * v + a) * v + d];
+    C_DGEMM('n', 'n', niv, ov, ov, -0.5, &u[0], ov, &m[0], ov, 1.0, &wa[0], ov);
+    for (long i = i0, iald = 0L; i < i1; ++i)
+      for (long a = 0L; a < v; ++a)
+        for (long l = 0L; l < o; ++l)
+          for (long d = 0L; d < v; ++d, ++iald)
+            u[iald] = 0.5 * t2[((i * o + l) * v + d) * v + a] + t1[i * v + d] * t1[l * v + a];
+    C_DGEMM('n', 'n', niv, ov, ov, -1.0, &u[0], ov, &m[0], ov, 1.0, &wb[0], ov);
+
+    // [2 wa - wb] t2(k,j,c,b) - wa t2(k,j,b,c) and -wb(b,k,c,i) t2(k,j,a,c);
+    // the amplitudes are sorted to m((k,c),(j,b)) = t2(k,j,c,b) and u((k,c),(j,b)) = t2(k,j,b,c)
+    u.resize(ov * ov);
+    for (long k = 0L, kcjb = 0L; k < o; ++k)
+      for (long c = 0L; c < v; ++c)
+        for (long j = 0L; j < o; ++j)
+          for (long b = 0L; b < v; ++b, ++kcjb) {
+            m[kcjb] = t2[((k * o + j) * v + c) * v + b];
+            u[kcjb] = t2[((k * o + j) * v + b) * v + c];
+          }
+    vector<double> rr(niv * ov);
+    C_DGEMM('n', 'n', niv, ov, ov, -1.0, &wb[0], ov, &m[0], ov, 0.0, &rr[0], ov);
+    C_DGEMM('n', 'n', niv, ov, ov, 2.0, &wa[0], ov, &m[0], ov, 1.0, &rr[0], ov);
+    C_DGEMM('n', 'n', niv, ov, ov, -1.0, &wa[0], ov, &u[0], ov, 1.0, &rr[0], ov);
+    for (long i = 0L, ijab = i0 * o * vv; i < ni; ++i)
+      for (long j = 0L; j < o; ++j)
+        for (long a = 0L; a < v; ++a)
+          for (long b = 0L; b < v; ++b, ++ijab)
+            r[ijab] += rr[((i * v + a) * o + j) * v + b];
+    C_DGEMM('n', 'n', niv, ov, ov, 1.0, &wb[0], ov, &u[0], ov, 0.0, &rr[0], ov);
+    for (long i = 0L, ijab = i0 * o * vv; i < ni; ++i)
+      for (long j = 0L; j < o; ++j)
+        for (long a = 0L; a < v; ++a)
+          for (long b = 0L; b < v; ++b, ++ijab)
+            r[ijab] -= rr[((i * v + b) * o + j) * v + a];
+  }
+  sum(&r[0], oovv);
+
+  for (long i = i0, ijab = i0 * o * vv; i < i1; ++i)
+    for (long j = 0L; j < o; ++j)
+      for (long a = 0L; a < v; ++a)
+        for (long b = 0L; b < v; ++b, ++ijab)
+          t2new[ijab] = ovov_[((i * v + a) * o + j) * v + b] + r[ijab] + r[((j * o + i) * v + b) * v + a];
+  r.clear();
+
+  // hole-hole ladder with w(k,l,i,j) = (ki|lj) + (lc|ki) t1(j,c) + (kc|lj) t1(i,c) + (kc|ld) tau(i,j,c,d)
+  {
+    const long nij = ni * o;
+    vector<double> w(oo * nij);
+    if (nij > 0L) {
+    for (long k = 0L, klij = 0L; k < o; ++k)
+      for (long l = 0L; l < o; ++l)
+        for (long i = i0; i < i1; ++i)
+          for (long j = 0L; j < o; ++j, ++klij) {
+            double tmp = oooo_[((k * o + i) * o + l) * o + j];
+            for (long c = 0L; c < v; ++c)
+              tmp += ovoo_[((l * v + c) * o + k) * o + i] * t1[j * v + c]
+                   + ovoo_[((k * v + c) * o + l) * o + j] * t1[i * v + c];
+            w[klij] = tmp;
+          }
+    C_DGEMM('n', 't', oo, nij, vv, 1.0, &g[0], vv, &tau[i0 * o * vv], vv, 1.0, &w[0], nij);
+    C_DGEMM('t', 'n', nij, vv, oo, 1.0, &w[0], nij, &tau[0], vv, 1.0, t2new + i0 * o * vv, vv);
+    }
+  }
+
+  // particle-particle ladder
+  vvvv_contract(&tau[0], t2new);
+
+  sum(t1new, ov);
+  sum(t2new, oovv);
+
+  for (long i = 0L; i < o; ++i)
+    for (long a = 0L; a < v; ++a)
+      t1new[i * v + a] /= eo_[i] - ev_[a];
+  for (long i = 0L, ijab = 0L; i < o; ++i)
+    for (long j = 0L; j < o; ++j)
+      for (long a = 0L; a < v; ++a)
+        for (long b = 0L; b < v; ++b, ++ijab)
+          t2new[ijab] /= eo_[i] + eo_[j] - ev_[a] - ev_[b];
+}
+
+
+static inline long
+perm_index(const long* ijk, const int* s, long o)
+{
+  // the element of w(ijk) for the virtual labels permuted by s:
+  // the occupied index paired with label s[n] is ijk[n]
+  long idx[3];
+  idx[s[0]] = ijk[0];
+  idx[s[1]] = ijk[1];
+  idx[s[2]] = ijk[2];
+  return (idx[0] * o + idx[1]) * o + idx[2];
+}
+
+
+double CCSD_CS::triples(const double* t1, const double* t2) const {
+  const long o = no_;
+  const long v = nv_;
+  const long oo = o * o;
+  const long ooo = oo * o;
+  const long vv = v * v;
+
+  static const int perms[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+
+  // zoo(z,l,q,r) = (zr|ql)
+  vector<double> zoo(v * ooo);
+  for (long zz = 0L, zlqr = 0L; zz < v; ++zz)
+    for (long l = 0L; l < o; ++l)
+      for (long q = 0L; q < o; ++q)
+        for (long r = 0L; r < o; ++r, ++zlqr)
+          zoo[zlqr] = ovoo_[((r * v + zz) * o + q) * o + l];
+
+  vector<double> w(ooo);
+  vector<double> vt(ooo);
+  vector<double> tmp(ooo);
+  vector<double> txy(oo);
+
+  // the virtual triples are split among the processes
+  const int nproc = msg_->n();
+  const int me = msg_->me();
+  long abc = 0L;
+  double et = 0.0;
+  for (long a = 0L; a < v; ++a) {
+    for (long b = 0L; b <= a; ++b) {
+      for (long c = 0L; c <= b; ++c, ++abc) {
+        if (abc % nproc != me) continue;
+        const long lab[3] = {a, b, c};
+
+        // w(ijk) = P[sum_d (bd|ck) t2(i,j,a,d) - sum_l (ck|jl) t2(i,l,a,b)], where P sums over the
+        // permutations of the pairs (ia), (jb) and (kc)
+        std::fill(w.begin(), w.end(), 0.0);
+        for (int n = 0; n < 6; ++n) {
+          const int* p = perms[n];
+          const long x = lab[p[0]];
+          const long y = lab[p[1]];
+          const long zz = lab[p[2]];
+          // tmp(p,q,r) = sum_d (yd|zr) t2(p,q,x,d) - sum_l (zr|ql) t2(p,l,x,y)
+          C_DGEMM('n', 't', oo, o, v, 1.0, t2 + x * v, vv, &ovvv_[(zz * v + y) * v], v * vv, 0.0, &tmp[0], o);
+          for (long pp = 0L; pp < o; ++pp)
+            for (long l = 0L; l < o; ++l)
+              txy[pp * o + l] = t2[((pp * o + l) * v + x) * v + y];
+          C_DGEMM('n', 'n', o, oo, o, -1.0, &txy[0], o, &zoo[zz * ooo], oo, 1.0, &tmp[0], oo);
+          for (long i = 0L, ijk = 0L; i < o; ++i)
+            for (long j = 0L; j < o; ++j)
+              for (long k = 0L; k < o; ++k, ++ijk) {
+                const long occ[3] = {i, j, k};
+                w[ijk] += tmp[(occ[p[0]] * o + occ[p[1]]) * o + occ[p[2]]];
+              }
+        }
+
+        // v(ijk) = w(ijk) + (jb|kc) t1(i,a) + (ia|kc) t1(j,b) + (ia|jb) t1(k,c)
+        for (long i = 0L, ijk = 0L; i < o; ++i)
+          for (long j = 0L; j < o; ++j)
+            for (long k = 0L; k < o; ++k, ++ijk)
+              vt[ijk] = w[ijk] + ovov_[((j * v + b) * o + k) * v + c] * t1[i * v + a]
+                               + ovov_[((i * v + a) * o + k) * v + c] * t1[j * v + b]
+                               + ovov_[((i * v + a) * o + j) * v + b] * t1[k * v + c];
+
+        // E = 1/3 sum [4 w(abc) + w(bca) + w(cab)] [v(abc) - v(cba)] / D over all orderings of a, b and c
+        const double factor = a == c ? 1.0 / 6.0 : ((a == b || b == c) ? 0.5 : 1.0);
+        const double eabc = ev_[a] + ev_[b] + ev_[c];
+        double eperm = 0.0;
+        for (int n = 0; n < 6; ++n) {
+          const int* s = perms[n];
+          const int sbca[3] = {s[1], s[2], s[0]};
+          const int scab[3] = {s[2], s[0], s[1]};
+          const int scba[3] = {s[2], s[1], s[0]};
+          for (long i = 0L; i < o; ++i)
+            for (long j = 0L; j < o; ++j)
+              for (long k = 0L; k < o; ++k) {
+                const long occ[3] = {i, j, k};
+                const double d = eo_[i] + eo_[j] + eo_[k] - eabc;
+                eperm += (4.0 * w[perm_index(occ, s, o)] + w[perm_index(occ, sbca, o)] + w[perm_index(occ, scab, o)])
+                       * (vt[perm_index(occ, s, o)] - vt[perm_index(occ, scba, o)]) / d;
+              }
+        }
+        et += factor * eperm / 3.0;
+      }
+    }
+  }
+  msg_->sum(et);
+  return et;
+}
+
+
+double CCSD_CS::compute_amp() {
+  const long n1 = no_ * nv_;
+  const long n2 = n1 * n1;
+  vector<double> t1(n1);
+  vector<double> t2(n2);
+  t1_->get_block(0L, &t1[0]);
+  t2_->get_block(0L, &t2[0]);
+
+  const double e = energy(&t1[0], &t2[0]);
+
+  vector<double> t1new(n1, 0.0);
+  vector<double> t2new(n2, 0.0);
+  update_amp(&t1[0], &t2[0], &t1new[0], &t2new[0]);
+
+  // every process has the summed amplitudes; one of them stores them
+  if (z->mem()->me() == 0) {
+    t1_->put_block(0L, &t1new[0]);
+    t2_->put_block(0L, &t2new[0]);
+  }
+  t1_->sync();
+  t2_->sync();
+  return e;
+}
+
+
+double CCSD_CS::compute_pt() {
+  const long n1 = no_ * nv_;
+  vector<double> t1(n1);
+  vector<double> t2(n1 * n1);
+  t1_->get_block(0L, &t1[0]);
+  t2_->get_block(0L, &t2[0]);
+  return triples(&t1[0], &t2[0]);
+}
@@ -0,0 +1,111 @@
+//
+// ccsd_cs.h --- spin-adapted closed-shell CCSD and CCSD(T)
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#ifndef _chemistry_qc_ccr12_ccsd_cs_h
+#define _chemistry_qc_ccr12_ccsd_cs_h
+
+#include <vector>
+#include <util/group/message.h>
+#include <chemistry/qc/ccr12/ccr12_info.h>
+
+namespace sc {
+
+/** CCSD_CS solves the closed-shell CCSD equations in spatial orbitals and
+    evaluates the closed-shell (T) correction.
+
+    The two-electron integrals (pr|qs) = <pq|rs> are read from the source
+    integrals of a CCR12_Info constructed with spin_adapted = true, which
+    does not build the spin-orbital v2; the Fock matrix is taken from the
+    alpha blocks of f1.  All integral classes except the four-virtual one
+    are kept in core on every process as dense arrays over the correlated
+    spatial orbitals; the particle-particle ladder reads the four-virtual
+    integrals one virtual index at a time.
+
+    The work is split over the processes: each computes the amplitude
+    equations for its range of the first occupied index, the ladder for its
+    share of the first virtual index, and the (T) correction for its share
+    of the virtual triples, and the results are summed.  The amplitudes
+    t1(i,a) and t2(i,j,a,b) are stored as single-block Tensor objects, so
+    that they can be extrapolated with DIIS exactly as the spin-orbital
+    ones.
+
+    The integrals and the amplitudes are replicated on every process.  Their
+    size is taken from the ConsumableResources memory when the object is
+    constructed, and the constructor throws LimitExceeded if it does not fit.
+*/
+class CCSD_CS : public RefCount {
+
+  protected:
+    CCR12_Info* z;
+    Ref<MessageGrp> msg_;
+
+    /// the number of correlated occupied and virtual spatial orbitals
+    long no_, nv_;
+
+    /// the alpha occupied and virtual tiles, the spatial index of their first
+    /// orbital, and the beta tile of each alpha tile
+    std::vector<long> otiles_, ostart_, vtiles_, vstart_;
+    std::vector<long> beta_;
+    /// the index in CCR12_Info::aobs_space() of each occupied and virtual orbital
+    std::vector<int> omap_, vmap_;
+
+    /// Fock matrix blocks and the orbital energies used in the denominators
+    std::vector<double> foo_, fov_, fvv_, eo_, ev_;
+    /// integrals (pq|rs) in chemists' notation, stored as [p][q][r][s]
+    std::vector<double> oooo_, ovoo_, oovv_, ovov_, ovvv_;
+    /// the bytes of memory taken from ConsumableResources
+    size_t incore_;
+
+    Ref<Tensor> t1_, t2_;
+
+    /// the dense <pq|rs> for the orbital classes given by cls, e.g. "oovv"
+    void spatial_v2(const char* cls, std::vector<double>& out) const;
+    void fill_in();
+    /// sums data over the processes
+    void sum(double* data, size_t n) const;
+
+    /// out(i,j,a,b) += sum_cd (ac|bd) tau(i,j,c,d) for the virtuals a of this process
+    void vvvv_contract(const double* tau, double* out) const;
+
+    double energy(const double* t1, const double* t2) const;
+    /// the Jacobi update of the amplitudes; t1new and t2new must be zero on entry
+    void update_amp(const double* t1, const double* t2, double* t1new, double* t2new) const;
+    double triples(const double* t1, const double* t2) const;
+
+  public:
+    CCSD_CS(CCR12_Info* info);
+    ~CCSD_CS();
+
+    const Ref<Tensor>& t1() const { return t1_; };
+    const Ref<Tensor>& t2() const { return t2_; };
+
+    /// Computes the energy with the current amplitudes and replaces them
+    /// by the updated ones.  Returns the energy.
+    double compute_amp();
+
+    /// Returns the (T) correction for the current amplitudes.
+    double compute_pt();
+};
+
+}
+
+#endif
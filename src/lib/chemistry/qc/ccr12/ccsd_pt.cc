@@ -27,6 +27,7 @@
 
 #include <algorithm>
 #include <chemistry/qc/ccr12/ccsd_pt.h>
+#include <chemistry/qc/ccr12/smith_tasks.h>
 
 using namespace sc;
   
@@ -36,105 +37,178 @@ static ClassDesc CCSD_PT_cd(
   ,0,0,0);
   
 
-double CCSD_PT::compute_energy(Ref<PTNum> eval_left, Ref<PTNum> eval_right){
-
- double energy = 0.0;
+namespace {
+  // A task is the list of sextets of one particle triple (p4b,p5b,p6b),
+  // which keeps the tasks coarse enough that the shared task counter is
+  // rarely accessed.  The sextets of a task read some of the same t2 and v2
+  // tiles; the thread running the task keeps the tiles it read last (see
+  // TensorTileCache::set_thread_max_bytes), so that the next sextet finds
+  // them without I/O.
+  struct PTTask {
+    double cost;
+    std::vector<long> sextets; // 6 tile indices per sextet
+    bool operator<(const PTTask& other) const { return cost > other.cost; }
+  };
+}
 
- long count = 0L;
+double CCSD_PT::compute_energy(Ref<PTNum> eval_left, Ref<PTNum> eval_right){
 
  const size_t maxtile = z->maxtilesize();
  const size_t mem_singles = maxtile * maxtile;
  const size_t mem_doubles = mem_singles * mem_singles;
  const size_t mem_triples = mem_singles * mem_doubles;
 
- double* k_a0     = z->mem()->malloc_local_double(mem_doubles); 
- double* k_a0_sort= z->mem()->malloc_local_double(mem_doubles); 
- double* k_a1     = z->mem()->malloc_local_double(mem_doubles); 
- double* k_a1_sort= z->mem()->malloc_local_double(mem_doubles); 
- double* k_c_sort = z->mem()->malloc_local_double(mem_triples); 
-
- double* doubles = z->mem()->malloc_local_double(mem_triples);
- double* singles = z->mem()->malloc_local_double(mem_triples);
-
- double* work_doubles[6] = {doubles, k_a0, k_a0_sort, k_a1, k_a1_sort, k_c_sort};
- double* work_singles[6] = {singles, k_a0, k_a0_sort, k_a1, k_a1_sort, k_c_sort};
-
+ // Enumerate the symmetry and spin allowed sextets.  Their cost is
+ // proportional to the size of the triples block.
+ std::vector<PTTask> tasks;
  for (long t_p4b = z->noab(); t_p4b<z->noab() + z->nvab(); ++t_p4b){
   for (long t_p5b = t_p4b;     t_p5b<z->noab() + z->nvab(); ++t_p5b){
    for (long t_p6b = t_p5b;     t_p6b<z->noab() + z->nvab(); ++t_p6b){
-
+    PTTask task;
+    task.cost = 0.0;
     for (long t_h1b = 0L;    t_h1b<z->noab(); ++t_h1b){
      for (long t_h2b = t_h1b; t_h2b<z->noab(); ++t_h2b){
       for (long t_h3b  =t_h2b; t_h3b<z->noab(); ++t_h3b){
+       if(!z->restricted() ||  z->get_spin(t_p4b) + z->get_spin(t_p5b) + z->get_spin(t_p6b)
+                             + z->get_spin(t_h1b) + z->get_spin(t_h2b) + z->get_spin(t_h3b) < 9L){
+       if(z->get_spin(t_p4b) + z->get_spin(t_p5b) + z->get_spin(t_p6b) == z->get_spin(t_h1b) + z->get_spin(t_h2b) + z->get_spin(t_h3b)){
+       if((z->get_sym(t_p4b)^(z->get_sym(t_p5b)^(z->get_sym(t_p6b)^(z->get_sym(t_h1b)^(z->get_sym(t_h2b)^z->get_sym(t_h3b)))))) == 0L){
+        const long sextet[6] = {t_p4b, t_p5b, t_p6b, t_h1b, t_h2b, t_h3b};
+        task.sextets.insert(task.sextets.end(), sextet, sextet + 6);
+        task.cost += (double) z->get_range(t_p4b) * z->get_range(t_p5b) * z->get_range(t_p6b)
+                            * z->get_range(t_h1b) * z->get_range(t_h2b) * z->get_range(t_h3b);
+       }
+       }
+       }
+      }
+     }
+    }
+    if (!task.sextets.empty()) tasks.push_back(task);
+   }
+  }
+ }
 
-       // Naive way of parallelization; will be updated
-       if (count%z->mem()->n() == z->mem()->me()){ 
-
-        if(!z->restricted() ||  z->get_spin(t_p4b) + z->get_spin(t_p5b) + z->get_spin(t_p6b)
-                              + z->get_spin(t_h1b) + z->get_spin(t_h2b) + z->get_spin(t_h3b) < 9L){
-        if(z->get_spin(t_p4b) + z->get_spin(t_p5b) + z->get_spin(t_p6b) == z->get_spin(t_h1b) + z->get_spin(t_h2b) + z->get_spin(t_h3b)){
-        if((z->get_sym(t_p4b)^(z->get_sym(t_p5b)^(z->get_sym(t_p6b)^(z->get_sym(t_h1b)^(z->get_sym(t_h2b)^z->get_sym(t_h3b)))))) == 0L){
- 
-         const long size = z->get_range(t_p4b) * z->get_range(t_p5b) * z->get_range(t_p6b)
-                         * z->get_range(t_h1b) * z->get_range(t_h2b) * z->get_range(t_h3b);
-
-         std::fill(doubles, doubles + size, 0.0);
-         std::fill(singles, singles + size, 0.0);
-
-         eval_left->compute_amp(work_singles, t_p4b, t_p5b, t_p6b, t_h1b, t_h2b, t_h3b, 2L);  
-         eval_right->compute_amp(work_doubles, t_p4b, t_p5b, t_p6b, t_h1b, t_h2b, t_h3b, 2L);  
-
-         double factor = 1.0;
-         if (z->restricted()) factor *= 2.0; 
- 
-         if      (t_p4b == t_p5b && t_p5b == t_p6b) factor *= 0.166666666666666667;
-         else if (t_p4b == t_p5b || t_p5b == t_p6b) factor *= 0.5; 
- 
-         if      (t_h1b == t_h2b && t_h2b == t_h3b) factor *= 0.166666666666666667; 
-         else if (t_h1b == t_h2b || t_h2b == t_h3b) factor *= 0.5; 
-
-         long iall = 0L;
-         for (long p4 = 0L; p4 < z->get_range(t_p4b); ++p4) {
-          const double ep4 = z->get_orb_energy(z->get_offset(t_p4b) + p4);
-          for (long p5 = 0L; p5 < z->get_range(t_p5b); ++p5) {
-           const double ep5 = z->get_orb_energy(z->get_offset(t_p5b) + p5);
-           for (long p6 = 0L; p6 < z->get_range(t_p6b); ++p6) {
-            const double ep6 = z->get_orb_energy(z->get_offset(t_p6b) + p6);
-            const double eps = ep4 + ep5 + ep6;
-
-            for (long h1 = 0L; h1 < z->get_range(t_h1b); ++h1) {
-             const double eh1 = z->get_orb_energy(z->get_offset(t_h1b) + h1);
-             for (long h2 = 0L; h2 < z->get_range(t_h2b); ++h2) {
-              const double eh2 = z->get_orb_energy(z->get_offset(t_h2b) + h2);
-              for (long h3 = 0L; h3 < z->get_range(t_h3b); ++h3, ++iall) {
-               const double eh3 = z->get_orb_energy(z->get_offset(t_h3b) + h3);
-
-               const double numerator = factor * (singles[iall] + doubles[iall]) * doubles[iall];
-               energy += numerator / (eh1 + eh2 + eh3 - eps);
-              }
-             }
-            }
-           }
-          }
-         }
-        }
-        }
+ // With few particle triples the tasks are too coarse to balance; then
+ // every sextet is a task.
+ const long nworker = (long) z->thrgrp()->nthread() * z->mem()->n();
+ if ((long) tasks.size() < 8L * nworker) {
+  std::vector<PTTask> sextet_tasks;
+  for (std::vector<PTTask>::const_iterator t = tasks.begin(); t != tasks.end(); ++t) {
+   for (size_t i = 0; i < t->sextets.size(); i += 6) {
+    PTTask task;
+    task.sextets.assign(t->sextets.begin() + i, t->sextets.begin() + i + 6);
+    task.cost = 1.0;
+    for (int j = 0; j < 6; ++j) task.cost *= z->get_range(task.sextets[j]);
+    sextet_tasks.push_back(task);
+   }
+  }
+  tasks.swap(sextet_tasks);
+ }
+ // the most expensive tasks are handed out first
+ std::stable_sort(tasks.begin(), tasks.end());
+
+ // The numerators are called from several threads and copy the
+ // Ref<Tensor>'s that they use.  The tensors are not modified during the
+ // (T) correction, so their blocks can be cached.
+ Ref<Tensor> tensors[4] = {z->t1(), z->t2(), z->v2(), z->qy()};
+ for (int i = 0; i < 4; ++i)
+   if (tensors[i]) {
+     tensors[i]->use_locks(true);
+     tensors[i]->set_cached(true);
+   }
+
+ double energy = 0.0;
+ Ref<ThreadLock> energy_lock = z->thrgrp()->new_lock();
+ PTNum* left = eval_left.pointer();
+ PTNum* right = eval_right.pointer();
+ const CCR12_Info* zz = z;
+
+ SmithTaskRunner::Kernel kernel = [&](long itask, double* const* scratch) {
+  double* doubles = scratch[0];
+  double* singles = scratch[1];
+  double* work_doubles[6] = {doubles, scratch[2], scratch[3], scratch[4], scratch[5], scratch[6]};
+  double* work_singles[6] = {singles, scratch[2], scratch[3], scratch[4], scratch[5], scratch[6]};
+
+  double task_energy = 0.0;
+  const std::vector<long>& sextets = tasks[itask].sextets;
+  for (size_t isextet = 0; isextet < sextets.size(); isextet += 6) {
+   const long t_p4b = sextets[isextet  ];
+   const long t_p5b = sextets[isextet+1];
+   const long t_p6b = sextets[isextet+2];
+   const long t_h1b = sextets[isextet+3];
+   const long t_h2b = sextets[isextet+4];
+   const long t_h3b = sextets[isextet+5];
+
+   const long size = zz->get_range(t_p4b) * zz->get_range(t_p5b) * zz->get_range(t_p6b)
+                   * zz->get_range(t_h1b) * zz->get_range(t_h2b) * zz->get_range(t_h3b);
+
+   std::fill(doubles, doubles + size, 0.0);
+   std::fill(singles, singles + size, 0.0);
+
+   left->compute_amp(work_singles, t_p4b, t_p5b, t_p6b, t_h1b, t_h2b, t_h3b, 2L);
+   right->compute_amp(work_doubles, t_p4b, t_p5b, t_p6b, t_h1b, t_h2b, t_h3b, 2L);
+
+   double factor = 1.0;
+   if (zz->restricted()) factor *= 2.0;
+
+   if      (t_p4b == t_p5b && t_p5b == t_p6b) factor *= 0.166666666666666667;
+   else if (t_p4b == t_p5b || t_p5b == t_p6b) factor *= 0.5;
+
+   if      (t_h1b == t_h2b && t_h2b == t_h3b) factor *= 0.166666666666666667;
+   else if (t_h1b == t_h2b || t_h2b == t_h3b) factor *= 0.5;
+
+   long iall = 0L;
+   for (long p4 = 0L; p4 < zz->get_range(t_p4b); ++p4) {
+    const double ep4 = zz->get_orb_energy(zz->get_offset(t_p4b) + p4);
+    for (long p5 = 0L; p5 < zz->get_range(t_p5b); ++p5) {
+     const double ep5 = zz->get_orb_energy(zz->get_offset(t_p5b) + p5);
+     for (long p6 = 0L; p6 < zz->get_range(t_p6b); ++p6) {
+      const double ep6 = zz->get_orb_energy(zz->get_offset(t_p6b) + p6);
+      const double eps = ep4 + ep5 + ep6;
+
+      for (long h1 = 0L; h1 < zz->get_range(t_h1b); ++h1) {
+       const double eh1 = zz->get_orb_energy(zz->get_offset(t_h1b) + h1);
+       for (long h2 = 0L; h2 < zz->get_range(t_h2b); ++h2) {
+        const double eh2 = zz->get_orb_energy(zz->get_offset(t_h2b) + h2);
+        for (long h3 = 0L; h3 < zz->get_range(t_h3b); ++h3, ++iall) {
+         const double eh3 = zz->get_orb_energy(zz->get_offset(t_h3b) + h3);
+
+         const double numerator = factor * (singles[iall] + doubles[iall]) * doubles[iall];
+         task_energy += numerator / (eh1 + eh2 + eh3 - eps);
         }
-       } // end parallel loop 
-       ++count;
+       }
       }
      }
     }
    }
   }
+
+  ThreadLockHolder lh(energy_lock);
+  energy += task_energy;
+ };
+
+ std::vector<long> scratch_sizes;
+ scratch_sizes.push_back(mem_triples); // doubles
+ scratch_sizes.push_back(mem_triples); // singles
+ scratch_sizes.push_back(mem_doubles); // k_a0
+ scratch_sizes.push_back(mem_doubles); // k_a0_sort
+ scratch_sizes.push_back(mem_doubles); // k_a1
+ scratch_sizes.push_back(mem_doubles); // k_a1_sort
+ scratch_sizes.push_back(mem_triples); // k_c_sort
+ // each thread keeps up to a triples block worth of tiles; this is
+ // accounted for in CCR12_Info::determine_maxtilesize
+ TensorTileCache::instance()->set_thread_max_bytes(mem_triples * sizeof(double));
+ {
+  SmithTaskRunner runner(z, scratch_sizes);
+  runner.run((long) tasks.size(), kernel);
  }
- z->mem()->free_local_double(singles);
- z->mem()->free_local_double(doubles);
- z->mem()->free_local_double(k_c_sort); 
- z->mem()->free_local_double(k_a0); 
- z->mem()->free_local_double(k_a0_sort); 
- z->mem()->free_local_double(k_a1); 
- z->mem()->free_local_double(k_a1_sort); 
+ TensorTileCache::instance()->set_thread_max_bytes(0);
+
+ for (int i = 0; i < 4; ++i)
+   if (tensors[i]) {
+     tensors[i]->set_cached(false);
+     tensors[i]->use_locks(false);
+   }
 
  z->mem()->sync();
  Ref<MessageGrp> msg_=MessageGrp::get_default_messagegrp();
@@ -142,4 +216,4 @@ double CCSD_PT::compute_energy(Ref<PTNum> eval_left, Ref<PTNum> eval_right){
 
  return energy;
 }  
-  
+
@@ -291,6 +291,7 @@ void CCSD_R12::compute(){
 #endif
 
   set_energy(energy + this->ref()->energy());
+  print_tile_cache_statistics();
   mem_->sync();
 }
 
@@ -30,6 +30,7 @@
 #include <algorithm>
 #include <chemistry/qc/ccr12/ccsd_t2.h>
 #include <chemistry/qc/ccr12/tensor.h>
+#include <chemistry/qc/ccr12/smith_tasks.h>
 using namespace sc;
   
   
@@ -128,66 +129,23 @@ smith_0_13(out); //z->t2(),z->v2()=>out
 }
   
 void CCSD_T2::smith_0_1(Ref<Tensor>& out){ 
-      
-double* k_a0=z->mem()->malloc_local_double(z->maxtilesize()*z->maxtilesize()*z->maxtilesize()*z->maxtilesize()); 
-double* k_a0_sort=z->mem()->malloc_local_double(z->maxtilesize()*z->maxtilesize()*z->maxtilesize()*z->maxtilesize()); 
-double* k_a1=z->mem()->malloc_local_double(z->maxtilesize()*z->maxtilesize()); 
-double* k_a1_sort=z->mem()->malloc_local_double(z->maxtilesize()*z->maxtilesize()); 
-double* k_c=z->mem()->malloc_local_double(z->maxtilesize()*z->maxtilesize()*z->maxtilesize()*z->maxtilesize()); 
-double* k_c_sort=z->mem()->malloc_local_double(z->maxtilesize()*z->maxtilesize()*z->maxtilesize()*z->maxtilesize()); 
+// Each output tile (p3b,p4b,h1b,h2b) is a task of SmithTaskRunner.  The
+// tasks are sorted by decreasing cost so that the last tasks to be
+// handed out are small.
+const long maxdim=z->maxtilesize()*z->maxtilesize()*z->maxtilesize()*z->maxtilesize(); 
+const long maxdim2=z->maxtilesize()*z->maxtilesize(); 
+std::vector<std::pair<long,long> > tasks; 
+std::vector<long> tiles; 
 for (long p3b=z->noab();p3b<z->noab()+z->nvab();++p3b) { 
  for (long p4b=p3b;p4b<z->noab()+z->nvab();++p4b) { 
   for (long h1b=0L;h1b<z->noab();++h1b) { 
    for (long h2b=0L;h2b<z->noab();++h2b) { 
-    long tileoffset; 
-    if (h1b<h2b) { 
-     tileoffset=(h2b+z->noab()*(h1b+z->noab()*(p4b-z->noab()+z->nvab()*(p3b-z->noab())))); 
-    } 
-    else if (h2b<=h1b) { 
-     tileoffset=(h1b+z->noab()*(h2b+z->noab()*(p4b-z->noab()+z->nvab()*(p3b-z->noab())))); 
-    } 
-    if (out->is_this_local(tileoffset)) { 
-     if (!z->restricted() || z->get_spin(p3b)+z->get_spin(p4b)+z->get_spin(h1b)+z->get_spin(h2b)!=8L) { 
-      if (z->get_spin(p3b)+z->get_spin(p4b)==z->get_spin(h1b)+z->get_spin(h2b)) { 
-       if ((z->get_sym(p3b)^(z->get_sym(p4b)^(z->get_sym(h1b)^z->get_sym(h2b))))==(z->irrep_t()^z->irrep_f())) { 
-        long dimc=z->get_range(p3b)*z->get_range(p4b)*z->get_range(h1b)*z->get_range(h2b); 
-        std::fill(k_c_sort,k_c_sort+dimc,0.0); 
-        for (long h5b=0L;h5b<z->noab();++h5b) { 
-         if (z->get_spin(p3b)+z->get_spin(p4b)==z->get_spin(h1b)+z->get_spin(h5b)) { 
-          if ((z->get_sym(p3b)^(z->get_sym(p4b)^(z->get_sym(h1b)^z->get_sym(h5b))))==z->irrep_t()) { 
-           long p3b_0,p4b_0,h1b_0,h5b_0; 
-           z->restricted_4(p3b,p4b,h1b,h5b,p3b_0,p4b_0,h1b_0,h5b_0); 
-           long h5b_1,h2b_1; 
-           z->restricted_2(h5b,h2b,h5b_1,h2b_1); 
-           long dim_common=z->get_range(h5b); 
-           long dima0_sort=z->get_range(p3b)*z->get_range(p4b)*z->get_range(h1b); 
-           long dima0=dim_common*dima0_sort; 
-           long dima1_sort=z->get_range(h2b); 
-           long dima1=dim_common*dima1_sort; 
-           if (h1b<h5b) { 
-            z->t2()->get_block(h5b_0+z->noab()*(h1b_0+z->noab()*(p4b_0-z->noab()+z->nvab()*(p3b_0-z->noab()))),k_a0); 
-            z->sort_indices4(k_a0,k_a0_sort,z->get_range(p3b),z->get_range(p4b),z->get_range(h1b),z->get_range(h5b),2,1,0,3,+1.0); 
-           } 
-           else if (h5b<=h1b) { 
-            z->t2()->get_block(h1b_0+z->noab()*(h5b_0+z->noab()*(p4b_0-z->noab()+z->nvab()*(p3b_0-z->noab()))),k_a0); 
-            z->sort_indices4(k_a0,k_a0_sort,z->get_range(p3b),z->get_range(p4b),z->get_range(h5b),z->get_range(h1b),3,1,0,2,-1.0); 
-           } 
-           in[1]->get_block(h2b_1+z->noab()*(h5b_1),k_a1); 
-           z->sort_indices2(k_a1,k_a1_sort,z->get_range(h5b),z->get_range(h2b),1,0,+1.0); 
-           double factor=1.0; 
-           z->smith_dgemm(dima0_sort,dima1_sort,dim_common,factor,k_a0_sort,dim_common,k_a1_sort,dim_common,1.0,k_c_sort,dima0_sort); 
-          } 
-         } 
-        } 
-        if (h2b>=h1b) { 
-         z->sort_indices4(k_c_sort,k_c,z->get_range(h2b),z->get_range(h1b),z->get_range(p4b),z->get_range(p3b),3,2,1,0,+1.0); 
-         out->add_block(h2b+z->noab()*(h1b+z->noab()*(p4b-z->noab()+z->nvab()*(p3b-z->noab()))),k_c); 
-        } 
-        if (h1b>=h2b) { 
-         z->sort_indices4(k_c_sort,k_c,z->get_range(h2b),z->get_range(h1b),z->get_range(p4b),z->get_range(p3b),3,2,0,1,-1.0); 
-         out->add_block(h1b+z->noab()*(h2b+z->noab()*(p4b-z->noab()+z->nvab()*(p3b-z->noab()))),k_c); 
-        } 
-       } 
+    if (!z->restricted() || z->get_spin(p3b)+z->get_spin(p4b)+z->get_spin(h1b)+z->get_spin(h2b)!=8L) { 
+     if (z->get_spin(p3b)+z->get_spin(p4b)==z->get_spin(h1b)+z->get_spin(h2b)) { 
+      if ((z->get_sym(p3b)^(z->get_sym(p4b)^(z->get_sym(h1b)^z->get_sym(h2b))))==(z->irrep_t()^z->irrep_f())) { 
+       long dimc=z->get_range(p3b)*z->get_range(p4b)*z->get_range(h1b)*z->get_range(h2b); 
+       tasks.push_back(std::make_pair(-dimc*z->noab(),(long)tiles.size()/4)); 
+       tiles.push_back(p3b); tiles.push_back(p4b); tiles.push_back(h1b); tiles.push_back(h2b); 
       } 
      } 
     } 
@@ -195,12 +153,80 @@ for (long p3b=z->noab();p3b<z->noab()+z->nvab();++p3b) {
   } 
  } 
 } 
-z->mem()->free_local_double(k_a1_sort); 
-z->mem()->free_local_double(k_a1); 
-z->mem()->free_local_double(k_a0_sort); 
-z->mem()->free_local_double(k_a0); 
-z->mem()->free_local_double(k_c_sort); 
-z->mem()->free_local_double(k_c); 
+std::sort(tasks.begin(),tasks.end()); 
+ 
+// the kernel may only use raw pointers, since Ref is not thread-safe 
+const CCR12_Info* zz=z; 
+Tensor* t2=z->t2().pointer(); 
+Tensor* in1=in[1]; 
+Tensor* outp=out.pointer(); 
+SmithTaskRunner::Kernel kernel=[&](long task, double* const* scratch) { 
+ double* k_a0=scratch[0]; 
+ double* k_a0_sort=scratch[1]; 
+ double* k_a1=scratch[2]; 
+ double* k_a1_sort=scratch[3]; 
+ double* k_c=scratch[4]; 
+ double* k_c_sort=scratch[5]; 
+ const long* tile=&tiles[4*tasks[task].second]; 
+ const long p3b=tile[0],p4b=tile[1],h1b=tile[2],h2b=tile[3]; 
+ long dimc=zz->get_range(p3b)*zz->get_range(p4b)*zz->get_range(h1b)*zz->get_range(h2b); 
+ std::fill(k_c_sort,k_c_sort+dimc,0.0); 
+ // the t2 tiles of all h5b are read in the background while the
+ // contractions of the first ones are done
+ for (long h5b=0L;h5b<zz->noab();++h5b) { 
+  if (zz->get_spin(p3b)+zz->get_spin(p4b)==zz->get_spin(h1b)+zz->get_spin(h5b)) { 
+   if ((zz->get_sym(p3b)^(zz->get_sym(p4b)^(zz->get_sym(h1b)^zz->get_sym(h5b))))==zz->irrep_t()) { 
+    long p3b_0,p4b_0,h1b_0,h5b_0; 
+    zz->restricted_4(p3b,p4b,h1b,h5b,p3b_0,p4b_0,h1b_0,h5b_0); 
+    if (h1b<h5b) t2->prefetch_block(h5b_0+zz->noab()*(h1b_0+zz->noab()*(p4b_0-zz->noab()+zz->nvab()*(p3b_0-zz->noab())))); 
+    else t2->prefetch_block(h1b_0+zz->noab()*(h5b_0+zz->noab()*(p4b_0-zz->noab()+zz->nvab()*(p3b_0-zz->noab())))); 
+   } 
+  } 
+ } 
+ for (long h5b=0L;h5b<zz->noab();++h5b) { 
+  if (zz->get_spin(p3b)+zz->get_spin(p4b)==zz->get_spin(h1b)+zz->get_spin(h5b)) { 
+   if ((zz->get_sym(p3b)^(zz->get_sym(p4b)^(zz->get_sym(h1b)^zz->get_sym(h5b))))==zz->irrep_t()) { 
+    long p3b_0,p4b_0,h1b_0,h5b_0; 
+    zz->restricted_4(p3b,p4b,h1b,h5b,p3b_0,p4b_0,h1b_0,h5b_0); 
+    long h5b_1,h2b_1; 
+    zz->restricted_2(h5b,h2b,h5b_1,h2b_1); 
+    long dim_common=zz->get_range(h5b); 
+    long dima0_sort=zz->get_range(p3b)*zz->get_range(p4b)*zz->get_range(h1b); 
+    long dima1_sort=zz->get_range(h2b); 
+    if (h1b<h5b) { 
+     t2->get_block(h5b_0+zz->noab()*(h1b_0+zz->noab()*(p4b_0-zz->noab()+zz->nvab()*(p3b_0-zz->noab()))),k_a0); 
+     zz->sort_indices4(k_a0,k_a0_sort,zz->get_range(p3b),zz->get_range(p4b),zz->get_range(h1b),zz->get_range(h5b),2,1,0,3,+1.0); 
+    } 
+    else if (h5b<=h1b) { 
+     t2->get_block(h1b_0+zz->noab()*(h5b_0+zz->noab()*(p4b_0-zz->noab()+zz->nvab()*(p3b_0-zz->noab()))),k_a0); 
+     zz->sort_indices4(k_a0,k_a0_sort,zz->get_range(p3b),zz->get_range(p4b),zz->get_range(h5b),zz->get_range(h1b),3,1,0,2,-1.0); 
+    } 
+    in1->get_block(h2b_1+zz->noab()*(h5b_1),k_a1); 
+    zz->sort_indices2(k_a1,k_a1_sort,zz->get_range(h5b),zz->get_range(h2b),1,0,+1.0); 
+    double factor=1.0; 
+    zz->smith_dgemm(dima0_sort,dima1_sort,dim_common,factor,k_a0_sort,dim_common,k_a1_sort,dim_common,1.0,k_c_sort,dima0_sort); 
+   } 
+  } 
+ } 
+ if (h2b>=h1b) { 
+  zz->sort_indices4(k_c_sort,k_c,zz->get_range(h2b),zz->get_range(h1b),zz->get_range(p4b),zz->get_range(p3b),3,2,1,0,+1.0); 
+  outp->add_block(h2b+zz->noab()*(h1b+zz->noab()*(p4b-zz->noab()+zz->nvab()*(p3b-zz->noab()))),k_c); 
+ } 
+ if (h1b>=h2b) { 
+  zz->sort_indices4(k_c_sort,k_c,zz->get_range(h2b),zz->get_range(h1b),zz->get_range(p4b),zz->get_range(p3b),3,2,0,1,-1.0); 
+  outp->add_block(h1b+zz->noab()*(h2b+zz->noab()*(p4b-zz->noab()+zz->nvab()*(p3b-zz->noab()))),k_c); 
+ } 
+}; 
+ 
+std::vector<long> scratch_sizes; 
+scratch_sizes.push_back(maxdim); 
+scratch_sizes.push_back(maxdim); 
+scratch_sizes.push_back(maxdim2); 
+scratch_sizes.push_back(maxdim2); 
+scratch_sizes.push_back(maxdim); 
+scratch_sizes.push_back(maxdim); 
+SmithTaskRunner runner(z,scratch_sizes); 
+runner.run((long)tasks.size(),kernel); 
 z->mem()->sync(); 
 } 
   
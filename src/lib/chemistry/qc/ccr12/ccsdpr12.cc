@@ -332,6 +332,7 @@ void CCSDPR12::compute(){
   } // end of do_lambda
 
   set_energy(energy + this->ref()->energy());
+  print_tile_cache_statistics();
   mem_->sync();
 }
 
@@ -152,6 +152,7 @@ void CCSDT::compute(){
   delete ccsdt_e;
 
   set_energy(energy + this->ref()->energy());
+  print_tile_cache_statistics();
   mem_->sync();
 }
 
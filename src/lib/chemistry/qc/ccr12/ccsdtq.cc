@@ -170,6 +170,7 @@ void CCSDTQ::compute(){
   delete ccsdtq_e;
 
   set_energy(energy + this->ref()->energy());
+  print_tile_cache_statistics();
   mem_->sync();
 }
 
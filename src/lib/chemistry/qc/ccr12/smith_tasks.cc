@@ -0,0 +1,154 @@
+//
+// smith_tasks.cc --- threaded execution of SMITH-generated contractions
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#include <algorithm>
+#include <util/misc/regtime.h>
+#include <chemistry/qc/ccr12/ccr12_info.h>
+#include <chemistry/qc/ccr12/smith_tasks.h>
+
+using namespace std;
+using namespace sc;
+
+namespace {
+
+class SmithTaskThread : public Thread {
+    SmithTaskRunner* runner_;
+    const SmithTaskRunner::Kernel& kernel_;
+    double* const* scratch_;
+    int mythread_;
+  public:
+    SmithTaskThread(SmithTaskRunner* runner, const SmithTaskRunner::Kernel& kernel,
+                    double* const* scratch, int mythread)
+      : runner_(runner), kernel_(kernel), scratch_(scratch), mythread_(mythread) {}
+
+    void run() {
+      const double start = RegionTimer::get_wall_time();
+      long ntask = 0;
+      long task;
+      while ((task = runner_->next_task()) >= 0) {
+        kernel_(task, scratch_);
+        ++ntask;
+      }
+      runner_->add_thread_stats(mythread_, ntask, RegionTimer::get_wall_time() - start);
+    }
+};
+
+}
+
+SmithTaskRunner::SmithTaskRunner(const CCR12_Info* z, const vector<long>& scratch_sizes)
+  : z_(z), thrgrp_(z->thrgrp()), scratch_sizes_(scratch_sizes),
+    ntask_(0), chunk_(1), next_(0), end_(0) {
+  lock_ = thrgrp_->new_lock();
+  const int nthread = thrgrp_->nthread();
+  scratch_.resize(nthread);
+  for (int t = 0; t != nthread; ++t)
+    for (vector<long>::const_iterator i = scratch_sizes_.begin(); i != scratch_sizes_.end(); ++i)
+      scratch_[t].push_back(z_->mem()->malloc_local_double(*i));
+  thread_ntask_.resize(nthread, 0L);
+  thread_time_.resize(nthread, 0.0);
+#ifndef DISK_BASED_SMITH
+  const Ref<MemoryGrp>& mem = z_->mem();
+  mem->sync();
+  counter_ = new MemoryGrpRegion(mem, sizeof(double));
+  counter_->set_localsize(mem->me() == 0 ? sizeof(double) : 0);
+#endif
+}
+
+
+SmithTaskRunner::~SmithTaskRunner() {
+#ifndef DISK_BASED_SMITH
+  delete counter_;
+#endif
+  for (int t = 0; t != (int)scratch_.size(); ++t)
+    for (vector<double*>::reverse_iterator i = scratch_[t].rbegin(); i != scratch_[t].rend(); ++i)
+      z_->mem()->free_local_double(*i);
+}
+
+
+void SmithTaskRunner::run(long ntask, const Kernel& kernel) {
+  const int nthread = thrgrp_->nthread();
+  ntask_ = ntask;
+  next_ = end_ = 0;
+  // a few chunks per thread and process keep the counter traffic low, and
+  // the chunks small enough to balance the load
+  const long nworker = (long)nthread * z_->mem()->n();
+  chunk_ = max(1L, ntask / (8L * nworker));
+  fill(thread_ntask_.begin(), thread_ntask_.end(), 0L);
+  fill(thread_time_.begin(), thread_time_.end(), 0.0);
+
+#ifndef DISK_BASED_SMITH
+  if (z_->mem()->me() == 0) *((double*) counter_->localdata()) = 0.0;
+  counter_->sync();
+#endif
+
+  vector<SmithTaskThread*> threads(nthread);
+  for (int t = 0; t != nthread; ++t) {
+    threads[t] = new SmithTaskThread(this, kernel, &(scratch_[t][0]), t);
+    thrgrp_->add_thread(t, threads[t]);
+  }
+  thrgrp_->start_threads();
+  thrgrp_->wait_threads();
+  for (int t = 0; t != nthread; ++t) delete threads[t];
+
+#ifndef DISK_BASED_SMITH
+  // the tasks may have accumulated into tiles of any process
+  counter_->sync();
+#endif
+
+  RegionTimer* regtim = RegionTimer::default_regiontimer();
+  if (regtim && nthread > 1) {
+    const double tmax = *max_element(thread_time_.begin(), thread_time_.end());
+    const double tmin = *min_element(thread_time_.begin(), thread_time_.end());
+    regtim->add_wall_time("thread max", tmax);
+    regtim->add_wall_time("thread min", tmin);
+  }
+}
+
+
+bool SmithTaskRunner::fetch_chunk() {
+#ifndef DISK_BASED_SMITH
+  double* c = (double*) counter_->obtain_readwrite(0, sizeof(double));
+  const long first = (long) *c;
+  *c += chunk_;
+  counter_->release_readwrite((void*) c, 0, sizeof(double));
+#else
+  const long first = end_;
+#endif
+  if (first >= ntask_) return false;
+  next_ = first;
+  end_ = min(first + chunk_, ntask_);
+  return true;
+}
+
+
+long SmithTaskRunner::next_task() {
+  ThreadLockHolder lh(lock_);
+  if (next_ >= end_ && !fetch_chunk()) return -1L;
+  return next_++;
+}
+
+
+void SmithTaskRunner::add_thread_stats(int thread, long ntask, double time) {
+  thread_ntask_[thread] = ntask;
+  thread_time_[thread] = time;
+}
+
@@ -0,0 +1,107 @@
+//
+// smith_tasks.h --- threaded execution of SMITH-generated contractions
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#ifndef _chemistry_qc_ccr12_smith_tasks_h
+#define _chemistry_qc_ccr12_smith_tasks_h
+
+#include <functional>
+#include <vector>
+#include <util/group/memory.h>
+#include <util/group/memregion.h>
+#include <util/group/thread.h>
+#include <chemistry/qc/ccr12/tensor.h>
+
+namespace sc {
+
+class CCR12_Info;
+
+/** SmithTaskRunner executes the iterations of the outermost loops of a
+    SMITH-generated contraction, one output tile each, as tasks.
+
+    Rather than having each process walk the whole loop nest and compute
+    the tiles that it owns, the tasks are handed out in chunks from a
+    counter shared by all processes and, within a process, to the threads
+    of the ThreadGrp of CCR12_Info.  Each thread has its own scratch
+    buffers (the k_a0, k_a0_sort, ... arrays of the generated code).  Since
+    a task may accumulate into a tile owned by another process,
+    Tensor::add_block must be atomic, which it is.  The threads read and
+    accumulate blocks concurrently; two threads only wait for each other
+    when they accumulate into the same block (or, in the DISK_BASED_SMITH
+    build, into blocks sharing a lock).
+
+    With DISK_BASED_SMITH only a single process is supported, so the
+    shared counter is then local to the process. */
+class SmithTaskRunner {
+  public:
+    /** The body of a task.  scratch[i] has the size given by the i-th
+        element of the scratch sizes given to the constructor. */
+    typedef std::function<void(long task, double* const* scratch)> Kernel;
+
+  private:
+    const CCR12_Info* z_;
+    Ref<ThreadGrp> thrgrp_;
+    Ref<ThreadLock> lock_;
+    std::vector<long> scratch_sizes_;
+    // scratch_[thread][i]
+    std::vector<std::vector<double*> > scratch_;
+
+    long ntask_;
+    long chunk_;
+    // the range of tasks fetched from the counter, but not yet started
+    long next_;
+    long end_;
+#ifndef DISK_BASED_SMITH
+    // a single double on node 0 that counts the tasks handed out
+    MemoryGrpRegion* counter_;
+#endif
+
+    // statistics
+    std::vector<long> thread_ntask_;
+    std::vector<double> thread_time_;
+
+    bool fetch_chunk();
+
+  public:
+    /** Allocates the scratch buffers of each thread.  All processes must
+        construct the runner together. */
+    SmithTaskRunner(const CCR12_Info* z, const std::vector<long>& scratch_sizes);
+    ~SmithTaskRunner();
+
+    /** Runs tasks 0 to ntask-1.  All processes must call this together,
+        with the same ntask.  The kernel is called concurrently from several
+        threads, so it may only modify its scratch buffers and the output
+        tensor through Tensor::add_block. */
+    void run(long ntask, const Kernel& kernel);
+
+    /// Returns the next task for the calling thread, or -1 if none remain.
+    long next_task();
+
+    /// Records that a thread has finished ntask tasks in time seconds.
+    void add_thread_stats(int thread, long ntask, double time);
+
+    /// The number of threads.
+    int nthread() const { return thrgrp_->nthread(); }
+};
+
+}
+
+#endif
@@ -34,16 +34,285 @@
 #include <sstream>
 #include <cstdio>
 #include <unistd.h>
+#include <fcntl.h>
 #include <util/misc/exenv.h>
-#include <util/misc/exenv.h>
+#include <util/misc/formio.h>
 #include <math/scmat/blas.h>
 #include <util/misc/consumableresources.h>
+#include <util/misc/scexception.h>
 #include <chemistry/qc/ccr12/tensor.h>
 #include <chemistry/qc/ccr12/ccr12_info.h>
 
 using namespace std;
 using namespace sc;
 
+/// TensorTileCache >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+TensorTileCache::TensorTileCache()
+  : max_bytes_(0), bytes_(0), reading_(0), stop_(false),
+    thread_max_bytes_(0), epoch_(0),
+    nhit_(0), nmiss_(0), nprefetch_(0), nprefetch_hit_(0), nevict_(0),
+    nthread_hit_(0) {
+}
+
+TensorTileCache::~TensorTileCache() {
+  {
+    std::lock_guard<std::mutex> lh(mutex_);
+    stop_ = true;
+  }
+  queue_cv_.notify_all();
+  if (worker_.joinable()) worker_.join();
+}
+
+TensorTileCache* TensorTileCache::instance() {
+  static TensorTileCache cache;
+  return &cache;
+}
+
+void TensorTileCache::set_max_bytes(size_t nbytes) {
+  std::lock_guard<std::mutex> lh(mutex_);
+  max_bytes_ = nbytes;
+  evict_locked();
+}
+
+size_t TensorTileCache::max_bytes() const {
+  std::lock_guard<std::mutex> lh(mutex_);
+  return max_bytes_;
+}
+
+void TensorTileCache::set_thread_max_bytes(size_t nbytes) {
+  std::lock_guard<std::mutex> lh(mutex_);
+  thread_max_bytes_ = nbytes;
+  ++epoch_;
+}
+
+TensorTileCache::ThreadTiles& TensorTileCache::thread_tiles() {
+  static thread_local ThreadTiles tiles;
+  return tiles;
+}
+
+bool TensorTileCache::thread_get(const Key& key, double* data, long size) {
+  ThreadTiles& tiles = thread_tiles();
+  if (tiles.lru.empty()) return false;
+  if (tiles.epoch != epoch_) {
+    tiles.lru.clear();
+    tiles.bytes = 0;
+    return false;
+  }
+  for (LRUList::iterator e = tiles.lru.begin(); e != tiles.lru.end(); ++e) {
+    if (e->key == key) {
+      MPQC_ASSERT(e->data.size() == (size_t)size);
+      std::copy(e->data.begin(), e->data.end(), data);
+      tiles.lru.splice(tiles.lru.begin(), tiles.lru, e);
+      ++nthread_hit_;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TensorTileCache::thread_insert(const Key& key, const double* data, long size,
+                                    unsigned long epoch) {
+  const size_t max_bytes = thread_max_bytes_;
+  const size_t nbytes = size * sizeof(double);
+  if (nbytes > max_bytes) return;
+  ThreadTiles& tiles = thread_tiles();
+  if (tiles.epoch != epoch) {
+    tiles.lru.clear();
+    tiles.bytes = 0;
+    tiles.epoch = epoch;
+  }
+  tiles.lru.push_front(Entry());
+  Entry& e = tiles.lru.front();
+  e.key = key;
+  e.data.assign(data, data + size);
+  e.prefetched = false;
+  tiles.bytes += nbytes;
+  while (tiles.bytes > max_bytes) {
+    tiles.bytes -= tiles.lru.back().data.size() * sizeof(double);
+    tiles.lru.pop_back();
+  }
+}
+
+bool TensorTileCache::get(const Tensor* t, long tag, double* data, long size) {
+  const Key key(t, tag);
+  if (thread_get(key, data, size)) return true;
+  unsigned long epoch;
+  {
+    std::lock_guard<std::mutex> lh(mutex_);
+    if (max_bytes_ == 0) return false;
+    std::map<Key, LRUList::iterator>::iterator iter = entries_.find(key);
+    if (iter == entries_.end()) {
+      ++nmiss_;
+      return false;
+    }
+    LRUList::iterator e = iter->second;
+    MPQC_ASSERT(e->data.size() == (size_t)size);
+    std::copy(e->data.begin(), e->data.end(), data);
+    if (e->prefetched) {
+      ++nprefetch_hit_;
+      e->prefetched = false;
+    }
+    ++nhit_;
+    lru_.splice(lru_.begin(), lru_, e);
+    epoch = epoch_;
+  }
+  thread_insert(key, data, size, epoch);
+  return true;
+}
+
+unsigned long TensorTileCache::generation(const Tensor* t) {
+  std::lock_guard<std::mutex> lh(mutex_);
+  return generation_[t];
+}
+
+void TensorTileCache::insert(const Tensor* t, long tag, const double* data, long size,
+                             unsigned long generation) {
+  unsigned long epoch;
+  {
+    std::lock_guard<std::mutex> lh(mutex_);
+    // the block is stale if the blocks of t were dropped while it was read
+    if (generation_[t] != generation) return;
+    insert_locked(Key(t, tag), data, size, false);
+    epoch = epoch_;
+  }
+  thread_insert(Key(t, tag), data, size, epoch);
+}
+
+void TensorTileCache::insert_locked(const Key& key, const double* data, long size,
+                                    bool prefetched) {
+  const size_t nbytes = size * sizeof(double);
+  if (nbytes > max_bytes_) return;
+  if (entries_.find(key) != entries_.end()) return;
+
+  lru_.push_front(Entry());
+  Entry& e = lru_.front();
+  e.key = key;
+  e.data.assign(data, data + size);
+  e.prefetched = prefetched;
+  entries_[key] = lru_.begin();
+  bytes_ += nbytes;
+  evict_locked();
+}
+
+void TensorTileCache::evict_locked() {
+  while (bytes_ > max_bytes_ && !lru_.empty()) {
+    Entry& e = lru_.back();
+    bytes_ -= e.data.size() * sizeof(double);
+    entries_.erase(e.key);
+    lru_.pop_back();
+    ++nevict_;
+  }
+}
+
+void TensorTileCache::erase_locked(const Tensor* t) {
+  ++generation_[t];
+  ++epoch_;
+  for (std::deque<Key>::iterator i = queue_.begin(); i != queue_.end(); ) {
+    if (i->first == t) i = queue_.erase(i);
+    else ++i;
+  }
+  std::map<Key, LRUList::iterator>::iterator begin = entries_.lower_bound(Key(t, LONG_MIN));
+  std::map<Key, LRUList::iterator>::iterator end = begin;
+  while (end != entries_.end() && end->first.first == t) {
+    bytes_ -= end->second->data.size() * sizeof(double);
+    lru_.erase(end->second);
+    ++end;
+  }
+  entries_.erase(begin, end);
+}
+
+void TensorTileCache::prefetch(const Tensor* t, long tag) {
+  {
+    std::lock_guard<std::mutex> lh(mutex_);
+    if (max_bytes_ == 0) return;
+    const Key key(t, tag);
+    if (entries_.find(key) != entries_.end()) return;
+    if (std::find(queue_.begin(), queue_.end(), key) != queue_.end()) return;
+    queue_.push_back(key);
+    ++nprefetch_;
+    if (!worker_.joinable())
+      worker_ = std::thread(&TensorTileCache::run_prefetch, this);
+  }
+  queue_cv_.notify_one();
+}
+
+void TensorTileCache::run_prefetch() {
+  std::vector<double> buffer;
+  std::unique_lock<std::mutex> lh(mutex_);
+  while (true) {
+    queue_cv_.wait(lh, [this]{ return stop_ || !queue_.empty(); });
+    if (stop_) return;
+
+    const Key key = queue_.front();
+    queue_.pop_front();
+    if (entries_.find(key) != entries_.end()) continue;
+    Tensor* t = const_cast<Tensor*>(key.first);
+    const unsigned long generation = generation_[t];
+    reading_ = t;
+
+    // the tensor cannot be destroyed while reading_ points to it, since
+    // forget waits for reading_ to change
+    lh.unlock();
+    long doffset;
+    buffer.resize(t->block_size(key.second, doffset));
+    t->read_block(key.second, &buffer[0]);
+    lh.lock();
+
+    // the block is stale if the tensor was modified while it was being read
+    if (generation_[t] == generation)
+      insert_locked(key, &buffer[0], buffer.size(), true);
+    reading_ = 0;
+    reading_cv_.notify_all();
+  }
+}
+
+void TensorTileCache::invalidate(const Tensor* t) {
+  std::lock_guard<std::mutex> lh(mutex_);
+  erase_locked(t);
+}
+
+void TensorTileCache::forget(const Tensor* t) {
+  std::unique_lock<std::mutex> lh(mutex_);
+  erase_locked(t);
+  reading_cv_.wait(lh, [this, t]{ return reading_ != t; });
+  generation_.erase(t);
+}
+
+void TensorTileCache::clear() {
+  std::lock_guard<std::mutex> lh(mutex_);
+  queue_.clear();
+  entries_.clear();
+  lru_.clear();
+  bytes_ = 0;
+  ++epoch_;
+  for (std::map<const Tensor*, unsigned long>::iterator i = generation_.begin();
+       i != generation_.end(); ++i)
+    ++i->second;
+}
+
+void TensorTileCache::print(std::ostream& os) const {
+  std::lock_guard<std::mutex> lh(mutex_);
+  if (max_bytes_ == 0 && nthread_hit_ == 0) return;
+  const unsigned long nget = nhit_ + nmiss_;
+  os << indent << "Tile cache (" << max_bytes_ << " bytes):" << endl;
+  os << incindent;
+  os << indent << scprintf("hits        = %12lu (%6.2f%%)", nhit_,
+                           nget ? 100.0 * nhit_ / nget : 0.0) << endl;
+  os << indent << scprintf("misses      = %12lu", nmiss_) << endl;
+  os << indent << scprintf("prefetches  = %12lu (%lu used)", nprefetch_, nprefetch_hit_) << endl;
+  os << indent << scprintf("evictions   = %12lu", nevict_) << endl;
+  if (nthread_hit_ > 0)
+    os << indent << scprintf("thread hits = %12lu", (unsigned long)nthread_hit_) << endl;
+  os << decindent;
+}
+
+void TensorTileCache::reset_statistics() {
+  std::lock_guard<std::mutex> lh(mutex_);
+  nhit_ = nmiss_ = nprefetch_ = nprefetch_hit_ = nevict_ = 0;
+  nthread_hit_ = 0;
+}
+
+/// Tensor >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
 static ClassDesc Tensor_cd(
   typeid(Tensor), "Tensor", 1, "virtual public RefCount",
   0, 0, 0);
@@ -54,6 +323,13 @@ Tensor::Tensor(string filename, const Ref<MemoryGrp>& mem): mem_(mem) {
                                   basename_prefix;
   filename_ = full_prefix + filename;
   file_allocated_ = false;
+  cached_ = false;
+#ifdef DISK_BASED_SMITH
+  file_ = -1;
+  Ref<ThreadGrp> thr = ThreadGrp::get_default_threadgrp();
+  block_locks_.resize(nblocklocks);
+  for (int i = 0; i < nblocklocks; ++i) block_locks_[i] = thr->new_lock();
+#endif
 }
 
 Tensor::~Tensor(){
@@ -78,6 +354,37 @@ void Tensor::set_filesize(long i){
 #ifdef DISK_BASED_SMITH
 // must fit into the cache of the hard drive (?)
 static const long cachesize = 100000;
+
+namespace {
+  // pread and pwrite do not move a shared file position, hence
+  // several threads can access different blocks of the file at once
+  void read_doubles(int fd, double* data, long n, long doffset) {
+    char* buf = (char*) data;
+    size_t nbyte = n * sizeof(double);
+    off_t offset = (off_t)doffset * sizeof(double);
+    while (nbyte > 0) {
+      const ssize_t nread = ::pread(fd, buf, nbyte, offset);
+      if (nread <= 0)
+        throw FileOperationFailed("could not read a Tensor block",
+                                  __FILE__, __LINE__, 0,
+                                  FileOperationFailed::Read);
+      buf += nread; nbyte -= nread; offset += nread;
+    }
+  }
+  void write_doubles(int fd, const double* data, long n, long doffset) {
+    const char* buf = (const char*) data;
+    size_t nbyte = n * sizeof(double);
+    off_t offset = (off_t)doffset * sizeof(double);
+    while (nbyte > 0) {
+      const ssize_t nwritten = ::pwrite(fd, buf, nbyte, offset);
+      if (nwritten <= 0)
+        throw FileOperationFailed("could not write a Tensor block",
+                                  __FILE__, __LINE__, 0,
+                                  FileOperationFailed::Write);
+      buf += nwritten; nbyte -= nwritten; offset += nwritten;
+    }
+  }
+}
 #endif
 
 void Tensor::createfile(){
@@ -91,23 +398,15 @@ void Tensor::createfile(){
 
  zero();
 #else
- // create a zero-cleared file of the specified size
- file_ = new fstream(filename_.c_str(), fstream::out | fstream::binary); 
- MPQC_ASSERT(file()->is_open());
- double* aux_array = new double[cachesize];
- fill(aux_array, aux_array + cachesize, 0.0);
- long size_back = filesize_; 
- while (size_back > 0L) {
-   file_->write((const char*)aux_array, min(cachesize, size_back) * sizeof(double)); 
-   size_back -= cachesize;
- }
- delete[] aux_array;
- delete file_;
-
- // reopen with in/out/binary; will be delete'd in the destructor
- file_ = new fstream(filename_.c_str(), fstream::in | fstream::out | fstream::binary); 
+ // create a zero-cleared file of the specified size; will be closed in the destructor
+ file_ = ::open(filename_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+ if (file_ < 0)
+   throw FileOperationFailed("could not create the Tensor file",
+                             __FILE__, __LINE__, filename_.c_str(),
+                             FileOperationFailed::OpenRW);
  // Unlinking while open to avoid garbage. When closed, the file is physically removed.
  unlink(filename_.c_str());
+ assign(0.0);
 #endif
 
  file_allocated_ = true;
@@ -146,89 +445,119 @@ vector<long> Tensor::determine_filesizes(){
 
 
 void Tensor::deletefile(){
+ TensorTileCache::instance()->forget(this);
+#ifndef DISK_BASED_SMITH
  delete file_;
+#else
+ ::close(file_);
+#endif
 }
 
 
 /// routines called from one node (i.e. inside the loops) >>>>>>>>>>>>>>>>>>>>>>>>>
-void Tensor::get_block(long tag, double* data){
-  std::map<long, long>::iterator iter = hash_table_.find(tag);
+long Tensor::block_size(long tag, long& doffset) const {
+  std::map<long, long>::const_iterator iter = hash_table_.find(tag);
   MPQC_ASSERT(iter != hash_table_.end());
-  long doffset = iter->second;
-  long dsize   = (++iter)->second-doffset;
+  doffset = iter->second;
+  return (++iter)->second - doffset;
+}
+
+
+void Tensor::read_block(long tag, double* data){
+  long doffset;
+  long dsize = block_size(tag, doffset);
   distsize_t offset = (distsize_t)doffset * sizeof(double);
-  const int    size =        (int)dsize   * sizeof(double); // in byte
+  const size_t size =                dsize   * sizeof(double); // in byte
 
 #ifndef DISK_BASED_SMITH
   double* buffer = (double*) file_->obtain_readonly(offset, size);
   ::memcpy((void*) data, (void*) buffer, size);
   file_->release_readonly(buffer, offset, size);
 #else
-  file_->clear();
-  file_->seekg(doffset * sizeof(double));
-  file_->read((char*) data, size);
+  read_doubles(file_, data, dsize, doffset);
 #endif
 }
 
 
+void Tensor::set_cached(bool cached){
+  // the blocks must not be modified by any node while they are cached
+  sync();
+  TensorTileCache::instance()->invalidate(this);
+  cached_ = cached;
+}
+
+
+void Tensor::get_block(long tag, double* data){
+  if (!cached_) {
+    read_block(tag, data);
+    return;
+  }
+  TensorTileCache* cache = TensorTileCache::instance();
+  long doffset;
+  const long dsize = block_size(tag, doffset);
+  if (cache->get(this, tag, data, dsize)) return;
+  const unsigned long generation = cache->generation(this);
+  read_block(tag, data);
+  cache->insert(this, tag, data, dsize, generation);
+}
+
+
+void Tensor::prefetch_block(long tag){
+  MPQC_ASSERT(exists(tag));
+  if (cached_) TensorTileCache::instance()->prefetch(this, tag);
+}
+
+
 void Tensor::put_block(long tag, double* data){
+  MPQC_ASSERT(!cached_);
   std::map<long,long>::iterator iter = hash_table_.find(tag);
   MPQC_ASSERT(iter != hash_table_.end());
   long doffset = iter->second;
   long dsize   = (++iter)->second - doffset;
   distsize_t offset = (distsize_t)doffset * sizeof(double);
-  const int    size =        (int)dsize   * sizeof(double); // in byte
+  const size_t size =                dsize   * sizeof(double); // in byte
 
 #ifndef DISK_BASED_SMITH
   double* buffer = (double *) file_->obtain_writeonly(offset, size);
   ::memcpy((void*) buffer, (void*) data, size);
   file_->release_writeonly((void*) buffer, offset, size);
 #else
-  file_->clear();
-  file_->seekp(doffset * sizeof(double));
-  file_->write((char*)data, size);
+  write_doubles(file_, data, dsize, doffset);
 #endif
 }
 
 
 void Tensor::add_block(long tag, double* data){
-// copy of data will be allocated;
-// probably it is ok (in smith codes, k_a and k_a_sort are
-// already deallocated at the time this is called)...
+  MPQC_ASSERT(!cached_);
   std::map<long,long>::iterator iter = hash_table_.find(tag);
   MPQC_ASSERT(iter != hash_table_.end());
   long doffset = iter->second;
-  blasint dsize    = (int)((++iter)->second - doffset);
-  distsize_t offset = (distsize_t) doffset * sizeof(double);
-  const int    size =          (int)dsize  * sizeof(double); // in byte
+  long dsize   = (++iter)->second - doffset;
 
-  double* copy_data = mem_->malloc_local_double(dsize);
 #ifndef DISK_BASED_SMITH
-  ::memcpy((void*) copy_data, (void*) data, size);
-
-  double* buffer = (double*) file_->obtain_readonly(offset, size);
-  const blasint unit = 1;
-  const double one = 1.0;
-  F77_DAXPY(&dsize, &one, buffer, &unit, copy_data, &unit);
-  file_->release_readonly((void*) buffer, offset, size);
-
-  buffer = (double*) file_->obtain_writeonly(offset, size);
-  ::memcpy((void*) buffer, (void*) copy_data, size);
-  file_->release_writeonly((void*) buffer, offset, size);
+  // sum_reduction locks the region, hence blocks can also be accumulated
+  // into by other nodes
+  file_->sum_reduction(data, doffset, dsize);
 #else
-  file_->clear();
-  file_->seekg(doffset * sizeof(double));
-  file_->read((char*)copy_data, size);
+// copy of data will be allocated;
+// probably it is ok (in smith codes, k_a and k_a_sort are
+// already deallocated at the time this is called)...
+// Only the read-modify-write of this block has to be atomic.
+  ThreadLockHolder lh(block_locks_[(unsigned long)tag % nblocklocks]);
+  double* copy_data = mem_->malloc_local_double(dsize);
+  read_doubles(file_, copy_data, dsize, doffset);
   const double one = 1.0;
   const blasint unit = 1;
-  F77_DAXPY(&dsize, &one, data, &unit, copy_data, &unit);
+  // the BLAS length may be a 32-bit integer
+  for (long i = 0L; i < dsize; i += INT_MAX) {
+    const blasint n = min(dsize - i, (long)INT_MAX);
+    F77_DAXPY(&n, &one, data + i, &unit, copy_data + i, &unit);
+  }
 
-  file_->clear();
-  file_->seekp(doffset * sizeof(double));
-  file_->write((const char*)copy_data, size);
-#endif
+  write_doubles(file_, copy_data, dsize, doffset);
 
   mem_->free_local_double(copy_data);
+#endif
 }
 
 bool Tensor::exists(long tag) const {
@@ -259,20 +588,20 @@ void Tensor::zero(){
 }
 
 void Tensor::assign(double a){
+  MPQC_ASSERT(!cached_);
 #ifndef DISK_BASED_SMITH
   double* buffer = (double *) file_->localdata();
   const size_t dsize = (size_t)file()->localsize() / sizeof(double);
   fill(buffer, buffer + dsize, a);
   sync();
 #else
-  file_->clear();
-  file_->seekp(0);
   double* aux_array = new double[cachesize];
   fill(aux_array, aux_array + cachesize, a);
+  long size_now = 0L;
   long size_back = filesize_;
   while (size_back > 0) {
-    const size_t readsize = min(size_back, cachesize) * sizeof(double);
-    file_->write((const char*)aux_array, readsize); 
+    write_doubles(file_, aux_array, min(size_back, cachesize), size_now);
+    size_now += cachesize;
     size_back -= cachesize;
   }
   delete[] aux_array;
@@ -290,6 +619,7 @@ namespace {
   };
 }
 void Tensor::scale(double a){
+  MPQC_ASSERT(!cached_);
 #ifndef DISK_BASED_SMITH
   double* buffer=(double *) file_->localdata();
   const size_t dsize =(size_t)file()->localsize() / sizeof(double);
@@ -297,22 +627,16 @@ void Tensor::scale(double a){
   for_each(buffer, buffer + dsize, scaler);
   sync();
 #else
-  file_->clear();
   double* aux_array = new double [cachesize];
-  size_t size_now = 0UL; 
+  long size_now = 0L;
   long size_back = filesize_;
   ElementScaler scaler(a);
   while (size_back > 0) {
    const int rsize = min(cachesize, size_back);
-   const size_t readsize = rsize * sizeof(double);
-   const size_t position = size_now * sizeof(double);
 
-   file_->seekg(position);
-   file_->read((char*)aux_array, readsize); 
+   read_doubles(file_, aux_array, rsize, size_now);
    for_each(aux_array, aux_array + rsize, scaler);
-
-   file_->seekp(position);
-   file_->write((const char*)aux_array, readsize); 
+   write_doubles(file_, aux_array, rsize, size_now);
 
    size_now += cachesize;
    size_back -= cachesize;
@@ -322,6 +646,7 @@ void Tensor::scale(double a){
 }
 
 void Tensor::daxpy(const Ref<Tensor>& other, double a){ // add to self
+  MPQC_ASSERT(!cached_);
   const blasint unit = 1;
 #ifndef DISK_BASED_SMITH
   const blasint dsize = file_->localsize() / sizeof(double);
@@ -331,27 +656,17 @@ void Tensor::daxpy(const Ref<Tensor>& other, double a){ // add to self
   F77_DAXPY(&dsize, &a, buffer2, &unit, buffer1, &unit);
   sync();
 #else
-// Assuming that this and other point to different Tensor's. Probably OK, right?
-// Otherwise, we need to insert fstream::clear for the last block.
   double* aux_array = new double[cachesize];
   double* aux_array2 = new double[cachesize];
-  size_t size_now = 0UL; 
+  long size_now = 0L;
   long size_back = filesize_;
-  this->file_->clear();
-  other->file_->clear();
   while (size_back > 0L) {
     const blasint rsize = min(cachesize, size_back);
-    const size_t readsize = rsize * sizeof(double);
-    const size_t position = size_now * sizeof(double); 
 
-    this->file_->seekg(position);
-    this->file_->read((char*)aux_array, readsize);
-    other->file_->seekg(position);
-    other->file_->read((char*)aux_array2, readsize);
+    read_doubles(this->file_, aux_array, rsize, size_now);
+    read_doubles(other->file_, aux_array2, rsize, size_now);
     F77_DAXPY(&rsize, &a, aux_array2, &unit, aux_array, &unit);
-
-    this->file_->seekp(position);
-    this->file_->write((const char*)aux_array, readsize); 
+    write_doubles(this->file_, aux_array, rsize, size_now);
 
     size_now += cachesize;
     size_back -= cachesize;
@@ -382,16 +697,14 @@ Ref<Tensor> Tensor::copy() const{
   ::memcpy((void*) buffer2, (void*) buffer1, size);
   sync();
 #else
-  file_->clear();
-  other->file()->clear();
-  file_->seekg(0);
-  other->file()->seekp(0);
-  char* aux_array = new char[cachesize * sizeof(double)];
-  long size_back = filesize_; 
+  double* aux_array = new double[cachesize];
+  long size_now = 0L;
+  long size_back = filesize_;
   while (size_back > 0L) {
-    const size_t readsize = min(cachesize, size_back) * sizeof(double);
-    file_->read(aux_array, readsize);
-    other->file()->write(aux_array, readsize);
+    const long rsize = min(cachesize, size_back);
+    read_doubles(file_, aux_array, rsize, size_now);
+    write_doubles(other->file_, aux_array, rsize, size_now);
+    size_now += cachesize;
     size_back -= cachesize;
   }
   delete[] aux_array;
@@ -424,15 +737,15 @@ double Tensor::norm() const {
   Ref<MessageGrp> msg_ = MessageGrp::get_default_messagegrp();
   msg_->sum(norm_);
 #else
-  file_->clear();
-  file_->seekg(0);
   double* aux_array = new double[cachesize];
   double norm_ = 0.0;
+  long size_now = 0L;
   long size_back = filesize_;
   while (size_back > 0L) {
     const blasint bsize = min(cachesize, size_back);
-    file_->read((char*)aux_array, bsize * sizeof(double));
+    read_doubles(file_, aux_array, bsize, size_now);
     norm_ += F77_DDOT(&bsize, aux_array, &unit, aux_array, &unit);
+    size_now += cachesize;
     size_back -= cachesize;
   }
   delete[] aux_array;
@@ -458,21 +771,15 @@ double Tensor::ddot(Ref<Tensor>& other) const {
   Ref<MessageGrp> msg_ = MessageGrp::get_default_messagegrp();
   msg_->sum(ddotproduct);
 #else
-  file_->clear();
-  other->file_->clear();
   double* aux_array = new double[cachesize];
   double* aux_array2 = new double[cachesize];
   double ddotproduct = 0.0;
-  long size_back = filesize_; 
-  size_t size_now = 0LU;
+  long size_back = filesize_;
+  long size_now = 0L;
   while (size_back > 0L) {
     const blasint rsize = min(cachesize, size_back);
-    const size_t readsize = rsize * sizeof(double);
-    const size_t position = size_now * sizeof(double);
-    file_->seekg(position);
-    file_->read((char*)aux_array, readsize);
-    other->file_->seekg(position);
-    other->file_->read((char*)aux_array2, readsize);
+    read_doubles(file_, aux_array, rsize, size_now);
+    read_doubles(other->file_, aux_array2, rsize, size_now);
     ddotproduct += F77_DDOT(&rsize, aux_array, &unit, aux_array2, &unit);
     size_back -= cachesize;
     size_now += cachesize;
@@ -501,7 +808,7 @@ void Tensor::print(const std::string& label,
       long doffset = i->second;
       long dsize   = ii->second-doffset;
       distsize_t offset = (distsize_t)doffset * sizeof(double);
-      const int    size =        (int)dsize   * sizeof(double); // in byte
+      const size_t size =                dsize   * sizeof(double); // in byte
       double* buffer = (double*) file()->obtain_readonly(offset, size);
       os << indent << "tile " << i->first << std::endl;
       for(int k=0; k<dsize; ++k)
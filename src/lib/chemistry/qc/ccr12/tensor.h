@@ -30,7 +30,16 @@
 
 #include <string>
 #include <vector>
+#include <list>
+#include <map>
+#include <deque>
+#include <utility>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 #include <util/misc/compute.h>
+#include <util/misc/exenv.h>
 #include <util/group/memory.h>
 #include <util/group/memregion.h>
 #include <util/group/message.h>
@@ -40,12 +49,130 @@
 // note disk-based algorithm does not support parallel execution so far.
 #define DISK_BASED_SMITH
 
-#ifdef DISK_BASED_SMITH
-#include <fstream>
-#endif
-
 namespace sc {
 
+class Tensor;
+
+/** TensorTileCache is a per-process read-through cache of the blocks
+    obtained with Tensor::get_block.  Blocks are keyed by the tensor and the
+    tag and evicted in least-recently-used order when the total size exceeds
+    the byte budget.  A budget of zero disables the cache.
+
+    Blocks can be requested ahead of time with Tensor::prefetch_block; these
+    are read by a background thread so that the I/O (or the remote memory
+    access) overlaps with the contractions of the current block.
+
+    Only the blocks of tensors that are marked as read-only with
+    Tensor::set_cached are cached.  The cache is local to the process, but
+    the blocks of a tensor can be modified by any process (add_block on a
+    remote block, for example), so a tensor may only be marked while none
+    of the processes modifies it.  Its blocks are dropped when the mark is
+    removed.
+
+    In addition, each thread can keep the blocks that were last returned to
+    it (see set_thread_max_bytes).  A thread that reads the same blocks in
+    consecutive tasks then finds them without taking the lock of the cache.
+ */
+class TensorTileCache {
+  private:
+    typedef std::pair<const Tensor*, long> Key;
+    struct Entry {
+      Key key;
+      std::vector<double> data;
+      bool prefetched;
+    };
+    typedef std::list<Entry> LRUList;
+    /// the blocks kept by one thread, most recently used first
+    struct ThreadTiles {
+      LRUList lru;
+      size_t bytes;
+      unsigned long epoch;
+      ThreadTiles() : bytes(0), epoch(0) {}
+    };
+
+    size_t max_bytes_;
+    size_t bytes_;
+    LRUList lru_;                                  // most recently used first
+    std::map<Key, LRUList::iterator> entries_;
+    /// incremented whenever the entries of a tensor are invalidated
+    std::map<const Tensor*, unsigned long> generation_;
+
+    std::atomic<size_t> thread_max_bytes_;
+    /// incremented whenever blocks are dropped; the blocks kept by a
+    /// thread are only valid for the epoch in which they were stored
+    std::atomic<unsigned long> epoch_;
+
+    // prefetch queue and the background thread that services it
+    std::deque<Key> queue_;
+    const Tensor* reading_;
+    bool stop_;
+    std::thread worker_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    std::condition_variable reading_cv_;
+
+    // statistics
+    unsigned long nhit_;
+    unsigned long nmiss_;
+    unsigned long nprefetch_;
+    unsigned long nprefetch_hit_;
+    unsigned long nevict_;
+    std::atomic<unsigned long> nthread_hit_;
+
+    TensorTileCache();
+    ~TensorTileCache();
+
+    void insert_locked(const Key& key, const double* data, long size,
+                       bool prefetched);
+    void erase_locked(const Tensor* t);
+    void evict_locked();
+    void run_prefetch();
+
+    static ThreadTiles& thread_tiles();
+    bool thread_get(const Key& key, double* data, long size);
+    void thread_insert(const Key& key, const double* data, long size,
+                       unsigned long epoch);
+
+  public:
+    static TensorTileCache* instance();
+
+    /// set/get the budget in bytes; a budget of zero disables the cache
+    void set_max_bytes(size_t nbytes);
+    size_t max_bytes() const;
+
+    /** Sets the number of bytes of blocks that each thread keeps for
+        itself, in addition to the shared budget.  These are the blocks last
+        returned to the thread by get or stored by it with insert.  Zero, the
+        default, disables them; the memory of a thread is released at its
+        next get. */
+    void set_thread_max_bytes(size_t nbytes);
+
+    /** Copies the block to data and returns true if it is cached,
+        otherwise returns false. */
+    bool get(const Tensor* t, long tag, double* data, long size);
+    /// the number of times the blocks of t have been dropped
+    unsigned long generation(const Tensor* t);
+    /** Stores a copy of a block that was just read, unless the blocks of t
+        have been dropped since generation(t) returned generation. */
+    void insert(const Tensor* t, long tag, const double* data, long size,
+                unsigned long generation);
+    /// queues a block to be read by the background thread
+    void prefetch(const Tensor* t, long tag);
+
+    /// drops the blocks of t, including queued prefetches
+    void invalidate(const Tensor* t);
+    /** As invalidate, but also waits until the background thread is not
+        reading from t; called before the storage of t is deleted. */
+    void forget(const Tensor* t);
+    /// drops all blocks
+    void clear();
+
+    /// print/reset the hit rate statistics
+    void print(std::ostream& os = ExEnv::out0()) const;
+    void reset_statistics();
+};
+
 class Tensor : virtual public RefCount {
   protected:
     const Ref<MemoryGrp>& mem_;
@@ -63,13 +190,33 @@ class Tensor : virtual public RefCount {
 #ifndef DISK_BASED_SMITH
     MemoryGrpRegion* file_;
 #else
-    std::fstream* file_;
+    /// descriptor of the (unlinked) file; blocks are accessed with pread/pwrite
+    int file_;
 #endif
     bool file_allocated_;
 
+    /// true if the blocks are read-only and go through the TensorTileCache
+    bool cached_;
+
+#ifdef DISK_BASED_SMITH
+    /// makes the read-modify-write in add_block atomic.  Blocks are
+    /// assigned to the locks by their tags, so that threads accumulating
+    /// into different blocks rarely wait for each other.  Reads and writes
+    /// need no lock, and neither does the MemoryGrp, where add_block
+    /// relies on the region locks taken by sum_reduction.
+    static const int nblocklocks = 64;
+    std::vector<Ref<ThreadLock> > block_locks_;
+#endif
+
     /// determines the distribution of blocks to nodes
     std::vector<long> determine_filesizes();
 
+    /// the size of block tag in double; offset receives its offset
+    long block_size(long tag, long& doffset) const;
+    /// reads a block bypassing the cache
+    void read_block(long tag, double* data);
+    friend class TensorTileCache;
+
   public:
     Tensor(std::string filename,const Ref<MemoryGrp>& mem);
     ~Tensor();
@@ -81,7 +228,7 @@ class Tensor : virtual public RefCount {
 #ifndef DISK_BASED_SMITH
     MemoryGrpRegion* file() const {return file_;};
 #else
-    std::fstream* file() { return file_; };
+    int file() const { return file_; };
 #endif
 
     /// set/get the filesize of the tensor
@@ -95,9 +242,20 @@ class Tensor : virtual public RefCount {
     /// input for the hash table
     void input_offset(long tag, long offset);
 
-    /// get a block from the distributed file (non-blocking)
+    /** Marks the tensor as read-only, in which case get_block reads
+        through the TensorTileCache, or removes the mark.  Must be called
+        by all nodes together; the tensor may not be modified while it is
+        marked. */
+    void set_cached(bool cached);
+    bool cached() const { return cached_; }
+
+    /// get a block from the distributed file (non-blocking); reads through the TensorTileCache if cached()
     void get_block(long tag, double* data);
-    /// add a block to the distributed file (non-blocking); double* data will be destroyed
+    /// starts reading a block into the TensorTileCache in the background;
+    /// a later get_block of the block will not have to wait for I/O.  Does nothing unless cached().
+    void prefetch_block(long tag);
+    /// add a block to the distributed file (non-blocking); double* data will be destroyed.
+    /// The addition is atomic, also if the block resides on another node.
     void add_block(long tag, double* data);
     /// put a block to the distributed file (non-blocking)
     void put_block(long tag, double* data);
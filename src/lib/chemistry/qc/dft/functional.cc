@@ -97,6 +97,115 @@ PointInputData::compute_derived(int spin_polarized,
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+// PointBatchInputData
+
+void
+PointBatchInputData::compute_derived(int spin_polarized,
+                                     int need_gradient)
+{
+  int i;
+  for (i=0; i<n; i++) a.rho_13[i] = pow(a.rho[i], 1.0/3.0);
+  if (need_gradient) {
+      for (i=0; i<n; i++) {
+          const double *g = &a.del_rho[3*i];
+          a.gamma[i] = g[0]*g[0] + g[1]*g[1] + g[2]*g[2];
+        }
+    }
+
+  if (spin_polarized) {
+      for (i=0; i<n; i++) b.rho_13[i] = pow(b.rho[i], 1.0/3.0);
+      if (need_gradient) {
+          for (i=0; i<n; i++) {
+              const double *g = &b.del_rho[3*i];
+              const double *ga = &a.del_rho[3*i];
+              b.gamma[i] = g[0]*g[0] + g[1]*g[1] + g[2]*g[2];
+              gamma_ab[i] = ga[0]*g[0] + ga[1]*g[1] + ga[2]*g[2];
+            }
+        }
+    }
+  else {
+      for (i=0; i<n; i++) {
+          b.rho[i] = a.rho[i];
+          b.rho_13[i] = a.rho_13[i];
+        }
+      if (need_gradient) {
+          for (i=0; i<3*n; i++) b.del_rho[i] = a.del_rho[i];
+          for (i=0; i<n; i++) {
+              b.gamma[i] = a.gamma[i];
+              gamma_ab[i] = a.gamma[i];
+            }
+        }
+    }
+}
+
+void
+PointBatchInputData::get_point(int i, PointInputData &id,
+                               int need_gradient) const
+{
+  id.a.rho = a.rho[i];
+  id.a.rho_13 = a.rho_13[i];
+  id.b.rho = b.rho[i];
+  id.b.rho_13 = b.rho_13[i];
+  if (need_gradient) {
+      for (int j=0; j<3; j++) {
+          id.a.del_rho[j] = a.del_rho[3*i+j];
+          id.b.del_rho[j] = b.del_rho[3*i+j];
+        }
+      id.a.gamma = a.gamma[i];
+      id.b.gamma = b.gamma[i];
+      id.gamma_ab = gamma_ab[i];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// PointBatchOutputData
+
+void
+PointBatchOutputData::zero(int n)
+{
+  for (int i=0; i<n; i++) {
+      energy[i] = 0.0;
+      df_drho_a[i] = 0.0;
+      df_drho_b[i] = 0.0;
+      df_dgamma_aa[i] = 0.0;
+      df_dgamma_bb[i] = 0.0;
+      df_dgamma_ab[i] = 0.0;
+    }
+}
+
+void
+PointBatchOutputData::set_point(int i, const PointOutputData &od)
+{
+  energy[i] = od.energy;
+  df_drho_a[i] = od.df_drho_a;
+  df_drho_b[i] = od.df_drho_b;
+  df_dgamma_aa[i] = od.df_dgamma_aa;
+  df_dgamma_bb[i] = od.df_dgamma_bb;
+  df_dgamma_ab[i] = od.df_dgamma_ab;
+}
+
+// Returns the part of a batch that starts at point start.
+static PointBatchInputData
+batch_part(const PointBatchInputData &id, int start, int n)
+{
+  PointBatchInputData r = id;
+  r.n = n;
+  r.r = id.r + start;
+  r.a.rho = id.a.rho + start;
+  r.a.rho_13 = id.a.rho_13 + start;
+  r.b.rho = id.b.rho + start;
+  r.b.rho_13 = id.b.rho_13 + start;
+  if (id.a.gamma) {
+      r.a.del_rho = id.a.del_rho + 3*start;
+      r.a.gamma = id.a.gamma + start;
+      r.b.del_rho = id.b.del_rho + 3*start;
+      r.b.gamma = id.b.gamma + start;
+      r.gamma_ab = id.gamma_ab + start;
+    }
+  return r;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // DenFunctional
 
@@ -145,6 +254,20 @@ DenFunctional::a0() const
   return a0_;
 }
 
+void
+DenFunctional::points(const PointBatchInputData &id,
+                      PointBatchOutputData &od)
+{
+  int need_gradient = need_density_gradient();
+  for (int i=0; i<id.n; i++) {
+      PointInputData pid(id.r[i]);
+      id.get_point(i, pid, need_gradient);
+      PointOutputData pod;
+      point(pid, pod);
+      od.set_point(i, pod);
+    }
+}
+
 int
 DenFunctional::need_density_gradient()
 {
@@ -819,6 +942,51 @@ SumDenFunctional::point(const PointInputData &id,
     }
 }
 
+void
+SumDenFunctional::points(const PointBatchInputData &id,
+                         PointBatchOutputData &od)
+{
+  // the components are evaluated in chunks so that the scratch
+  // space can be on the stack; the functional is shared by threads
+  const int nchunk = 64;
+  double tmp[6*nchunk];
+  PointBatchOutputData tmpod;
+  tmpod.energy = &tmp[0];
+  tmpod.df_drho_a = &tmp[nchunk];
+  tmpod.df_drho_b = &tmp[2*nchunk];
+  tmpod.df_dgamma_aa = &tmp[3*nchunk];
+  tmpod.df_dgamma_bb = &tmp[4*nchunk];
+  tmpod.df_dgamma_ab = &tmp[5*nchunk];
+
+  od.zero(id.n);
+  for (int start=0; start<id.n; start+=nchunk) {
+      int n = id.n - start;
+      if (n > nchunk) n = nchunk;
+      PointBatchInputData tmpid = batch_part(id, start, n);
+      for (int i=0; i < n_; i++) {
+          funcs_[i]->points(tmpid, tmpod);
+
+          double c = coefs_[i];
+          double *RESTRICT e = &od.energy[start];
+          for (int j=0; j<n; j++) e[j] += c * tmpod.energy[j];
+          if (compute_potential_) {
+              double *RESTRICT dra = &od.df_drho_a[start];
+              double *RESTRICT drb = &od.df_drho_b[start];
+              double *RESTRICT dgaa = &od.df_dgamma_aa[start];
+              double *RESTRICT dgab = &od.df_dgamma_ab[start];
+              double *RESTRICT dgbb = &od.df_dgamma_bb[start];
+              for (int j=0; j<n; j++) {
+                  dra[j] += c * tmpod.df_drho_a[j];
+                  drb[j] += c * tmpod.df_drho_b[j];
+                  dgaa[j] += c * tmpod.df_dgamma_aa[j];
+                  dgab[j] += c * tmpod.df_dgamma_ab[j];
+                  dgbb[j] += c * tmpod.df_dgamma_bb[j];
+                }
+            }
+        }
+    }
+}
+
 void
 SumDenFunctional::print(ostream& o) const
 {
@@ -1148,6 +1316,43 @@ SlaterXFunctional::point(const PointInputData &id,
     }
 }
 
+void
+SlaterXFunctional::points(const PointBatchInputData &id,
+                          PointBatchOutputData &od)
+{
+  const double mcx2rthird = -0.9305257363491; // -1.5*(3/4pi)^1/3
+  const double dmcx2rthird = -1.2407009817988; // 2*(3/4pi)^1/3
+  const int n = id.n;
+  const double *RESTRICT ra = id.a.rho;
+  const double *RESTRICT ra13 = id.a.rho_13;
+  const double *RESTRICT rb = id.b.rho;
+  const double *RESTRICT rb13 = id.b.rho_13;
+  double *RESTRICT e = od.energy;
+  double *RESTRICT dra = od.df_drho_a;
+  double *RESTRICT drb = od.df_drho_b;
+  int i;
+  od.zero(n);
+
+  if (!spin_polarized_) {
+      for (i=0; i<n; i++) e[i] = mcx2rthird * 2.0 * ra[i] * ra13[i];
+      if (compute_potential_) {
+          for (i=0; i<n; i++) {
+              dra[i] = dmcx2rthird * ra13[i];
+              drb[i] = dra[i];
+            }
+        }
+    }
+  else {
+      for (i=0; i<n; i++) e[i] = mcx2rthird * (ra[i]*ra13[i] + rb[i]*rb13[i]);
+      if (compute_potential_) {
+          for (i=0; i<n; i++) {
+              dra[i] = dmcx2rthird * ra13[i];
+              drb[i] = dmcx2rthird * rb13[i];
+            }
+        }
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // PW92LCFunctional
 // Coded by Matt Leininger
@@ -2411,6 +2616,56 @@ Becke88XFunctional::point(const PointInputData &id,
 }
 
 
+// The contribution of one spin to Becke's exchange for a batch of
+// points.  The energy is scaled by escale and added to e; the
+// derivatives are only computed if dr is nonnull.
+static void
+becke88_spin(int n, double beta, double beta6, double escale,
+             const double *RESTRICT rho, const double *RESTRICT rho_13,
+             const double *RESTRICT gamma, double *RESTRICT e,
+             double *RESTRICT dr, double *RESTRICT dg)
+{
+  for (int i=0; i<n; i++) {
+      bool significant = rho[i] > MIN_DENSITY;
+      double r13 = significant ? rho_13[i] : 1.;
+      double r43 = significant ? rho[i]*r13 : 1.;
+      double x = significant ? sqrt(gamma[i])/r43 : 0.;
+      double x2 = x*x;
+      double denom = 1./(1.+beta6*x*asinh(x));
+      e[i] += significant ? -escale*r43*beta*x2*denom : 0.;
+      if (dr) {
+          double F = sqrt(1.+x2);
+          double H = 1. - 6.*beta*x2/F;
+          dr[i] = significant ? 4./3. * beta * r13 * x2 * denom*denom * H : 0.;
+          dg[i] = significant ? -beta * denom / (2.*r43) * (1. + denom*H) : 0.;
+        }
+    }
+}
+
+void
+Becke88XFunctional::points(const PointBatchInputData &id,
+                           PointBatchOutputData &od)
+{
+  const int n = id.n;
+  od.zero(n);
+
+  becke88_spin(n, beta_, beta6_, (spin_polarized_?1.:2.),
+               id.a.rho, id.a.rho_13, id.a.gamma, od.energy,
+               (compute_potential_?od.df_drho_a:0), od.df_dgamma_aa);
+
+  if (spin_polarized_) {
+      becke88_spin(n, beta_, beta6_, 1.,
+                   id.b.rho, id.b.rho_13, id.b.gamma, od.energy,
+                   (compute_potential_?od.df_drho_b:0), od.df_dgamma_bb);
+    }
+  else if (compute_potential_) {
+      for (int i=0; i<n; i++) {
+          od.df_drho_b[i] = od.df_drho_a[i];
+          od.df_dgamma_bb[i] = od.df_dgamma_aa[i];
+        }
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // LYPCFunctional
 // Coded by Matt Leininger
@@ -2579,6 +2834,101 @@ LYPCFunctional::point(const PointInputData &id,
 
 }
 
+void
+LYPCFunctional::points(const PointBatchInputData &id,
+                       PointBatchOutputData &od)
+{
+  const int n = id.n;
+  const double a = a_;
+  const double b = b_;
+  const double c = c_;
+  const double d = d_;
+  const double cf = 0.3*pow(3.* M_PI*M_PI,2./3.);
+  const double cf8 = pow(2.,2./3.)*144.*cf;
+  const double *RESTRICT ra = id.a.rho;
+  const double *RESTRICT rb = id.b.rho;
+  const double *RESTRICT gaa = id.a.gamma;
+  const double *RESTRICT gbb = id.b.gamma;
+  const double *RESTRICT gab = id.gamma_ab;
+  double *RESTRICT e = od.energy;
+  double *RESTRICT dra = od.df_drho_a;
+  double *RESTRICT drb = od.df_drho_b;
+  double *RESTRICT dgaa = od.df_dgamma_aa;
+  double *RESTRICT dgbb = od.df_dgamma_bb;
+  double *RESTRICT dgab = od.df_dgamma_ab;
+  od.zero(n);
+
+  for (int i=0; i<n; i++) {
+      double rhoa = ra[i], rhob = rb[i];
+      double dens = rhoa + rhob;
+      double dens2 = dens*dens;
+      double dens1_3 = pow(dens,-1./3.);
+      double denom = 1.+d*dens1_3;
+      double omega = exp(-c*dens1_3)/denom*pow(dens,-11./3.);
+      double delta = c*dens1_3+d*dens1_3/denom;
+      double rhoa_53 = pow(rhoa,5./3.);
+      double rhob_53 = pow(rhob,5./3.);
+
+      double dens_a2 = rhoa*rhoa;
+      double dens_b2 = rhob*rhob;
+      double dens_ab = rhoa*rhob;
+      double grad_a2 = gaa[i];
+      double grad_b2 = gbb[i];
+      double grad_ab = gab[i];
+
+      double eflyp_1 = -4.*a*dens_ab/(dens*denom);
+      double intermediate_1 = cf8*(rhoa_53*rhoa+rhob_53*rhob)
+           + (47.-7.*delta)*(grad_a2+grad_b2+2.*grad_ab)
+           - (45.-delta)*(grad_a2+grad_b2)
+           + 2.*(11.-delta)/dens*(rhoa*grad_a2+rhob*grad_b2);
+      double intermediate_2 = -4./3.*dens2*grad_ab
+           - (dens_a2*grad_b2+dens_b2*grad_a2);
+      double intermediate_3 = dens_ab/18.* intermediate_1 + intermediate_2;
+      e[i] = eflyp_1 - omega*a*b*intermediate_3;
+
+      if (!compute_potential_) continue;
+
+      double dens4_3 = pow(dens,-4./3.);
+      double ddelta_drho = 1./3* (d*d*dens4_3*dens1_3/(denom*denom)
+                                  - delta/dens);
+      double domega_drho = -1./3.*omega*dens4_3*(11./dens1_3 - c - d/denom);
+      double grad_sum = rhoa*grad_a2 + rhob*grad_b2;
+      double common = - 2./dens*ddelta_drho*grad_sum
+                      - 2.*(11.-delta)/dens2*grad_sum
+                      - 7.*ddelta_drho*(grad_a2+grad_b2+2.*grad_ab)
+                      + ddelta_drho*(grad_a2+grad_b2);
+
+      double df1_drho_a = -4.*a*rhob/(dens*denom) *
+                          (rhoa/3.*d*dens4_3/denom + 1. - rhoa/dens);
+      double df2_drho_a = -domega_drho*a*b*intermediate_3
+                  - omega*a*b*( rhob/18.* intermediate_1
+                  + dens_ab/18.*(cf8*8./3.*rhoa_53
+                                 + 2.*(11.-delta)*grad_a2/dens + common)
+                  - 8./3.*dens*grad_ab - 2.*rhoa*grad_b2 );
+      dra[i] = df1_drho_a + df2_drho_a;
+      dgaa[i] = -omega*a*b
+          * (dens_ab/9.*(1.-3.*delta + rhoa*(11.-delta)/dens) - dens_b2);
+      dgab[i] = -omega*a*b*(dens_ab/9.*(47.-7.*delta) - 4./3.*dens2);
+
+      if (spin_polarized_) {
+          double df1_drho_b = -4.*a*rhoa/(dens*denom) *
+                              (rhob/3.*d*dens4_3/denom + 1. - rhob/dens);
+          double df2_drho_b = -domega_drho*a*b*intermediate_3
+                  - omega*a*b*( rhoa/18.* intermediate_1
+                  + dens_ab/18.*(cf8*8./3.*rhob_53
+                                 + 2.*(11.-delta)*grad_b2/dens + common)
+                  - 8./3.*dens*grad_ab - 2.*rhob*grad_a2 );
+          drb[i] = df1_drho_b + df2_drho_b;
+          dgbb[i] = -omega*a*b
+              * (dens_ab/9.*(1.-3.*delta + rhob*(11.-delta)/dens) - dens_a2);
+        }
+      else {
+          drb[i] = dra[i];
+          dgbb[i] = dgaa[i];
+        }
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Perdew 1986 (P86) Correlation Functional
 // J. P. Perdew, PRB, 33, 8822, 1986.
@@ -4091,6 +4441,64 @@ PBEXFunctional::point(const PointInputData &id,
     }
 }
 
+// The contribution of one spin to the PBE exchange for a batch of
+// points, as in PBEXFunctional::spin_contrib.  The energy is scaled by
+// escale and added to e; the derivatives are only computed if dr is
+// nonnull.
+static void
+pbex_spin(int n, double mu, double kappa, double escale,
+          const double *RESTRICT rho, const double *RESTRICT rho_13,
+          const double *RESTRICT gamma, double *RESTRICT e,
+          double *RESTRICT dr, double *RESTRICT dg)
+{
+  for (int i=0; i<n; i++) {
+      bool significant = rho[i] >= MIN_DENSITY;
+      double gaa = gamma[i] < MIN_GAMMA ? 0.0 : gamma[i];
+      double rhoa = significant ? rho[i] : 1.0;
+      double rhoa_13 = significant ? rho_13[i] : 1.0;
+      double rhoa_43 = rhoa*rhoa_13;
+      double rhoa_83 = rhoa_43*rhoa_43;
+      double r0 = (0.016455307846020562*gaa*mu)/kappa/rhoa_83+1.0;
+      double fx = -(kappa/r0)+kappa+1.0;
+
+      e[i] += significant ? -escale*0.93052573634910007*fx*rhoa_43 : 0.0;
+      if (dr) {
+          double rhoa_73 = rhoa_43*rhoa;
+          dr[i] = significant
+              ? -(1.2407009817988002*fx*rhoa_13)
+                + (0.040832233200718403*gaa*mu)/(r0*r0)/rhoa_73
+              : 0.0;
+          dg[i] = significant
+              ? -((0.015312087450269402*mu)/(r0*r0)/rhoa_43)
+              : 0.0;
+        }
+    }
+}
+
+void
+PBEXFunctional::points(const PointBatchInputData &id,
+                       PointBatchOutputData &od)
+{
+  const int n = id.n;
+  od.zero(n);
+
+  pbex_spin(n, mu, kappa, (spin_polarized_?1.0:2.0),
+            id.a.rho, id.a.rho_13, id.a.gamma, od.energy,
+            (compute_potential_?od.df_drho_a:0), od.df_dgamma_aa);
+
+  if (spin_polarized_) {
+      pbex_spin(n, mu, kappa, 1.0,
+                id.b.rho, id.b.rho_13, id.b.gamma, od.energy,
+                (compute_potential_?od.df_drho_b:0), od.df_dgamma_bb);
+    }
+  else if (compute_potential_) {
+      for (int i=0; i<n; i++) {
+          od.df_drho_b[i] = od.df_drho_a[i];
+          od.df_dgamma_bb[i] = od.df_dgamma_aa[i];
+        }
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // mPW91XFunctional
 
@@ -93,6 +93,48 @@ struct PointOutputData {
 
 };
 
+/** Contains the data needed by a DenFunctional for a batch of points.
+    Each quantity is stored as an array over the points.  The arrays are
+    owned by the caller.  The density hessian is not available. */
+struct PointBatchInputData {
+    struct SpinData {
+        double *rho;
+        double *rho_13;
+        // del_rho[3*i+xyz], only needed if the gradient is needed
+        double *del_rho;
+        double *gamma;
+    };
+    int n;
+    SpinData a, b;
+    double *gamma_ab;
+
+    const SCVector3 *r;
+
+    /** Fill in derived quantities.  The beta arrays must be provided
+        even if the density is not spin polarized; they are then
+        set equal to the alpha arrays. */
+    void compute_derived(int spin_polarized, int need_gradient);
+
+    /// Copy the data for point i into id.
+    void get_point(int i, PointInputData &id, int need_gradient) const;
+};
+
+/** Contains the data generated by a DenFunctional for a batch of points,
+    stored as one array per quantity.  The arrays are owned by the
+    caller. */
+struct PointBatchOutputData {
+    double *energy;
+    double *df_drho_a;
+    double *df_drho_b;
+    double *df_dgamma_aa;
+    double *df_dgamma_bb;
+    double *df_dgamma_ab;
+
+    void zero(int n);
+    /// Copy od into point i.
+    void set_point(int i, const PointOutputData &od);
+};
+
 /** An abstract base class for density functionals. */
 class DenFunctional: virtual public SavableState {
   protected:
@@ -124,6 +166,11 @@ class DenFunctional: virtual public SavableState {
     virtual int need_density_hessian();
 
     virtual void point(const PointInputData&, PointOutputData&) = 0;
+    /** Evaluate the functional at a batch of points.  The default
+        implementation calls point for each point.  Functionals that are
+        often used override this with loops over the points that can be
+        vectorized. */
+    virtual void points(const PointBatchInputData&, PointBatchOutputData&);
     void gradient(const PointInputData&, PointOutputData&,
                   double *gradient, int acenter,
                   GaussianBasisSet *basis,
@@ -201,6 +248,7 @@ class SumDenFunctional: public DenFunctional {
     int need_density_gradient();
 
     void point(const PointInputData&, PointOutputData&);
+    void points(const PointBatchInputData&, PointBatchOutputData&);
 
     void print(std::ostream& =ExEnv::out0()) const;
 
@@ -451,6 +499,7 @@ class SlaterXFunctional: public DenFunctional {
     ~SlaterXFunctional();
     void save_data_state(StateOut &);
     void point(const PointInputData&, PointOutputData&);
+    void points(const PointBatchInputData&, PointBatchOutputData&);
 };
 
 /** An abstract base class from which the various VWN (Vosko, Wilk and
@@ -647,6 +696,7 @@ class Becke88XFunctional: public DenFunctional {
     int need_density_gradient();
 
     void point(const PointInputData&, PointOutputData&);
+    void points(const PointBatchInputData&, PointBatchOutputData&);
 };
 
 /** Implements the Lee, Yang, and Parr functional.
@@ -674,6 +724,7 @@ class LYPCFunctional: public DenFunctional {
     int need_density_gradient();
 
     void point(const PointInputData&, PointOutputData&);
+    void points(const PointBatchInputData&, PointBatchOutputData&);
 };
 
 /** Implements the Perdew-Wang 1986 (PW86) Exchange functional.
@@ -731,6 +782,7 @@ class PBEXFunctional: public DenFunctional {
     int need_density_gradient();
 
     void point(const PointInputData&, PointOutputData&);
+    void points(const PointBatchInputData&, PointBatchOutputData&);
 };
 
 /** The Perdew-Wang 1991 exchange functional computes energies and densities
@@ -27,10 +27,13 @@
 
 #include <util/misc/math.h>
 
+#include <algorithm>
+
 #include <util/misc/regtime.h>
 #include <util/misc/formio.h>
 #include <util/state/stateio.h>
 #include <util/container/carray.h>
+#include <math/scmat/blas.h>
 #include <chemistry/qc/dft/integrator.h>
 
 using namespace std;
@@ -132,6 +135,18 @@ class DenIntegratorThread: public Thread {
     double *w_gradient_;
     double *f_gradient_;
 
+    // scratch for batches of points
+    std::vector<double> batch_rho_a_, batch_rho_b_;
+    std::vector<double> batch_grad_a_, batch_grad_b_;
+    std::vector<double> batch_za_, batch_zb_, batch_m_;
+    std::vector<double> batch_func_, batch_func_grad_;
+    std::vector<int> batch_index_;
+    std::vector<SCVector3> batch_sig_points_;
+
+    void accumulate_batch_vmat(int npoint, int nbf, const int *contrib_bf,
+                               const double *bs_values, double *z,
+                               double *vmat);
+
   public:
     DenIntegratorThread(int ithread, int nthread,
                         DenIntegrator *integrator,
@@ -147,6 +162,15 @@ class DenIntegratorThread: public Thread {
                     double weight, double multiplier,
                     double *nuclear_gradient,
                     double *f_gradient, double *w_gradient);
+    /** Integrates over a batch of points using the basis function
+        values of the whole batch at once.  w_mult gives the weight
+        times the multiplier of each point.  The sum of the weighted
+        densities is returned.  This cannot be used for nuclear
+        gradients.  The shells that may be nonzero at the points can be
+        given, as computed by BatchElectronDensity::batch_shells. */
+    double do_batch(int npoint, const SCVector3 *r, const double *w_mult,
+                    int nshell = -1, const int *shells = 0,
+                    const double *bounds = 0);
     double *nuclear_gradient() { return nuclear_gradient_; }
     double *alpha_vmat() { return alpha_vmat_; }
     double *beta_vmat() { return beta_vmat_; }
@@ -517,6 +541,162 @@ DenIntegratorThread::do_point(int iatom, const SCVector3 &r,
   return id.a.rho + id.b.rho;
 }
 
+void
+DenIntegratorThread::accumulate_batch_vmat(int npoint, int nbf,
+                                           const int *contrib_bf,
+                                           const double *bs_values,
+                                           double *z, double *vmat)
+{
+  // M = X^T Z, where X holds the basis function values and Z the
+  // weighted potential applied to them, then V += M + M^T
+  double *m = &batch_m_[0];
+  C_DGEMM('t', 'n', nbf, nbf, npoint, 1.0, bs_values, nbf,
+          z, nbf, 0.0, m, nbf);
+  for (int j=0; j<nbf; j++) {
+      int jt = contrib_bf[j];
+      int jtoff = (jt*(jt+1))>>1;
+      for (int k=0; k<=j; k++) {
+          vmat[jtoff + contrib_bf[k]] += m[j*nbf+k] + m[k*nbf+j];
+        }
+    }
+}
+
+double
+DenIntegratorThread::do_batch(int npoint, const SCVector3 *r,
+                              const double *w_mult,
+                              int nshell, const int *shells,
+                              const double *bounds)
+{
+  int i, k, ip;
+
+  if (batch_rho_a_.size() < npoint) {
+      batch_rho_a_.resize(npoint);
+      batch_rho_b_.resize(npoint);
+      batch_index_.resize(npoint);
+      // storage for the functional's input and output: rho, rho_13,
+      // and gamma for each spin, gamma_ab, and six outputs
+      batch_func_.resize(13*npoint);
+      if (need_gradient_) {
+          batch_grad_a_.resize(3*npoint);
+          batch_grad_b_.resize(3*npoint);
+          batch_func_grad_.resize(6*npoint);
+        }
+    }
+  double *rho_a = &batch_rho_a_[0];
+  double *rho_b = &batch_rho_b_[0];
+  double *grad_a = (need_gradient_?&batch_grad_a_[0]:0);
+  double *grad_b = (need_gradient_?&batch_grad_b_[0]:0);
+
+  den_->compute_density_batch(npoint, r, nshell, shells, bounds,
+                              rho_a, grad_a, rho_b, grad_b);
+
+  // gather the points with significant density
+  double density = 0.0;
+  int *index = &batch_index_[0];
+  int nsig = 0;
+  for (ip=0; ip<npoint; ip++) {
+      double rho = rho_a[ip] + rho_b[ip];
+      density += w_mult[ip] * rho;
+      if (rho > 1e2*DBL_EPSILON) index[nsig++] = ip;
+    }
+
+  double *f = &batch_func_[0];
+  PointBatchInputData id;
+  id.n = nsig;
+  id.r = 0;
+  id.a.rho = f;             id.b.rho = f + npoint;
+  id.a.rho_13 = f + 2*npoint; id.b.rho_13 = f + 3*npoint;
+  id.a.del_rho = id.b.del_rho = 0;
+  id.a.gamma = id.b.gamma = id.gamma_ab = 0;
+  if (need_gradient_) {
+      id.a.gamma = f + 4*npoint;
+      id.b.gamma = f + 5*npoint;
+      id.gamma_ab = f + 6*npoint;
+      id.a.del_rho = &batch_func_grad_[0];
+      id.b.del_rho = &batch_func_grad_[3*npoint];
+    }
+  PointBatchOutputData od;
+  od.energy = f + 7*npoint;
+  od.df_drho_a = f + 8*npoint;
+  od.df_drho_b = f + 9*npoint;
+  od.df_dgamma_aa = f + 10*npoint;
+  od.df_dgamma_bb = f + 11*npoint;
+  od.df_dgamma_ab = f + 12*npoint;
+
+  batch_sig_points_.resize(nsig);
+  for (k=0; k<nsig; k++) {
+      ip = index[k];
+      batch_sig_points_[k] = r[ip];
+      id.a.rho[k] = rho_a[ip];
+      id.b.rho[k] = rho_b[ip];
+      if (need_gradient_) {
+          for (i=0; i<3; i++) {
+              id.a.del_rho[3*k+i] = grad_a[3*ip+i];
+              id.b.del_rho[3*k+i] = grad_b[3*ip+i];
+            }
+        }
+    }
+  if (nsig) id.r = &batch_sig_points_[0];
+  id.compute_derived(spin_polarized_, need_gradient_);
+
+  func_->points(id, od);
+
+  for (k=0; k<nsig; k++) value_ += od.energy[k] * w_mult[index[k]];
+
+  int nbf = den_->ncontrib_bf();
+  if (!compute_potential_integrals_ || nbf == 0) return density;
+
+  int *contrib_bf = den_->contrib_bf();
+  double *bs_values = den_->batch_values();
+  double *bsg_values = den_->batch_gradient_values();
+
+  if (batch_za_.size() < npoint*nbf) {
+      batch_za_.resize(npoint*nbf);
+      if (spin_polarized_) batch_zb_.resize(npoint*nbf);
+    }
+  if (batch_m_.size() < nbf*nbf) batch_m_.resize(nbf*nbf);
+  double *za = &batch_za_[0];
+  double *zb = (spin_polarized_?&batch_zb_[0]:0);
+  memset(za, 0, sizeof(double)*npoint*nbf);
+  if (spin_polarized_) memset(zb, 0, sizeof(double)*npoint*nbf);
+
+  for (k=0; k<nsig; k++) {
+      ip = index[k];
+      double w = w_mult[ip];
+
+      // row ip of Z is 1/2 w df/drho phi + w df/d(del rho) . del phi,
+      // so that X^T Z + Z^T X gives the potential integrals
+      const double *x = &bs_values[ip*nbf];
+      double *zar = &za[ip*nbf];
+      double *zbr = (spin_polarized_?&zb[ip*nbf]:0);
+      double drhoa = 0.5*w*od.df_drho_a[k];
+      double drhob = 0.5*w*od.df_drho_b[k];
+      for (i=0; i<nbf; i++) zar[i] = drhoa*x[i];
+      if (spin_polarized_) for (i=0; i<nbf; i++) zbr[i] = drhob*x[i];
+      if (need_gradient_) {
+          for (int ixyz=0; ixyz<3; ixyz++) {
+              const double *g = &bsg_values[(ixyz*npoint + ip)*nbf];
+              double gradsa = w*(2.0*od.df_dgamma_aa[k]*id.a.del_rho[3*k+ixyz]
+                                 + od.df_dgamma_ab[k]*id.b.del_rho[3*k+ixyz]);
+              for (i=0; i<nbf; i++) zar[i] += gradsa*g[i];
+              if (spin_polarized_) {
+                  double gradsb
+                      = w*(2.0*od.df_dgamma_bb[k]*id.b.del_rho[3*k+ixyz]
+                           + od.df_dgamma_ab[k]*id.a.del_rho[3*k+ixyz]);
+                  for (i=0; i<nbf; i++) zbr[i] += gradsb*g[i];
+                }
+            }
+        }
+    }
+
+  accumulate_batch_vmat(npoint, nbf, contrib_bf, bs_values, za, alpha_vmat_);
+  if (spin_polarized_)
+      accumulate_batch_vmat(npoint, nbf, contrib_bf, bs_values,
+                            zb, beta_vmat_);
+
+  return density;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // IntegrationWeight
 
@@ -1419,6 +1599,67 @@ GaussLegendreAngularIntegrator::print(ostream &o) const
 //////////////////////////////////////////////
 //  RadialAngularIntegratorThread
 
+/// A radial shell of one integration center.
+struct RadialAngularWorkUnit {
+    int icenter;
+    int ir;
+    double r;
+    int npoint;
+    double cost;
+    double time;
+};
+
+/// The cached points of a radial shell.
+struct RadialAngularCachedShell {
+    bool filled;
+    double r;
+    // the number of points, including those with zero weight
+    int npoint;
+    // the points with nonzero weight, ordered by octant, and their weights
+    std::vector<SCVector3> points;
+    std::vector<double> weights;
+    // the shells that may be nonzero on each batch, as given by
+    // BatchElectronDensity::batch_shells
+    std::vector<int> batch_nshell;
+    std::vector<int> shells;
+    std::vector<double> bounds;
+};
+
+/// The cached grid of a molecule.
+struct RadialAngularGridCache {
+    const GaussianBasisSet *basis;
+    std::vector<double> geometry;
+    int batch_size;
+    std::vector<RadialAngularCachedShell> units;
+    // the work units of this process, fixed by the first load balanced
+    // integration so that each process fills the cache for its own units
+    bool assigned;
+    std::vector<int> my_units;
+};
+
+/** Hands out the work units assigned to this process to its threads. */
+class RadialAngularWorkQueue {
+    std::vector<RadialAngularWorkUnit> &units_;
+    std::vector<int> order_;
+    int next_;
+    Ref<ThreadLock> lock_;
+  public:
+    RadialAngularWorkQueue(std::vector<RadialAngularWorkUnit> &units,
+                           const std::vector<int> &order,
+                           const Ref<ThreadLock> &lock):
+      units_(units), order_(order), next_(0), lock_(lock) {}
+    /// Returns the index of unit.
+    int index(const RadialAngularWorkUnit *unit) const {
+      return unit - &units_[0];
+    }
+    /// Returns the next unit or null if none remain.
+    RadialAngularWorkUnit *next() {
+      ThreadLockHolder lh(lock_);
+      if (next_ == order_.size()) return 0;
+      return &units_[order_[next_++]];
+    }
+};
+
 class RadialAngularIntegratorThread: public DenIntegratorThread {
   protected:
     SCVector3 *centers_;
@@ -1429,6 +1670,21 @@ class RadialAngularIntegratorThread: public DenIntegratorThread {
     IntegrationWeight *weight_;
     int point_count_total_;
     double total_density_;
+    int batch_size_;
+
+    // points and weights of the current radial shell
+    std::vector<SCVector3> shell_points_;
+    std::vector<double> shell_weights_;
+    std::vector<int> shell_octant_;
+    std::vector<SCVector3> batch_points_;
+    std::vector<double> batch_weights_;
+
+    RadialAngularWorkQueue *queue_;
+    RadialAngularGridCache *cache_;
+
+    void do_shell_batches(int npoint, RadialAngularCachedShell *cached);
+    void do_cached_shell(const RadialAngularCachedShell &cached);
+    void do_radial_shell(int icenter, int ir, int iunit);
   public:
     RadialAngularIntegratorThread(int ithread, int nthread,
                                   RadialAngularIntegrator *integrator,
@@ -1440,6 +1696,13 @@ class RadialAngularIntegratorThread: public DenIntegratorThread {
                                   int need_nuclear_gradient);
     ~RadialAngularIntegratorThread();
     void run();
+    /** Take the work units from queue, rather than dealing out radial
+        shells round robin. */
+    void set_work_queue(RadialAngularWorkQueue *queue) { queue_ = queue; }
+    /** Use and fill in the cached grid.  The units of the cache must be
+        those of the work queue, or the radial shells in order if there
+        is no queue. */
+    void set_grid_cache(RadialAngularGridCache *cache) { cache_ = cache; }
     double total_density() { return total_density_; }
     int point_count() { return point_count_total_; }
 };
@@ -1493,6 +1756,13 @@ RadialAngularIntegratorThread
 
   point_count_total_ = 0;
   total_density_ = 0.0;
+  queue_ = 0;
+  cache_ = 0;
+
+  // batches are only used for energies and potentials of functionals
+  // that do not need the density hessian
+  batch_size_ = ra_integrator_->batch_size();
+  if (need_nuclear_gradient || need_hessian_) batch_size_ = 0;
 }
 
 RadialAngularIntegratorThread::~RadialAngularIntegratorThread()
@@ -1503,56 +1773,197 @@ RadialAngularIntegratorThread::~RadialAngularIntegratorThread()
 }
 
 void
-RadialAngularIntegratorThread::run()
-{
-  int icenter;
+RadialAngularIntegratorThread::do_radial_shell(int icenter, int ir,
+                                               int iunit)
+{
+  RadialAngularCachedShell *cached = 0;
+  if (cache_ && batch_size_ > 0) {
+      cached = &cache_->units[iunit];
+      if (cached->filled) {
+          do_cached_shell(*cached);
+          point_count_total_ += cached->npoint;
+          return;
+        }
+    }
+
   int nangular;
-  int ir, iangular;           // Loop indices for diff. integration dim
-  int point_count;            // Counter for # integration points per center
-  int nr;
+  int iangular;
+  int point_count = 0;
 
-  SCVector3 center;           // Cartesian position of center
   SCVector3 integration_point;
 
   double w,radial_multiplier,angular_multiplier;
   int deriv_order = (nuclear_gradient_==0?0:1);
-        
+
+  int iatom = mol_->non_q_atom(icenter);
+  SCVector3 center = centers_[icenter];
+  // get current radial grid: depends on convergence threshold
+  RadialIntegrator *radial
+      = ra_integrator_->get_radial_grid(mol_->Z(iatom), deriv_order);
+  int nr = radial->nr();
+  double r = radial->radial_value(ir, nr, atomic_radius_[icenter],
+                                  radial_multiplier);
+  // get current angular grid: depends on radial point and threshold
+  AngularIntegrator *angular
+      = ra_integrator_->get_angular_grid(r, atomic_radius_[icenter],
+                                         mol_->Z(iatom),
+                                         deriv_order);
+  nangular = angular->num_angular_points(r/atomic_radius_[icenter],ir);
+  if (batch_size_ > 0) {
+      // collect the points of the shell that have nonzero weight
+      shell_points_.resize(nangular);
+      shell_weights_.resize(nangular);
+      shell_octant_.resize(nangular);
+      int npoint = 0;
+      for (iangular=0; iangular<nangular; iangular++) {
+          angular_multiplier
+              = angular->angular_point_cartesian(iangular,r,
+                                                 integration_point);
+          int octant = (integration_point[0] < 0.0 ? 1 : 0)
+                     + (integration_point[1] < 0.0 ? 2 : 0)
+                     + (integration_point[2] < 0.0 ? 4 : 0);
+          integration_point += center;
+          w=weight_->w(icenter, integration_point, 0);
+          point_count++;
+          if (w == 0.0) continue;
+          shell_points_[npoint] = integration_point;
+          shell_weights_[npoint]
+              = w * angular_multiplier * radial_multiplier;
+          shell_octant_[npoint] = octant;
+          npoint++;
+        }
+      if (cached) cached->npoint = point_count;
+      do_shell_batches(npoint, cached);
+    }
+  else {
+      for (iangular=0; iangular<nangular; iangular++) {
+          angular_multiplier
+              = angular->angular_point_cartesian(iangular,r,
+                                                 integration_point);
+          integration_point += center;
+          w=weight_->w(icenter, integration_point, w_gradient_);
+          point_count++;
+          double multiplier = angular_multiplier * radial_multiplier;
+          total_density_
+              += w * multiplier
+              * do_point(iatom, integration_point,
+                         w, multiplier,
+                         nuclear_gradient_, f_gradient_, w_gradient_);
+        }
+    }
+  point_count_total_ += point_count;
+}
+
+void
+RadialAngularIntegratorThread::run()
+{
+  if (queue_) {
+      RadialAngularWorkUnit *unit;
+      while ((unit = queue_->next()) != 0) {
+          double start = RegionTimer::get_wall_time();
+          do_radial_shell(unit->icenter, unit->ir, queue_->index(unit));
+          unit->time = RegionTimer::get_wall_time() - start;
+        }
+      return;
+    }
+
+  int deriv_order = (nuclear_gradient_==0?0:1);
   int parallel_counter = 0;
 
-  for (icenter=0; icenter < n_integration_center_; icenter++) {
+  for (int icenter=0; icenter < n_integration_center_; icenter++) {
       int iatom = mol_->non_q_atom(icenter);
-      point_count=0;
-      center = centers_[icenter];
-      // get current radial grid: depends on convergence threshold
-      RadialIntegrator *radial
-          = ra_integrator_->get_radial_grid(mol_->Z(iatom), deriv_order);
-      nr = radial->nr();
-      for (ir=0; ir < nr; ir++) {
-          if (! (parallel_counter++%nthread_ == ithread_)) continue;
-          double r = radial->radial_value(ir, nr, atomic_radius_[icenter],
-                                          radial_multiplier);
-          // get current angular grid: depends on radial point and threshold
-          AngularIntegrator *angular
-              = ra_integrator_->get_angular_grid(r, atomic_radius_[icenter],
-                                                 mol_->Z(iatom),
-						 deriv_order);
-          nangular = angular->num_angular_points(r/atomic_radius_[icenter],ir);
-          for (iangular=0; iangular<nangular; iangular++) {
-              angular_multiplier
-                  = angular->angular_point_cartesian(iangular,r,
-                                                     integration_point);
-              integration_point += center;
-              w=weight_->w(icenter, integration_point, w_gradient_);
-              point_count++;
-              double multiplier = angular_multiplier * radial_multiplier;
-              total_density_
-                  += w * multiplier
-                  * do_point(iatom, integration_point,
-                             w, multiplier,
-                             nuclear_gradient_, f_gradient_, w_gradient_);
+      int nr = ra_integrator_->get_radial_grid(mol_->Z(iatom),
+                                               deriv_order)->nr();
+      for (int ir=0; ir < nr; ir++) {
+          int iunit = parallel_counter++;
+          if (! (iunit%nthread_ == ithread_)) continue;
+          do_radial_shell(icenter, ir, iunit);
+        }
+    }
+}
+
+void
+RadialAngularIntegratorThread::do_shell_batches(
+    int npoint, RadialAngularCachedShell *cached)
+{
+  if (cached) {
+      cached->points.clear();
+      cached->weights.clear();
+      cached->batch_nshell.clear();
+      cached->shells.clear();
+      cached->bounds.clear();
+    }
+
+  if (npoint == 0) {
+      if (cached) cached->filled = true;
+      return;
+    }
+
+  // order the points by octant so that each batch is spatially compact
+  // and shares most of its contributing shells
+  batch_points_.resize(npoint);
+  batch_weights_.resize(npoint);
+  int offset[9];
+  int i;
+  for (i=0; i<9; i++) offset[i] = 0;
+  for (i=0; i<npoint; i++) offset[shell_octant_[i]+1]++;
+  for (i=0; i<8; i++) offset[i+1] += offset[i];
+  for (i=0; i<npoint; i++) {
+      int j = offset[shell_octant_[i]]++;
+      batch_points_[j] = shell_points_[i];
+      batch_weights_[j] = shell_weights_[i];
+    }
+
+  if (cached) {
+      cached->points = batch_points_;
+      cached->weights = batch_weights_;
+      std::vector<int> shells(nshell_);
+      std::vector<double> bounds(nshell_);
+      for (int start=0; start<npoint; start+=batch_size_) {
+          int n = npoint - start;
+          if (n > batch_size_) n = batch_size_;
+          int nshell = den_->batch_shells(n, &batch_points_[start],
+                                          &shells[0], &bounds[0]);
+          cached->batch_nshell.push_back(nshell);
+          for (i=0; i<nshell; i++) {
+              cached->shells.push_back(shells[i]);
+              cached->bounds.push_back(bounds[i]);
             }
         }
-      point_count_total_ += point_count;
+      cached->filled = true;
+      do_cached_shell(*cached);
+      return;
+    }
+
+  for (int start=0; start<npoint; start+=batch_size_) {
+      int n = npoint - start;
+      if (n > batch_size_) n = batch_size_;
+      total_density_ += do_batch(n, &batch_points_[start],
+                                 &batch_weights_[start]);
+    }
+}
+
+void
+RadialAngularIntegratorThread::do_cached_shell(
+    const RadialAngularCachedShell &cached)
+{
+  int npoint = cached.points.size();
+  int ishell = 0;
+  for (int start=0, ibatch=0; start<npoint; start+=batch_size_, ibatch++) {
+      int n = npoint - start;
+      if (n > batch_size_) n = batch_size_;
+      int nshell = cached.batch_nshell[ibatch];
+      if (nshell > 0) {
+          total_density_ += do_batch(n, &cached.points[start],
+                                     &cached.weights[start], nshell,
+                                     &cached.shells[ishell],
+                                     &cached.bounds[ishell]);
+          ishell += nshell;
+        }
+      else if (nshell < 0) {
+          total_density_ += do_batch(n, &cached.points[start],
+                                     &cached.weights[start]);
+        }
     }
 }
 
@@ -1560,7 +1971,7 @@ RadialAngularIntegratorThread::run()
 //  RadialAngularIntegrator
 
 static ClassDesc RadialAngularIntegrator_cd(
-  typeid(RadialAngularIntegrator),"RadialAngularIntegrator",1,"public DenIntegrator",
+  typeid(RadialAngularIntegrator),"RadialAngularIntegrator",4,"public DenIntegrator",
   0, create<RadialAngularIntegrator>, create<RadialAngularIntegrator>);
 
 RadialAngularIntegrator::RadialAngularIntegrator(StateIn& s):
@@ -1573,7 +1984,6 @@ RadialAngularIntegrator::RadialAngularIntegrator(StateIn& s):
   s.get(gridtype_);
   s.get(npruned_partitions_);
   s.get(dynamic_grids_);
-
 //  ExEnv::outn() << "natomic_rows_ = " << natomic_rows_ << endl;
 //  ExEnv::outn() << "max_gridtype_ = " << max_gridtype_ << endl;
 //  ExEnv::outn() << "prune_grid_ = " << prune_grid_ << endl;
@@ -1596,6 +2006,25 @@ RadialAngularIntegrator::RadialAngularIntegrator(StateIn& s):
 
   radial_user_ << SavableState::restore_state(s);
   angular_user_ << SavableState::restore_state(s);
+  if (s.version(::class_desc<RadialAngularIntegrator>()) >= 2) {
+      s.get(batch_size_);
+    }
+  else {
+      batch_size_ = 128;
+    }
+  if (s.version(::class_desc<RadialAngularIntegrator>()) >= 3) {
+      s.get(load_balance_);
+    }
+  else {
+      load_balance_ = 1;
+    }
+  if (s.version(::class_desc<RadialAngularIntegrator>()) >= 4) {
+      s.get(cache_grid_);
+    }
+  else {
+      cache_grid_ = 0;
+    }
+  grid_cache_ = 0;
 
   init_default_grids();    
   set_grids();
@@ -1637,6 +2066,7 @@ RadialAngularIntegrator::~RadialAngularIntegrator()
   delete_c_array2(nr_points_);
   delete[] xcoarse_l_;
   delete[] grid_accuracy_;
+  clear_grid_cache();
 }
 
 void
@@ -1662,6 +2092,9 @@ RadialAngularIntegrator::save_data_state(StateOut& s)
   
   SavableState::save_state(radial_user_.pointer(),s);
   SavableState::save_state(angular_user_.pointer(),s);
+  s.put(batch_size_);
+  s.put(load_balance_);
+  s.put(cache_grid_);
 }
 
 void
@@ -1674,6 +2107,10 @@ RadialAngularIntegrator::init_parameters(void)
   dynamic_grids_ = 1;
   max_gridtype_ = 6;
   natomic_rows_ = 5;
+  batch_size_ = 128;
+  load_balance_ = 1;
+  cache_grid_ = 0;
+  grid_cache_ = 0;
   grid_accuracy_ = new double[max_gridtype_];
   
   int i;
@@ -1725,6 +2162,11 @@ RadialAngularIntegrator::init_parameters(const Ref<KeyVal>& keyval)
   //ExEnv::outn() << " max_gridtype = " << max_gridtype_ << endl;
   dynamic_grids_ = keyval->intvalue("dynamic");
   if (keyval->error() != KeyVal::OK) dynamic_grids_ = 1;
+  batch_size_ = keyval->intvalue("batch_size", KeyValValueint(128));
+  if (batch_size_ < 0) batch_size_ = 0;
+  load_balance_ = keyval->booleanvalue("load_balance", KeyValValueboolean(1));
+  cache_grid_ = keyval->booleanvalue("cache_grid", KeyValValueboolean(0));
+  grid_cache_ = 0;
   grid_accuracy_ = new double[max_gridtype_];
   //ExEnv::outn() << "init_parameters:: max_gridtype_ = " << max_gridtype_;
   
@@ -2024,6 +2466,186 @@ RadialAngularIntegrator::get_angular_grid(double radius, double atomic_radius,
     }
 }
 
+void
+RadialAngularIntegrator::init_work_units(
+    std::vector<RadialAngularWorkUnit> &units, int deriv_order)
+{
+  Ref<Molecule> mol = basis()->molecule();
+  int ncenter = mol->n_non_q_atom();
+  ShellExtent *extent = den_->shell_extent();
+
+  units.clear();
+  for (int icenter=0; icenter<ncenter; icenter++) {
+      int iatom = mol->non_q_atom(icenter);
+      double atomic_radius = get_radius(mol, iatom);
+      RadialIntegrator *radial = get_radial_grid(mol->Z(iatom), deriv_order);
+      int nr = radial->nr();
+      for (int ir=0; ir<nr; ir++) {
+          double radial_multiplier;
+          double r = radial->radial_value(ir, nr, atomic_radius,
+                                          radial_multiplier);
+          AngularIntegrator *angular
+              = get_angular_grid(r, atomic_radius, mol->Z(iatom),
+                                 deriv_order);
+          RadialAngularWorkUnit unit;
+          unit.icenter = icenter;
+          unit.ir = ir;
+          unit.r = r;
+          unit.npoint = angular->num_angular_points(r/atomic_radius,ir);
+          unit.time = 0.0;
+          // the model cost is the number of points times the number of
+          // basis functions significant on the shell (sampled at one
+          // point) plus the number of centers (for the weights)
+          int nbf = nbasis_;
+          if (extent) {
+              const std::vector<ExtentData> &cs
+                  = extent->contributing_shells(mol->r(iatom,0),
+                                                mol->r(iatom,1),
+                                                mol->r(iatom,2) + r);
+              nbf = 0;
+              for (int i=0; i<cs.size(); i++)
+                  nbf += basis()->shell(cs[i].shell).nfunction();
+            }
+          unit.cost = double(unit.npoint) * (nbf + ncenter);
+          units.push_back(unit);
+        }
+    }
+
+  // if the grid has the same shape as last time, use the measured times
+  // instead, scaled by the change in the number of points
+  int nunit = units.size();
+  if (unit_time_.size() == nunit) {
+      double time = 0.0, npoint = 0.0;
+      for (int i=0; i<nunit; i++) {
+          time += unit_time_[i];
+          npoint += unit_npoint_[i];
+        }
+      if (time > 0.0) {
+          double time_per_point = time/npoint;
+          for (int i=0; i<nunit; i++) {
+              if (unit_npoint_[i] > 0 && unit_time_[i] > 0.0) {
+                  units[i].cost
+                      = unit_time_[i] * units[i].npoint / unit_npoint_[i];
+                }
+              else {
+                  units[i].cost = time_per_point * units[i].npoint;
+                }
+            }
+        }
+    }
+}
+
+namespace {
+  struct decreasing_unit_cost {
+      const std::vector<RadialAngularWorkUnit> &units;
+      decreasing_unit_cost(const std::vector<RadialAngularWorkUnit> &u):
+        units(u) {}
+      bool operator()(int i, int j) const {
+        if (units[i].cost != units[j].cost)
+            return units[i].cost > units[j].cost;
+        return i < j;
+      }
+  };
+}
+
+void
+RadialAngularIntegrator::assign_work_units(
+    std::vector<RadialAngularWorkUnit> &units, std::vector<int> &my_units)
+{
+  int me = messagegrp_->me();
+  int nproc = messagegrp_->n();
+  int nunit = units.size();
+
+  // every process computes the same assignment: the most expensive
+  // remaining unit goes to the process with the least work per thread.
+  // A shared counter across processes is not used: MessageGrp has no
+  // one-sided fetch-and-add, and a rank-0 server (as in DistShellPair)
+  // needs a thread-safe MessageGrp and takes rank 0 out of the
+  // integration.  The measured unit times correct the estimates after
+  // the first integration, unless the grid is cached, in which case
+  // integrate() keeps the first assignment (see RadialAngularGridCache).
+  std::vector<double> nthread(nproc, 0.0);
+  nthread[me] = threadgrp_->nthread();
+  messagegrp_->sum(&nthread[0], nproc);
+
+  std::vector<int> order(nunit);
+  for (int i=0; i<nunit; i++) order[i] = i;
+  std::sort(order.begin(), order.end(), decreasing_unit_cost(units));
+
+  std::vector<double> load(nproc, 0.0);
+  my_units.clear();
+  for (int i=0; i<nunit; i++) {
+      int iunit = order[i];
+      int best = 0;
+      for (int p=1; p<nproc; p++) {
+          if ((load[p] + units[iunit].cost)/nthread[p]
+              < (load[best] + units[iunit].cost)/nthread[best]) best = p;
+        }
+      load[best] += units[iunit].cost;
+      if (best == me) my_units.push_back(iunit);
+    }
+}
+
+void
+RadialAngularIntegrator::clear_grid_cache()
+{
+  delete grid_cache_;
+  grid_cache_ = 0;
+}
+
+void
+RadialAngularIntegrator::init_grid_cache(
+    const std::vector<RadialAngularWorkUnit> &units)
+{
+  Ref<Molecule> mol = basis()->molecule();
+  int nunit = units.size();
+
+  // the cache can be used if the basis, geometry, batch size, and grid
+  // are unchanged
+  bool valid = grid_cache_ != 0
+      && grid_cache_->basis == basis().pointer()
+      && grid_cache_->batch_size == batch_size_
+      && grid_cache_->units.size() == nunit
+      && grid_cache_->geometry.size() == 3*mol->natom();
+  for (int i=0; valid && i<mol->natom(); i++) {
+      for (int j=0; valid && j<3; j++) {
+          if (grid_cache_->geometry[3*i+j] != mol->r(i,j)) valid = false;
+        }
+    }
+  for (int i=0; valid && i<nunit; i++) {
+      if (grid_cache_->units[i].filled
+          && (grid_cache_->units[i].r != units[i].r
+              || grid_cache_->units[i].npoint != units[i].npoint)) {
+          valid = false;
+        }
+    }
+  if (valid) {
+      for (int i=0; i<nunit; i++) {
+          if (!grid_cache_->units[i].filled) {
+              grid_cache_->units[i].r = units[i].r;
+              grid_cache_->units[i].npoint = units[i].npoint;
+            }
+        }
+      return;
+    }
+
+  clear_grid_cache();
+  grid_cache_ = new RadialAngularGridCache;
+  grid_cache_->basis = basis().pointer();
+  grid_cache_->batch_size = batch_size_;
+  grid_cache_->geometry.resize(3*mol->natom());
+  for (int i=0; i<mol->natom(); i++) {
+      for (int j=0; j<3; j++) grid_cache_->geometry[3*i+j] = mol->r(i,j);
+    }
+  grid_cache_->assigned = false;
+  grid_cache_->units.resize(nunit);
+  for (int i=0; i<nunit; i++) {
+      grid_cache_->units[i].filled = false;
+      grid_cache_->units[i].r = units[i].r;
+      grid_cache_->units[i].npoint = units[i].npoint;
+    }
+}
+
 void
 RadialAngularIntegrator::integrate(const Ref<DenFunctional> &denfunc,
                               const RefSymmSCMatrix& densa,
@@ -2055,6 +2677,36 @@ RadialAngularIntegrator::integrate(const Ref<DenFunctional> &denfunc,
   //cout << "creating test lock" << endl;
   //Ref<ThreadLock> reflock = threadgrp_->new_lock();
   //tlock = reflock.pointer();
+  // distribute the radial shells according to their cost
+  std::vector<RadialAngularWorkUnit> units;
+  RadialAngularWorkQueue *queue = 0;
+  if (load_balance_ || cache_grid_) {
+      init_work_units(units, (nuclear_gradient==0?0:1));
+    }
+  if (cache_grid_) init_grid_cache(units);
+  if (load_balance_) {
+      tim.enter("load balance");
+      std::vector<int> my_units;
+      // The cached points of a unit are only reused if the unit stays on
+      // the same process, so while the cache is valid the assignment of
+      // the first integration is kept.  Otherwise the units would move
+      // between processes as the measured times change, and the cache of
+      // every process would fill toward the whole grid.
+      if (cache_grid_ && grid_cache_->assigned) {
+          my_units = grid_cache_->my_units;
+        }
+      else {
+          assign_work_units(units, my_units);
+          if (cache_grid_) {
+              grid_cache_->my_units = my_units;
+              grid_cache_->assigned = true;
+            }
+        }
+      queue = new RadialAngularWorkQueue(units, my_units,
+                                         threadgrp_->new_lock());
+      tim.exit("load balance");
+    }
+
   RadialAngularIntegratorThread **threads =
       new RadialAngularIntegratorThread*[nthread];
   for (i=0; i<nthread; i++) {
@@ -2070,6 +2722,8 @@ RadialAngularIntegrator::integrate(const Ref<DenFunctional> &denfunc,
           linear_scaling_, use_dmat_bound_,
           accuracy_, compute_potential_integrals_,
           nuclear_gradient != 0);
+      threads[i]->set_work_queue(queue);
+      if (cache_grid_) threads[i]->set_grid_cache(grid_cache_);
       threadgrp_->add_thread(i, threads[i]);
     }
 
@@ -2123,6 +2777,19 @@ RadialAngularIntegrator::integrate(const Ref<DenFunctional> &denfunc,
   threadgrp_->delete_threads();
   delete[] threads;
 
+  // save the measured times for the next integration
+  if (queue) {
+      delete queue;
+      int nunit = units.size();
+      unit_time_.resize(nunit);
+      unit_npoint_.resize(nunit);
+      for (i=0; i<nunit; i++) {
+          unit_time_[i] = units[i].time;
+          unit_npoint_[i] = units[i].npoint;
+        }
+      if (nunit) messagegrp_->sum(&unit_time_[0], nunit);
+    }
+
   messagegrp_->sum(point_count_total);
   messagegrp_->sum(total_density);
   done_integration();
@@ -28,6 +28,8 @@
 #ifndef _chemistry_qc_dft_integrator_h
 #define _chemistry_qc_dft_integrator_h
 
+#include <vector>
+
 #include <util/state/state.h>
 #include <util/group/thread.h>
 #include <chemistry/qc/dft/functional.h>
@@ -365,6 +367,9 @@ class GaussLegendreAngularIntegrator: public AngularIntegrator {
     void print(std::ostream & =ExEnv::out0()) const;
 };
 
+struct RadialAngularWorkUnit;
+struct RadialAngularGridCache;
+
 /** An implementation of an integrator using any combination of
     a RadialIntegrator and an AngularIntegrator. */
 class RadialAngularIntegrator: public DenIntegrator {
@@ -376,7 +381,22 @@ class RadialAngularIntegrator: public DenIntegrator {
     int npruned_partitions_;
     double *grid_accuracy_;
     int dynamic_grids_;
+    int batch_size_;
+    int load_balance_;
+    int cache_grid_;
+    RadialAngularGridCache *grid_cache_;
     int natomic_rows_;
+
+    // the measured time and number of points of each work unit in the
+    // last integration, used to balance the next one
+    std::vector<double> unit_time_;
+    std::vector<int> unit_npoint_;
+
+    void init_work_units(std::vector<RadialAngularWorkUnit> &units,
+                         int deriv_order);
+    void assign_work_units(std::vector<RadialAngularWorkUnit> &units,
+                           std::vector<int> &my_units);
+    void init_grid_cache(const std::vector<RadialAngularWorkUnit> &units);
     int max_gridtype_;
   protected:
     Ref<IntegrationWeight> weight_;
@@ -424,6 +444,35 @@ class RadialAngularIntegrator: public DenIntegrator {
         <dt><tt>weight</tt><dd>Specifies the IntegrationWeight object.
         The default is BeckeIntegrationWeight.
 
+        <dt><tt>batch_size</tt><dd>The maximum number of points of a
+        radial shell that are evaluated together.  The basis function
+        values of a batch are computed once and the density and
+        exchange-correlation potential integrals are formed with matrix
+        multiplies.  Nuclear gradients and functionals that need the
+        density hessian always use one point at a time, as does a value
+        of zero.  The default is 128.
+
+        <dt><tt>load_balance</tt><dd>If true, the radial shells of all
+        the atoms are distributed among the processes according to their
+        estimated cost, and the threads of each process take the shells
+        from a shared queue, most expensive first.  The cost is estimated
+        from the number of points and basis functions for the first
+        integration and from the measured times of the previous
+        integration afterwards.  If false, the shells are dealt out
+        round robin.  The default is true.
+
+        <dt><tt>cache_grid</tt><dd>If true, the points of the grid that
+        have nonzero weight, their weights, and the shells that may be
+        nonzero on each batch of points are stored the first time they
+        are computed and reused until the molecule or the grid changes.
+        This avoids recomputing the integration weights, which costs
+        O(N^2) in the number of atoms per point, in every iteration.
+        Only the batched integration (see <tt>batch_size</tt>) uses the
+        cache.  With <tt>load_balance</tt>, the distribution of the
+        shells among the processes is then fixed by the first
+        integration, so that each process only caches its own shells.
+        The default is false.
+
         </dl>
      */
     RadialAngularIntegrator(const Ref<KeyVal> &);
@@ -450,6 +499,10 @@ class RadialAngularIntegrator: public DenIntegrator {
     void init_alpha_coefficients(void);
     int select_dynamic_grid(void);
     Ref<IntegrationWeight> weight() { return weight_; }
+    /// The maximum number of points evaluated together.
+    int batch_size() const { return batch_size_; }
+    /// Discard the cached grid.
+    void clear_grid_cache();
 };
 
 }
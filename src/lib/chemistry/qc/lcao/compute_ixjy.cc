@@ -26,10 +26,16 @@
 //
 
 #include <stdexcept>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <deque>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <sstream>
 
 #include <mpqc_config.h>
 #include <util/misc/formio.h>
@@ -43,20 +49,250 @@
 #include <chemistry/qc/lcao/transform_ixjy.h>
 #include <math/scmat/blas.h>
 #include <chemistry/qc/lcao/transform_13inds.h>
+#include <util/misc/scratchstore.h>
 #include <util/misc/print.h>
 #include <math/distarray4/distarray4.h>
+#include <util/group/thread.h>
 
 using namespace std;
 using namespace sc;
 
 #define SINGLE_THREAD_E13   0
 #define PRINT2Q 0
-#define PRINT3Q 0
 #define PRINT4Q 0
 #define PRINT_NUM_TE_TYPES 1
 #define ALL_TASKS_ON_SAME_NODE 1
 #define CHECK_INTS_SYMM 1
 
+namespace {
+
+  /** Performs the third and fourth quarter transforms of the ij blocks held
+      by this task in the MemoryGrp, in place, on all threads. Every block
+      that this task must also store to the accumulator (see
+      detail::store_memorygrp()) is stored as soon as it is transformed,
+      by one thread at a time, while the other threads keep transforming. */
+  class Transform34Pipeline {
+      Ref<DistArray4> acc_;
+      char* localdata_;
+      size_t memgrp_blocksize_;
+      int num_te_types_;
+      int ni_, i_offset_, acc_i_offset_;
+      blasint rank2_, rank3_, rank4_, nbasis2_, nbasis4_;
+      const double* vector2_;
+      const double* vector4_;
+      const unsigned int* orbsym1_;
+      const unsigned int* orbsym2_;
+      const unsigned int* orbsym3_;
+      const unsigned int* orbsym4_;
+
+      std::vector<int> blocks_;          // ij indices of the local blocks
+      std::vector<bool> store_early_;    // store block to acc_ right after its transform?
+      std::atomic<int> next_block_;
+      std::mutex mutex_;
+      std::condition_variable cond_;
+      std::deque<int> to_store_;         // transformed blocks waiting to be stored
+      int ntransformed_;
+      bool storing_;
+      std::atomic<bool> aborted_;
+      std::exception_ptr error_;
+
+      int nproc_;
+
+      double* block(int ij, int te_type) const {
+        const int ij_local = ij/nproc_;
+        return (double*) (localdata_ + (ij_local*num_te_types_+te_type)*memgrp_blocksize_);
+      }
+
+      void transform(int ij, double* sx_ints, double* ijxy_ints);
+      void finished(int b);
+      bool store_one();
+      bool done();
+
+    public:
+      Transform34Pipeline(const Ref<DistArray4>& acc, const Ref<MemoryGrp>& mem,
+                          size_t memgrp_blocksize, int num_te_types,
+                          int ni, int i_offset, int acc_i_offset,
+                          blasint rank2, blasint rank3, blasint rank4,
+                          blasint nbasis2, blasint nbasis4,
+                          const double* vector2, const double* vector4,
+                          const std::vector<unsigned int>& orbsym1,
+                          const std::vector<unsigned int>& orbsym2,
+                          const std::vector<unsigned int>& orbsym3,
+                          const std::vector<unsigned int>& orbsym4);
+
+      /// executed by each thread
+      void run();
+      /// rethrows the first exception thrown by any thread
+      void check_error() const { if (error_) std::rethrow_exception(error_); }
+  };
+
+  class Transform34Thread: public Thread {
+      Transform34Pipeline* pipeline_;
+    public:
+      Transform34Thread(Transform34Pipeline* p) : pipeline_(p) {}
+      void run() { pipeline_->run(); }
+  };
+
+  Transform34Pipeline::Transform34Pipeline(const Ref<DistArray4>& acc, const Ref<MemoryGrp>& mem,
+                                           size_t memgrp_blocksize, int num_te_types,
+                                           int ni, int i_offset, int acc_i_offset,
+                                           blasint rank2, blasint rank3, blasint rank4,
+                                           blasint nbasis2, blasint nbasis4,
+                                           const double* vector2, const double* vector4,
+                                           const std::vector<unsigned int>& orbsym1,
+                                           const std::vector<unsigned int>& orbsym2,
+                                           const std::vector<unsigned int>& orbsym3,
+                                           const std::vector<unsigned int>& orbsym4) :
+    acc_(acc), localdata_((char*) mem->localdata()), memgrp_blocksize_(memgrp_blocksize),
+    num_te_types_(num_te_types), ni_(ni), i_offset_(i_offset), acc_i_offset_(acc_i_offset),
+    rank2_(rank2), rank3_(rank3), rank4_(rank4), nbasis2_(nbasis2), nbasis4_(nbasis4),
+    vector2_(vector2), vector4_(vector4),
+    orbsym1_(&orbsym1[0]), orbsym2_(&orbsym2[0]), orbsym3_(&orbsym3[0]), orbsym4_(&orbsym4[0]),
+    next_block_(0), ntransformed_(0), storing_(false), aborted_(false),
+    nproc_(mem->n())
+  {
+    const int me = mem->me();
+
+    // same assignment of blocks to writers as in detail::store_memorygrp()
+    std::vector<int> writers;
+    const int nwriters = acc_->tasks_with_access(writers);
+    const bool have_access = acc_->has_access(me);
+
+    for (int ij = me; ij < ni*rank3; ij += nproc_) {
+      blocks_.push_back(ij);
+      store_early_.push_back(have_access && (ij % nwriters == writers[me]));
+    }
+  }
+
+  void
+  Transform34Pipeline::transform(int ij, double* sx_ints, double* ijxy_ints)
+  {
+    const char notransp = 'n';
+    const char transp = 't';
+    const double one = 1.0;
+    const double zero = 0.0;
+    const size_t sx_size = nbasis4_ * rank2_ * sizeof(double);
+    const size_t xy_size = rank2_ * rank4_ * sizeof(double);
+
+    const int i = ij / rank3_;
+    const int j = ij % rank3_;
+    const unsigned int ij_sym = orbsym1_[i+i_offset_] ^ orbsym3_[j];
+
+    for(int te_type=0; te_type<num_te_types_; te_type++) {
+      double* ints = block(ij, te_type);
+
+      // third quarter transform
+      // sx = sq * qx
+      F77_DGEMM(&notransp,&notransp,&rank2_,&nbasis4_,&nbasis2_,&one,vector2_,&rank2_,
+                ints,&nbasis2_,&zero,sx_ints,&rank2_);
+
+      // fourth quarter transform
+      // xy = sx^t * sy
+      F77_DGEMM(&notransp,&transp,&rank4_,&rank2_,&nbasis4_,&one,vector4_,&rank4_,
+                sx_ints,&rank2_,&zero,ijxy_ints,&rank4_);
+
+      // Zero out nonsymmetric integrals -- Pitzer theorem in action
+      double* ijxy_ptr = ijxy_ints;
+      for (int x = 0; x<rank2_; x++) {
+        const unsigned int ijx_sym = ij_sym ^ orbsym2_[x];
+        for (int y = 0; y<rank4_; y++, ijxy_ptr++) {
+          if (ijx_sym ^ orbsym4_[y]) {
+            *ijxy_ptr = 0.0;
+          }
+        }
+      }
+
+      // copy the result back to the MemoryGrp
+      memcpy((void*)ints,(const void*)ijxy_ints,xy_size);
+    }
+  }
+
+  void
+  Transform34Pipeline::finished(int b)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++ntransformed_;
+    if (store_early_[b])
+      to_store_.push_back(blocks_[b]);
+    cond_.notify_all();
+  }
+
+  bool
+  Transform34Pipeline::store_one()
+  {
+    int ij;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (storing_ || aborted_ || to_store_.empty())
+        return false;
+      ij = to_store_.front();
+      to_store_.pop_front();
+      storing_ = true;
+    }
+
+    const int i = ij / rank3_;
+    const int j = ij % rank3_;
+    try {
+      for(int te_type=0; te_type<num_te_types_; te_type++)
+        acc_->store_pair_block(i + acc_i_offset_, j, te_type, block(ij, te_type));
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      storing_ = false;
+      cond_.notify_all();
+      throw;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    storing_ = false;
+    cond_.notify_all();
+    return true;
+  }
+
+  bool
+  Transform34Pipeline::done()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (aborted_ || (ntransformed_ == (int)blocks_.size() && to_store_.empty() && !storing_))
+      return true;
+    // wait until there is something to store or another thread finished storing
+    if (to_store_.empty() || storing_)
+      cond_.wait(lock);
+    return false;
+  }
+
+  void
+  Transform34Pipeline::run()
+  {
+    try {
+      std::vector<double> sx_ints(nbasis4_ * rank2_);
+      std::vector<double> ijxy_ints(rank2_ * rank4_);
+
+      // transform blocks, storing the finished ones whenever nobody else is
+      while (!aborted_) {
+        if (store_one())
+          continue;
+        const int b = next_block_++;
+        if (b >= (int)blocks_.size())
+          break;
+        transform(blocks_[b], &sx_ints[0], &ijxy_ints[0]);
+        finished(b);
+      }
+      // no more blocks to transform: help draining the store queue
+      while (!done())
+        store_one();
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_)
+        error_ = std::current_exception();
+      aborted_ = true;
+      cond_.notify_all();
+    }
+  }
+
+}
+
 /*-------------------------------------
   Based on MBPT2::compute_mp2_energy()
  -------------------------------------*/
@@ -155,6 +391,23 @@ TwoBodyMOIntsTransform_ixjy::compute()
                                                      this->log2_epsilon(),debug());
   }
 
+  // If more than one pass is needed, the AO integrals computed by each
+  // thread in the first pass are kept in scratch files, up to
+  // factory()->aoints_store_size() bytes per process, and read back in
+  // the later passes instead of being recomputed.
+  const size_t aoints_store_size = factory()->aoints_store_size();
+  ScratchTaskStore** int_stores = 0;
+  std::vector<int> stored_tasks;
+  if (npass_ > 1 && aoints_store_size > 0 && !partially_tformed_ints_) {
+    int_stores = new ScratchTaskStore*[thr_->nthread()];
+    for (int i=0; i<thr_->nthread(); i++) {
+      std::ostringstream filename;
+      filename << file_prefix_ << "." << name_ << ".aoints." << me << "." << i;
+      int_stores[i] = new ScratchTaskStore(filename.str(), aoints_store_size/thr_->nthread());
+      e13thread[i]->set_int_store(int_stores[i], 0);
+    }
+  }
+
   /*-----------------------------------
 
     Start the integrals transformation
@@ -228,6 +481,50 @@ TwoBodyMOIntsTransform_ixjy::compute()
       thr_->wait_threads();
 #   endif
       tim12.exit();
+
+      if (int_stores && pass == 0) {
+        // Mark the shell pairs held in a store, so that the later passes
+        // replay them from the store and distribute only the others.
+        stored_tasks.assign(nshell4*nshell3, 0);
+        int nbad = 0;
+        double nbyte_stored = 0.0;
+        for (int i=0; i<thr_->nthread(); i++) {
+          int_stores[i]->finish_writing();
+          if (int_stores[i]->bad()) {
+            nbad++;
+            delete int_stores[i];
+            int_stores[i] = 0;
+            continue;
+          }
+          for (int itask=0; itask<int_stores[i]->ntask(); itask++) {
+            const int S = int_stores[i]->task_S(itask);
+            const int R = int_stores[i]->task_R(itask);
+            stored_tasks[S*nshell3 + R] = 1;
+          }
+          nbyte_stored += int_stores[i]->size();
+        }
+        msg_->sum(&stored_tasks[0], stored_tasks.size());
+        msg_->sum(nbad);
+        msg_->sum(nbyte_stored);
+        int nstored_tasks = 0;
+        for (size_t i=0; i<stored_tasks.size(); i++) {
+          if (stored_tasks[i]) nstored_tasks++;
+        }
+        if (nbad) {
+          ExEnv::out0() << indent
+                        << "WARNING: could not write " << nbad
+                        << " AO integral scratch files; their integrals will be recomputed"
+                        << endl;
+        }
+        ExEnv::out0() << indent
+                      << "Stored AO integrals of " << nstored_tasks << " of "
+                      << stored_tasks.size() << " shell pairs ("
+                      << nbyte_stored << " Bytes)" << endl;
+        for (int i=0; i<thr_->nthread(); i++) {
+          e13thread[i]->set_int_store(int_stores[i], &stored_tasks[0]);
+        }
+      }
+
       ExEnv::out0() << indent << "End of loop over shells" << endl;
     }
 
@@ -257,131 +554,40 @@ TwoBodyMOIntsTransform_ixjy::compute()
     }
 #endif
 
-    // Third quarter transform
-    ExEnv::out0() << indent << "Begin third q.t." << endl;
-    Timer tim3("3. q.t.");
+    // Third and fourth quarter transforms
     // Begin third quarter transformation;
     // from (iq|js) stored as ijsq
     // generate (ix|js) stored as ijsx
-
-    const int sx_size = nbasis4 * rank2 * sizeof(double);
-    double* sx_ints = new double[nbasis4 * rank2];
-    for (int i = 0; i<ni; i++) {
-      for (int j = 0; j<rank3; j++) {
-        int ij = i*rank3+j;
-        int ij_local = ij/nproc;
-        if (ij%nproc == me) {
-
-          for(int te_type=0; te_type<num_te_types(); te_type++) {
-
-            const double *sq_ptr = (const double*) ((size_t)integral_ijsq + (ij_local*num_te_types()+te_type)*memgrp_blocksize);
-
-            // fourth quarter transform
-            // sx = sq * qx
-            const char notransp = 'n';
-            const double one = 1.0;
-            const double zero = 0.0;
-            F77_DGEMM(&notransp,&notransp,&rank2,&nbasis4,&nbasis2,&one,vector2[0],&rank2,
-                      sq_ptr,&nbasis2,&zero,sx_ints,&rank2);
-
-            // copy the result back to integrals_ijsq
-            memcpy((void*)sq_ptr,(const void*)sx_ints,sx_size);
-          }
-        }
-      }
-    }
-    delete[] sx_ints;
-    tim3.exit();
-    ExEnv::out0() << indent << "End of third q.t." << endl;
+    // then fourth quarter transformation;
+    // generate (ix|jy) stored as ijxy
+    // Locally held blocks written by this task are stored to the accumulator
+    // as they become ready, the rest are stored after all tasks finish.
+    ExEnv::out0() << indent << "Begin third and fourth q.t." << endl;
+    Timer tim34("3.+4. q.t.");
     integral_ijsq = 0;
-
-    double* integral_ijsx = (double*) mem_->localdata();
-#if PRINT3Q
+    ints_acc_->activate();
     {
-      for(int te_type=0; te_type<PRINT_NUM_TE_TYPES; te_type++) {
-        for (int i = 0; i<ni; i++) {
-          for (int x = 0; x<rank2; x++) {
-            for (int j = 0; j<rank3; j++) {
-              int ij = i*rank3+j;
-              int ij_local = ij/nproc;
-              if (ij%nproc == me) {
-                const double* ijsx_ints = (const double*) ((size_t)integral_ijsx + (ij_local*num_te_types()+te_type)*memgrp_blocksize);
-                for (int s = 0; s<nbasis4; s++) {
-                  double value = ijsx_ints[s*rank2+x];
-                  printf("3Q: type = %d (%d %d|%d %d) = %12.8f\n",
-                         te_type,i+i_offset,x,j,s,value);
-                }
-              }
-            }
-          }
-        }
-      }
-    }
-#endif
-
-    // Fourth quarter transform
-    ExEnv::out0() << indent << "Begin fourth q.t." << endl;
-    Timer tim4("4. q.t.");
-    // Begin fourth quarter transformation;
-    // generate (ix|jy) stored as ijxy
-
-    double* ijxy_ints = new double[rank2*rank4];
-    const size_t xy_size = rank2*rank4*sizeof(double);
-    for(int te_type=0; te_type<num_te_types(); te_type++) {
-
-      for (int i = 0; i<ni; i++) {
-        for (int j = 0; j<rank3; j++) {
-          int ij = i*rank3+j;
-          int ij_local = ij/nproc;
-          if (ij%nproc == me) {
-
-            const double *sx_ptr = (const double*) ((size_t)integral_ijsx + (ij_local*num_te_types()+te_type)*memgrp_blocksize);
-
-            // fourth quarter transform
-            // xy = sx^t * sy
-            const char notransp = 'n';
-            const char transp = 't';
-            const double one = 1.0;
-            const double zero = 0.0;
-            F77_DGEMM(&notransp,&transp,&rank4,&rank2,&nbasis4,&one,vector4[0],&rank4,
-                      sx_ptr,&rank2,&zero,ijxy_ints,&rank4);
-
-            // copy the result back to integrals_ijsx
-            memcpy((void*)sx_ptr,(const void*)ijxy_ints,xy_size);
-          }
-        }
+      Transform34Pipeline pipeline(ints_acc_, mem_, memgrp_blocksize, num_te_types(),
+                                   ni, i_offset, restart_orbital_,
+                                   rank2, rank3, rank4, nbasis2, nbasis4,
+                                   vector2[0], vector4[0],
+                                   orbsym1, orbsym2, orbsym3, orbsym4);
+      std::vector<Transform34Thread*> t34threads(thr_->nthread());
+      for (int i=0; i<thr_->nthread(); i++) {
+        t34threads[i] = new Transform34Thread(&pipeline);
+        thr_->add_thread(i, t34threads[i]);
       }
+      thr_->start_threads();
+      thr_->wait_threads();
+      for (int i=0; i<thr_->nthread(); i++)
+        delete t34threads[i];
+      pipeline.check_error();
     }
-    delete[] ijxy_ints;
-    tim4.exit();
-    ExEnv::out0() << indent << "End of fourth q.t." << endl;
+    tim34.exit();
+    ExEnv::out0() << indent << "End of third and fourth q.t." << endl;
 
-    integral_ijsx = 0;
     double* integral_ijxy = (double*) mem_->localdata();
 
-    // Zero out nonsymmetric integrals -- Pitzer theorem in action
-    {
-      for (int i = 0; i<ni; i++) {
-        for (int j = 0; j<rank3; j++) {
-          int ij = i*rank3+j;
-          int ij_local = ij/nproc;
-          if (ij%nproc == me) {
-            const int ij_sym = orbsym1[i+i_offset] ^ orbsym3[j];
-            for(int te_type=0; te_type<num_te_types(); te_type++) {
-              double* ijxy_ptr = (double*) ((size_t)integral_ijxy + (ij_local*num_te_types()+te_type)*memgrp_blocksize);
-              for (int x = 0; x<rank2; x++) {
-                const int ijx_sym = ij_sym ^ orbsym2[x];
-                for (int y = 0; y<rank4; y++, ijxy_ptr++) {
-                  if (ijx_sym ^ orbsym4[y]) {
-                    *ijxy_ptr = 0.0;
-                  }
-                }
-              }
-            }
-          }
-        }
-      }
-    }
     // Sync up tasks before integrals are committed
     mem_->sync();
 
@@ -430,8 +636,8 @@ TwoBodyMOIntsTransform_ixjy::compute()
     // Push locally stored integrals to an accumulator
     // This could involve storing the data to disk or simply remembering the pointer
     Timer tim_mostore("MO ints store");
-    ints_acc_->activate();
-    detail::store_memorygrp(ints_acc_,mem_,restart_orbital_,ni,memgrp_blocksize);
+    detail::store_memorygrp(ints_acc_,mem_,restart_orbital_,ni,memgrp_blocksize,
+                            true);
     if (ints_acc_->data_persistent()) ints_acc_->deactivate();
     // if didn't throw can safely update the counter
     restart_orbital_ += ni;
@@ -447,6 +653,14 @@ TwoBodyMOIntsTransform_ixjy::compute()
   } // end of loop over passes
   tim_pass.exit();
 
+  if (int_stores) {
+    for (int i=0; i<thr_->nthread(); i++) {
+      e13thread[i]->set_int_store(0, 0);
+      delete int_stores[i];
+    }
+    delete[] int_stores;
+  }
+
   for (int i=0; i<thr_->nthread(); i++) {
     delete e13thread[i];
   }
@@ -38,11 +38,118 @@
 #include <math/optimize/gaussianfit.h>
 #include <math/optimize/gaussianfit.timpl.h>
 #include <chemistry/qc/lcao/fockbuilder.h>
+#include <util/group/thread.h>
+#include <util/misc/consumableresources.h>
 
 #define USE_KERNEL_INVERSE 0
 
 using namespace sc;
 
+namespace {
+
+  /// solves the density fitting equations for a range of right-hand sides, see DensityFitting::compute()
+  class DensityFittingSolveThread : public Thread {
+    public:
+      /**
+       * @param cC nrhs rows of n3 conjugate coefficients
+       * @param C on output nrhs rows of n3 fitting coefficients
+       */
+      DensityFittingSolveThread(DensityFitting::SolveMethod solver,
+                                bool flip_kernel_sign,
+                                int n3,
+                                const double* kernel_i,
+                                const Ref<KernelFactorization>& kernel_factor,
+                                const double* cC,
+                                double* C,
+                                int nrhs) :
+        solver_(solver), flip_kernel_sign_(flip_kernel_sign), n3_(n3),
+        kernel_i_(kernel_i), kernel_factor_(kernel_factor),
+        cC_(cC), C_(C), nrhs_(nrhs) {}
+
+      void run() {
+        if (nrhs_ == 0)
+          return;
+
+        bool refine_solution = true;
+        switch (solver_) {
+          case DensityFitting::SolveMethod_InverseCholesky:
+          case DensityFitting::SolveMethod_InverseBunchKaufman:
+          {
+            C_DGEMM('n', 'n', nrhs_, n3_, n3_,
+                    (flip_kernel_sign_ ? -1.0 : 1.0),
+                    cC_, n3_, kernel_i_, n3_,
+                    0.0, C_, n3_);
+          }
+          break;
+
+          case DensityFitting::SolveMethod_Cholesky:
+          {
+            // kernel = U^t U -> C = cC U^-1 U^-t
+            // in Fortran (column-major) terms solve U^t U C^t = cC^t
+            // kernel sign was flipped, but cC kept the sign ... apply the sign instead to the result
+            std::copy(cC_, cC_ + (size_t)nrhs_ * n3_, C_);
+            const char left = 'L';
+            const char upper = 'U';
+            const char transp = 't';
+            const char notransp = 'n';
+            const char nonunit = 'n';
+            const blasint n = n3_;
+            const blasint nrhs = nrhs_;
+            const double alpha = flip_kernel_sign_ ? -1.0 : 1.0;
+            const double one = 1.0;
+            const double* U = &(kernel_factor_->U[0]);
+            F77_DTRSM(&left, &upper, &transp, &nonunit, &n, &nrhs, &alpha,
+                      U, &n, C_, &n);
+            F77_DTRSM(&left, &upper, &notransp, &nonunit, &n, &nrhs, &one,
+                      U, &n, C_, &n);
+          }
+          break;
+
+          case DensityFitting::SolveMethod_RefinedCholesky:
+          {
+            sc::lapack_linsolv_cholesky_symmposdef(&(kernel_factor_->kernel_packed[0]), n3_,
+                                                   &(kernel_factor_->kernel_factorized[0]),
+                                                   C_, cC_, nrhs_,
+                                                   refine_solution);
+            if (flip_kernel_sign_) { // kernel sign was flipped, but cC kept the sign ...
+                                     // apply the sign instead to the result
+              const blasint n = (blasint)nrhs_ * n3_;
+              const blasint one = 1;
+              const double minus_1 = -1.0;
+              F77_DSCAL(&n, &minus_1, C_, &one);
+            }
+          }
+          break;
+
+          case DensityFitting::SolveMethod_BunchKaufman:
+            refine_solution = false;
+          case DensityFitting::SolveMethod_RefinedBunchKaufman:
+          {
+            sc::lapack_linsolv_dpf_symmnondef(&(kernel_factor_->kernel_packed[0]), n3_,
+                                              &(kernel_factor_->kernel_factorized[0]),
+                                              &(kernel_factor_->ipiv[0]), C_, cC_, nrhs_,
+                                              refine_solution);
+          }
+          break;
+
+          default:
+            MPQC_ASSERT(false); // unreachable, DensityFitting::compute() checked the solver
+        }
+      }
+
+    private:
+      DensityFitting::SolveMethod solver_;
+      bool flip_kernel_sign_;
+      int n3_;
+      const double* kernel_i_;
+      Ref<KernelFactorization> kernel_factor_;
+      const double* cC_;
+      double* C_;
+      int nrhs_;
+  };
+
+}
+
 ClassDesc DensityFitting::class_desc_(
   typeid(DensityFitting),"DensityFitting",2,
   "virtual public SavableState",
@@ -208,13 +315,8 @@ DensityFitting::compute()
       const int n1 = space1_->rank();
       const int n2 = space2_->rank();
       const int n3 = fbasis_->nbasis();
-      // scratch for holding solution vectors
-      std::vector<double> C_jR(n2 * n3);
-
       std::vector<double> kernel_i;       // holds the inverse (or inverse square root, if RI), only needed for inverse method
-      std::vector<double> kernel_packed;  // only needed for factorized methods
-      std::vector<double> kernel_factorized;
-      std::vector<blasint> ipiv;
+      Ref<KernelFactorization> kernel_factor; // only needed for factorized methods
 
       // factorize or invert kernel
       switch (solver_) {
@@ -249,29 +351,42 @@ DensityFitting::compute()
 
         case SolveMethod_Cholesky:
         case SolveMethod_RefinedCholesky:
-        {
-          // convert kernel_ to a packed upper-triangle form
-          kernel_packed.resize(n3 * (n3 + 1) / 2);
-          kernel_->convert(&(kernel_packed[0]));
-          // factorize kernel_ using diagonal pivoting from LAPACK's DSPTRF
-          kernel_factorized.resize(n3 * (n3 + 1) / 2);
-          sc::lapack_cholesky_symmposdef(kernel_,
-                                         &(kernel_factorized[0]),
-                                         1e10);
-        }
-        break;
-
         case SolveMethod_BunchKaufman:
         case SolveMethod_RefinedBunchKaufman:
         {
-          // convert kernel_ to a packed upper-triangle form
-          kernel_packed.resize(n3 * (n3 + 1) / 2);
-          kernel_->convert(&(kernel_packed[0]));
-          // factorize kernel_ using diagonal pivoting from LAPACK's DSPTRF
-          kernel_factorized.resize(n3 * (n3 + 1) / 2);
-          ipiv.resize(n3);
-          sc::lapack_dpf_symmnondef(kernel_, &(kernel_factorized[0]),
-                                    &(ipiv[0]), 1e10);
+          // the factorization only depends on the fitting basis and the kernel, compute it once
+          const std::string factor_key = kernel_ints_key + (cholesky ? "_cholesky" : "_bunchkaufman");
+          if (not runtime_->runtime_2c_factor()->key_exists(factor_key)) {
+            Ref<KernelFactorization> factor = new KernelFactorization;
+            // the packed kernel and its packed factorization, plus the dense U or the pivots
+            const size_t npacked = (size_t)n3 * (n3 + 1) / 2;
+            factor->consume_memory(2 * npacked * sizeof(double)
+                                   + (cholesky ? (size_t)n3 * n3 * sizeof(double)
+                                               : n3 * sizeof(blasint)));
+            // convert kernel_ to a packed upper-triangle form
+            factor->kernel_packed.resize(n3 * (n3 + 1) / 2);
+            kernel_->convert(&(factor->kernel_packed[0]));
+            factor->kernel_factorized.resize(n3 * (n3 + 1) / 2);
+            if (cholesky) {
+              // factorize kernel_ = U^t U using LAPACK's DPPTRF
+              sc::lapack_cholesky_symmposdef(kernel_,
+                                             &(factor->kernel_factorized[0]),
+                                             1e10);
+              // unpack U for DTRSM
+              factor->U.resize(n3 * n3, 0.0);
+              for (int c = 0, rc = 0; c < n3; ++c)
+                for (int r = 0; r <= c; ++r, ++rc)
+                  factor->U[r + c * n3] = factor->kernel_factorized[rc];
+            }
+            else {
+              // factorize kernel_ using diagonal pivoting from LAPACK's DSPTRF
+              factor->ipiv.resize(n3);
+              sc::lapack_dpf_symmnondef(kernel_, &(factor->kernel_factorized[0]),
+                                        &(factor->ipiv[0]), 1e10);
+            }
+            runtime_->runtime_2c_factor()->add(factor_key, factor);
+          }
+          kernel_factor = runtime_->runtime_2c_factor()->value(factor_key);
         }
         break;
 
@@ -279,84 +394,81 @@ DensityFitting::compute()
           throw ProgrammingError("unknown solve method", __FILE__, __LINE__, class_desc());
       }
 
+      // solve for several i at once: stacking the (n2 x n3) blocks of enough i's
+      // to make the right-hand sides at least as many as the unknowns
+      // keeps the level-3 solvers efficient even if n2 is small
+      std::vector<int> local_i;
       for (int i = 0; i < n1; ++i) {
-
         // work on local blocks
-        if (not cC_->is_local(0, i))
-          continue;
+        if (cC_->is_local(0, i))
+          local_i.push_back(i);
+      }
+      Ref<ThreadGrp> thr = ThreadGrp::get_default_threadgrp();
+      const int nthread = thr->nthread();
+      const int nblock_per_thread = std::max(1, std::min(n3 / std::max(n2, 1), 64));
+      // cC_block and C_block together may use at most half of the available memory
+      const size_t blocksize = (size_t)n2 * n3;
+      const size_t nbytes_per_block = 2 * sizeof(double) * blocksize; // 2 to account for cC_block and C_block
+      const size_t stack_budget = ConsumableResources::get_default_instance()->memory() / 2;
+      const size_t nblock_budget = std::max((size_t)1, stack_budget / std::max((size_t)1, nbytes_per_block));
+      const int nblock_max = (int)std::min((size_t)std::min((int)local_i.size(), nthread * nblock_per_thread),
+                                           nblock_budget);
+      const size_t stack_nbytes = (size_t)std::max(nblock_max, 1) * nbytes_per_block;
+      ConsumableResources::get_default_instance()->consume_memory(stack_nbytes);
+      std::vector<double> cC_block((size_t)std::max(nblock_max, 1) * blocksize);
+      std::vector<double> C_block(cC_block.size());
+
+      for (int b = 0; b < (int)local_i.size(); b += nblock_max) {
+        const int nblock = std::min(nblock_max, (int)local_i.size() - b);
+
+        for (int k = 0; k < nblock; ++k) {
+          const double* cC_jR = cC_->retrieve_pair_block(0, local_i[b + k], ints_type_idx);
+          std::copy(cC_jR, cC_jR + blocksize, cC_block.begin() + k * blocksize);
+          // release this block
+          cC_->release_pair_block(0, local_i[b + k], ints_type_idx);
+        }
 
-        const double* cC_jR = cC_->retrieve_pair_block(0, i, ints_type_idx);
+        // each thread solves for a contiguous range of the nblock*n2 right-hand sides
+        const int nrhs = nblock * n2;
+        std::vector<DensityFittingSolveThread*> threads(nthread);
+        for (int t = 0; t < nthread; ++t) {
+          const int rhs_begin = (int)(((size_t)nrhs * t) / nthread);
+          const int rhs_end = (int)(((size_t)nrhs * (t + 1)) / nthread);
+          threads[t] = new DensityFittingSolveThread(solver_, flip_kernel_sign, n3,
+                                                     kernel_i.empty() ? 0 : &(kernel_i[0]),
+                                                     kernel_factor,
+                                                     &(cC_block[0]) + (size_t)rhs_begin * n3,
+                                                     &(C_block[0]) + (size_t)rhs_begin * n3,
+                                                     rhs_end - rhs_begin);
+          thr->add_thread(t, threads[t]);
+        }
+        thr->start_threads();
+        thr->wait_threads();
+        for (int t = 0; t < nthread; ++t)
+          delete threads[t];
 
-        bool refine_solution = true;
-        // solve the linear system
-        switch (solver_) {
-          case SolveMethod_InverseCholesky:
-          case SolveMethod_InverseBunchKaufman:
-          {
-            C_DGEMM('n', 'n', n2, n3, n3,
-                    (flip_kernel_sign ? -1.0 : 1.0),
-                    cC_jR, n3, &(kernel_i[0]), n3,
-                    0.0, &(C_jR[0]), n3);
-          }
 #if 0
-          if (i == 0) {
-            RefSCMatrix C_jR_mat = kernel_.kit()->matrix(new SCDimension(n2),
-                                                         new SCDimension(n3));
-            C_jR_mat.assign(&(C_jR[0]));
-            C_jR_mat.print("debug DensityFitting: C(0j|R)");
-
-            RefSCMatrix cC_jR_mat = kernel_.kit()->matrix(new SCDimension(n2),
-                                                          new SCDimension(n3));
-            cC_jR_mat.assign(cC_jR);
-
-            // reconstruct
-            (cC_jR_mat * C_jR_mat.t()).print("debug DensityFitting: V(0j|0j)");
-          }
-#endif
-          break;
-
-          case SolveMethod_Cholesky:
-            refine_solution = false;
-          case SolveMethod_RefinedCholesky:
-          {
-            sc::lapack_linsolv_cholesky_symmposdef(&(kernel_packed[0]), n3,
-                                                   &(kernel_factorized[0]),
-                                                   &(C_jR[0]), cC_jR, n2,
-                                                   refine_solution);
-            if (flip_kernel_sign) { // kernel sign was flipped, but cC kept the sign ...
-                                    // apply the sign instead to the result
-              const blasint n23 = n2*n3;
-              const blasint one = 1;
-              const double minus_1 = -1.0;
-              F77_DSCAL(&n23, &minus_1, &(C_jR[0]), &one);
-            }
-
-          }
-          break;
-
-          case SolveMethod_BunchKaufman:
-            refine_solution = false;
-          case SolveMethod_RefinedBunchKaufman:
-          {
-            //sc::lapack_linsolv_symmnondef(&(kernel_packed[0]), n3, &(C_jR[0]), cC_jR, n2);
-            sc::lapack_linsolv_dpf_symmnondef(&(kernel_packed[0]), n3,
-                                                   &(kernel_factorized[0]),
-                                                   &(ipiv[0]), &(C_jR[0]), cC_jR, n2,
-                                                   refine_solution);
-          }
-          break;
-
-          default:
-            throw ProgrammingError("unknown solve method", __FILE__, __LINE__, class_desc());
+        if (b == 0) {
+          RefSCMatrix C_jR_mat = kernel_.kit()->matrix(new SCDimension(n2),
+                                                       new SCDimension(n3));
+          C_jR_mat.assign(&(C_block[0]));
+          C_jR_mat.print("debug DensityFitting: C(0j|R)");
+
+          RefSCMatrix cC_jR_mat = kernel_.kit()->matrix(new SCDimension(n2),
+                                                        new SCDimension(n3));
+          cC_jR_mat.assign(&(cC_block[0]));
+
+          // reconstruct
+          (cC_jR_mat * C_jR_mat.t()).print("debug DensityFitting: V(0j|0j)");
         }
+#endif
 
         // write
-        C_->store_pair_block(0, i, 0, &(C_jR[0]));
-
-        // release this block
-        cC_->release_pair_block(0, i, ints_type_idx);
+        for (int k = 0; k < nblock; ++k)
+          C_->store_pair_block(0, local_i[b + k], 0, &(C_block[0]) + k * blocksize);
 
       }
+      ConsumableResources::get_default_instance()->release_memory(stack_nbytes);
 
     }
 
@@ -476,6 +476,7 @@ DensityFittingInfo::obsolete() {
   runtime()->moints_runtime()->runtime_2c()->obsolete();
   runtime()->moints_runtime()->runtime_3c()->obsolete();
   runtime()->moints_runtime()->runtime_2c_inv()->clear();
+  runtime()->moints_runtime()->runtime_2c_factor()->clear();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -159,6 +159,8 @@ FockBuildRuntime::obsolete_density_dependents() {
     dfinfo()->runtime()->moints_runtime()->runtime_3c()->remove_if(std::string("dd"));
     key_equals<std::string, RefSymmSCMatrix> pred("dd");
     dfinfo()->runtime()->moints_runtime()->runtime_2c_inv()->remove_if(pred);
+    key_equals<std::string, Ref<KernelFactorization> > fpred("dd");
+    dfinfo()->runtime()->moints_runtime()->runtime_2c_factor()->remove_if(fpred);
   }
 }
 
@@ -639,6 +639,21 @@ TwoBodyMOIntsRuntime<2>::create_eval(const std::string& key)
 
 /////////////////////////////////////////////////////////////////////////////
 
+KernelFactorization::KernelFactorization() : nbytes_(0) {}
+
+KernelFactorization::~KernelFactorization() {
+  if (not resources_.null()) resources_->release_memory(nbytes_);
+}
+
+void
+KernelFactorization::consume_memory(size_t nbytes) {
+  if (resources_.null()) resources_ = ConsumableResources::get_default_instance();
+  resources_->consume_memory(nbytes);
+  nbytes_ += nbytes;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
 ClassDesc
 TwoBodyMOIntsRuntimeUnion23::class_desc_(typeid(this_type),
                            "TwoBodyMOIntsRuntimeUnion23",
@@ -654,7 +669,8 @@ TwoBodyMOIntsRuntimeUnion23::TwoBodyMOIntsRuntimeUnion23(const Ref<MOIntsTransfo
   factory_(factory),
   runtime_2c_(r2c.null() ? Ref<TwoBodyTwoCenterMOIntsRuntime>(new TwoBodyTwoCenterMOIntsRuntime(factory_)) : r2c),
   runtime_3c_(r3c.null() ? Ref<TwoBodyThreeCenterMOIntsRuntime>(new TwoBodyThreeCenterMOIntsRuntime(factory_)) : r3c),
-  runtime_2c_inv_(KernelInverseRegistry::instance())
+  runtime_2c_inv_(KernelInverseRegistry::instance()),
+  runtime_2c_factor_(KernelFactorizationRegistry::instance())
 {
 }
 
@@ -666,6 +682,7 @@ TwoBodyMOIntsRuntimeUnion23::TwoBodyMOIntsRuntimeUnion23(StateIn& si) {
   runtime_2c_ << SavableState::restore_state(si);
   runtime_3c_ << SavableState::restore_state(si);
   runtime_2c_inv_ = KernelInverseRegistry::restore_instance(si);
+  runtime_2c_factor_ = KernelFactorizationRegistry::instance();
 }
 
 void
@@ -29,9 +29,12 @@
 #define _mpqc_src_lib_chemistry_qc_lcao_tbint_runtime_h
 
 #include <string>
+#include <vector>
 #include <util/state/state.h>
+#include <math/scmat/blas.h>
 #include <chemistry/qc/basis/intdescr.h>
 #include <math/distarray4/distarray4.h>
+#include <util/misc/consumableresources.h>
 #include <chemistry/qc/wfn/spin.h>
 #include <chemistry/qc/lcao/transform_factory.h>
 
@@ -520,7 +523,37 @@ namespace sc {
 
   //////////////////////
 
+  /** KernelFactorization holds the factorization of a density-fitting kernel matrix \f$ (A|\hat{W}|B) \f$
+      computed by DensityFitting. It depends only on the fitting basis and the kernel, hence it is
+      computed once and shared by all DensityFitting objects that use them. The memory it holds is
+      charged to ConsumableResources until it is destroyed.
+    */
+  struct KernelFactorization : public RefCount {
+      KernelFactorization();
+      ~KernelFactorization();
+
+      /** charges nbytes to ConsumableResources; call before allocating the members.
+          @throw LimitExceeded if the memory is not available */
+      void consume_memory(size_t nbytes);
+
+      /// the kernel matrix, packed upper triangle (needed to refine the solutions)
+      std::vector<double> kernel_packed;
+      /// the Cholesky (DPPTRF) or Bunch-Kaufman (DSPTRF) factorization, packed upper triangle
+      std::vector<double> kernel_factorized;
+      /// the Bunch-Kaufman pivots; empty for the Cholesky factorization
+      std::vector<blasint> ipiv;
+      /// the Cholesky factor \f$ U \f$ (kernel = \f$ U^t U \f$) as a dense column-major matrix,
+      /// for solving with DTRSM; empty for the Bunch-Kaufman factorization
+      std::vector<double> U;
+
+    private:
+      // the instance charged with nbytes_, which may outlive the default instance
+      Ref<ConsumableResources> resources_;
+      size_t nbytes_;
+  };
+
   /** TwoBodyMOIntsRuntimeUnion23 packages 2-center and 3-center runtimes; it also keeps track of 2-center matrix inverses
+      and factorizations
     */
   class TwoBodyMOIntsRuntimeUnion23 : virtual public SavableState {
     public:
@@ -528,6 +561,8 @@ namespace sc {
       typedef Registry<std::string, RefSymmSCMatrix,
                        detail::NonsingletonCreationPolicy,
                        std::equal_to<std::string>, RefSymmSCMatrixEqual > KernelInverseRegistry;
+      typedef Registry<std::string, Ref<KernelFactorization>,
+                       detail::NonsingletonCreationPolicy > KernelFactorizationRegistry;
 
       TwoBodyMOIntsRuntimeUnion23(const Ref<MOIntsTransformFactory>& factory,
                                   const Ref<TwoBodyTwoCenterMOIntsRuntime>& runtime_2c = 0,
@@ -544,6 +579,8 @@ namespace sc {
       const Ref<TwoBodyThreeCenterMOIntsRuntime>& runtime_3c() const { return runtime_3c_; }
       /// runtime for 2-center integral matrix inverses
       const Ref<KernelInverseRegistry>& runtime_2c_inv() const { return runtime_2c_inv_; }
+      /// runtime for 2-center integral matrix factorizations; these are not checkpointed
+      const Ref<KernelFactorizationRegistry>& runtime_2c_factor() const { return runtime_2c_factor_; }
 
     private:
       static ClassDesc class_desc_;
@@ -552,6 +589,7 @@ namespace sc {
       Ref<TwoBodyTwoCenterMOIntsRuntime> runtime_2c_;
       Ref<TwoBodyThreeCenterMOIntsRuntime> runtime_3c_;
       Ref<KernelInverseRegistry> runtime_2c_inv_;
+      Ref<KernelFactorizationRegistry> runtime_2c_factor_;
 
   };
 
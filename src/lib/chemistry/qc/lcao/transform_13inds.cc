@@ -54,7 +54,7 @@ TwoBodyMOIntsTransform_13Inds::TwoBodyMOIntsTransform_13Inds(
   const Ref<TwoBodyMOIntsTransform>& tform, int mythread, int nthread,
   const Ref<ThreadLock>& lock, const Ref<TwoBodyInt> &tbint, double tol, int debug) :
   tform_(tform), mythread_(mythread), nthread_(nthread), lock_(lock), tbint_(tbint),
-  tol_(tol), debug_(debug)
+  tol_(tol), debug_(debug), int_store_(0), stored_tasks_(0)
 {
   timer_ = new RegionTimer();
   aoint_computed_ = 0;
@@ -197,10 +197,19 @@ TwoBodyMOIntsTransform_13Inds::run()
     }
 #endif
 
-  int R = 0;
-  int S = 0;
+  // the quartets of all integral types, as written to and read from int_store_
+  double* quartet_buf = 0;
+  const double** stored_intbuf = 0;
+  if (int_store_ != 0) {
+    quartet_buf = new double[num_te_types*nfuncmax1*nfuncmax2*nfuncmax3*nfuncmax4];
+    stored_intbuf = new const double*[num_te_types];
+  }
+
   int RS_count = 0;
-  while (shellpairs.get_task(S,R)) {
+
+  // Computes the contributions of the shell pair RS to the half-transformed
+  // integrals.  If read_ints is true the stored quartets of RS are taken from int_store_.
+  auto do_shellpair = [&](int S, int R, bool read_ints) {
     // if bs3_eq_bs4 then S >= R always (see sc::DistShellPair)
     int nr = bs3->shell(R).nfunction();
     int r_offset = bs3->shell_to_function(R);
@@ -210,19 +219,9 @@ TwoBodyMOIntsTransform_13Inds::run()
 
     int nrs = nr*ns;
 
-    if (debug_ > 1 && (print_index++)%print_interval == 0) {
-      lock_->lock();
-      ExEnv::outn() << scprintf("%d:%d: (PQ|%d %d) %d%%",
-			       me,mythread_,R,S,(100*print_index)/work_per_thread)
-		   << endl;
-      lock_->unlock();
-    }
-    if (debug_ > 1 && (print_index)%time_interval == 0) {
-      lock_->lock();
-      ExEnv::outn() << scprintf("timer for %d:%d:",me,mythread_) << endl;
-      timer_->print();
-      lock_->unlock();
-    }
+    const bool write_ints = (!read_ints && int_store_ != 0 && stored_tasks_ == 0
+                             && int_store_->begin_task(S,R));
+    if (read_ints) int_store_->begin_read_task();
 
 #if !FAST_BUT_WRONG
     // Zero out 1 q.t. storage
@@ -248,11 +247,31 @@ TwoBodyMOIntsTransform_13Inds::run()
           continue;  // skip shell quartets less than tol
 	}
 
-        aoint_computed_++;
-
-        timer_->enter("AO integrals");
-        tbint_->compute_shell(P,Q,R,S);
-        timer_->exit("AO integrals");
+        const double** ints = intbuf;
+        const size_t npqrs = np*nq*nrs;
+        if (read_ints && int_store_->next_is(P,Q)) {
+          timer_->enter("AO integrals read");
+          int_store_->get(quartet_buf, num_te_types*npqrs);
+          timer_->exit("AO integrals read");
+          for(int te_type=0; te_type<num_te_types; te_type++)
+            stored_intbuf[te_type] = quartet_buf + te_type*npqrs;
+          ints = stored_intbuf;
+        }
+        else {
+          aoint_computed_++;
+
+          timer_->enter("AO integrals");
+          tbint_->compute_shell(P,Q,R,S);
+          timer_->exit("AO integrals");
+
+          if (write_ints) {
+            timer_->enter("AO integrals write");
+            for(int te_type=0; te_type<num_te_types; te_type++)
+              std::copy(intbuf[te_type], intbuf[te_type]+npqrs, quartet_buf + te_type*npqrs);
+            int_store_->put(P,Q,quartet_buf,num_te_types*npqrs);
+            timer_->exit("AO integrals write");
+          }
+        }
 
 #if PRINT0Q
     {
@@ -279,7 +298,7 @@ TwoBodyMOIntsTransform_13Inds::run()
                   int rr = r + r_offset;
                   for (int s = 0; s < ns; s++) {
                     int ss = s + s_offset;
-                    double value = intbuf[te_type][s + ns * (r + nr * (q
+                    double value = ints[te_type][s + ns * (r + nr * (q
                         + nq * p))];
                     ints_file << scprintf("0Q: type = %d |(%d %d|%d %d)| = %12.8f\n",
                                           te_type, pp, qq, rr, ss, fabs(value));
@@ -304,7 +323,7 @@ TwoBodyMOIntsTransform_13Inds::run()
         // if bs1_eq_bs2 then (ip|rs) are also generated
         // store the integrals as rsiq
 	for(int te_type=0; te_type<num_te_types; te_type++) {
-	  const double *pqrs_ptr = intbuf[te_type];
+	  const double *pqrs_ptr = ints[te_type];
 
 	  for (int bf1 = 0; bf1 < np; bf1++) {
 	    int p = p_offset + bf1;
@@ -531,7 +550,42 @@ TwoBodyMOIntsTransform_13Inds::run()
     }  // endif te_type
     timer_->exit("2. q.t.");
 
+    if (write_ints) int_store_->end_task();
+    if (read_ints) int_store_->end_read_task();
+
     ++RS_count;
+  };
+
+  // The shell pairs held in the store were assigned to this thread when
+  // the store was written; do them first, reading the stored quartets
+  // instead of recomputing them.
+  if (int_store_ != 0 && stored_tasks_ != 0) {
+    int_store_->rewind();
+    for (int itask=0; itask<int_store_->ntask(); itask++)
+      do_shellpair(int_store_->task_S(itask), int_store_->task_R(itask), true);
+  }
+
+  int R = 0;
+  int S = 0;
+  while (shellpairs.get_task(S,R)) {
+    // skip the shell pairs that some thread replays from its store
+    if (stored_tasks_ != 0 && stored_tasks_[S*nsh3 + R]) continue;
+
+    if (debug_ > 1 && (print_index++)%print_interval == 0) {
+      lock_->lock();
+      ExEnv::outn() << scprintf("%d:%d: (PQ|%d %d) %d%%",
+			       me,mythread_,R,S,(100*print_index)/work_per_thread)
+		   << endl;
+      lock_->unlock();
+    }
+    if (debug_ > 1 && (print_index)%time_interval == 0) {
+      lock_->lock();
+      ExEnv::outn() << scprintf("timer for %d:%d:",me,mythread_) << endl;
+      timer_->print();
+      lock_->unlock();
+    }
+
+    do_shellpair(S, R, false);
   }         // exit while get_task
 
   if (debug_) {
@@ -550,6 +604,8 @@ TwoBodyMOIntsTransform_13Inds::run()
   delete[] vector1[0]; delete[] vector1;
   delete[] vector3[0]; delete[] vector3;
   delete[] intbuf;
+  delete[] stored_intbuf;
+  delete[] quartet_buf;
 }
 
 size_t
@@ -568,6 +624,8 @@ TwoBodyMOIntsTransform_13Inds::compute_required_dynamic_memory(const TwoBodyMOIn
   const int nbasis1 = bs1->nbasis();
   const int nbasis2 = bs2->nbasis();
   const int nbasis3 = bs3->nbasis();
+  const int nfuncmax1 = bs1->max_nfunction_in_shell();
+  const int nfuncmax2 = bs2->max_nfunction_in_shell();
   const int nfuncmax3 = bs3->max_nfunction_in_shell();
   const int nfuncmax4 = bs4->max_nfunction_in_shell();
   const unsigned int num_te_types = tform.num_te_types();
@@ -576,8 +634,10 @@ TwoBodyMOIntsTransform_13Inds::compute_required_dynamic_memory(const TwoBodyMOIn
   const size_t coefs3 = rank3*nbasis3;
   const size_t iqrs = num_te_types * ibatchsize * nbasis2 * nfuncmax3 * nfuncmax4;
   const size_t ijqs = nbasis2 * nfuncmax4 * (bs3_eq_bs4 ? 2.0 : 1.0);
+  // quartet buffer, only allocated if the AO integrals are stored
+  const size_t pqrs = (size_t)num_te_types * nfuncmax1 * nfuncmax2 * nfuncmax3 * nfuncmax4;
 
-  return (coefs1 + coefs3 + iqrs + ijqs) * sizeof(double);
+  return (coefs1 + coefs3 + iqrs + ijqs + pqrs) * sizeof(double);
 }
 
 
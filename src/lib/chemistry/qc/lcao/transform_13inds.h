@@ -33,6 +33,7 @@
 #include <util/group/thread.h>
 #include <chemistry/qc/basis/integral.h>
 #include <chemistry/qc/lcao/transform_tbint.h>
+#include <util/misc/scratchstore.h>
 
 namespace sc {
 
@@ -55,6 +56,9 @@ class TwoBodyMOIntsTransform_13Inds: public Thread {
 
     int aoint_computed_;
 
+    ScratchTaskStore *int_store_;
+    const int *stored_tasks_;
+
   public:
     TwoBodyMOIntsTransform_13Inds(const Ref<TwoBodyMOIntsTransform>& tform,
     int mythread, int nthread, const Ref<ThreadLock>& lock, const Ref<TwoBodyInt> &tbint,
@@ -63,6 +67,15 @@ class TwoBodyMOIntsTransform_13Inds: public Thread {
 
     void set_i_offset(const int ioff) { i_offset_ = ioff; }
     void set_ni(const int nivalue) { ni_ = nivalue; }
+    /** If stored_tasks is null, the AO shell quartets computed by this
+        thread are written to store.  Otherwise the tasks held by store
+        are read back from it, and the shell pairs RS for which
+        stored_tasks[S*nshell3+R] is nonzero are skipped, since some
+        thread holds them in its store.  store may be null. */
+    void set_int_store(ScratchTaskStore *store, const int *stored_tasks) {
+      int_store_ = store;
+      stored_tasks_ = stored_tasks;
+    }
 
     void run();
 
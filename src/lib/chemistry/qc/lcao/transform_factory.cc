@@ -53,7 +53,7 @@ inline int max(int a,int b) { return (a > b) ? a : b;}
   MOIntsTransformFactory
  -----------*/
 static ClassDesc MOIntsTransformFactory_cd(
-  typeid(MOIntsTransformFactory),"MOIntsTransformFactory",1,"virtual public SavableState",
+  typeid(MOIntsTransformFactory),"MOIntsTransformFactory",2,"virtual public SavableState",
   0, 0, create<MOIntsTransformFactory>);
 
 MOIntsTransformFactory::MOIntsTransformFactory(const Ref<Integral>& integral) :
@@ -74,6 +74,7 @@ MOIntsTransformFactory::MOIntsTransformFactory(const Ref<Integral>& integral) :
   ints_method_ = MOIntsTransform::StoreMethod::mem_posix;
   file_prefix_ = "/tmp/moints";
   log2_precision_ = -50.0; // 2^{-50} \sim 10^{-15}
+  aoints_store_size_ = 0;
 }
 
 MOIntsTransformFactory::MOIntsTransformFactory(StateIn& si) : SavableState(si)
@@ -98,6 +99,13 @@ MOIntsTransformFactory::MOIntsTransformFactory(StateIn& si) : SavableState(si)
   ints_method_ = static_cast<MOIntsTransform::StoreMethod::type>(ints_method);
   si.get(file_prefix_);
   si.get(log2_precision_);
+  if (si.version(::class_desc<MOIntsTransformFactory>()) >= 2) {
+    double daoints_store_size;
+    si.get(daoints_store_size);
+    aoints_store_size_ = size_t(daoints_store_size);
+  }
+  else
+    aoints_store_size_ = 0;
 }
 
 MOIntsTransformFactory::~MOIntsTransformFactory()
@@ -122,6 +130,8 @@ MOIntsTransformFactory::save_data_state(StateOut& so)
   so.put((int)ints_method_);
   so.put(file_prefix_);
   so.put(log2_precision_);
+  double daoints_store_size = aoints_store_size_;
+  so.put(daoints_store_size);
 }
 
 void
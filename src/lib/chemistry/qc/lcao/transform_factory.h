@@ -107,6 +107,7 @@ private:
   MOIntsTransform::StoreMethod::type ints_method_;
   std::string file_prefix_;
   double log2_precision_; //< numerical precision of the integrals
+  size_t aoints_store_size_; //< disk space per process for the AO integrals of multi-pass transforms
 
   template <typename TransformType> Ref<TwoBodyMOIntsTransform>
     twobody_transform(const std::string& name,
@@ -152,6 +153,9 @@ public:
    *        requested from the produced MOIntsTransform objects. The default is -50 ( \f$ 2^{-50} \approx 10^{-15} \f$ ).
    */
   void set_log2_precision(double prec) { log2_precision_ = prec; }
+  /** Sets the disk space, in bytes per process, that a multi-pass transform may use to keep
+      the AO integrals of its first pass for the later passes. The default is 0 (none). */
+  void set_aoints_store_size(size_t size) { aoints_store_size_ = size; }
 
   /// Returns the MemoryGrp object
   Ref<MemoryGrp> mem() const { return mem_; }
@@ -179,6 +183,8 @@ public:
    *         requested from the produced MOIntsTransform objects
    */
   double log2_precision() const { return log2_precision_; }
+  /// \sa set_aoints_store_size()
+  size_t aoints_store_size() const { return aoints_store_size_; }
 
   /// Returns OrbitalSpace object 1
   Ref<OrbitalSpace> space1() const;
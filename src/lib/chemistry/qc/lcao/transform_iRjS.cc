@@ -29,6 +29,8 @@
 #include <chemistry/qc/lcao/transform_13inds.h>
 #include <math/distarray4/distarray4_memgrp.h>
 #include <math/distarray4/distarray4_node0file.h>
+#include <math/distarray4/distarray4_mmapfile.h>
+#include <math/distarray4/distarray4_compressed.h>
 #ifdef HAVE_MPIIO
 #  include <math/distarray4/distarray4_mpiiofile.h>
 #endif
@@ -96,7 +98,8 @@ TwoBodyMOIntsTransform_iRjS::compute_transform_dynamic_memory_(int ni) const
   const distsize_t memsize_memgrp = num_te_types() * nij * (distsize_t) memgrp_blksize();
 
   // determine the peak memory requirements
-  return memsize_memgrp + memsize12;
+  // DistArray4_Compressed holds all integrals on node 0, in addition to the batch
+  return memsize_memgrp + memsize12 + compressed_ints_memory();
 }
 
 size_t
@@ -157,6 +160,20 @@ TwoBodyMOIntsTransform_iRjS::init_acc()
                                          DistArray4Storage_YX);
     break;
 
+  case MOIntsTransform::StoreMethod::mmap:
+    ints_acc_ = new DistArray4_MMapFile((file_prefix_+"."+name_).c_str(), num_te_types(),
+                                        space1()->rank(), space3()->rank(),
+                                        space2()->rank(), space4()->rank(),
+                                        DistArray4Storage_YX);
+    break;
+
+  case MOIntsTransform::StoreMethod::compressed:
+  case MOIntsTransform::StoreMethod::compressed_lossy:
+    ints_acc_ = new DistArray4_Compressed(num_te_types(),
+                                          space1()->rank(), space3()->rank(), space2()->rank(), space4()->rank(),
+                                          compression_tolerance(), DistArray4Storage_YX);
+    break;
+
 #ifdef HAVE_MPIIO
   case MOIntsTransform::StoreMethod::mem_mpi:
     // if can do in one pass, use the factory hints about how data will be used
@@ -29,6 +29,8 @@
 #include<chemistry/qc/lcao/transform_ijR.h>
 #include <math/distarray4/distarray4_memgrp.h>
 #include <math/distarray4/distarray4_node0file.h>
+#include <math/distarray4/distarray4_mmapfile.h>
+#include <math/distarray4/distarray4_compressed.h>
 #ifdef HAVE_MPIIO
 #  include <math/distarray4/distarray4_mpiiofile.h>
 #endif
@@ -182,6 +184,18 @@ TwoBodyThreeCenterMOIntsTransform_ijR::init_acc() {
                                          1, space1()->rank(), space2()->rank(), space3()->rank());
     break;
 
+  case MOIntsTransform::StoreMethod::mmap:
+    ints_acc_ = new DistArray4_MMapFile((file_prefix_+"."+name_).c_str(), num_te_types(),
+                                        1, space1()->rank(), space2()->rank(), space3()->rank());
+    break;
+
+  case MOIntsTransform::StoreMethod::compressed:
+  case MOIntsTransform::StoreMethod::compressed_lossy:
+    ints_acc_ = new DistArray4_Compressed(num_te_types(),
+                                          1, space1()->rank(), space2()->rank(), space3()->rank(),
+                                          compression_tolerance());
+    break;
+
 #ifdef HAVE_MPIIO
   case MOIntsTransform::StoreMethod::mem_mpi:
     // if can do in one pass, use the factory hints about how data will be used
@@ -44,6 +44,8 @@
 #include <cassert>
 
 #include <math/distarray4/distarray4_node0file.h>
+#include <math/distarray4/distarray4_mmapfile.h>
+#include <math/distarray4/distarray4_compressed.h>
 
 // set to 1 when finished rewriting DistArray4_MPIIO
 #define HAVE_R12IA_MPIIO 1
@@ -123,7 +125,8 @@ TwoBodyMOIntsTransform_ikjy::compute_transform_dynamic_memory_(int ni) const
   const distsize_t memsize_memgrp = num_te_types() * nij * (distsize_t) memgrp_blksize();
 
   // determine the peak memory requirements
-  return memsize_memgrp + std::max(memsize123,memsize4);
+  // DistArray4_Compressed holds all integrals on node 0, in addition to the batch
+  return memsize_memgrp + std::max(memsize123,memsize4) + compressed_ints_memory();
 }
 
 size_t
@@ -189,6 +192,18 @@ TwoBodyMOIntsTransform_ikjy::init_acc()
                                          space1_->rank(), space3_->rank(), space2_->rank(), space4_->rank());
     break;
 
+  case MOIntsTransform::StoreMethod::mmap:
+    ints_acc_ = new DistArray4_MMapFile((file_prefix_+"."+name_).c_str(), num_te_types(),
+                                        space1_->rank(), space3_->rank(), space2_->rank(), space4_->rank());
+    break;
+
+  case MOIntsTransform::StoreMethod::compressed:
+  case MOIntsTransform::StoreMethod::compressed_lossy:
+    ints_acc_ = new DistArray4_Compressed(num_te_types(),
+                                          space1_->rank(), space3_->rank(), space2_->rank(), space4_->rank(),
+                                          compression_tolerance());
+    break;
+
 #ifdef HAVE_MPIIO
   case MOIntsTransform::StoreMethod::mem_mpi:
     try {
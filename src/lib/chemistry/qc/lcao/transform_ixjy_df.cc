@@ -49,6 +49,8 @@
 #include <cassert>
 
 #include <math/distarray4/distarray4_node0file.h>
+#include <math/distarray4/distarray4_mmapfile.h>
+#include <math/distarray4/distarray4_compressed.h>
 #ifdef HAVE_MPIIO
 #  include <math/distarray4/distarray4_mpiiofile.h>
 #endif
@@ -118,6 +120,7 @@ distsize_t
 TwoBodyMOIntsTransform_ixjy_df::compute_transform_dynamic_memory_(int ni) const
 {
   const bool ints_held_on_disk = (this->ints_method_ == MOIntsTransform::StoreMethod::posix) ||
+                                 (this->ints_method_ == MOIntsTransform::StoreMethod::mmap) ||
                                  (this->ints_method_ == MOIntsTransform::StoreMethod::mpi);
 
   TwoBodyOperSet::type oset = intdescr()->operset();
@@ -144,7 +147,8 @@ TwoBodyMOIntsTransform_ixjy_df::compute_transform_dynamic_memory_(int ni) const
   }
 
   // determine the peak memory requirements
-  return memsize_memgrp;
+  // DistArray4_Compressed holds all integrals on node 0, in addition to the batch
+  return memsize_memgrp + compressed_ints_memory();
 }
 
 size_t
@@ -211,6 +215,18 @@ TwoBodyMOIntsTransform_ixjy_df::init_acc()
                                          space1_->rank(), space3_->rank(), space2_->rank(), space4_->rank());
     break;
 
+  case MOIntsTransform::StoreMethod::mmap:
+    ints_acc_ = new DistArray4_MMapFile((file_prefix_+"."+name_).c_str(), num_te_types(),
+                                        space1_->rank(), space3_->rank(), space2_->rank(), space4_->rank());
+    break;
+
+  case MOIntsTransform::StoreMethod::compressed:
+  case MOIntsTransform::StoreMethod::compressed_lossy:
+    ints_acc_ = new DistArray4_Compressed(num_te_types(),
+                                          space1_->rank(), space3_->rank(), space2_->rank(), space4_->rank(),
+                                          compression_tolerance());
+    break;
+
 #ifdef HAVE_MPIIO
   case MOIntsTransform::StoreMethod::mem_mpi:
     try {
@@ -25,6 +25,7 @@
 // The U.S. Government is granted a limited license as per AL 91-7.
 //
 
+#include <cmath>
 #include <stdexcept>
 #include <sstream>
 #include <cassert>
@@ -34,6 +35,7 @@
 #include <util/state/state_bin.h>
 #include <util/ref/ref.h>
 #include <math/scmat/local.h>
+#include <math/distarray4/distarray4_compressed.h>
 #include <chemistry/qc/basis/integral.h>
 #include <chemistry/qc/basis/tbint.h>
 #include <chemistry/qc/lcao/transform_tbint.h>
@@ -193,6 +195,22 @@ TwoBodyMOIntsTransform::set_log2_epsilon(double prec) {
   log2_epsilon_ = prec;
 }
 
+distsize_t
+TwoBodyMOIntsTransform::compressed_ints_memory() const {
+  if (ints_method_ != MOIntsTransform::StoreMethod::compressed &&
+      ints_method_ != MOIntsTransform::StoreMethod::compressed_lossy)
+    return 0;
+  // a pair block of space1 and space3 holds the integrals of space2 and space4
+  const size_t blksize = DistArray4_Compressed::estimated_block_size(
+      (size_t)space2_->rank() * space4_->rank(), compression_tolerance());
+  return (distsize_t)num_te_types() * space1_->rank() * space3_->rank() * blksize;
+}
+
+double
+TwoBodyMOIntsTransform::compression_tolerance() const {
+  return (ints_method_ == MOIntsTransform::StoreMethod::compressed_lossy) ? pow(2.0, log2_epsilon_) : 0.0;
+}
+
 ///////////////////////////////////////////////////////
 // Compute the batchsize for the transformation
 //
@@ -286,9 +304,9 @@ TwoBodyMOIntsTransform::init_vars()
     memory_ = static_memory_ + mem_dyn;
     peak_memory_ = memory_;
   }
-  else { // data is held elsewhere
-    memory_ = static_memory_;
-    peak_memory_ = memory_ + mem_dyn;
+  else { // data is held elsewhere, or compressed on node 0
+    memory_ = static_memory_ + distsize_to_size(compressed_ints_memory());
+    peak_memory_ = static_memory_ + mem_dyn;
   }
 }
 
@@ -519,6 +537,11 @@ TwoBodyThreeCenterMOIntsTransform::set_log2_epsilon(double prec) {
   log2_epsilon_ = prec;
 }
 
+double
+TwoBodyThreeCenterMOIntsTransform::compression_tolerance() const {
+  return (ints_method_ == MOIntsTransform::StoreMethod::compressed_lossy) ? pow(2.0, log2_epsilon_) : 0.0;
+}
+
 void
 TwoBodyThreeCenterMOIntsTransform::init_vars()
 {
@@ -57,6 +57,11 @@ private:
   virtual distsize_t compute_transform_dynamic_memory_(int ni) const = 0;
 
 protected:
+  /** The memory that DistArray4_Compressed is estimated to hold on node 0 for all
+      integrals of this transform, 0 if the integrals are not stored compressed.
+      \sa DistArray4_Compressed::estimated_block_size() */
+  distsize_t compressed_ints_memory() const;
+
   /** By default, integrals smaller than zero_integral are considered zero.
       This constant is only used in checking integrals, not computing them. */
   static double zero_integral;
@@ -181,6 +186,9 @@ public:
   double log2_epsilon() const { return log2_epsilon_; }
   /// \sa log2_epsilon()
   void set_log2_epsilon(double prec);
+  /// The maximum absolute error of the stored integrals: \f$ \epsilon \f$ if they are stored
+  /// with StoreMethod::compressed_lossy, else 0
+  double compression_tolerance() const;
 
   /// Supplies the partially transformed integrals.
   virtual void partially_transformed_ints(const Ref<DistArray4>&);
@@ -276,6 +284,8 @@ class TwoBodyThreeCenterMOIntsTransform: virtual public SavableState {
     double log2_epsilon() const { return log2_epsilon_; }
     /// \sa log2_epsilon()
     void set_log2_epsilon(double prec);
+    /// \sa TwoBodyMOIntsTransform::compression_tolerance()
+    double compression_tolerance() const;
 
     /// Returns amount of memory used by this object after compute() has been called
     size_t memory() const;
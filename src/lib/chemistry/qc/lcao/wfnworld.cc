@@ -59,7 +59,7 @@ namespace {
   WavefunctionWorld
  ---------------*/
 static ClassDesc WavefunctionWorld_cd(
-  typeid(WavefunctionWorld),"WavefunctionWorld",12,"virtual public SavableState",
+  typeid(WavefunctionWorld),"WavefunctionWorld",13,"virtual public SavableState",
   0, create<WavefunctionWorld>, create<WavefunctionWorld>);
 
 WavefunctionWorld::WavefunctionWorld(const Ref<KeyVal>& keyval)
@@ -115,6 +115,15 @@ WavefunctionWorld::WavefunctionWorld(const Ref<KeyVal>& keyval)
   else if (ints_str == std::string("mem-posix")) {
     ints_method_ = StoreMethod::mem_posix;
   }
+  else if (ints_str == std::string("mmap")) {
+    ints_method_ = StoreMethod::mmap;
+  }
+  else if (ints_str == std::string("compressed")) {
+    ints_method_ = StoreMethod::compressed;
+  }
+  else if (ints_str == std::string("compressed-lossy")) {
+    ints_method_ = StoreMethod::compressed_lossy;
+  }
   else if (ints_str == std::string("mpi")) {
 #ifdef HAVE_MPIIO
     ints_method_ = StoreMethod::mpi;
@@ -154,6 +163,9 @@ WavefunctionWorld::WavefunctionWorld(const Ref<KeyVal>& keyval)
   // the default will indicate that ints_precision will be determined heuristically
   ints_precision_ = keyval->doublevalue("ints_precision", KeyValValuedouble(DBL_MAX));
 
+  // disk space for the AO integrals of multi-pass transforms
+  aoints_store_size_ = keyval->sizevalue("aoints_store", KeyValValuesize(0));
+
   // world should have their own communicators, thus currently only one world will work
   mem_ = MemoryGrp::get_default_memorygrp();
   msg_ = MessageGrp::get_default_messagegrp();
@@ -203,6 +215,14 @@ WavefunctionWorld::WavefunctionWorld(StateIn& si) : SavableState(si)
 
   bs_df_ << SavableState::restore_state(si);
 
+  if (si.version(::class_desc<WavefunctionWorld>()) >= 13) {
+    double daoints_store_size;
+    si.get(daoints_store_size);
+    aoints_store_size_ = size_t(daoints_store_size);
+  }
+  else
+    aoints_store_size_ = 0;
+
   // allocate MemoryGrp storage if will use it for integrals
   if (ints_method_ == StoreMethod::mem_only ||
       ints_method_ == StoreMethod::mem_posix ||
@@ -233,6 +253,8 @@ void WavefunctionWorld::save_data_state(StateOut& so)
   SavableState::save_state(fockbuild_runtime_.pointer(),so);
   so.put(df_);
   SavableState::save_state(bs_df_.pointer(),so);
+  double daoints_store_size = aoints_store_size_;
+  so.put(daoints_store_size);
 }
 
 void
@@ -257,6 +279,7 @@ WavefunctionWorld::initialize()
   tfactory_->set_dynamic(dynamic_);
   tfactory_->set_ints_method(ints_method_);
   tfactory_->set_file_prefix(ints_file_);
+  tfactory_->set_aoints_store_size(aoints_store_size_);
   double tfactory_ints_precision;
   if (ints_precision_ != DBL_MAX) { // precision provided in the constructor -- override wfn
     tfactory_ints_precision = ints_precision_;
@@ -372,6 +395,12 @@ WavefunctionWorld::print(std::ostream& o) const {
     ints_str = std::string("mem-posix"); break;
   case WavefunctionWorld::StoreMethod::posix:
     ints_str = std::string("posix"); break;
+  case WavefunctionWorld::StoreMethod::mmap:
+    ints_str = std::string("mmap"); break;
+  case WavefunctionWorld::StoreMethod::compressed:
+    ints_str = std::string("compressed"); break;
+  case WavefunctionWorld::StoreMethod::compressed_lossy:
+    ints_str = std::string("compressed-lossy"); break;
 #ifdef HAVE_MPIIO
   case WavefunctionWorld::StoreMethod::mem_mpi:
     ints_str = std::string("mem-mpi"); break;
@@ -59,6 +59,16 @@ public:
       <dt><tt>posix</tt><dd> Store integrals in a binary file on task 0's node using POSIX I/O.
       This method does not allow all steps to be parallelized but it is most likely to work in all environments.
 
+      <dt><tt>mmap</tt><dd> Store integrals in a binary file that is memory-mapped by all tasks
+      if they run on one host (else by task 0 only). Blocks of integrals are accessed without copying
+      and the page cache is shared among the tasks.
+
+      <dt><tt>compressed</tt><dd> Store integrals in task 0's memory, each block compressed losslessly.
+      Like <tt>posix</tt>, only task 0 has access to the integrals.
+
+      <dt><tt>compressed-lossy</tt><dd> As <tt>compressed</tt>, but the integrals are stored with absolute error
+      not exceeding <tt>ints_precision</tt>, which usually gives much better compression.
+
       <dt><tt>mpi</tt><dd> Store integrals in a binary file using MPI-I/O. This method allows
       parallelization of all steps, but requires MPI-I/O capability (including MPI-I/O capable file system;
       see keyword <tt>ints_file</tt>)
@@ -83,6 +93,12 @@ public:
     If MPI-I/O is used then it is user's responsibility to ensure
     that the file resides on a file system that supports MPI-I/O.
 
+    <dt><tt>aoints_store</tt><dd> The disk space, in bytes per process, that a multi-pass
+    transform (currently the ixjy transform) may use to keep the AO integrals computed in its
+    first pass. They are kept in scratch files that start with the <tt>ints_file</tt> prefix,
+    and the later passes read them instead of computing them again.
+    The default is 0, which turns this off.
+
     <dt><tt>df</tt><dd> This optional boolean specifies whether to perform density fitting.
     The default is to not perform density fitting, unless <tt>df_basis</tt> is provided.
     @note The default is likely to change before MPQC 3 release.
@@ -164,6 +180,8 @@ public:
   StoreMethod::type ints_method() const { return ints_method_; };
   const std::string& ints_file() const;
   double ints_precision() const { return ints_precision_; }
+  /// the disk space, in bytes per process, for the AO integrals of multi-pass transforms
+  size_t aoints_store_size() const { return aoints_store_size_; }
 
   /// Returns the MOIntsTransformFactory object
   const Ref<MOIntsTransformFactory>& tfactory() const { return tfactory_; };
@@ -200,6 +218,7 @@ private:
   StoreMethod::type ints_method_;
   std::string ints_file_;
   double ints_precision_;
+  size_t aoints_store_size_;
 
   /// The transform factory
   Ref<MOIntsTransformFactory> tfactory_;
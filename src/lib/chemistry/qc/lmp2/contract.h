@@ -28,8 +28,11 @@
 #include <chemistry/qc/lmp2/dgemminfo.h>
 
 #include <stdexcept>
+#include <atomic>
+#include <vector>
 
 #include <math/scmat/blas.h>
+#include <util/group/thread.h>
 
 #define USE_BOUNDS_IN_CONTRACT_UNION 1
 
@@ -313,6 +316,262 @@ repack(Array<N> &A, const IndexList &row_indices, const IndexList &col_indices,
   delete[] tmp_data;
 }
 
+/** Computes the contributions of all pairs of A and B blocks to given
+    blocks of C for contract().  Each C block is independent of all others,
+    hence different C blocks can be processed concurrently.  Only const
+    lookups are performed on the block map of A and the block index of B.
+ */
+template <int NC, int NA, int NB>
+class ContractCBlocks {
+    const Array<NC> &C_;
+    const Array<NA> &A_;
+    const Array<NB> &B_;
+    const typename Array<NA>::cached_blockmap_t &remappedAbm_;
+#ifdef USE_HASH
+    const typename Array<NB>::blockhash_t &Bbh_;
+#else
+    const BlockIndex<NB> &Bindex_;
+#endif
+    const IndexList &extCA_, &extCB_, &extA_, &extB_, &intA_, &intB_;
+    BlockInfo<NA> Abi_;
+    BlockInfo<NB> Bbi_;
+    bool transpose_A_, transpose_B_, transpose_C_;
+    double ABfactor_;
+  public:
+    ContractCBlocks(const Array<NC> &C, const Array<NA> &A, Array<NB> &B,
+                    const typename Array<NA>::cached_blockmap_t &remappedAbm,
+                    const IndexList &extCA, const IndexList &extCB,
+                    const IndexList &extA, const IndexList &extB,
+                    const IndexList &intA, const IndexList &intB,
+                    const IndexList &fixA, const BlockInfo<NA> &fixvalA,
+                    const IndexList &fixB, const BlockInfo<NB> &fixvalB,
+                    const RepackScheme<NC,NA,NB> &repack_scheme,
+                    double ABfactor):
+      C_(C), A_(A), B_(B), remappedAbm_(remappedAbm),
+#ifdef USE_HASH
+      Bbh_(B.blockhash()),
+#else
+      Bindex_(B.block_index()),
+#endif
+      extCA_(extCA), extCB_(extCB), extA_(extA), extB_(extB),
+      intA_(intA), intB_(intB),
+      transpose_A_(repack_scheme.transpose_A()),
+      transpose_B_(repack_scheme.transpose_B()),
+      transpose_C_(repack_scheme.transpose_C()),
+      ABfactor_(ABfactor) {
+      Abi_.assign_blocks(fixA,fixvalA);
+      Bbi_.zero();
+      Bbi_.assign_blocks(fixB,fixvalB);
+    }
+
+    /// Accumulates A * B into the C block Cbi whose data is Cdata.
+    void operator()(const BlockInfo<NC> &Cbi, double *Cdata,
+                    sc::RegionTimer *timer = 0) const {
+      BlockInfo<NA> Abi(Abi_);
+      BlockInfo<NB> Bbi(Bbi_);
+      Abi.assign_blocks(extA_, Cbi, extCA_);
+      std::pair<
+          typename Array<NA>::cached_blockmap_t::const_iterator,
+          typename Array<NA>::cached_blockmap_t::const_iterator >
+          rangeA;
+#ifdef USE_BOUND
+      // cannot use equal range on remappedA because bound is used to sort
+      // rangeA = remappedAbm.equal_range(Abi);
+      Abi.set_bound(DBL_MAX);
+      rangeA.first = remappedAbm_.lower_bound(Abi);
+      Abi.set_bound(0.0);
+      rangeA.second = remappedAbm_.upper_bound(Abi);
+#else
+      rangeA = remappedAbm_.equal_range(Abi);
+#endif
+      typename Array<NA>::cached_blockmap_t::const_iterator
+          firstA = rangeA.first,
+          fenceA = rangeA.second;
+      Bbi.assign_blocks(extB_, Cbi, extCB_);
+      blasint n_extB = Cbi.subset_size(C_.indices(), extCB_);
+      blasint n_extA = Cbi.subset_size(C_.indices(), extCA_);
+#ifdef USE_HASH
+      typename Array<NB>::blockhash_t::const_iterator Biter;
+#endif
+      if (timer) timer->enter("A loop");
+      for (typename Array<NA>::cached_blockmap_t::const_iterator
+               Aiter = firstA;
+           Aiter != fenceA;
+           Aiter++) {
+          const BlockInfo<NA> &Abi = Aiter->first;
+          double *Adata = Aiter->second;
+          Bbi.assign_blocks(intB_, Abi, intA_);
+#ifdef USE_HASH
+          Biter = Bbh_.find(Bbi);
+          if (Biter == Bbh_.end()) continue;
+          double *Bdata = Biter->second;
+#else
+          double *Bdata = Bindex_.find(Bbi);
+          if (Bdata == 0) continue;
+#endif
+          blasint n_int = Abi.subset_size(A_.indices(), intA_);
+
+          double one = 1.0;
+          double ABfactor = ABfactor_;
+          if (timer) timer->enter("dgemm");
+
+#ifdef USE_COUNT_DGEMM
+          double t0 = cpu_walltime();
+#endif
+
+          if (n_extA == 1 && n_int == 1) {
+              double tmp = ABfactor * Adata[0];
+              for (int i=0; i<n_extB; i++) {
+                  Cdata[i] += tmp*Bdata[i];
+                }
+            }
+          else if (n_extA == 1 && n_extB == 1) {
+              double tmp = 0.0;
+              for (int i=0; i<n_int; i++) {
+                  tmp += Adata[i]*Bdata[i];
+                }
+              Cdata[0] += ABfactor*tmp;
+            }
+          else if (n_int == 1 && n_extB == 1) {
+              double tmp = ABfactor*Bdata[0];
+              for (int i=0; i<n_extA; i++) {
+                  Cdata[i] += Adata[i]*tmp;
+                }
+            }
+          else if (n_int == 1) {
+              if (transpose_C_) {
+                  for (int i=0,ij=0; i<n_extB; i++) {
+                      for (int j=0; j<n_extA; j++,ij++) {
+                          Cdata[ij] += ABfactor*Adata[j]*Bdata[i];
+                        }
+                    }
+                }
+              else {
+                  for (int i=0,ij=0; i<n_extA; i++) {
+                      for (int j=0; j<n_extB; j++,ij++) {
+                          Cdata[ij] += ABfactor*Adata[i]*Bdata[j];
+                        }
+                    }
+                }
+            }
+          else if (n_extA == 1) {
+              if (transpose_B_) {
+                  for (int i=0,ij=0; i<n_extB; i++) {
+                      double tmp = 0.0;
+                      for (int j=0; j<n_int; j++,ij++) {
+                          tmp += Adata[j]*Bdata[ij];
+                        }
+                      Cdata[i] += tmp * ABfactor;
+                    }
+                }
+              else {
+                  for (int i=0; i<n_extB; i++) {
+                      double tmp = 0.0;
+                      for (int j=0,ij=i; j<n_int; j++,ij+=n_extB) {
+                          tmp += Adata[j]*Bdata[ij];
+                        }
+                      Cdata[i] += tmp * ABfactor;
+                    }
+                }
+            }
+          else if (n_extB == 1) {
+              if (transpose_A_) {
+                  for (int i=0; i<n_extA; i++) {
+                      double tmp = 0.0;
+                      for (int j=0,ij=i; j<n_int; j++,ij+=n_extA) {
+                          tmp += Bdata[j]*Adata[ij];
+                        }
+                      Cdata[i] += tmp * ABfactor;
+                    }
+                }
+              else {
+                  for (int i=0,ij=0; i<n_extA; i++) {
+                      double tmp = 0.0;
+                      for (int j=0; j<n_int; j++,ij++) {
+                          tmp += Bdata[j]*Adata[ij];
+                        }
+                      Cdata[i] += tmp * ABfactor;
+                    }
+                }
+            }
+          else if (transpose_C_) {
+              const char *tA = "T";
+              blasint lda = n_int;
+              if (transpose_A_) { tA = "N"; lda = n_extA; }
+
+              const char *tB = "T";
+              blasint ldb = n_extB;
+              if (transpose_B_) { tB = "N"; ldb = n_int; }
+
+              blasint ldc = n_extA;
+
+//               std::cout << " tA: " << tA
+//                         << " tB: " << tB
+//                         << " nr: " << n_extA
+//                         << " nc: " << n_extB
+//                         << " nl: " << n_int
+//                         << " lda: " << lda
+//                         << " ldb: " << ldb
+//                         << " ldc: " << ldc
+//                         << std::endl;
+
+              F77_DGEMM(tA, tB, &n_extA, &n_extB, &n_int,
+                        &ABfactor,Adata,&lda,Bdata,&ldb,
+                        &one,Cdata,&ldc);
+            }
+          else {
+              const char *tA = "N";
+              blasint lda = n_int;
+              if (transpose_A_) { tA = "T"; lda = n_extA; }
+
+              const char *tB = "N";
+              blasint ldb = n_extB;
+              if (transpose_B_) { tB = "T"; ldb = n_int; }
+
+              blasint ldc = n_extB;
+
+              F77_DGEMM(tB, tA, &n_extB, &n_extA, &n_int,
+                        &ABfactor,Bdata,&ldb,Adata,&lda,
+                        &one,Cdata,&ldc);
+            }
+#ifdef USE_COUNT_DGEMM
+          count_dgemm(n_extA, n_int, n_extB,
+                      cpu_walltime()-t0);
+#endif
+          if (timer) timer->exit();
+        }
+      if (timer) timer->exit();
+    }
+};
+
+/** Processes the C blocks for contract() on one thread of a ThreadGrp.
+    The blocks are handed out dynamically in batches of consecutive blocks,
+    so that threads work on nearby blocks of A and B. */
+template <int NC, int NA, int NB>
+class ContractThread: public sc::Thread {
+    const ContractCBlocks<NC,NA,NB> &kernel_;
+    const std::vector<typename Array<NC>::blockmap_t::const_iterator> &Cblocks_;
+    std::atomic<size_t> &next_batch_;
+    size_t batch_size_;
+  public:
+    ContractThread(const ContractCBlocks<NC,NA,NB> &kernel,
+                   const std::vector<typename Array<NC>::blockmap_t::const_iterator> &Cblocks,
+                   std::atomic<size_t> &next_batch, size_t batch_size):
+      kernel_(kernel), Cblocks_(Cblocks),
+      next_batch_(next_batch), batch_size_(batch_size) {}
+    void run() {
+      while (true) {
+          const size_t begin = batch_size_ * next_batch_++;
+          if (begin >= Cblocks_.size()) break;
+          const size_t end = std::min(begin + batch_size_, Cblocks_.size());
+          for (size_t i=begin; i<end; i++) {
+              typename Array<NC>::blockmap_t::const_iterator Citer = Cblocks_[i];
+              kernel_(Citer->first, Citer->second);
+            }
+        }
+    }
+};
+
 /** Perform a contraction.
     The contraction C += f * A * B is computed, where C, A, and B
     are arrays and f is a scalar.  A and B can have fixed indices;
@@ -541,27 +800,15 @@ contract(
     }
 #endif
 
-  const typename Array<NB>::blockmap_t &
-      Bbm = B.blockmap();
-#ifdef USE_HASH
-  const typename Array<NB>::blockhash_t &
-      Bbh = B.blockhash();
-#endif
+  ContractCBlocks<NC,NA,NB> contract_C_blocks(C, A, B, remappedAbm,
+                                               extCA, extCB, extA, extB,
+                                               intA, intB,
+                                               fixA, fixvalA, fixB, fixvalB,
+                                               repack_scheme, ABfactor);
+
   const typename Array<NC>::blockmap_t &
       Cbm = C.blockmap();
 
-  BlockInfo<NA> Abi;
-  Abi.assign_blocks(fixA,fixvalA);
-
-  BlockInfo<NB> Bbi;
-  Bbi.zero();
-  Bbi.assign_blocks(fixB,fixvalB);
-
-#ifndef USE_HASH
-  typename Array<NB>::blockmap_t::const_iterator B_fixed_hint
-      = Bbm.lower_bound(Bbi);
-#endif
-
   typename Array<NC>::blockmap_t::const_iterator C_begin, C_end;
   BlockInfo<NC> Cbi_lb;
   BlockInfo<NC> Cbi_ub;
@@ -575,194 +822,42 @@ contract(
   C_end = Cbm.upper_bound(Cbi_ub);
 
   if (timer) timer->enter("C loop");
-  for (typename Array<NC>::blockmap_t::const_iterator
-           Citer = C_begin;
-       Citer != C_end;
-       Citer++) {
-      const BlockInfo<NC> &Cbi = Citer->first;
-      double *Cdata = Citer->second;
-      Abi.assign_blocks(extA, Cbi, extCA);
-      std::pair<
-          typename Array<NA>::cached_blockmap_t::const_iterator,
-          typename Array<NA>::cached_blockmap_t::const_iterator >
-          rangeA;
-#ifdef USE_BOUND
-      // cannot use equal range on remappedA because bound is used to sort
-      // rangeA = remappedAbm.equal_range(Abi);
-      Abi.set_bound(DBL_MAX);
-      rangeA.first = remappedAbm.lower_bound(Abi);
-      Abi.set_bound(0.0);
-      rangeA.second = remappedAbm.upper_bound(Abi);
-#else
-      rangeA = remappedAbm.equal_range(Abi);
-#endif
-      typename Array<NA>::cached_blockmap_t::const_iterator
-          firstA = rangeA.first,
-          fenceA = rangeA.second;
-      Bbi.assign_blocks(extB, Cbi, extCB);
-      blasint n_extB = Cbi.subset_size(C.indices(), extCB);
-      blasint n_extA = Cbi.subset_size(C.indices(), extCA);
-#ifdef USE_HASH
-      typename Array<NB>::blockhash_t::const_iterator Biter;
-#else
-      typename Array<NB>::blockmap_t::const_iterator Biter = Bbm.begin();
-#endif
-      if (timer) timer->enter("A loop");
-      for (typename Array<NA>::cached_blockmap_t::const_iterator
-               Aiter = firstA;
-           Aiter != fenceA;
-           Aiter++) {
-          const BlockInfo<NA> &Abi = Aiter->first;
-          double *Adata = Aiter->second;
-          Bbi.assign_blocks(intB, Abi, intA);
-#ifdef USE_HASH
-          Biter = Bbh.find(Bbi);
-          if (Biter == Bbh.end()) continue;
-#else
-          if (fixB.n() > 0) {
-#if USE_STL_MULTIMAP
-              Biter = Bbm.find(Bbi);
-#else
-              Biter = Bbm.find(B_fixed_hint, Bbi);
-#endif
-            }
-          else {
-              //blindly using a hint here makes this a bit slower
-              //Biter = Bbm.find(Biter, Bbi);
-              Biter = Bbm.find(Bbi);
-            }
-          if (Biter == Bbm.end()) continue;
-#endif
-          double *Bdata = Biter->second;
-          blasint n_int = Abi.subset_size(A.indices(), intA);
-
-          double one = 1.0;
-          if (timer) timer->enter("dgemm");
-
-          double t0 = cpu_walltime();
-
-          if (n_extA == 1 && n_int == 1) {
-              double tmp = ABfactor * Adata[0];
-              for (int i=0; i<n_extB; i++) {
-                  Cdata[i] += tmp*Bdata[i];
-                }
-            }
-          else if (n_extA == 1 && n_extB == 1) {
-              double tmp = 0.0;
-              for (int i=0; i<n_int; i++) {
-                  tmp += Adata[i]*Bdata[i];
-                }
-              Cdata[0] += ABfactor*tmp;
-            }
-          else if (n_int == 1 && n_extB == 1) {
-              double tmp = ABfactor*Bdata[0];
-              for (int i=0; i<n_extA; i++) {
-                  Cdata[i] += Adata[i]*tmp;
-                }
-            }
-          else if (n_int == 1) {
-              if (repack_scheme.transpose_C()) {
-                  for (int i=0,ij=0; i<n_extB; i++) {
-                      for (int j=0; j<n_extA; j++,ij++) {
-                          Cdata[ij] += ABfactor*Adata[j]*Bdata[i];
-                        }
-                    }
-                }
-              else {
-                  for (int i=0,ij=0; i<n_extA; i++) {
-                      for (int j=0; j<n_extB; j++,ij++) {
-                          Cdata[ij] += ABfactor*Adata[i]*Bdata[j];
-                        }
-                    }
-                }
-            }
-          else if (n_extA == 1) {
-              if (repack_scheme.transpose_B()) {
-                  for (int i=0,ij=0; i<n_extB; i++) {
-                      double tmp = 0.0;
-                      for (int j=0; j<n_int; j++,ij++) {
-                          tmp += Adata[j]*Bdata[ij];
-                        }
-                      Cdata[i] += tmp * ABfactor;
-                    }
-                }
-              else {
-                  for (int i=0; i<n_extB; i++) {
-                      double tmp = 0.0;
-                      for (int j=0,ij=i; j<n_int; j++,ij+=n_extB) {
-                          tmp += Adata[j]*Bdata[ij];
-                        }
-                      Cdata[i] += tmp * ABfactor;
-                    }
-                }
-            }
-          else if (n_extB == 1) {
-              if (repack_scheme.transpose_A()) {
-                  for (int i=0; i<n_extA; i++) {
-                      double tmp = 0.0;
-                      for (int j=0,ij=i; j<n_int; j++,ij+=n_extA) {
-                          tmp += Bdata[j]*Adata[ij];
-                        }
-                      Cdata[i] += tmp * ABfactor;
-                    }
-                }
-              else {
-                  for (int i=0,ij=0; i<n_extA; i++) {
-                      double tmp = 0.0;
-                      for (int j=0; j<n_int; j++,ij++) {
-                          tmp += Bdata[j]*Adata[ij];
-                        }
-                      Cdata[i] += tmp * ABfactor;
-                    }
-                }
-            }
-          else if (repack_scheme.transpose_C()) {
-              const char *tA = "T";
-              blasint lda = n_int;
-              if (repack_scheme.transpose_A()) { tA = "N"; lda = n_extA; }
-
-              const char *tB = "T";
-              blasint ldb = n_extB;
-              if (repack_scheme.transpose_B()) { tB = "N"; ldb = n_int; }
-
-              blasint ldc = n_extA;
-
-//               std::cout << " tA: " << tA
-//                         << " tB: " << tB
-//                         << " nr: " << n_extA
-//                         << " nc: " << n_extB
-//                         << " nl: " << n_int
-//                         << " lda: " << lda
-//                         << " ldb: " << ldb
-//                         << " ldc: " << ldc
-//                         << std::endl;
-
-              F77_DGEMM(tA, tB, &n_extA, &n_extB, &n_int,
-                        &ABfactor,Adata,&lda,Bdata,&ldb,
-                        &one,Cdata,&ldc);
-            }
-          else {
-              const char *tA = "N";
-              blasint lda = n_int;
-              if (repack_scheme.transpose_A()) { tA = "T"; lda = n_extA; }
-
-              const char *tB = "N";
-              blasint ldb = n_extB;
-              if (repack_scheme.transpose_B()) { tB = "T"; ldb = n_int; }
-
-              blasint ldc = n_extB;
-
-              F77_DGEMM(tB, tA, &n_extB, &n_extA, &n_int,
-                        &ABfactor,Bdata,&ldb,Adata,&lda,
-                        &one,Cdata,&ldc);
-            }
+  const sc::Ref<sc::ThreadGrp> &thr = contract_threadgrp();
+  int nthread = thr.null() ? 1 : thr->nthread();
 #ifdef USE_COUNT_DGEMM
-          count_dgemm(n_extA, n_int, n_extB,
-                      cpu_walltime()-t0);
+  nthread = 1; // count_dgemm is not reentrant
 #endif
-          if (timer) timer->exit();
+  std::vector<typename Array<NC>::blockmap_t::const_iterator> Cblocks;
+  if (nthread > 1) {
+      for (typename Array<NC>::blockmap_t::const_iterator
+               Citer = C_begin;
+           Citer != C_end;
+           Citer++) {
+          Cblocks.push_back(Citer);
+        }
+    }
+  if (Cblocks.size() > 1) {
+      // several batches per thread to balance the load
+      const size_t batch_size
+          = std::max(size_t(1), Cblocks.size() / (contract_batches_per_thread * nthread));
+      std::atomic<size_t> next_batch(0);
+      std::vector<ContractThread<NC,NA,NB>*> threads(nthread);
+      for (int i=0; i<nthread; i++) {
+          threads[i] = new ContractThread<NC,NA,NB>(contract_C_blocks, Cblocks,
+                                                     next_batch, batch_size);
+          thr->add_thread(i, threads[i]);
+        }
+      thr->start_threads();
+      thr->wait_threads();
+      for (int i=0; i<nthread; i++) delete threads[i];
+    }
+  else {
+      for (typename Array<NC>::blockmap_t::const_iterator
+               Citer = C_begin;
+           Citer != C_end;
+           Citer++) {
+          contract_C_blocks(Citer->first, Citer->second, timer.pointer());
         }
-      if (timer) timer->exit();
     }
   if (timer) timer->exit();
   
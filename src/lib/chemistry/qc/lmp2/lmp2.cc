@@ -37,6 +37,7 @@
 #include <util/group/message.h>
 #include <util/group/mstate.h>
 #include <util/group/pregtime.h>
+#include <util/group/thread.h>
 #include <util/state/state_bin.h>
 #include <util/misc/scexception.h>
 #include <chemistry/qc/scf/scf.h>
@@ -288,7 +289,17 @@ LMP2::compute(void)
   ref_->set_desired_value_accuracy(desired_value_accuracy()
                                    / extra_hf_acc);
   double refenergy = ref_->energy();
-  double lmp2energy = compute_lmp2_energy();
+  // let the block-sparse contractions use all threads
+  sma2::set_contract_threadgrp(ThreadGrp::get_default_threadgrp());
+  double lmp2energy;
+  try {
+      lmp2energy = compute_lmp2_energy();
+    }
+  catch (...) {
+      sma2::set_contract_threadgrp(0);
+      throw;
+    }
+  sma2::set_contract_threadgrp(0);
 
   double totalenergy = refenergy + lmp2energy;
 
@@ -773,6 +784,9 @@ LMP2::compute_K_2occ(sc::RefSCMatrix &T_schwarz, sc::RefSCVector &T_schwarz_maxv
       final_q2_K_oo = &q2_K_oo_redist;
     }
   else {
+      // the blocks of q2_K_oo were allocated one at a time; they are
+      // packed in chunks, so the copy does not double its memory use
+      q2_K_oo.pack_blocks();
       final_q2_K_oo = &q2_K_oo;
     }
       
@@ -29,6 +29,20 @@ namespace sc {
 
 namespace sma2 {
 
+    static sc::Ref<sc::ThreadGrp> contract_threadgrp_;
+
+    void
+    set_contract_threadgrp(const sc::Ref<sc::ThreadGrp> &thr)
+    {
+      contract_threadgrp_ = thr;
+    }
+
+    const sc::Ref<sc::ThreadGrp> &
+    contract_threadgrp()
+    {
+      return contract_threadgrp_;
+    }
+
     Data::Data():
       ndata_(0)
     {
@@ -66,6 +80,14 @@ namespace sma2 {
       delete[] dat;
     }
 
+    long
+    Data::allocation_size(double *dat) const
+    {
+      memitermap_t::const_iterator memiter = memitermap_.find(dat);
+      if (memiter == memitermap_.end()) return 0;
+      return memiter->second->second.second;
+    }
+
     double *
     Data::data() const
     {
@@ -37,6 +37,7 @@
 #include <util/state/stateout.h>
 #include <util/misc/regtime.h>
 #include <util/misc/scexception.h>
+#include <util/group/thread.h>
 
 #ifndef TWO_INDEX_SPECIALIZATIONS
 #  define THREE_INDEX_SPECIALIZATIONS 1
@@ -60,6 +61,7 @@
 
 #include <math.h>
 #include <float.h>
+#include <algorithm>
 #include <vector>
 #include <map>
 #ifdef USE_HASH
@@ -1039,6 +1041,11 @@ namespace sma2 {
         ~Data();
         virtual double *allocate(long size);
         virtual void deallocate(double *);
+        /** Returns the size of the allocation that begins at dat, or 0
+            if no allocation begins there. */
+        long allocation_size(double *dat) const;
+        /// Returns the number of separate allocations.
+        long nallocation() const { return memmap_.size(); }
         double *data() const;
         long ndata() const { return ndata_; }
     };
@@ -1240,6 +1247,57 @@ namespace sma2 {
       vec[0]++;
     }
 
+    /** \brief A flat index of the blocks of an Array.
+        The blocks and their data pointers are held in two contiguous
+        vectors sorted like the Array's blockmap, so a lookup is a binary
+        search over the block keys only and iteration streams through
+        memory instead of chasing tree nodes. */
+    template <int N>
+    class BlockIndex {
+        std::vector<BlockInfo<N> > blocks_;
+        std::vector<double*> data_;
+        bool valid_;
+      public:
+        BlockIndex(): valid_(false) {}
+        /// Builds the index from a blockmap.
+        template <class Map>
+        void init(const Map &blockmap) {
+          blocks_.clear();
+          data_.clear();
+          blocks_.reserve(blockmap.size());
+          data_.reserve(blockmap.size());
+          for (typename Map::const_iterator i = blockmap.begin();
+               i != blockmap.end();
+               i++) {
+              blocks_.push_back(i->first);
+              data_.push_back(i->second);
+            }
+          valid_ = true;
+        }
+        /// Empties the index and marks it out of date.
+        void clear() {
+          blocks_.clear();
+          data_.clear();
+          valid_ = false;
+        }
+        /// Returns true if the index is up to date with its Array.
+        bool valid() const { return valid_; }
+        /// Returns the number of blocks.
+        int n_block() const { return blocks_.size(); }
+        /// Returns the i'th block.
+        const BlockInfo<N> &block(int i) const { return blocks_[i]; }
+        /// Returns the data of the i'th block.
+        double *data(int i) const { return data_[i]; }
+        /// Returns the data of block b, or 0 if b is not held.
+        double *find(const BlockInfo<N> &b) const {
+          IndicesLess<N> less;
+          typename std::vector<BlockInfo<N> >::const_iterator i
+              = std::lower_bound(blocks_.begin(), blocks_.end(), b, less);
+          if (i == blocks_.end() || less(b, *i)) return 0;
+          return data_[i - blocks_.begin()];
+        }
+    };
+
     /** \brief Implements a block sparse tensor.
         Array maps the BlockInfo to the block's data using the
         given Compare type to sort the blocks. */
@@ -1284,6 +1342,8 @@ namespace sma2 {
         std::map<IndexList, cached_blockmap_t*> blockmap_cache_;
         bool use_blockmap_cache_;
 
+        BlockIndex<N> block_index_;
+
         void init_indices(int n) {
           // This routine is used to reset the indices_ to
           // avoid a warning about newing a length 0 array
@@ -1474,6 +1534,7 @@ namespace sma2 {
         /** Make this array store nothing. */
         void clear() {
           clear_blockmap_cache();
+          block_index_.clear();
           allocated_ = false;
           blocks_.clear();
 #ifdef USE_HASH
@@ -1518,6 +1579,7 @@ namespace sma2 {
               throw std::runtime_error(
                   "cannot add unalloced block to alloced array");
             }
+          block_index_.clear();
           // check the indices
           for (int i=0; i<N; i++) {
               if (b.block(i) >= index(i).nblock()) {
@@ -1540,6 +1602,7 @@ namespace sma2 {
         typename blockmap_t::value_type &
         add_allocated_block(const BlockInfo<N>&b) {
           allocated_ = 1;
+          block_index_.clear();
           // check the indices
           for (int i=0; i<N; i++) {
               if (b.block(i) >= index(i).nblock()) {
@@ -1560,6 +1623,7 @@ namespace sma2 {
         typename blockmap_t::value_type &
         add_zeroed_block(const BlockInfo<N>&b) {
           allocated_ = 1;
+          block_index_.clear();
           // check the indices
           for (int i=0; i<N; i++) {
               if (b.block(i) >= index(i).nblock()) {
@@ -1584,6 +1648,7 @@ namespace sma2 {
         void remove_block(const BlockInfo<N>&b) {
           typename blockmap_t::iterator bi = blocks_.find(b);
           if (bi != blocks_.end()) {
+              block_index_.clear();
               data_->deallocate(bi->second);
               blocks_.erase(bi);
             }
@@ -1591,6 +1656,7 @@ namespace sma2 {
         void relocate_block(const BlockInfo<N>&b_old,const BlockInfo<N>&b_new) {
           typename blockmap_t::iterator bi = blocks_.find(b_old);
           if (bi != blocks_.end()) {
+              block_index_.clear();
               double *data = bi->second;
               blocks_.erase(bi);
               blocks_.insert(std::make_pair(b_new,data));
@@ -1608,6 +1674,7 @@ namespace sma2 {
               throw std::runtime_error(
                   "cannot add unalloced block to alloced array");
             }
+          block_index_.clear();
           // check the indices
           for (int i=0; i<N; i++) {
               if (b.block(i) >= index(i).nblock()) {
@@ -1632,6 +1699,7 @@ namespace sma2 {
               throw std::runtime_error(
                   "cannot add unalloced block to alloced array");
             }
+          block_index_.clear();
           // check the indices
           for (int i=0; i<N; i++) {
               if (b.block(i) > index(i).nblock()) {
@@ -1763,6 +1831,7 @@ namespace sma2 {
             allocated. */
         void allocate_blocks() {
           if (allocated_) return;
+          block_index_.clear();
           size_t nblock = 0;
           long n = n_element();
           // clj debug
@@ -1800,6 +1869,7 @@ namespace sma2 {
         /** Deallocate storage for all blocks. */
         void deallocate_blocks() {
           data_ = new Data;
+          block_index_.clear();
           for (typename blockmap_t::iterator i = blocks_.begin();
                i != blocks_.end();
                i++) {
@@ -1810,6 +1880,73 @@ namespace sma2 {
           bound_ = DBL_MAX;
 #endif
         }
+        /** Moves the data of the blocks into allocations of about
+            chunksize elements, with the blocks laid out in the order of
+            the blockmap.  Arrays built block by block with
+            add_allocated_block() or add_zeroed_block() otherwise hold one
+            allocation per block.  Each block is deallocated as soon as it
+            has been copied, so the peak memory use exceeds that of the
+            array by at most one chunk.  A block larger than chunksize is
+            given an allocation of its own.  Does nothing if the data
+            already occupies no more allocations than this would use. */
+        void pack_blocks(size_t chunksize = 4194304) {
+          if (!allocated_) return;
+          if (chunksize == 0) chunksize = 1;
+          size_t n = 0;
+          for (typename blockmap_t::const_iterator i = blocks_.begin();
+               i != blocks_.end();
+               i++) {
+              n += block_size(i->first);
+            }
+          if (n_element_allocated() == n
+              && size_t(data_->nallocation()) <= (n + chunksize - 1)/chunksize)
+              return;
+
+          sc::Ref<Data> packed_data = new Data;
+          typename blockmap_t::iterator chunk_begin = blocks_.begin();
+          while (chunk_begin != blocks_.end()) {
+              // a chunk holds at least one block
+              typename blockmap_t::iterator chunk_end = chunk_begin;
+              size_t nchunk = 0;
+              do {
+                  nchunk += block_size(chunk_end->first);
+                  chunk_end++;
+                } while (chunk_end != blocks_.end()
+                         && nchunk + block_size(chunk_end->first) <= chunksize);
+
+              double *dat = packed_data->allocate(nchunk);
+              for (typename blockmap_t::iterator i = chunk_begin;
+                   i != chunk_end;
+                   i++) {
+                  long size = block_size(i->first);
+                  memcpy(dat, i->second, sizeof(double)*size);
+                  // blocks that share an allocation, as made by
+                  // allocate_blocks(), are freed with data_ below
+                  if (data_->allocation_size(i->second) == size)
+                      data_->deallocate(i->second);
+                  i->second = dat;
+                  dat += size;
+                }
+              chunk_begin = chunk_end;
+            }
+#ifdef USE_HASH
+          block_hash_.clear();
+          for (typename blockmap_t::iterator i = blocks_.begin();
+               i != blocks_.end();
+               i++) {
+              block_hash_.insert(*i);
+            }
+#endif
+          data_ = packed_data;
+          clear_blockmap_cache();
+          block_index_.clear();
+        }
+        /** Returns the flat index of the blocks, building it if the
+            blocks changed since it was last built. */
+        const BlockIndex<N> &block_index() {
+          if (!block_index_.valid()) block_index_.init(blocks_);
+          return block_index_;
+        }
         ContractPart<N> operator()() {
           return ContractPart<N>(*this);
         }
@@ -2055,6 +2192,15 @@ namespace sma2 {
 
     template <int N> double scalar_contract(Array<N> &c, Array<N> &a, const IndexList &alist);
 
+    /** Sets the ThreadGrp used by contract() to process the blocks of the
+        result concurrently.  If it is null (the default), contract() runs
+        on the calling thread only. */
+    void set_contract_threadgrp(const sc::Ref<sc::ThreadGrp> &thr);
+    /// Returns the ThreadGrp used by contract().
+    const sc::Ref<sc::ThreadGrp> &contract_threadgrp();
+    /// The number of batches of result blocks handed out per thread by contract().
+    const int contract_batches_per_thread = 8;
+
     /** \brief Represents a pairs of contracted array and their
         symbolic indices.
      */
@@ -2114,6 +2260,7 @@ namespace sma2 {
       const typename Array<N>::blockmap_t &sourceblocks
           = source.blockmap();
       target.blocks_.clear();
+      target.block_index_.clear();
       for (typename Array<N>::blockmap_t::const_iterator i = sourceblocks.begin();
            i != sourceblocks.end();
            i++) {
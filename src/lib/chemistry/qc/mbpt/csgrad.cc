@@ -29,6 +29,9 @@
 #include <math.h>
 #include <limits.h>
 
+#include <sstream>
+#include <vector>
+
 #include <util/misc/formio.h>
 #include <util/misc/regtime.h>
 #include <util/group/memory.h>
@@ -43,6 +46,7 @@
 #include <chemistry/qc/mbpt/mbpt.h>
 #include <chemistry/qc/mbpt/util.h>
 #include <chemistry/qc/mbpt/csgrade12.h>
+#include <util/misc/scratchstore.h>
 #include <chemistry/qc/mbpt/csgrad34qb.h>
 #include <chemistry/qc/mbpt/csgrads2pdm.h>
 
@@ -390,6 +394,13 @@ MBPT2::compute_cs_grad()
     if (rest == 0) npass--;
     }
 
+  if (npass > 1 && integral_store_size_ > 0) {
+    ExEnv::out0() << indent
+         << "Integral scratch space per process:  " << integral_store_size_
+         << " Bytes"
+         << endl;
+    }
+
   if (me == 0) {
     ExEnv::out0() << indent
          << scprintf(" npass  rest  nbasis  nshell  nfuncmax") << endl;
@@ -600,6 +611,34 @@ MBPT2::compute_cs_grad()
         }
       }
 
+  // If more than one pass is needed, the AO integrals computed by each
+  // thread in the first pass are kept on local scratch, up to
+  // integral_store_size_ bytes per process, and read back in later passes.
+  //
+  // A stored shell pair is replayed in the later passes by the thread that
+  // stored it; only the shell pairs that were not stored are handed out
+  // through DistShellPair.  The distribution of the stored shell pairs is
+  // thus fixed by the first pass.  Balancing them dynamically across
+  // processes with a shared task counter would require every process to
+  // read the integrals of any other, which local scratch files cannot
+  // provide, so this is not done.
+  ScratchTaskStore** int_stores = 0;
+  std::vector<int> stored_tasks;
+  if (npass > 1 && integral_store_size_ > 0) {
+    std::string dir = integral_store_dir_;
+    if (!dir.empty() && *dir.rbegin() != '/') dir += '/';
+    int_stores = new ScratchTaskStore*[thr_->nthread()];
+    for (i=0; i<thr_->nthread(); i++) {
+      std::ostringstream ext;
+      ext << ".csints." << me << "." << i;
+      int_stores[i]
+          = new ScratchTaskStore(dir + SCFormIO::fileext_to_filename_string(
+                                     ext.str().c_str()),
+                                 integral_store_size_/thr_->nthread());
+      e12thread[i]->set_int_store(int_stores[i], 0);
+      }
+    }
+
   tim.enter("mp2 passes");
   for (pass=0; pass<npass; pass++) {
 
@@ -668,6 +707,50 @@ MBPT2::compute_cs_grad()
 #   endif
     tim.exit("erep+1.qt+2.qt");
 
+    if (int_stores && pass == 0) {
+      // Mark the shell pairs held in a store, so that the later passes
+      // replay them from the store and distribute only the others.
+      stored_tasks.assign((nshell*(nshell+1))/2, 0);
+      int nbad = 0;
+      double nbyte_stored = 0.0;
+      for (i=0; i<thr_->nthread(); i++) {
+        int_stores[i]->finish_writing();
+        if (int_stores[i]->bad()) {
+          nbad++;
+          delete int_stores[i];
+          int_stores[i] = 0;
+          continue;
+          }
+        for (int itask=0; itask<int_stores[i]->ntask(); itask++) {
+          int S = int_stores[i]->task_S(itask);
+          int R = int_stores[i]->task_R(itask);
+          stored_tasks[(S*(S+1))/2 + R] = 1;
+          }
+        nbyte_stored += int_stores[i]->size();
+        }
+      msg_->sum(&stored_tasks[0], stored_tasks.size());
+      msg_->sum(nbad);
+      msg_->sum(nbyte_stored);
+      int nstored_tasks = 0;
+      for (i=0; i<stored_tasks.size(); i++) {
+        if (stored_tasks[i]) nstored_tasks++;
+        }
+      if (nbad) {
+        ExEnv::out0() << indent
+             << "WARNING: could not write " << nbad
+             << " integral scratch files; their integrals will be recomputed"
+             << endl;
+        }
+      ExEnv::out0() << indent
+           << "Stored integrals of " << nstored_tasks << " of "
+           << stored_tasks.size() << " shell pairs ("
+           << nbyte_stored << " Bytes)"
+           << endl;
+      for (i=0; i<thr_->nthread(); i++) {
+        e12thread[i]->set_int_store(int_stores[i], &stored_tasks[0]);
+        }
+      }
+
     if (me == 0) {
       ExEnv::out0() << indent << "End of loop over shells" << endl;
       }
@@ -1505,6 +1588,14 @@ MBPT2::compute_cs_grad()
     }           // exit loop over i-batches (pass)
   tim.exit("mp2 passes");
 
+  if (int_stores) {
+    for (i=0; i<thr_->nthread(); i++) {
+      e12thread[i]->set_int_store(0, 0);
+      delete int_stores[i];
+      }
+    delete[] int_stores;
+    }
+
   if (dograd || do_d1_) {
     for (i=0; i<thr_->nthread(); i++) {
       delete qbt34thread[i];
@@ -56,7 +56,9 @@ CSGradErep12Qtr::CSGradErep12Qtr(int mythread_a, int nthread_a,
                                  int dynamic_a, double print_percent_a,
                                  DistShellPair::SharedData *shellpair_shared_data,
                                  int usep4):
-  shellpair_shared_data_(shellpair_shared_data)
+  shellpair_shared_data_(shellpair_shared_data),
+  int_store_(0),
+  stored_tasks_(0)
 {
   msg = msg_a;
   mythread = mythread_a;
@@ -84,9 +86,10 @@ CSGradErep12Qtr::~CSGradErep12Qtr()
 }
 
 void
-CSGradErep12Qtr::run()
+CSGradErep12Qtr::do_shellpair(int S, int R, bool read_ints,
+                              const Ref<PetiteList> &p4list, Timer &tim)
 {
-  int P,Q,R,S;
+  int P,Q;
   int p,q,r,s;
   int np,nq,nr,ns;
   int bf1,bf2,bf3,bf4;
@@ -101,17 +104,229 @@ CSGradErep12Qtr::run()
   double *c_pi, *c_qi;
   double tmpval;
   int i,j;
-  double *iqjs_contrib;  // local contributions to integral_iqjs
-  double *iqjr_contrib;  // local contributions to integral_iqjr
+  double *integral_iqrs = integral_iqrs_;
+  double *iqjs_contrib = iqjs_contrib_;
+  double *iqjr_contrib = iqjr_contrib_;
+
+  ns = basis->shell(S).nfunction();
+  s_offset = basis->shell_to_function(S);
+
+  nr = basis->shell(R).nfunction();
+  r_offset = basis->shell_to_function(R);
+
+  bool write_ints = (!read_ints && int_store_ != 0 && stored_tasks_ == 0
+                     && int_store_->begin_task(S,R));
+  if (read_ints) int_store_->begin_read_task();
+
+  bzerofast(integral_iqrs, ni*nbasis*nfuncmax*nfuncmax);
+
+  for (Q=0; Q<nshell; Q++) {
+    nq = basis->shell(Q).nfunction();
+    q_offset = basis->shell_to_function(Q);
+    for (P=0; P<=Q; P++) {
+      np = basis->shell(P).nfunction();
+      p_offset = basis->shell_to_function(P);
+
+      // check if symmetry unique and compute degeneracy
+      int deg;
+      if (usep4_) deg = p4list->in_p4(P,Q,R,S);
+      else deg = 1;
+      double symfac = (double) deg;
+      if (deg == 0)
+        continue;
+
+      if (tbint->log2_shell_bound(P,Q,R,S) < tol) {
+        continue;  // skip ereps less than tol
+        }
+
+      const double *intbuf;
+      if (read_ints && int_store_->next_is(P,Q)) {
+        tim.enter("read erep");
+        int_store_->get(quartet_buf_, np*nq*nr*ns);
+        tim.exit("read erep");
+        intbuf = quartet_buf_;
+        }
+      else {
+        aoint_computed++;
+
+        tim.enter("erep");
+        tbint->compute_shell(P,Q,R,S);
+        tim.exit("erep");
+        intbuf = tbint->buffer();
+
+        if (write_ints) {
+          tim.enter("write erep");
+          int_store_->put(P,Q,intbuf,np*nq*nr*ns);
+          tim.exit("write erep");
+          }
+        }
+
+      tim.enter("1. q.t.");
+      // Begin first quarter transformation;
+      // generate (iq|rs) for i active
+
+      offset = nr*ns*nbasis;
+      const double *pqrs_ptr = intbuf;
+      for (bf1 = 0; bf1 < np; bf1++) {
+        p = p_offset + bf1;
+        for (bf2 = 0; bf2 < nq; bf2++) {
+          q = q_offset + bf2;
+
+          if (q < p) {
+            pqrs_ptr = &intbuf[ns*nr*(bf2+1 + nq*bf1)];
+            continue; // skip to next q value
+            }
+
+          for (bf3 = 0; bf3 < nr; bf3++) {
+            r = r_offset + bf3;
+
+            for (bf4 = 0; bf4 < ns; bf4++) {
+              s = s_offset + bf4;
+
+              if (s < r) {
+                pqrs_ptr++;
+                continue; // skip to next bf4 value
+                }
+
+              if (fabs(*pqrs_ptr) > dtol) {
+                iprs_ptr = &integral_iqrs[bf4 + ns*(p + nbasis*bf3)];
+                iqrs_ptr = &integral_iqrs[bf4 + ns*(q + nbasis*bf3)];
+                c_qi = &scf_vector[q][i_offset];
+                c_pi = &scf_vector[p][i_offset];
+                tmpval = *pqrs_ptr;
+                // multiply each integral by its symmetry degeneracy factor
+                tmpval *= symfac;
+                for (i=0; i<ni; i++) {
+                  *iprs_ptr += *c_qi++*tmpval;
+                  iprs_ptr += offset;
+                  if (p != q) {
+                    *iqrs_ptr += *c_pi++*tmpval;
+                    iqrs_ptr += offset;
+                    }
+                  } // exit i loop
+                }   // endif
+
+              pqrs_ptr++;
+              } // exit bf4 loop
+            }   // exit bf3 loop
+          }     // exit bf2 loop
+        }       // exit bf1 loop
+      // end of first quarter transformation
+      tim.exit("1. q.t.");
+
+      }           // exit P loop
+    }             // exit Q loop
+
+  if (write_ints) int_store_->end_task();
+  if (read_ints) int_store_->end_read_task();
+
+#if PRINT1Q
+    {
+    lock->lock();
+    double *tmp = integral_iqrs;
+    for (int i = 0; i<ni; i++) {
+      for (int r = 0; r<nr; r++) {
+        for (int q = 0; q<nbasis; q++) {
+          for (int s = 0; s<ns; s++) {
+            printf("1Q: (%d %d|%d %d) = %12.8f\n",
+                   i,q,r+r_offset,s+s_offset,*tmp);
+            tmp++;
+            }
+          }
+        }
+      }
+    lock->unlock();
+    }
+#endif
+#if PRINT_BIGGEST_INTS
+    {
+    lock->lock();
+    double *tmp = integral_iqrs;
+    for (int i = 0; i<ni; i++) {
+      for (int r = 0; r<nr; r++) {
+        for (int q = 0; q<nbasis; q++) {
+          for (int s = 0; s<ns; s++) {
+            if (i+i_offset==104) {
+              biggest_ints_1.insert(*tmp,i+i_offset,q,r+r_offset,s+s_offset);
+              }
+            tmp++;
+            }
+          }
+        }
+      }
+    lock->unlock();
+    }
+#endif
+
+  tim.enter("2. q.t.");
+  // Begin second quarter transformation;
+  // generate (iq|jr) for i active and j active or frozen
+  for (i=0; i<ni; i++) {
+    for (j=0; j<nocc; j++) {
+
+      bzerofast(iqjs_contrib, nbasis*nfuncmax);
+      bzerofast(iqjr_contrib, nbasis*nfuncmax);
+
+      for (bf1=0; bf1<ns; bf1++) {
+        s = s_offset + bf1;
+        double *c_sj = &scf_vector[s][j];
+        double *iqjr_ptr = iqjr_contrib;
+        for (bf2=0; bf2<nr; bf2++) {
+          r = r_offset + bf2;
+          if (r > s) {
+            break; // skip to next bf1 value
+            }
+          double c_rj = scf_vector[r][j];
+          iqjs_ptr = &iqjs_contrib[bf1*nbasis];
+          iqrs_ptr = &integral_iqrs[bf1 + ns*nbasis*(bf2 + nr*i)];
+          for (q=0; q<nbasis; q++) {
+            *iqjs_ptr++ += c_rj * *iqrs_ptr;
+            if (r != s) *iqjr_ptr += *c_sj * *iqrs_ptr;
+            iqjr_ptr++;
+            iqrs_ptr += ns;
+            } // exit q loop
+          }   // exit bf2 loop
+        }     // exit bf1 loop
+
+      // We now have contributions to iqjs and iqjr for one pair i,j,
+      // all q, r in R and s in S; send iqjs and iqjr to the node
+      // (ij_proc) which is going to have this ij pair
+      int ij_proc =  (i*nocc + j)%nproc;
+      int ij_index = (i*nocc + j)/nproc;
+
+      // Sum the iqjs_contrib to the appropriate place
+      size_t ij_offset = size_t(nbasis)*(s_offset + size_t(nbasis)*ij_index);
+      mem->sum_reduction_on_node(iqjs_contrib,
+                                 ij_offset, ns*nbasis, ij_proc);
+
+      ij_offset = size_t(nbasis)*(r_offset + size_t(nbasis)*ij_index);
+      mem->sum_reduction_on_node(iqjr_contrib,
+                                 ij_offset, nr*nbasis, ij_proc);
+
+      }     // exit j loop
+    }       // exit i loop
+  // end of second quarter transformation
+  tim.exit("2. q.t.");
+}
+
+void
+CSGradErep12Qtr::run()
+{
+  int S,R;
+  int nfuncmax = basis->max_nfunction_in_shell();
+  int nshell = basis->nshell();
+  int nbasis = basis->nbasis();
 
-  const double *intbuf = tbint->buffer();
+  bool replay = (int_store_ != 0 && stored_tasks_ != 0);
 
-  iqjs_contrib  = mem->malloc_local_double(nbasis*nfuncmax);
-  iqjr_contrib  = mem->malloc_local_double(nbasis*nfuncmax);
+  iqjs_contrib_  = mem->malloc_local_double(nbasis*nfuncmax);
+  iqjr_contrib_  = mem->malloc_local_double(nbasis*nfuncmax);
 
-  double *integral_iqrs; // quarter transformed two-el integrals
+  // quarter transformed two-el integrals
   lock->lock();
-  integral_iqrs = new double[ni*nbasis*nfuncmax*nfuncmax];
+  integral_iqrs_ = new double[ni*nbasis*nfuncmax*nfuncmax];
+  if (replay) quartet_buf_ = new double[nfuncmax*nfuncmax*nfuncmax*nfuncmax];
+  else quartet_buf_ = 0;
   lock->unlock();
 
   int work_per_thread = ((nshell*(nshell+1))/2)/(nproc*nthread);
@@ -131,6 +346,19 @@ CSGradErep12Qtr::run()
   // Use petite list for symmetry utilization
   Ref<PetiteList> p4list = tbint->integral()->petite_list();
 
+  Timer tim(timer);
+
+  // The shell pairs held in the store were assigned to this thread
+  // when the store was written; do them first, reading the stored
+  // quartets instead of recomputing them.
+  if (replay) {
+    int_store_->rewind();
+    for (int itask=0; itask<int_store_->ntask(); itask++) {
+      do_shellpair(int_store_->task_S(itask), int_store_->task_R(itask),
+                   true, p4list, tim);
+      }
+    }
+
   DistShellPair shellpairs(msg,nthread,mythread,lock,basis,basis,dynamic_,
                            shellpair_shared_data_);
   shellpairs.set_print_percent(print_percent_);
@@ -138,13 +366,9 @@ CSGradErep12Qtr::run()
   if (debug) shellpairs.set_print_percent(1);
   S = 0;
   R = 0;
-  Timer tim(timer);
   while (shellpairs.get_task(S,R)) {
-    ns = basis->shell(S).nfunction();
-    s_offset = basis->shell_to_function(S);
-
-    nr = basis->shell(R).nfunction();
-    r_offset = basis->shell_to_function(R);
+    // skip the shell pairs that some thread replays from its store
+    if (stored_tasks_ != 0 && stored_tasks_[(S*(S+1))/2 + R]) continue;
 
     if (debug > 1 && (print_index++)%print_interval == 0) {
       lock->lock();
@@ -160,176 +384,7 @@ CSGradErep12Qtr::run()
       lock->unlock();
       }
 
-    bzerofast(integral_iqrs, ni*nbasis*nfuncmax*nfuncmax);
-
-    for (Q=0; Q<nshell; Q++) {
-      nq = basis->shell(Q).nfunction();
-      q_offset = basis->shell_to_function(Q);
-      for (P=0; P<=Q; P++) {
-        np = basis->shell(P).nfunction();
-        p_offset = basis->shell_to_function(P);
-
-	// check if symmetry unique and compute degeneracy
-        int deg;
-        if (usep4_) deg = p4list->in_p4(P,Q,R,S);
-        else deg = 1;
-        double symfac = (double) deg;
-        if (deg == 0)
-          continue;
-
-        if (tbint->log2_shell_bound(P,Q,R,S) < tol) {
-          continue;  // skip ereps less than tol
-          }
-
-        aoint_computed++;
-
-        tim.enter("erep");
-        tbint->compute_shell(P,Q,R,S);
-        tim.exit("erep");
-
-        tim.enter("1. q.t.");
-        // Begin first quarter transformation;
-        // generate (iq|rs) for i active
-
-        offset = nr*ns*nbasis;
-        const double *pqrs_ptr = intbuf;
-        for (bf1 = 0; bf1 < np; bf1++) {
-          p = p_offset + bf1;
-          for (bf2 = 0; bf2 < nq; bf2++) {
-            q = q_offset + bf2;
-
-            if (q < p) {
-              pqrs_ptr = &intbuf[ns*nr*(bf2+1 + nq*bf1)];
-              continue; // skip to next q value
-              }
-
-            for (bf3 = 0; bf3 < nr; bf3++) {
-              r = r_offset + bf3;
-
-              for (bf4 = 0; bf4 < ns; bf4++) {
-                s = s_offset + bf4;
-
-                if (s < r) {
-                  pqrs_ptr++;
-                  continue; // skip to next bf4 value
-                  }
-
-                if (fabs(*pqrs_ptr) > dtol) {
-                  iprs_ptr = &integral_iqrs[bf4 + ns*(p + nbasis*bf3)];
-                  iqrs_ptr = &integral_iqrs[bf4 + ns*(q + nbasis*bf3)];
-                  c_qi = &scf_vector[q][i_offset];
-                  c_pi = &scf_vector[p][i_offset];
-                  tmpval = *pqrs_ptr;
-		  // multiply each integral by its symmetry degeneracy factor
-		  tmpval *= symfac;
-                  for (i=0; i<ni; i++) {
-                    *iprs_ptr += *c_qi++*tmpval;
-                    iprs_ptr += offset;
-                    if (p != q) {
-                      *iqrs_ptr += *c_pi++*tmpval;
-                      iqrs_ptr += offset;
-                      }
-                    } // exit i loop
-                  }   // endif
-
-                pqrs_ptr++;
-                } // exit bf4 loop
-              }   // exit bf3 loop
-            }     // exit bf2 loop
-          }       // exit bf1 loop
-        // end of first quarter transformation
-        tim.exit("1. q.t.");
-
-        }           // exit P loop
-      }             // exit Q loop
-
-#if PRINT1Q
-      {
-      lock->lock();
-      double *tmp = integral_iqrs;
-      for (int i = 0; i<ni; i++) {
-        for (int r = 0; r<nr; r++) {
-          for (int q = 0; q<nbasis; q++) {
-            for (int s = 0; s<ns; s++) {
-              printf("1Q: (%d %d|%d %d) = %12.8f\n",
-                     i,q,r+r_offset,s+s_offset,*tmp);
-              tmp++;
-              }
-            }
-          }
-        }
-      lock->unlock();
-      }
-#endif
-#if PRINT_BIGGEST_INTS
-      {
-      lock->lock();
-      double *tmp = integral_iqrs;
-      for (int i = 0; i<ni; i++) {
-        for (int r = 0; r<nr; r++) {
-          for (int q = 0; q<nbasis; q++) {
-            for (int s = 0; s<ns; s++) {
-              if (i+i_offset==104) {
-                biggest_ints_1.insert(*tmp,i+i_offset,q,r+r_offset,s+s_offset);
-                }
-              tmp++;
-              }
-            }
-          }
-        }
-      lock->unlock();
-      }
-#endif
-
-    tim.enter("2. q.t.");
-    // Begin second quarter transformation;
-    // generate (iq|jr) for i active and j active or frozen
-    for (i=0; i<ni; i++) {
-      for (j=0; j<nocc; j++) {
-
-        bzerofast(iqjs_contrib, nbasis*nfuncmax);
-        bzerofast(iqjr_contrib, nbasis*nfuncmax);
-
-        for (bf1=0; bf1<ns; bf1++) {
-          s = s_offset + bf1;
-          double *c_sj = &scf_vector[s][j];
-          double *iqjr_ptr = iqjr_contrib;
-          for (bf2=0; bf2<nr; bf2++) {
-            r = r_offset + bf2;
-            if (r > s) {
-              break; // skip to next bf1 value
-              }
-            double c_rj = scf_vector[r][j];
-            iqjs_ptr = &iqjs_contrib[bf1*nbasis];
-            iqrs_ptr = &integral_iqrs[bf1 + ns*nbasis*(bf2 + nr*i)];
-            for (q=0; q<nbasis; q++) {
-              *iqjs_ptr++ += c_rj * *iqrs_ptr;
-              if (r != s) *iqjr_ptr += *c_sj * *iqrs_ptr;
-              iqjr_ptr++;
-              iqrs_ptr += ns;
-              } // exit q loop
-            }   // exit bf2 loop
-          }     // exit bf1 loop
-
-        // We now have contributions to iqjs and iqjr for one pair i,j,
-        // all q, r in R and s in S; send iqjs and iqjr to the node
-        // (ij_proc) which is going to have this ij pair
-        int ij_proc =  (i*nocc + j)%nproc;
-        int ij_index = (i*nocc + j)/nproc;
-
-        // Sum the iqjs_contrib to the appropriate place
-        size_t ij_offset = size_t(nbasis)*(s_offset + size_t(nbasis)*ij_index);
-        mem->sum_reduction_on_node(iqjs_contrib,
-                                   ij_offset, ns*nbasis, ij_proc);
-
-        ij_offset = size_t(nbasis)*(r_offset + size_t(nbasis)*ij_index);
-        mem->sum_reduction_on_node(iqjr_contrib,
-                                   ij_offset, nr*nbasis, ij_proc);
-
-        }     // exit j loop
-      }       // exit i loop
-    // end of second quarter transformation
-    tim.exit("2. q.t.");
+    do_shellpair(S, R, false, p4list, tim);
 
     }         // exit while get_task
 
@@ -340,9 +395,10 @@ CSGradErep12Qtr::run()
     }
 
   lock->lock();
-  delete[] integral_iqrs;
-  mem->free_local_double(iqjs_contrib);
-  mem->free_local_double(iqjr_contrib);
+  delete[] integral_iqrs_;
+  delete[] quartet_buf_;
+  mem->free_local_double(iqjs_contrib_);
+  mem->free_local_double(iqjr_contrib_);
   lock->unlock();
 }
 
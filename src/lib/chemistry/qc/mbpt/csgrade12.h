@@ -34,6 +34,8 @@
 #include <util/group/thread.h>
 #include <chemistry/qc/basis/integral.h>
 #include <chemistry/qc/basis/distshpair.h>
+#include <chemistry/qc/basis/petite.h>
+#include <util/misc/scratchstore.h>
 
 namespace sc {
 
@@ -62,6 +64,20 @@ class CSGradErep12Qtr: public Thread {
     double print_percent_;
     int usep4_;
     DistShellPair::SharedData *shellpair_shared_data_;
+    ScratchTaskStore *int_store_;
+    const int *stored_tasks_;
+
+    // work arrays used by do_shellpair
+    double *integral_iqrs_;
+    double *iqjs_contrib_;
+    double *iqjr_contrib_;
+    double *quartet_buf_;
+
+    // Computes the contributions of the shell pair RS to the
+    // half-transformed integrals.  If read_ints is true the stored
+    // quartets of RS are taken from int_store_.
+    void do_shellpair(int S, int R, bool read_ints,
+                      const Ref<PetiteList> &p4list, Timer &tim);
   public:
     CSGradErep12Qtr(int mythread_a, int nthread_a,
                     int me_a, int nproc_a,
@@ -80,6 +96,15 @@ class CSGradErep12Qtr: public Thread {
 
     void set_i_offset(int ioff) { i_offset = ioff; }
     void set_ni(int nivalue) { ni = nivalue; }
+    /** If stored_tasks is null, the shell quartets computed by this
+        thread are written to store.  Otherwise the tasks held by store
+        are read back from it, and the shell pairs RS for which
+        stored_tasks[S*(S+1)/2+R] is nonzero are skipped, since some
+        thread holds them in its store.  store may be null. */
+    void set_int_store(ScratchTaskStore *store, const int *stored_tasks) {
+      int_store_ = store;
+      stored_tasks_ = stored_tasks;
+    }
 
     void run();
 };
@@ -28,6 +28,7 @@
 #include <util/misc/scexception.h>
 #include <util/misc/formio.h>
 #include <util/misc/exenv.h>
+#include <util/misc/consumableresources.h>
 #include <util/state/stateio.h>
 #include <math/scmat/blocked.h>
 #include <chemistry/qc/basis/petite.h>
@@ -83,7 +84,7 @@ dquicksort(double *item,int *index,int n)
 // MBPT2
 
 static ClassDesc MBPT2_cd(
-  typeid(MBPT2),"MBPT2",9,"public Wavefunction",
+  typeid(MBPT2),"MBPT2",11,"public Wavefunction",
   0, create<MBPT2>, create<MBPT2>);
 
 MBPT2::MBPT2(StateIn& s):
@@ -153,6 +154,23 @@ MBPT2::MBPT2(StateIn& s):
       do_d2_ = 1;
     }
 
+  if (s.version(::class_desc<MBPT2>()) >= 10) {
+      double dintegral_store_size;
+      s.get(dintegral_store_size);
+      integral_store_size_ = size_t(dintegral_store_size);
+    }
+  else {
+      integral_store_size_ = 0;
+    }
+
+  if (s.version(::class_desc<MBPT2>()) >= 11) {
+      s.get(integral_store_dir_);
+    }
+  else {
+      integral_store_dir_
+          = ConsumableResources::get_default_instance()->disk_location();
+    }
+
   hf_energy_ = 0.0;
 
   symorb_irrep_ = 0;
@@ -227,6 +245,12 @@ MBPT2::MBPT2(const Ref<KeyVal>& keyval):
 
   max_norb_ = keyval->intvalue("max_norb",KeyValValueint(-1));
 
+  integral_store_size_ = keyval->sizevalue("integral_store",
+                                           KeyValValuesize(0));
+  integral_store_dir_ = keyval->stringvalue("integral_store_dir",
+      KeyValValuestring(
+          ConsumableResources::get_default_instance()->disk_location()));
+
   hf_energy_ = 0.0;
 
   symorb_irrep_ = 0;
@@ -258,6 +282,9 @@ MBPT2::save_data_state(StateOut& s)
   s.put(cphf_epsilon_);
   s.put(max_norb_);
   s.put(do_d2_);
+  double dintegral_store_size = integral_store_size_;
+  s.put(dintegral_store_size);
+  s.put(integral_store_dir_);
 }
 
 void
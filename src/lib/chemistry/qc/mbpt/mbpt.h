@@ -74,6 +74,11 @@ class MBPT2: public Wavefunction {
     // The maximum number of orbitals in a pass.
     int max_norb_;
 
+    // The scratch space per process for storing AO integrals between passes.
+    size_t integral_store_size_;
+    // The directory of the integral scratch files.
+    std::string integral_store_dir_;
+
     // the irreps of the orbitals and the offset within the irrep
     int *symorb_irrep_;
     int *symorb_num_;
@@ -225,6 +230,21 @@ class MBPT2: public Wavefunction {
         <dt><tt>dynamic</tt><dd> This boolean keyword specifies whether dynamic load balancing
         is used. The default is false.
 
+        <dt><tt>integral_store</tt><dd> The number of bytes of local
+        scratch disk per process that the memgrp algorithm may use to
+        store the AO integrals computed in its first pass, so that later
+        passes read them instead of recomputing them.  Each process is
+        given this amount, so with several processes on a node the node
+        needs that multiple of it.  This is only used if more than one
+        pass is needed.  The default is 0, which recomputes the integrals
+        in every pass.
+
+        <dt><tt>integral_store_dir</tt><dd> The directory in which the
+        integral scratch files are placed.  It should be on a disk local
+        to each node.  The default is the disk location of the
+        ConsumableResources object, which is the current directory unless
+        specified otherwise.
+
 
         </dl> */
     MBPT2(const Ref<KeyVal>&);
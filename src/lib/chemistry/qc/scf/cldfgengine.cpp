@@ -28,6 +28,7 @@
 #include <chemistry/qc/scf/cldfgengine.hpp>
 #include <util/madness/world.h>
 #include <chemistry/qc/basis/integralenginepool.hpp>
+#include <mpqc/utility/mutex.hpp>
 #include <chemistry/qc/basis/integral.h>
 #include <chemistry/qc/libint2/libint2.h>
 #include <chemistry/qc/basis/tiledbasisset.hpp>
@@ -165,13 +166,13 @@ mpqc::TA::ClDFGEngine::density_contraction(
   const std::string nC("mpqc_TA_ClDfGFactory_n_coeff");
   const std::string mC(",mpqc_TA_ClDfGFactory_m_coeff");
 
-  // just for conveience
-  const TAMatrix &D = *density_;
+  // the contraction is done with block-sparse arrays
+  SparseMatrix D = sparse_copy(*density_, D_shape_, D_shape_set_);
 
-  TAMatrix expr; 
+  SparseMatrix expr;
   expr(i+j) = 2 * (df_ints_(i+j+X) * ( D(m+n) * df_ints_(m+n+X) ) )
                 - (df_ints_(i+n+X) * ( D(nC+mC) * df_ints_(m+j+X) ) );
-  return expr;
+  return to_dense(expr);
 }
 
 // Do contraction with coefficients
@@ -198,16 +199,33 @@ mpqc::TA::ClDFGEngine::coefficient_contraction(
   // Term where comma's need to removed
   const std::string jE = input.at(1);
 
-  // just for conveience
-  const TAMatrix &C = *coeff_;
+  // the contraction is done with block-sparse arrays
+  SparseMatrix C = sparse_copy(*coeff_, C_shape_, C_shape_set_);
 
   // Precompute Exch Term
   df_K_("j,Z,X") = C("m,Z") * df_ints_("m,j,X");
 
-  TAMatrix expr; 
+  SparseMatrix expr;
   expr(i+j) = 2 * (df_ints_(i+j+X) * (C(m+Z) * df_K_(m+Z+X) ) )
                 - (df_K_(i+Z+X) * df_K_(jE+Z+X) );
-  return expr;
+  return to_dense(expr);
+}
+
+// The shape of the density or coefficients is computed by the first G
+// build and kept for the later ones, which then only copy the tiles.  The
+// shape is recomputed if a tile that it has as zero becomes significant.
+mpqc::TA::ClDFGEngine::SparseMatrix
+mpqc::TA::ClDFGEngine::sparse_copy(const TAMatrix &dense,
+                                   ::TiledArray::SparseShape<float> &shape,
+                                   bool &shape_set) {
+  SparseMatrix sparse;
+  if (shape_set && to_sparse(dense, shape, sparse))
+    return sparse;
+
+  sparse = to_sparse(dense);
+  shape = sparse.get_shape();
+  shape_set = true;
+  return sparse;
 }
 
 void
@@ -215,6 +233,7 @@ mpqc::TA::ClDFGEngine::set_densities(std::vector<TAMatrix *> densities) {
   MPQC_ASSERT(densities.size() == 1);
   density_ = densities.at(0);
   density_set_ = true;
+  D_shape_set_ = false;
 }
 
 bool
@@ -226,6 +245,7 @@ void mpqc::TA::ClDFGEngine::set_coefficients(std::vector<TAMatrix*> coeffs) {
   MPQC_ASSERT(coeffs.size() == 1);
   coeff_ = coeffs.at(0);
   coeff_set_ = true;
+  C_shape_set_ = false;
 }
 
 bool mpqc::TA::ClDFGEngine::coefficients_set() {
@@ -256,8 +276,9 @@ mpqc::TA::ClDFGEngine::compute_symetric_df_ints() {
   using eri3pool = IntegralEnginePool<sc::Ref<sc::TwoBodyThreeCenterInt> >;
   auto eri3_ptr = std::make_shared<eri3pool>(eri3_clone);
 
-  // Using the df_ints as temporary storage for the twobody three center ints
-  df_ints_ =  Integrals(*world_->madworld(), eri3_ptr, basis_, dfbasis_);
+  // Using the df_ints as temporary storage for the twobody three center ints;
+  // Schwarz-screened tiles are neither computed nor stored
+  df_ints_ =  SparseIntegrals(*world_->madworld(), eri3_ptr, basis_, dfbasis_);
   world_->madworld()->gop.fence();
   tim.exit("Computing Eri3 Integrals");
 
@@ -295,7 +316,8 @@ mpqc::TA::ClDFGEngine::compute_symetric_df_ints() {
 
   tim.enter("Eri3 * Eri2^{-1} Contraction");
   // Create df_ints_ tensor from eri3(i,j,P) * U_{eri2}^{-1}(P,X)
-  df_ints_("i,j,X") = df_ints_("i,j,P") * eri2_ints("P,X");
+  SparseMatrix eri2_inv = to_sparse(eri2_ints);
+  df_ints_("i,j,X") = df_ints_("i,j,P") * eri2_inv("P,X");
   world_->madworld()->gop.fence(); // so eri2_ints doesn't go out of scope.
   tim.exit("Eri3 * Eri2^{-1} Contraction");
 
@@ -119,10 +119,28 @@ namespace mpqc {
       bool density_set_ = false;
       bool coeff_set_ = false;
 
+      // Block-sparse arrays; tiles that are screened out are not stored
+      typedef TiledArray::Array<double, 2, TiledArray::Tensor<double>,
+              TiledArray::SparsePolicy> SparseMatrix;
+      typedef TiledArray::Array<double, 3, TiledArray::Tensor<double>,
+              TiledArray::SparsePolicy> SparseArray3;
+
       // Tensor that holds the integrals which have been combined with the
       // sqrt inverse of the two body two center integrals.
-      TiledArray::Array<double, 3> df_ints_;
-      TiledArray::Array<double, 3> df_K_; // Holds exchange intermediate
+      SparseArray3 df_ints_;
+      SparseArray3 df_K_; // Holds exchange intermediate
+
+      // Shapes of the block-sparse copies of the density and coefficients,
+      // kept from one G build to the next
+      ::TiledArray::SparseShape<float> D_shape_;
+      ::TiledArray::SparseShape<float> C_shape_;
+      bool D_shape_set_ = false;
+      bool C_shape_set_ = false;
+
+      // Copies dense into a block-sparse matrix, reusing shape if it is set
+      SparseMatrix
+      sparse_copy(const TAMatrix &dense,
+                  ::TiledArray::SparseShape<float> &shape, bool &shape_set);
 
       static sc::ClassDesc class_desc_;
     };
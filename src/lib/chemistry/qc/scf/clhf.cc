@@ -143,6 +143,8 @@ CLHF::ao_fock(double accuracy)
     double gmat_accuracy = accuracy;
     if (min_orthog_res() < 1.0) { gmat_accuracy *= min_orthog_res(); }
 
+    Ref<GBuildTaskQueue> tasks = gbuild_tasks(pmax, gmat_accuracy);
+
     for (i=0; i < nthread; i++) {
       if (i) {
         gmats[i] = new double[ntri];
@@ -150,7 +152,8 @@ CLHF::ao_fock(double accuracy)
       }
       conts[i] = new LocalCLHFContribution(gmats[i], pmat);
       gblds[i] = new LocalGBuild<LocalCLHFContribution>(*conts[i], tbis_[i],
-               pl, bs, scf_grp_, pmax, gmat_accuracy, nthread, i
+               pl, bs, scf_grp_, pmax, gmat_accuracy, nthread, i,
+        tasks.pointer()
         );
 
       threadgrp_->add_thread(i, gblds[i]);
@@ -171,6 +174,8 @@ CLHF::ao_fock(double accuracy)
       abort();
     }
     tim.exit("stop thread");
+
+    if (tasks) tasks->report(debug_ > 0);
       
     double tnint=0;
     for (i=0; i < nthread; i++) {
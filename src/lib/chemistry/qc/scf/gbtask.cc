@@ -0,0 +1,280 @@
+//
+// gbtask.cc --- implementation of the work-stealing G matrix task queue
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <util/misc/regtime.h>
+#include <util/misc/formio.h>
+#include <math/scmat/offset.h>
+
+#include <chemistry/qc/scf/gbtask.h>
+
+using namespace std;
+using namespace sc;
+
+///////////////////////////////////////////////////////////////////////////
+// GBuildTaskQueue
+
+GBuildTaskQueue::GBuildTaskQueue(const Ref<ThreadGrp> &threadgrp,
+                                 const Ref<MessageGrp> &grp,
+                                 const Ref<GaussianBasisSet> &bs,
+                                 const Ref<PetiteList> &pl,
+                                 const Ref<TwoBodyInt> &tbi,
+                                 signed char *pmax, double accuracy):
+  nthread_(threadgrp->nthread()),
+  queues_(threadgrp->nthread()),
+  start_time_(threadgrp->nthread(), -1.0),
+  busy_time_(threadgrp->nthread(), 0.0),
+  cost_done_(threadgrp->nthread(), 0.0),
+  ntask_(threadgrp->nthread(), 0),
+  nstolen_(threadgrp->nthread(), 0),
+  total_cost_(0.0)
+{
+  for (int i=0; i<nthread_; i++) {
+    queues_[i].head = queues_[i].tail = 0;
+    queues_[i].remaining = 0.0;
+    queues_[i].lock = threadgrp->new_lock();
+  }
+
+  int tol = (int) (log(accuracy)/log(2.0));
+  estimate_costs(*bs.pointer(), *pl.pointer(), *tbi.pointer(),
+                 pmax, tol, grp->me(), grp->n());
+  partition();
+}
+
+GBuildTaskQueue::~GBuildTaskQueue()
+{
+}
+
+static inline int
+half_floor(int q)
+{
+  return (q >= 0) ? q/2 : -((1-q)/2);
+}
+
+void
+GBuildTaskQueue::estimate_costs(GaussianBasisSet &gbs, PetiteList &pl,
+                                TwoBodyInt &tbi, signed char *pmax, int tol,
+                                int me, int nproc)
+{
+  const int nshell = gbs.nshell();
+
+  // Schwarz factors: log2 of sqrt((ij|ij))
+  std::vector<int> q(i_offset(nshell));
+  int qmin = 0, qmax = 0;
+  for (int i=0, ij=0; i<nshell; i++) {
+    for (int j=0; j<=i; j++, ij++) {
+      q[ij] = half_floor(tbi.log2_shell_bound(i,j,i,j));
+      if (ij == 0 || q[ij] < qmin) qmin = q[ij];
+      if (ij == 0 || q[ij] > qmax) qmax = q[ij];
+    }
+  }
+  const int nq = qmax - qmin + 1;
+
+  // nfkl[t] accumulates, over all k <= i, nk times the number of
+  // functions in the l shells (l <= k) with q[kl]-qmin >= t.  Thus a task
+  // (i,j) with pair threshold t has about ni*nj*nfkl[t] integrals.
+  std::vector<double> nfkl(nq, 0.0);
+  std::vector<double> hist(nq);
+
+  sc_int_least64_t ijklind = 0;
+  for (int i=0; i<nshell; i++) {
+    int ni = gbs(i).nfunction();
+
+    std::fill(hist.begin(), hist.end(), 0.0);
+    for (int l=0, il=i_offset(i); l<=i; l++, il++)
+      hist[q[il]-qmin] += gbs(l).nfunction();
+    double sum = 0.0;
+    for (int t=nq-1; t>=0; t--) {
+      sum += hist[t];
+      nfkl[t] += ni * sum;
+    }
+
+    if (!pl.in_p1(i))
+      continue;
+
+    for (int j=0; j<=i; j++) {
+      int oij = i_offset(i)+j;
+      if (!pl.in_p2(oij))
+        continue;
+
+      sc_int_least64_t ijkbase = ijklind;
+      ijklind += i+1;
+
+      // the number of k in [0,i] handled by this process
+      int nk_me = (i+1)/nproc;
+      int first = (int) ((me - ijkbase%nproc + nproc)%nproc);
+      if (first < (i+1)%nproc) nk_me++;
+      if (nk_me == 0)
+        continue;
+
+      int t = tol - q[oij] - pmax[oij] - qmin;
+      double nint;
+      if (t <= 0) nint = nfkl[0];
+      else if (t >= nq) nint = 0.0;
+      else nint = nfkl[t];
+
+      Task task;
+      task.i = i;
+      task.j = j;
+      task.ijkbase = ijkbase;
+      // the k loop overhead is included so that screened tasks are
+      // not free
+      task.cost = (ni*gbs(j).nfunction()*nint + i + 1) * nk_me / (i+1);
+      tasks_.push_back(task);
+      total_cost_ += task.cost;
+    }
+  }
+}
+
+void
+GBuildTaskQueue::partition()
+{
+  // give each thread a contiguous block of tasks of about equal cost
+  sc_int_least64_t ntask = tasks_.size();
+  sc_int_least64_t itask = 0;
+  double cumulative = 0.0;
+  for (int t=0; t<nthread_; t++) {
+    double end = (t == nthread_-1) ? total_cost_
+                                   : total_cost_*(t+1)/nthread_;
+    queues_[t].head = itask;
+    while (itask < ntask
+           && (t == nthread_-1 || cumulative + 0.5*tasks_[itask].cost <= end)) {
+      cumulative += tasks_[itask].cost;
+      queues_[t].remaining += tasks_[itask].cost;
+      itask++;
+    }
+    queues_[t].tail = itask;
+  }
+}
+
+bool
+GBuildTaskQueue::steal(int thread, Task &task)
+{
+  while (true) {
+    // find the most loaded other thread
+    int victim = -1;
+    double vremaining = 0.0;
+    for (int t=0; t<nthread_; t++) {
+      if (t == thread) continue;
+      ThreadLockHolder lh(queues_[t].lock);
+      if (queues_[t].head < queues_[t].tail
+          && queues_[t].remaining >= vremaining) {
+        victim = t;
+        vremaining = queues_[t].remaining;
+      }
+    }
+    if (victim < 0)
+      return false;
+
+    // take the last task of its block; the victim may have emptied its
+    // queue in the meantime, in which case another victim is chosen
+    Queue &vq = queues_[victim];
+    ThreadLockHolder lh(vq.lock);
+    if (vq.head < vq.tail) {
+      task = tasks_[--vq.tail];
+      vq.remaining -= task.cost;
+      nstolen_[thread]++;
+      return true;
+    }
+  }
+}
+
+bool
+GBuildTaskQueue::next(int thread, int &i, int &j, sc_int_least64_t &ijkbase)
+{
+  if (start_time_[thread] < 0.0)
+    start_time_[thread] = RegionTimer::get_wall_time();
+
+  Task task;
+  bool found = false;
+  {
+    Queue &q = queues_[thread];
+    ThreadLockHolder lh(q.lock);
+    if (q.head < q.tail) {
+      task = tasks_[q.head++];
+      q.remaining -= task.cost;
+      found = true;
+    }
+  }
+  if (!found)
+    found = steal(thread, task);
+
+  if (!found) {
+    busy_time_[thread] = RegionTimer::get_wall_time() - start_time_[thread];
+    return false;
+  }
+
+  cost_done_[thread] += task.cost;
+  ntask_[thread]++;
+
+  i = task.i;
+  j = task.j;
+  ijkbase = task.ijkbase;
+  return true;
+}
+
+void
+GBuildTaskQueue::report(bool print) const
+{
+  double tmax = 0.0, tmin = 0.0, tsum = 0.0;
+  int nstolen = 0;
+  for (int t=0; t<nthread_; t++) {
+    if (t == 0 || busy_time_[t] > tmax) tmax = busy_time_[t];
+    if (t == 0 || busy_time_[t] < tmin) tmin = busy_time_[t];
+    tsum += busy_time_[t];
+    nstolen += nstolen_[t];
+  }
+  double tavg = tsum/nthread_;
+
+  RegionTimer *regtim = RegionTimer::default_regiontimer();
+  if (regtim) {
+    regtim->add_wall_time("thread max", tmax);
+    regtim->add_wall_time("thread min", tmin);
+    regtim->add_wall_time("thread imbalance", tmax - tavg);
+  }
+
+  if (print) {
+    ExEnv::out0() << indent
+                  << scprintf("G build: %d tasks, %d stolen,"
+                              " thread time max/avg = %6.3f\n",
+                              int(tasks_.size()), nstolen,
+                              (tavg > 0.0 ? tmax/tavg : 1.0));
+    for (int t=0; t<nthread_; t++) {
+      ExEnv::out0() << indent
+                    << scprintf("  thread %3d: %8d tasks %6d stolen"
+                                " %12.3f s %8.2f%% est. cost\n",
+                                t, ntask_[t], nstolen_[t], busy_time_[t],
+                                (total_cost_ > 0.0
+                                 ? 100.0*cost_done_[t]/total_cost_ : 0.0));
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Local Variables:
+// mode: c++
+// c-file-style: "ETS"
+// End:
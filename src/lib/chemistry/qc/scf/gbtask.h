@@ -0,0 +1,117 @@
+//
+// gbtask.h --- definition of the work-stealing G matrix task queue
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#ifndef _chemistry_qc_scf_gbtask_h
+#define _chemistry_qc_scf_gbtask_h
+
+#include <vector>
+
+#include <util/group/thread.h>
+#include <util/group/message.h>
+#include <util/misc/scint.h>
+#include <chemistry/qc/basis/petite.h>
+#include <chemistry/qc/basis/tbint.h>
+
+namespace sc {
+
+/** GBuildTaskQueue hands out the shell pairs of a two-electron G matrix
+    build to the threads of a process.
+
+    Each task is a shell pair (i,j); the thread executing it loops over
+    all k shells (subject to the usual ijklind%nproc process split, which
+    is unchanged so that the work done by each process is the same as with
+    the static distribution).  The cost of each task is estimated from the
+    Schwarz bounds returned by TwoBodyInt::log2_shell_bound and the
+    density bound pmax.  Tasks are initially split among the threads in
+    contiguous blocks of equal estimated cost; a thread that runs out of
+    work steals tasks from the end of the block of the thread with the
+    most remaining estimated work.
+*/
+class GBuildTaskQueue : public RefCount {
+  public:
+    struct Task {
+      int i;
+      int j;
+      sc_int_least64_t ijkbase; ///< value of ijklind for (i,j,0)
+      double cost;
+    };
+
+  private:
+    struct Queue {
+      sc_int_least64_t head;
+      sc_int_least64_t tail;
+      double remaining;
+      Ref<ThreadLock> lock;
+    };
+
+    int nthread_;
+    std::vector<Task> tasks_;
+    std::vector<Queue> queues_;
+
+    // per-thread statistics
+    std::vector<double> start_time_;
+    std::vector<double> busy_time_;
+    std::vector<double> cost_done_;
+    std::vector<int> ntask_;
+    std::vector<int> nstolen_;
+
+    double total_cost_;
+
+    void estimate_costs(GaussianBasisSet &gbs, PetiteList &pl,
+                        TwoBodyInt &tbi, signed char *pmax, int tol,
+                        int me, int nproc);
+    void partition();
+    bool steal(int thread, Task &t);
+
+  public:
+    /** Creates the task list for this process.  tbi is only used to
+        compute shell bounds and is not used after the constructor
+        returns. */
+    GBuildTaskQueue(const Ref<ThreadGrp> &threadgrp,
+                    const Ref<MessageGrp> &grp,
+                    const Ref<GaussianBasisSet> &bs,
+                    const Ref<PetiteList> &pl,
+                    const Ref<TwoBodyInt> &tbi,
+                    signed char *pmax, double accuracy);
+    ~GBuildTaskQueue();
+
+    /** Get the next shell pair for thread.  Returns false when
+        no work remains. */
+    bool next(int thread, int &i, int &j, sc_int_least64_t &ijkbase);
+
+    /// The number of tasks.
+    size_t ntask() const { return tasks_.size(); }
+
+    /** Adds the per-thread load balance statistics to the default
+        RegionTimer as subregions of the current region and, if
+        print is true, prints them. */
+    void report(bool print = false) const;
+};
+
+}
+
+#endif
+
+// Local Variables:
+// mode: c++
+// c-file-style: "ETS"
+// End:
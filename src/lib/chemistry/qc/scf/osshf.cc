@@ -150,6 +150,8 @@ OSSHF::ao_fock(double accuracy)
     double gmat_accuracy = accuracy;
     if (min_orthog_res() < 1.0) { gmat_accuracy *= min_orthog_res(); }
 
+    Ref<GBuildTaskQueue> tasks = gbuild_tasks(pmax, gmat_accuracy);
+
     int i;
     for (i=0; i < nthread; i++) {
       if (i) {
@@ -163,7 +165,8 @@ OSSHF::ao_fock(double accuracy)
       conts[i] = new LocalOSSContribution(gmats[i], pmat,
                                           gmatas[i], pmata, gmatbs[i], pmatb);
       gblds[i] = new LocalGBuild<LocalOSSContribution>(*conts[i], tbis_[i],
-        pl, bs, scf_grp_, pmax, gmat_accuracy, nthread, i
+        pl, bs, scf_grp_, pmax, gmat_accuracy, nthread, i,
+        tasks.pointer()
         );
 
       threadgrp_->add_thread(i, gblds[i]);
@@ -184,6 +187,8 @@ OSSHF::ao_fock(double accuracy)
       abort();
     }
     tim.exit("stop thread");
+
+    if (tasks) tasks->report(debug_ > 0);
       
     double tnint=0;
     for (i=0; i < nthread; i++) {
@@ -32,6 +32,7 @@
 #include <unistd.h>
 
 #include <util/misc/formio.h>
+#include <util/misc/regtime.h>
 #include <util/state/stateio.h>
 #include <util/group/mstate.h>
 
@@ -45,6 +46,7 @@
 #include <chemistry/qc/basis/petite.h>
 #include <chemistry/qc/lcao/soad.h>
 #include <chemistry/qc/scf/scf.h>
+#include <chemistry/qc/scf/gbtask.h>
 #include <chemistry/qc/lcao/df_runtime.h>
 
 using namespace std;
@@ -54,7 +56,7 @@ using namespace sc;
 // SCF
 
 static ClassDesc SCF_cd(
-  typeid(SCF),"SCF",7,"public OneBodyWavefunction",
+  typeid(SCF),"SCF",9,"public OneBodyWavefunction",
   0, 0, 0);
 
 SCF::SCF(StateIn& s) :
@@ -105,6 +107,14 @@ SCF::SCF(StateIn& s) :
   extrap_ << SavableState::restore_state(s);
   accumdih_ << SavableState::restore_state(s);
   accumddh_ << SavableState::restore_state(s);
+  if (s.version(::class_desc<SCF>()) >= 8) {
+    s.get(dynamic_gbuild_);
+  }
+  else dynamic_gbuild_ = 1;
+  if (s.version(::class_desc<SCF>()) >= 9) {
+    s.get(dens_reset_error_);
+  }
+  else dens_reset_error_ = 10.0;
 
   scf_grp_ = basis()->matrixkit()->messagegrp();
   threadgrp_ = ThreadGrp::get_default_threadgrp();
@@ -116,8 +126,10 @@ SCF::SCF(const Ref<KeyVal>& keyval) :
   maxiter_(100),
   miniter_(0),
   dens_reset_freq_(10),
+  dens_reset_error_(10.0),
   reset_occ_(0),
   local_dens_(1),
+  dynamic_gbuild_(1),
   storage_(0),
   level_shift_(0)
 {
@@ -130,6 +142,9 @@ SCF::SCF(const Ref<KeyVal>& keyval) :
   if (keyval->exists("density_reset_frequency"))
     dens_reset_freq_ = keyval->intvalue("density_reset_frequency");
 
+  if (keyval->exists("density_reset_error"))
+    dens_reset_error_ = keyval->doublevalue("density_reset_error");
+
   if (keyval->exists("reset_occupations"))
     reset_occ_ = keyval->booleanvalue("reset_occupations");
 
@@ -154,6 +169,9 @@ SCF::SCF(const Ref<KeyVal>& keyval) :
   if (keyval->exists("local_density"))
     local_dens_ = keyval->booleanvalue("local_density");
 
+  if (keyval->exists("dynamic_gbuild"))
+    dynamic_gbuild_ = keyval->booleanvalue("dynamic_gbuild");
+
   print_all_evals_ = keyval->booleanvalue("print_evals");
   print_occ_evals_ = keyval->booleanvalue("print_occupied_evals");
 
@@ -217,6 +235,8 @@ SCF::save_data_state(StateOut& s)
   SavableState::save_state(extrap_.pointer(),s);
   SavableState::save_state(accumdih_.pointer(),s);
   SavableState::save_state(accumddh_.pointer(),s);
+  s.put(dynamic_gbuild_);
+  s.put(dens_reset_error_);
 }
 
 RefSCMatrix
@@ -256,6 +276,7 @@ SCF::print(ostream&o) const
     o << indent << "miniter = " << miniter_ << endl;
   }
   o << indent << "density_reset_frequency = " << dens_reset_freq_ << endl
+    << indent << "density_reset_error = " << dens_reset_error_ << endl
     << indent << scprintf("level_shift = %f\n",level_shift_)
     << decindent << endl;
 }
@@ -378,6 +399,19 @@ SCF::init_pmax(double *pmat_data)
   return pmax;
 }
 
+Ref<GBuildTaskQueue>
+SCF::gbuild_tasks(signed char *pmax, double accuracy)
+{
+  Ref<GBuildTaskQueue> tasks;
+  if (dynamic_gbuild_ && threadgrp_->nthread() > 1) {
+    Timer tim("gbuild tasks");
+    tasks = new GBuildTaskQueue(threadgrp_, scf_grp_, basis(),
+                                integral()->petite_list(basis()),
+                                tbis_[0], pmax, accuracy);
+  }
+  return tasks;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 RefSymmSCMatrix
@@ -38,6 +38,8 @@
 
 namespace sc {
 
+class GBuildTaskQueue;
+
   class DensityFittingInfo;
 
 // //////////////////////////////////////////////////////////////////////////
@@ -61,8 +63,10 @@ class SCF: public OneBodyWavefunction {
     int maxiter_;
     int miniter_;
     int dens_reset_freq_;
+    double dens_reset_error_;
     int reset_occ_;
     int local_dens_;
+    int dynamic_gbuild_;
     size_t storage_;
     int print_all_evals_;
     int print_occ_evals_;
@@ -83,6 +87,11 @@ class SCF: public OneBodyWavefunction {
     // calculate the scf vector, returning the accuracy
     virtual double compute_vector(double&, double enuclear);
 
+    // called before each G build by compute_vector to reset the density
+    // difference if needed
+    void check_density_reset(int &iter_since_reset,
+                             double &accumulated_error, double accuracy);
+
     // return the DIIS error matrices
     virtual Ref<SCExtrapError> extrap_error();
 
@@ -103,6 +112,10 @@ class SCF: public OneBodyWavefunction {
     // returns the log of the max density element in each shell block
     signed char * init_pmax(double *);
 
+    // returns the task queue to be given to the LocalGBuild threads, or
+    // null if the shell triples are to be statically distributed
+    Ref<GBuildTaskQueue> gbuild_tasks(signed char *pmax, double accuracy);
+
     // given a matrix, this will convert the matrix to a local matrix if
     // it isn't one already, and return that local matrix.  it will also
     // set the double* to point to the local matrix's data.
@@ -150,6 +163,16 @@ class SCF: public OneBodyWavefunction {
         often, in term of SCF iterations, \f$\Delta D\f$ will be reset to
         \f$D\f$.  The default is 10.
 
+        <dt><tt>density_reset_error</tt><dd> After a reset, the two-electron
+        part of the Fock matrix is built incrementally from \f$\Delta D\f$.
+        The error of each incremental build is bounded by the integral
+        screening threshold used for it, so these thresholds are summed
+        and \f$\Delta D\f$ is reset to \f$D\f$ as soon as the sum exceeds
+        this ratio times the threshold of the next build.  This happens
+        automatically whenever the screening threshold is tightened.
+        Larger values give fewer full builds at the expense of the
+        accuracy of the Fock matrix.  The default is 10.
+
         <dt><tt>reset_occupations</tt><dd> Reassign the occupations after
         each iteration based on the eigenvalues.  This only has an effect
         for molecules with higher than \f$C_1\f$ symmetry.  The default is
@@ -171,6 +194,12 @@ class SCF: public OneBodyWavefunction {
         density and \f$G\f$ matrix will be made on all nodes, even if a
         distributed matrix specialization is used.  The default is true.
 
+        <dt><tt>dynamic_gbuild</tt><dd> If this is true, the shell pairs
+        of the two-electron part of the Fock matrix build are distributed
+        among the threads of each process with a work-stealing scheduler
+        that uses Schwarz estimates of their cost.  Otherwise they are
+        assigned round-robin.  The default is true.
+
         <dt><tt>guess_wavefunction</tt><dd> This specifies the initial
         guess for the solution to the SCF equations.  This can be either a
         OneBodyWavefunction object or the name of file that contains the
@@ -129,6 +129,25 @@ SCF::iter_print(int iter,
      << std::endl;
 }
 
+void
+SCF::check_density_reset(int &iter_since_reset, double &accumulated_error,
+                         double accuracy)
+{
+  // G is built from the density difference since the last reset.  Each
+  // incremental build can be in error by up to the accuracy it was
+  // computed with, so reset the density when the accumulated error
+  // becomes too large relative to the accuracy now required, and also
+  // from time to time.
+  if (iter_since_reset
+      && (!(iter_since_reset%dens_reset_freq_)
+          || accumulated_error + accuracy > dens_reset_error_ * accuracy)) {
+    reset_density();
+    iter_since_reset = 0;
+    accumulated_error = 0.0;
+  }
+  accumulated_error += accuracy;
+}
+
 double
 SCF::compute_vector(double& eelec, double nucrep)
 {
@@ -156,6 +175,7 @@ SCF::compute_vector(double& eelec, double nucrep)
   double delta = 1.0;
   int iter, iter_since_reset = 0;
   double accuracy = 1.0;
+  double accumulated_error = 0.0;
 
   ExEnv::out0() << indent
                 << "Beginning iterations.  Basis is "
@@ -169,12 +189,6 @@ SCF::compute_vector(double& eelec, double nucrep)
     delta = new_density();
     tim.exit("density");
 
-    // reset the density from time to time
-    if (iter_since_reset && !(iter_since_reset%dens_reset_freq_)) {
-      reset_density();
-      iter_since_reset = 0;
-    }
-
     // form the AO basis fock matrix & add density dependant H
     tim.enter("fock");
     double base_accuracy = delta;
@@ -183,13 +197,10 @@ SCF::compute_vector(double& eelec, double nucrep)
     double new_accuracy = 0.01 * base_accuracy;
     if (new_accuracy > 0.001) new_accuracy = 0.001;
     if (iter == 0) accuracy = new_accuracy;
-    else if (new_accuracy < accuracy) {
-      accuracy = new_accuracy/10.0;
-      if (iter_since_reset > 0) {
-        reset_density();
-        iter_since_reset = 0;
-      }
-    }
+    else if (new_accuracy < accuracy) accuracy = new_accuracy/10.0;
+
+    check_density_reset(iter_since_reset, accumulated_error, accuracy);
+
     ao_fock(accuracy);
     tim.exit("fock");
 
@@ -169,6 +169,8 @@ TCHF::ao_fock(double accuracy)
     double gmat_accuracy = accuracy;
     if (min_orthog_res() < 1.0) { gmat_accuracy *= min_orthog_res(); }
 
+    Ref<GBuildTaskQueue> tasks = gbuild_tasks(pmax, gmat_accuracy);
+
     for (i=0; i < nthread; i++) {
       if (i) {
         gmatas[i] = new double[ntri];
@@ -183,7 +185,8 @@ TCHF::ao_fock(double accuracy)
       conts[i] = new LocalTCContribution(gmatas[i], pmata, gmatbs[i], pmatb,
                                          kmatas[i], opmata, kmatbs[i], opmatb);
       gblds[i] = new LocalGBuild<LocalTCContribution>(*conts[i], tbis_[i],
-        pl, bs, scf_grp_, pmax, gmat_accuracy, nthread, i
+        pl, bs, scf_grp_, pmax, gmat_accuracy, nthread, i,
+        tasks.pointer()
         );
 
       threadgrp_->add_thread(i, gblds[i]);
@@ -204,6 +207,8 @@ TCHF::ao_fock(double accuracy)
       abort();
     }
     tim.exit("stop thread");
+
+    if (tasks) tasks->report(debug_ > 0);
       
     double tnint=0;
     for (i=0; i < nthread; i++) {
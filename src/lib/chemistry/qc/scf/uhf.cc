@@ -204,6 +204,8 @@ UHF::ao_fock(double accuracy)
     double gmat_accuracy = accuracy;
     if (min_orthog_res() < 1.0) { gmat_accuracy *= min_orthog_res(); }
 
+    Ref<GBuildTaskQueue> tasks = gbuild_tasks(pmax, gmat_accuracy);
+
     for (i=0; i < nthread; i++) {
       if (i) {
         gmats[i] = new double[ntri];
@@ -213,7 +215,8 @@ UHF::ao_fock(double accuracy)
       }
       conts[i] = new LocalUHFContribution(gmats[i], pmat, gmatos[i], pmato);
       gblds[i] = new LocalGBuild<LocalUHFContribution>(*conts[i], tbis_[i],
-        pl, bs, scf_grp_, pmax, gmat_accuracy, nthread, i
+        pl, bs, scf_grp_, pmax, gmat_accuracy, nthread, i,
+        tasks.pointer()
         );
 
       threadgrp_->add_thread(i, gblds[i]);
@@ -234,6 +237,8 @@ UHF::ao_fock(double accuracy)
       abort();
     }
     tim.exit("stop thread");
+
+    if (tasks) tasks->report(debug_ > 0);
       
     double tnint=0;
     for (i=0; i < nthread; i++) {
@@ -901,6 +901,7 @@ UnrestrictedSCF::compute_vector(double& eelec, double nucrep)
   double delta = 1.0;
   int iter, iter_since_reset = 0;
   double accuracy = 1.0;
+  double accumulated_error = 0.0;
 
   ExEnv::out0() << indent
                 << "Beginning iterations.  Basis is "
@@ -914,12 +915,6 @@ UnrestrictedSCF::compute_vector(double& eelec, double nucrep)
     delta = new_density();
     tim.exit("density");
 
-    // reset the density from time to time
-    if (iter_since_reset && !(iter_since_reset%dens_reset_freq_)) {
-      reset_density();
-      iter_since_reset = 0;
-    }
-
     // form the AO basis fock matrix
     tim.enter("fock");
     double base_accuracy = delta;
@@ -928,13 +923,10 @@ UnrestrictedSCF::compute_vector(double& eelec, double nucrep)
     double new_accuracy = 0.01 * base_accuracy;
     if (new_accuracy > 0.001) new_accuracy = 0.001;
     if (iter == 0) accuracy = new_accuracy;
-    else if (new_accuracy < accuracy) {
-      accuracy = new_accuracy/10.0;
-      if (iter_since_reset > 0) {
-        reset_density();
-        iter_since_reset = 0;
-      }
-    }
+    else if (new_accuracy < accuracy) accuracy = new_accuracy/10.0;
+
+    check_density_reset(iter_since_reset, accumulated_error, accuracy);
+
     ao_fock(accuracy);
     tim.exit("fock");
 
@@ -26,11 +26,13 @@
 //
 
 #include <stdexcept>
+#include <algorithm>
 
 #include <util/misc/formio.h>
 #include <util/render/polygons.h>
 #include <math/scmat/local.h>
 #include <math/scmat/vector3.h>
+#include <math/scmat/blas.h>
 #include <chemistry/molecule/molecule.h>
 #include <chemistry/qc/wfn/density.h>
 #include <util/misc/scexception.h>
@@ -227,6 +229,17 @@ BatchElectronDensity::zero_pointers()
   bs_values_ = 0;
   bsg_values_ = 0;
   bsh_values_ = 0;
+
+  batch_capacity_ = 0;
+  batch_npoint_ = 0;
+  batch_dmat_capacity_ = 0;
+  batch_shells_ = 0;
+  batch_shell_bound_ = 0;
+  batch_list_bound_ = 0;
+  batch_values_ = 0;
+  batch_gvalues_ = 0;
+  batch_dmat_ = 0;
+  batch_scratch_ = 0;
 }
 
 void
@@ -244,6 +257,13 @@ BatchElectronDensity::clear()
   delete[] bs_values_;
   delete[] bsg_values_;
   delete[] bsh_values_;
+  delete[] batch_shells_;
+  delete[] batch_shell_bound_;
+  delete[] batch_list_bound_;
+  delete[] batch_values_;
+  delete[] batch_gvalues_;
+  delete[] batch_dmat_;
+  delete[] batch_scratch_;
   delete valdat_;
   initialized_ = false;
 
@@ -634,6 +654,224 @@ BatchElectronDensity::compute_density(const SCVector3 &r,
 
 }
 
+void
+BatchElectronDensity::init_batch_data(int npoint)
+{
+  if (batch_shells_ == 0) {
+      batch_shells_ = new int[nshell_];
+      batch_shell_bound_ = new double[nshell_];
+      batch_list_bound_ = new double[nshell_];
+    }
+
+  if (npoint <= batch_capacity_) return;
+
+  delete[] batch_values_;
+  delete[] batch_gvalues_;
+  delete[] batch_scratch_;
+
+  batch_capacity_ = npoint;
+  batch_values_ = new double[npoint*nbasis_];
+  batch_gvalues_ = new double[3*npoint*nbasis_];
+  batch_scratch_ = new double[npoint*nbasis_];
+}
+
+int
+BatchElectronDensity::batch_shells(int npoint, const SCVector3 *r,
+                                   int *shells, double *bounds)
+{
+  if (!linear_scaling_ || extent_ == 0) return -1;
+
+  init_batch_data(0);
+
+  int i, ipoint;
+  for (i=0; i<nshell_; i++) batch_shell_bound_[i] = -1.0;
+  int nshell = 0;
+  for (ipoint=0; ipoint<npoint; ipoint++) {
+      const std::vector<ExtentData> &cs
+          = extent_->contributing_shells(r[ipoint][0],
+                                         r[ipoint][1],
+                                         r[ipoint][2]);
+      for (i=0; i<cs.size(); i++) {
+          int ish = cs[i].shell;
+          if (batch_shell_bound_[ish] < 0.0)
+              shells[nshell++] = ish;
+          if (cs[i].bound > batch_shell_bound_[ish])
+              batch_shell_bound_[ish] = cs[i].bound;
+        }
+    }
+  std::sort(shells, shells + nshell);
+  for (i=0; i<nshell; i++) bounds[i] = batch_shell_bound_[shells[i]];
+
+  return nshell;
+}
+
+void
+BatchElectronDensity::compute_batch_basis_values(int npoint,
+                                                 const SCVector3 *r,
+                                                 bool need_gradient,
+                                                 int ncandidate,
+                                                 const int *candidates,
+                                                 const double *bounds)
+{
+  int i, j, ipoint;
+
+  // find the shells that contribute at any of the points, using the
+  // largest bound of each shell over the batch
+  if (candidates == 0) {
+      ncandidate = batch_shells(npoint, r, batch_shells_, batch_list_bound_);
+      candidates = batch_shells_;
+      bounds = batch_list_bound_;
+    }
+
+  if (ncandidate >= 0) {
+      ncontrib_ = 0;
+      for (i=0; i<ncandidate; i++) {
+          int ish = candidates[i];
+          int contrib = !use_dmat_bound_;
+          for (j=0; !contrib && j<ncandidate; j++) {
+              int jsh = candidates[j];
+              int ijsh = (ish>jsh)?((ish*(ish+1))/2+jsh):((jsh*(jsh+1))/2+ish);
+              if (bounds[i]*bounds[j]*dmat_bound_[ijsh] > 0.00001*accuracy_) {
+                  contrib = 1;
+                }
+            }
+          if (contrib) contrib_[ncontrib_++] = ish;
+        }
+    }
+  else {
+      ncontrib_ = nshell_;
+      for (i=0; i<nshell_; i++) contrib_[i] = i;
+    }
+
+  ncontrib_bf_ = 0;
+  for (i=0; i<ncontrib_; i++) {
+      int nbf = basis_->shell(contrib_[i]).nfunction();
+      int bf = basis_->shell_to_function(contrib_[i]);
+      for (j=0; j<nbf; j++, bf++) {
+          contrib_bf_[ncontrib_bf_++] = bf;
+        }
+    }
+
+  // compute the basis function values directly into the rows of the
+  // batch matrix; the gradients are computed into scratch and then
+  // distributed into the x, y, and z matrices
+  const int nbf = ncontrib_bf_;
+  for (ipoint=0; ipoint<npoint; ipoint++) {
+      double *bsv = &batch_values_[ipoint*nbf];
+      double *bsg = (need_gradient?bsg_values_:0);
+      for (i=0; i<ncontrib_; i++) {
+          basis_->hessian_shell_values(r[ipoint],contrib_[i],valdat_,
+                                       0,bsg,bsv);
+          int shsize = basis_->shell(contrib_[i]).nfunction();
+          if (bsg) bsg += 3 * shsize;
+          bsv += shsize;
+        }
+      if (need_gradient) {
+          for (int ixyz=0; ixyz<3; ixyz++) {
+              double *g = &batch_gvalues_[(ixyz*npoint + ipoint)*nbf];
+              for (i=0; i<nbf; i++) g[i] = bsg_values_[i*3+ixyz];
+            }
+        }
+    }
+}
+
+void
+BatchElectronDensity::compute_batch_spin_density(const double *dmat,
+                                                 double *RESTRICT rho,
+                                                 double *RESTRICT grad)
+{
+  int i, j, ipoint;
+  const int nbf = ncontrib_bf_;
+  const int npoint = batch_npoint_;
+
+  // gather the density matrix elements of the contributing functions
+  // into a square matrix
+  if (nbf*nbf > batch_dmat_capacity_) {
+      delete[] batch_dmat_;
+      batch_dmat_capacity_ = nbf*nbf;
+      batch_dmat_ = new double[batch_dmat_capacity_];
+    }
+  for (i=0; i<nbf; i++) {
+      int it = contrib_bf_[i];
+      int itoff = (it*(it+1))>>1;
+      for (j=0; j<=i; j++) {
+          // contrib_bf_ is in increasing order
+          double d = dmat[itoff + contrib_bf_[j]];
+          batch_dmat_[i*nbf+j] = d;
+          batch_dmat_[j*nbf+i] = d;
+        }
+    }
+
+  // T = X D, then rho = sum_mu T X and grad rho = 2 sum_mu T del X
+  C_DGEMM('n', 'n', npoint, nbf, nbf, 1.0, batch_values_, nbf,
+          batch_dmat_, nbf, 0.0, batch_scratch_, nbf);
+
+  for (ipoint=0; ipoint<npoint; ipoint++) {
+      const double *RESTRICT t = &batch_scratch_[ipoint*nbf];
+      const double *RESTRICT x = &batch_values_[ipoint*nbf];
+      double r = 0.0;
+      for (i=0; i<nbf; i++) r += t[i]*x[i];
+      rho[ipoint] = r;
+      if (grad) {
+          for (int ixyz=0; ixyz<3; ixyz++) {
+              const double *RESTRICT g
+                  = &batch_gvalues_[(ixyz*npoint + ipoint)*nbf];
+              double gr = 0.0;
+              for (i=0; i<nbf; i++) gr += t[i]*g[i];
+              grad[ipoint*3+ixyz] = 2.0*gr;
+            }
+        }
+    }
+}
+
+void
+BatchElectronDensity::compute_density_batch(int npoint, const SCVector3 *r,
+                                            double *adens, double *agrad,
+                                            double *bdens, double *bgrad)
+{
+  compute_density_batch(npoint, r, -1, 0, 0, adens, agrad, bdens, bgrad);
+}
+
+void
+BatchElectronDensity::compute_density_batch(int npoint, const SCVector3 *r,
+                                            int nshell, const int *shells,
+                                            const double *bounds,
+                                            double *adens, double *agrad,
+                                            double *bdens, double *bgrad)
+{
+  if (alpha_dmat_ == 0) {
+      if (wfn_.null()) {
+          throw ProgrammingError("BatchElectronDensity::compute_density_batch: "
+                                 "set_densities must be used to initialize "
+                                 "object if wfn is not given",
+                                 __FILE__, __LINE__);
+        }
+      else {
+          if (!initialized_) {
+              init();
+            }
+          set_densities(wfn_);
+        }
+    }
+
+  init_batch_data(npoint);
+  batch_npoint_ = npoint;
+
+  compute_batch_basis_values(npoint, r, (agrad!=0) || (bgrad!=0),
+                             nshell, shells, bounds);
+
+  compute_batch_spin_density(alpha_dmat_, adens, agrad);
+
+  if (spin_polarized_) {
+      compute_batch_spin_density(beta_dmat_, bdens, bgrad);
+    }
+  else {
+      for (int i=0; i<npoint; i++) bdens[i] = adens[i];
+      if (bgrad!=0)
+          for (int i=0; i<3*npoint; i++) bgrad[i] = agrad[i];
+    }
+}
+
 void
 BatchElectronDensity::compute()
 {
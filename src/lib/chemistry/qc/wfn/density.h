@@ -85,6 +85,18 @@ class BatchElectronDensity: public Volume {
     double *bsg_values_;
     double *bsh_values_;
 
+    // private data for batches of points
+    int batch_capacity_;
+    int batch_npoint_;
+    double *batch_shell_bound_;
+    double *batch_list_bound_;
+    double *batch_values_;
+    double *batch_gvalues_;
+    int batch_dmat_capacity_;
+    int *batch_shells_;
+    double *batch_dmat_;
+    double *batch_scratch_;
+
     int nshell_;
     int nbasis_;
     bool spin_polarized_;
@@ -106,6 +118,15 @@ class BatchElectronDensity: public Volume {
                               double *RESTRICT rho,
                               double *RESTRICT grad,
                               double *RESTRICT hess);
+    void init_batch_data(int npoint);
+    void compute_batch_basis_values(int npoint, const SCVector3 *r,
+                                    bool need_gradient,
+                                    int ncandidate,
+                                    const int *candidates,
+                                    const double *bounds);
+    void compute_batch_spin_density(const double *dmat,
+                                    double *RESTRICT rho,
+                                    double *RESTRICT grad);
 
     virtual void compute();
   public:
@@ -152,6 +173,39 @@ class BatchElectronDensity: public Volume {
                          double *beta_density_grad,
                          double *beta_density_hessian);
 
+    /** Computes the densities, and their gradients if the gradient
+        pointers are nonnull, at each of the npoint points in r.  The
+        gradients are stored as grad[3*ipoint+ixyz].  This is more
+        efficient than calling compute_density for each point if the
+        points are close to each other: the basis functions that are
+        significant at any of the points are evaluated for all of them and
+        the density is formed with matrix multiplies.  The hessian is not
+        available.  The basis function values for the batch are then
+        available with batch_values() and batch_gradient_values(). */
+    void compute_density_batch(int npoint, const SCVector3 *r,
+                               double *alpha_density,
+                               double *alpha_density_grad,
+                               double *beta_density,
+                               double *beta_density_grad);
+    /** As above, but the shells that may be nonzero at the points are
+        given, as computed by batch_shells.  This avoids looking up the
+        shell extents again if the same batch is used repeatedly.  If
+        nshell is negative, all shells are used. */
+    void compute_density_batch(int npoint, const SCVector3 *r,
+                               int nshell, const int *shells,
+                               const double *bounds,
+                               double *alpha_density,
+                               double *alpha_density_grad,
+                               double *beta_density,
+                               double *beta_density_grad);
+    /** Finds the shells that may be nonzero at any of the npoint points in
+        r, and the largest bound of each over the points.  The shells are
+        placed in ascending order in shells and their bounds in bounds;
+        each must have room for one value per shell of the basis set.  The number of shells is
+        returned, or -1 if shell extents are not used. */
+    int batch_shells(int npoint, const SCVector3 *r,
+                     int *shells, double *bounds);
+
     /** This is called to finish initialization of the object.  It must not
         be called with objects created in a way that they share parent
         data; those objects are initialized when they are constructed. This
@@ -207,6 +261,19 @@ class BatchElectronDensity: public Volume {
     double *bs_values() { return bs_values_; }
     double *bsg_values() { return bsg_values_; }
     double *bsh_values() { return bsh_values_; }
+    /** The basis function values computed by the last call to
+        compute_density_batch.  This is a row-major npoint by
+        ncontrib_bf() matrix; the columns correspond to the basis
+        functions in contrib_bf(). */
+    double *batch_values() { return batch_values_; }
+    /** The basis function gradients computed by the last call to
+        compute_density_batch.  These are three consecutive matrices,
+        for x, y, and z, each laid out as batch_values(). */
+    double *batch_gradient_values() { return batch_gvalues_; }
+    /** The shell extents used to find the contributing shells.  This is
+        null if linear scaling is not used or if the object has not been
+        initialized. */
+    ShellExtent *shell_extent() { return extent_; }
     /** To ensure that that the basis functions gradients are computed,
         use this. */
     void set_need_basis_gradient(bool b) { need_basis_gradient_ = b; }
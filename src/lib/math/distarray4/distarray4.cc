@@ -168,7 +168,7 @@ DistArray4::tasks_with_access(vector<int>& twa_map) const
 namespace sc{ namespace detail {
 
 void store_memorygrp(Ref<DistArray4>& acc, Ref<MemoryGrp>& mem, int i_offset,
-                     int ni, const size_t blksize_memgrp) {
+                     int ni, const size_t blksize_memgrp, bool remote_only) {
   // if the accumulator does not accept data from this task, bolt
   if (acc->has_access(mem->me()) == false)
     return;
@@ -222,7 +222,7 @@ void store_memorygrp(Ref<DistArray4>& acc, Ref<MemoryGrp>& mem, int i_offset,
           mem->release_readonly(const_cast<void*>(static_cast<const void*>(data)), moffset, blksize);
           moffset += blksize_memgrp;
         }
-      } else {
+      } else if (!remote_only) {
         const double* data = (const double *) ((size_t)mem->localdata() + blksize_memgrp
             *num_te_types*local_ij_index);
         for (int te_type=0; te_type < num_te_types; te_type++) {
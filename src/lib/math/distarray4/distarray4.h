@@ -337,9 +337,12 @@ namespace detail {
    has blksize_memgrp bytes allocated for it. Note that
    blksize_memgrp may be larger than blksize_ because an ij-block of partially
    transformed integrals may be larger than the block of fully transformed integrals.
+   If remote_only is true, the blocks held by this task in mem are skipped (they
+   must have been stored already).
    */
   void store_memorygrp(Ref<DistArray4>& acc, Ref<MemoryGrp>& mem, int i_offset,
-                       int ni, const size_t blksize_memgrp = 0);
+                       int ni, const size_t blksize_memgrp = 0,
+                       bool remote_only = false);
 
   /** Reverse of store_memorygrp(). storage specifies the target storage of integrals in mem.
    * Give acc->storage() to maintain the same storage as in acc.
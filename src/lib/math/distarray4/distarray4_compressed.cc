@@ -0,0 +1,449 @@
+//
+// distarray4_compressed.cc
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <util/misc/consumableresources.h>
+#include <util/misc/scexception.h>
+#include <util/misc/formio.h>
+#include <util/misc/exenv.h>
+#include <math/distarray4/distarray4_compressed.h>
+
+using namespace std;
+using namespace sc;
+
+namespace {
+
+  // the first byte of a compressed block specifies the encoding
+  enum Encoding { Raw = 0, ShuffleRLE = 1, Quantized = 2 };
+
+  /// The RLE encoding of n bytes in src is appended to dst. A control byte
+  /// c < 128 is followed by c+1 literal bytes, c >= 128 by one byte that is
+  /// repeated c-125 times.
+  void rle_encode(const unsigned char* src, size_t n, std::vector<unsigned char>& dst) {
+    size_t i = 0;
+    while (i < n) {
+      size_t run = 1;
+      while (i + run < n && run < 130 && src[i+run] == src[i]) ++run;
+      if (run >= 3) {
+        dst.push_back(static_cast<unsigned char>(run + 125));
+        dst.push_back(src[i]);
+        i += run;
+        continue;
+      }
+      // literals end where a run of 3 begins
+      size_t lit = 0;
+      while (i + lit < n && lit < 128) {
+        if (i + lit + 2 < n && src[i+lit] == src[i+lit+1] && src[i+lit] == src[i+lit+2])
+          break;
+        ++lit;
+      }
+      dst.push_back(static_cast<unsigned char>(lit - 1));
+      dst.insert(dst.end(), src + i, src + i + lit);
+      i += lit;
+    }
+  }
+
+  /// decodes exactly n bytes into dst; returns the number of bytes of src used
+  size_t rle_decode(const unsigned char* src, size_t nsrc, unsigned char* dst, size_t n) {
+    size_t s = 0, d = 0;
+    while (d < n) {
+      if (s >= nsrc)
+        throw ProgrammingError("DistArray4_Compressed -- corrupt block", __FILE__, __LINE__);
+      const unsigned int c = src[s++];
+      if (c < 128) {
+        std::memcpy(dst + d, src + s, c + 1);
+        s += c + 1;
+        d += c + 1;
+      }
+      else {
+        std::memset(dst + d, src[s++], c - 125);
+        d += c - 125;
+      }
+    }
+    return s;
+  }
+
+  void shuffle_rle_encode(const double* ints, size_t n, std::vector<unsigned char>& dst) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(ints);
+    std::vector<unsigned char> shuffled(n * sizeof(double));
+    for(size_t b=0; b<sizeof(double); ++b) {
+      unsigned char* plane = &shuffled[b * n];
+      for(size_t k=0; k<n; ++k)
+        plane[k] = bytes[k * sizeof(double) + b];
+    }
+    rle_encode(&shuffled[0], shuffled.size(), dst);
+  }
+
+  void shuffle_rle_decode(const unsigned char* src, size_t nsrc, double* ints, size_t n) {
+    std::vector<unsigned char> shuffled(n * sizeof(double));
+    rle_decode(src, nsrc, &shuffled[0], shuffled.size());
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(ints);
+    for(size_t b=0; b<sizeof(double); ++b) {
+      const unsigned char* plane = &shuffled[b * n];
+      for(size_t k=0; k<n; ++k)
+        bytes[k * sizeof(double) + b] = plane[k];
+    }
+  }
+
+  /// Rounds each element to the nearest multiple of tolerance and appends the
+  /// zigzag-encoded multiples as LEB128 varints. Returns false if a multiple is too large.
+  /// (Rounding to multiples of 2*tolerance would allow errors slightly above tolerance.)
+  bool quantize_encode(const double* ints, size_t n, double tolerance,
+                       std::vector<unsigned char>& dst) {
+    const double scale = 1.0 / tolerance;
+    const double qmax = 4.0e18; // below 2^62
+    for(size_t k=0; k<n; ++k) {
+      const double q = std::floor(ints[k] * scale + 0.5);
+      if (!(std::fabs(q) < qmax)) return false; // also catches NaN
+      const long long iq = static_cast<long long>(q);
+      unsigned long long z = (static_cast<unsigned long long>(iq) << 1) ^
+                             static_cast<unsigned long long>(iq >> 63);
+      while (z >= 0x80) {
+        dst.push_back(static_cast<unsigned char>(z | 0x80));
+        z >>= 7;
+      }
+      dst.push_back(static_cast<unsigned char>(z));
+    }
+    return true;
+  }
+
+  void quantize_decode(const unsigned char* src, size_t nsrc, double tolerance,
+                       double* ints, size_t n) {
+    const double step = tolerance;
+    size_t s = 0;
+    for(size_t k=0; k<n; ++k) {
+      unsigned long long z = 0;
+      int shift = 0;
+      unsigned char c;
+      do {
+        if (s >= nsrc)
+          throw ProgrammingError("DistArray4_Compressed -- corrupt block", __FILE__, __LINE__);
+        c = src[s++];
+        z |= static_cast<unsigned long long>(c & 0x7f) << shift;
+        shift += 7;
+      } while (c & 0x80);
+      const long long iq = static_cast<long long>(z >> 1) ^ -static_cast<long long>(z & 1);
+      ints[k] = iq * step;
+    }
+  }
+
+}
+
+///////////////////////////////////////////////////////////////
+
+static ClassDesc DistArray4_Compressed_cd(
+  typeid(DistArray4_Compressed),"DistArray4_Compressed",1,"public DistArray4",
+  0, 0, create<DistArray4_Compressed>);
+
+DistArray4_Compressed::DistArray4_Compressed(int num_te_types,
+                                             int ni, int nj, int nx, int ny,
+                                             double tolerance,
+                                             DistArray4Storage storage) :
+  DistArray4(num_te_types, ni, nj, nx, ny, storage), tolerance_(tolerance)
+{
+  init();
+}
+
+DistArray4_Compressed::DistArray4_Compressed(StateIn& si) :
+  DistArray4(si)
+{
+  si.get(tolerance_);
+  init();
+  const int nij = ni() * nj();
+  for(int ij=0; ij<nij; ++ij)
+    for(int type=0; type<num_te_types(); ++type) {
+      unsigned long size; si.get(size);
+      if (size == 0) continue;
+      PairBlkInfo& pb = pairblk_[ij];
+      ConsumableResources::get_default_instance()->consume_memory(size);
+      pb.data_[type] = new unsigned char[size];
+      pb.size_[type] = size;
+      si.get_array_char(reinterpret_cast<char*>(pb.data_[type]), size);
+      compressed_size_ += size;
+    }
+}
+
+DistArray4_Compressed::~DistArray4_Compressed() {
+  const int nij = ni() * nj();
+  for(int ij=0; ij<nij; ++ij)
+    for(int type=0; type<num_te_types(); ++type) {
+      PairBlkInfo& pb = pairblk_[ij];
+      if (pb.manage_[type] && pb.ints_[type] != NULL)
+        deallocate(pb.ints_[type]);
+      if (pb.data_[type] != NULL)
+        delete[] pb.data_[type];
+    }
+  delete[] pairblk_;
+  ConsumableResources::get_default_instance()->release_memory(compressed_size_);
+}
+
+void
+DistArray4_Compressed::save_data_state(StateOut& so)
+{
+  DistArray4::save_data_state(so);
+  so.put(tolerance_);
+  const int nij = ni() * nj();
+  for(int ij=0; ij<nij; ++ij)
+    for(int type=0; type<num_te_types(); ++type) {
+      const PairBlkInfo& pb = pairblk_[ij];
+      so.put((unsigned long)pb.size_[type]);
+      if (pb.size_[type] != 0)
+        so.put_array_char(reinterpret_cast<const char*>(pb.data_[type]), pb.size_[type]);
+    }
+}
+
+Ref<DistArray4>
+DistArray4_Compressed::clone(const DistArray4Dimensions& dim) {
+  Ref<DistArray4> result;
+  if (dim == DistArray4Dimensions::default_dim())
+    result = new DistArray4_Compressed(num_te_types(), ni(), nj(), nx(), ny(),
+                                       tolerance_, storage());
+  else
+    result = new DistArray4_Compressed(dim.num_te_types(),
+                                       dim.n1(), dim.n2(), dim.n3(), dim.n4(),
+                                       tolerance_, dim.storage());
+  return result;
+}
+
+void
+DistArray4_Compressed::init()
+{
+  compressed_size_ = 0;
+  const int nij = ni() * nj();
+  pairblk_ = new PairBlkInfo[nij];
+  for(int ij=0; ij<nij; ++ij)
+    for(int type=0; type<num_te_types(); ++type) {
+      PairBlkInfo& pb = pairblk_[ij];
+      pb.ints_[type] = NULL;
+      pb.manage_[type] = false;
+      pb.refcount_[type] = 0;
+      pb.data_[type] = NULL;
+      pb.size_[type] = 0;
+    }
+}
+
+void
+DistArray4_Compressed::compress_block(int ij, tbint_type oper_type, const double* ints)
+{
+  const size_t n = nxy();
+  std::vector<unsigned char> encoded;
+  encoded.reserve(blksize() + 1);
+  encoded.push_back(Quantized);
+  bool compressed = (tolerance_ > 0.0) && quantize_encode(ints, n, tolerance_, encoded);
+  if (!compressed) {
+    encoded.resize(1);
+    encoded[0] = ShuffleRLE;
+    shuffle_rle_encode(ints, n, encoded);
+  }
+  if (encoded.size() >= blksize() + 1) {
+    encoded.resize(1);
+    encoded[0] = Raw;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(ints);
+    encoded.insert(encoded.end(), bytes, bytes + blksize());
+  }
+
+  // the compressed blocks are charged to the memory at their actual size
+  ConsumableResources::get_default_instance()->consume_memory(encoded.size());
+  unsigned char* data = new unsigned char[encoded.size()];
+  std::copy(encoded.begin(), encoded.end(), data);
+
+  unsigned char* old_data;
+  size_t old_size;
+  {
+    std::lock_guard<std::mutex> lock(store_lock_);
+    PairBlkInfo& pb = pairblk_[ij];
+    old_data = pb.data_[oper_type];
+    old_size = pb.size_[oper_type];
+    compressed_size_ += encoded.size();
+    compressed_size_ -= old_size;
+    pb.data_[oper_type] = data;
+    pb.size_[oper_type] = encoded.size();
+  }
+  if (old_data != NULL) {
+    delete[] old_data;
+    ConsumableResources::get_default_instance()->release_memory(old_size);
+  }
+}
+
+size_t
+DistArray4_Compressed::estimated_block_size(size_t n, double tolerance)
+{
+  const size_t raw = n * sizeof(double) + 1;
+  if (tolerance <= 0.0)
+    return raw;
+  // integrals over normalized orbitals do not exceed this in magnitude
+  const double max_integral = 100.0;
+  // the zigzag-encoded multiples of tolerance take 7 bits per varint byte
+  const double bits = std::log(2.0 * max_integral / tolerance + 1.0) / std::log(2.0);
+  const size_t estimate = static_cast<size_t>(std::ceil(bits / 7.0)) * n + 1;
+  return std::min(estimate, raw);
+}
+
+void
+DistArray4_Compressed::decompress_block(int ij, tbint_type oper_type, double* buf) const
+{
+  const PairBlkInfo& pb = pairblk_[ij];
+  const unsigned char* data = pb.data_[oper_type];
+  if (data == NULL) {
+    std::fill(buf, buf + nxy(), 0.0);
+    return;
+  }
+  const size_t size = pb.size_[oper_type] - 1;
+  switch (data[0]) {
+    case Raw:
+      std::memcpy(buf, data + 1, blksize());
+      break;
+    case ShuffleRLE:
+      shuffle_rle_decode(data + 1, size, buf, nxy());
+      break;
+    case Quantized:
+      quantize_decode(data + 1, size, tolerance_, buf, nxy());
+      break;
+    default:
+      throw ProgrammingError("DistArray4_Compressed::decompress_block -- corrupt block",
+                             __FILE__, __LINE__);
+  }
+}
+
+void
+DistArray4_Compressed::store_pair_block(int i, int j, tbint_type oper_type, const double *ints)
+{
+  MPQC_ASSERT(this->active());  //make sure we are active
+  if (!is_avail(i,j))
+    throw ProgrammingError("DistArray4_Compressed::store_pair_block -- can only be called on node 0",
+                           __FILE__,__LINE__);
+  compress_block(ij_index(i,j), oper_type, ints);
+}
+
+void
+DistArray4_Compressed::store_pair_subblock(int i, int j, tbint_type oper_type,
+                                           int xstart, int xfence, int ystart, int yfence,
+                                           const double *ints)
+{
+  MPQC_ASSERT(this->active());  //make sure we are active
+  if (!is_avail(i,j))
+    throw ProgrammingError("DistArray4_Compressed::store_pair_subblock -- can only be called on node 0",
+                           __FILE__,__LINE__);
+
+  const int ij = ij_index(i,j);
+  const int ysize = yfence - ystart;
+  double* block = allocate<double>(nxy());
+  decompress_block(ij, oper_type, block);
+  double* dst = block + xstart*ny() + ystart;
+  for(int x=xstart; x<xfence; ++x, dst+=ny(), ints+=ysize)
+    std::copy(ints, ints + ysize, dst);
+  compress_block(ij, oper_type, block);
+  deallocate(block);
+}
+
+const double *
+DistArray4_Compressed::retrieve_pair_block(int i, int j, tbint_type oper_type,
+                                           double* buf) const
+{
+  MPQC_ASSERT(this->active());  //make sure we are active
+  if (!is_avail(i, j))
+    throw ProgrammingError("DistArray4_Compressed::retrieve_pair_block -- can only be called on node 0",
+                           __FILE__,__LINE__);
+
+  const int ij = ij_index(i, j);
+  const PairBlkInfo* pb = &pairblk_[ij];
+  // if I don't manage the memory for this block, assume that the user is in charge of memory management
+  // therefore decompress again
+  if (pb->ints_[oper_type] == 0 || pb->manage_[oper_type] == false) {
+    if (buf != 0) {
+      pb->ints_[oper_type] = buf;
+      pb->manage_[oper_type] = false;
+    }
+    else {
+      pb->ints_[oper_type] = allocate<double>(nxy());
+      pb->manage_[oper_type] = true;
+    }
+    decompress_block(ij, oper_type, pb->ints_[oper_type]);
+  }
+  else { // data is already available
+    if (buf != 0 && buf != pb->ints_[oper_type]) // may need to copy
+      std::copy(pb->ints_[oper_type], pb->ints_[oper_type] + nxy(), buf);
+  }
+  pb->refcount_[oper_type] += 1;
+  if (buf)
+    return buf;
+  else
+    return pb->ints_[oper_type];
+}
+
+void
+DistArray4_Compressed::retrieve_pair_subblock(int i, int j, tbint_type oper_type,
+                                              int xstart, int xfence, int ystart, int yfence,
+                                              double* buf) const
+{
+  MPQC_ASSERT(this->active());  //make sure we are active
+  if (!is_avail(i, j))
+    throw ProgrammingError("DistArray4_Compressed::retrieve_pair_subblock -- can only be called on node 0",
+                           __FILE__,__LINE__);
+
+  const int ij = ij_index(i, j);
+  const PairBlkInfo* pb = &pairblk_[ij];
+  const int ysize = yfence - ystart;
+  double* block = 0;
+  const double* src;
+  if (pb->ints_[oper_type] != 0 && pb->manage_[oper_type]) // already decompressed
+    src = pb->ints_[oper_type];
+  else {
+    block = allocate<double>(nxy());
+    decompress_block(ij, oper_type, block);
+    src = block;
+  }
+  src += xstart*ny() + ystart;
+  for(int x=xstart; x<xfence; ++x, src+=ny(), buf+=ysize)
+    std::copy(src, src + ysize, buf);
+  if (block)
+    deallocate(block);
+}
+
+void
+DistArray4_Compressed::release_pair_block(int i, int j, tbint_type oper_type) const
+{
+  MPQC_ASSERT(this->active());  //make sure we are active
+  if (is_avail(i,j)) {
+    const int ij = ij_index(i,j);
+    const PairBlkInfo *pb = &pairblk_[ij];
+    if (pb->refcount_[oper_type] <= 0) {
+      ExEnv::outn() << indent << me() << ":refcount=0: i = " << i << " j = " << j << " tbint_type = " << oper_type << endl;
+      throw std::runtime_error("Logic error: DistArray4_Compressed::release_pair_block: refcount is already zero!");
+    }
+    if (pb->ints_[oper_type] != NULL && pb->refcount_[oper_type] == 1) {
+      if (pb->manage_[oper_type]) // deallocate if managed by me
+        deallocate(pb->ints_[oper_type]);
+      pb->ints_[oper_type] = NULL;
+      pb->manage_[oper_type] = false;
+    }
+    pb->refcount_[oper_type] -= 1;
+  }
+}
+
+// Local Variables:
+// mode: c++
+// c-file-style: "CLJ"
+// End:
@@ -0,0 +1,131 @@
+//
+// distarray4_compressed.h
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#ifndef _math_distarray4_distarray4_compressed_h
+#define _math_distarray4_distarray4_compressed_h
+
+#include <mutex>
+#include <util/ref/ref.h>
+#include <math/distarray4/distarray4.h>
+
+namespace sc {
+
+/////////////////////////////////////////////////////////////////////
+/** DistArray4_Compressed holds transformed integrals in memory of node 0,
+    each pair block compressed separately. Its access semantics are those of
+    DistArray4_Node0File, hence it can be used wherever the latter can.
+
+    If tolerance() is zero the compression is lossless: the bytes of the
+    block are shuffled so that the bytes of equal significance of all
+    elements are adjacent (sign and exponent bytes of integrals are highly
+    repetitive) and then run-length encoded. If tolerance() is positive,
+    each element is rounded to the nearest multiple of tolerance() and
+    the multiples are stored as variable-length integers, hence the
+    absolute error of every element does not exceed tolerance(). Blocks that
+    do not compress are stored as is.
+
+    A retrieved block is decompressed into a buffer that is held until
+    release_pair_block() is called.
+
+    Since node 0 holds all blocks, the transforms count the estimated size
+    of the whole array (see estimated_block_size()) against the memory of
+    node 0 when they choose the batch size; the memory of the other nodes
+    is not used. The compressed blocks are charged to ConsumableResources
+    at their actual size as they are stored, hence a store that does not
+    fit throws LimitExceeded.
+*/
+
+class DistArray4_Compressed: public DistArray4 {
+
+    double tolerance_;
+
+    struct PairBlkInfo {
+      // ints_ etc. are mutable since these data are only cached
+      mutable double* ints_[max_num_te_types];      // uncompressed blocks corresponding to each operator type
+      mutable bool manage_[max_num_te_types];       // is the buffer managed by me?
+      mutable int refcount_[max_num_te_types];      // number of references
+      unsigned char* data_[max_num_te_types];       // compressed blocks
+      size_t size_[max_num_te_types];               // their sizes in bytes
+    };
+    PairBlkInfo* pairblk_;
+    size_t compressed_size_;
+    std::mutex store_lock_;
+
+    /// Initialization tasks common to all constructors
+    void init();
+    /// replaces the compressed block of pair ij and oper_type with ints
+    void compress_block(int ij, tbint_type oper_type, const double* ints);
+    /// decompresses the block of pair ij and oper_type into buf (unstored blocks are zero)
+    void decompress_block(int ij, tbint_type oper_type, double* buf) const;
+
+  public:
+    /** @param tolerance the maximum absolute error of the stored integrals;
+        the default is to compress losslessly. */
+    DistArray4_Compressed(int num_te_types, int ni, int nj, int nx, int ny,
+                          double tolerance = 0.0,
+                          DistArray4Storage storage = DistArray4Storage_XY);
+    DistArray4_Compressed(StateIn&);
+    ~DistArray4_Compressed();
+    void save_data_state(StateOut&);
+
+    Ref<DistArray4> clone(const DistArray4Dimensions& dim = DistArray4Dimensions::default_dim());
+
+    /// implementation of DistArray4::data_persistent()
+    bool data_persistent() const { return true; }
+
+    void store_pair_block(int i, int j, tbint_type oper_type, const double* ints);
+    void store_pair_subblock(int i, int j, tbint_type oper_type,
+                             int xstart, int xfence, int ystart, int yfence,
+                             const double* ints);
+    const double* retrieve_pair_block(int i, int j, tbint_type oper_type, double* buf = 0) const;
+    void retrieve_pair_subblock(int i, int j, tbint_type oper_type,
+                                int xstart, int xfence, int ystart, int yfence,
+                                double* buf) const;
+    /// Releases an ij pair block of integrals
+    void release_pair_block(int i, int j, tbint_type oper_type) const;
+
+    /// the maximum absolute error of the stored integrals, 0 if lossless
+    double tolerance() const { return tolerance_; }
+    /// the total size of the compressed blocks, in bytes
+    size_t compressed_size() const { return compressed_size_; }
+    /** An estimate of the bytes taken by a stored block of n integrals,
+        which is an upper bound if no integral exceeds 100 in magnitude.
+        Lossless compression is not predictable, hence for tolerance = 0
+        this is the uncompressed size. */
+    static size_t estimated_block_size(size_t n, double tolerance);
+
+    /// Is this block stored locally?
+    bool is_local(int i, int j) const { return (me() == 0);};
+    /// In this implementation blocks are available only on node 0
+    bool is_avail(int i, int j) const { return (me() == 0);};
+    /// Does this task have access to all the integrals?
+    bool has_access(int proc) const { return (proc == 0);};
+};
+
+}
+
+#endif
+
+// Local Variables:
+// mode: c++
+// c-file-style: "CLJ"
+// End:
@@ -0,0 +1,332 @@
+//
+// distarray4_mmapfile.cc
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <util/misc/scexception.h>
+#include <util/misc/formio.h>
+#include <util/misc/exenv.h>
+#include <math/distarray4/distarray4_mmapfile.h>
+
+using namespace std;
+using namespace sc;
+
+namespace {
+  // the number of consecutive (non)sequential retrievals after which the
+  // advice for the whole mapping is changed
+  const int pattern_threshold = 4;
+
+  std::string errno_string(const char* what) {
+    std::ostringstream oss;
+    oss << what << ": " << strerror(errno);
+    return oss.str();
+  }
+
+  void clone_filename(std::string& result, const char* original, int id) {
+    std::ostringstream oss;
+    oss << original << ".clone" << id;
+    result = oss.str();
+  }
+}
+
+///////////////////////////////////////////////////////////////
+
+static ClassDesc DistArray4_MMapFile_cd(
+  typeid(DistArray4_MMapFile),"DistArray4_MMapFile",1,"public DistArray4",
+  0, 0, create<DistArray4_MMapFile>);
+
+DistArray4_MMapFile::DistArray4_MMapFile(const char* filename, int num_te_types,
+                                         int ni, int nj, int nx, int ny,
+                                         DistArray4Storage storage) :
+  DistArray4(num_te_types, ni, nj, nx, ny, storage)
+{
+  filename_ = strdup(filename);
+  init(false);
+}
+
+DistArray4_MMapFile::DistArray4_MMapFile(StateIn& si) :
+  DistArray4(si)
+{
+  si.getstring(filename_);
+  clonelist_ = ListOfClones::restore_instance(si);
+  init(true);
+}
+
+DistArray4_MMapFile::~DistArray4_MMapFile() {
+  if (data_ != 0)
+    munmap(data_, size_);
+  if (me() == 0)
+    unlink(filename_);
+  free(filename_);
+}
+
+void
+DistArray4_MMapFile::save_data_state(StateOut& so)
+{
+  DistArray4::save_data_state(so);
+  so.putstring(filename_);
+  ListOfClones::save_instance(clonelist_, so);
+}
+
+Ref<DistArray4>
+DistArray4_MMapFile::clone(const DistArray4Dimensions& dim) {
+  int id = 0;
+  std::string clonename;
+  clone_filename(clonename, this->filename_, id);
+  if (clonelist_) {
+    while (clonelist_->key_exists(clonename)) {
+      ++id;
+      clone_filename(clonename, this->filename_, id);
+    }
+  }
+  else {
+    clonelist_ = ListOfClones::instance();
+  }
+  clonelist_->add(clonename, id);
+
+  Ref<DistArray4_MMapFile> result;
+  if (dim == DistArray4Dimensions::default_dim())
+    result = new DistArray4_MMapFile(clonename.c_str(), num_te_types(),
+                                     ni(), nj(), nx(), ny(), storage());
+  else
+    result = new DistArray4_MMapFile(clonename.c_str(), dim.num_te_types(),
+                                     dim.n1(), dim.n2(), dim.n3(), dim.n4(),
+                                     dim.storage());
+
+  result->set_clonelist(clonelist_);
+  return result;
+}
+
+void
+DistArray4_MMapFile::set_clonelist(const Ref<ListOfClones>& cl) {
+  clonelist_ = cl;
+}
+
+void
+DistArray4_MMapFile::init(bool restart)
+{
+  data_ = 0;
+  size_ = (size_t)ni() * nj() * blocksize();
+  last_ij_ = -1;
+  nsequential_ = 0;
+  advice_ = MADV_NORMAL;
+
+  // the file can be shared only if all tasks are on the same host as task 0
+  {
+    char host[256], host0[256];
+    std::fill(host, host+sizeof(host), 0);
+    gethostname(host, sizeof(host)-1);
+    std::copy(host, host+sizeof(host), host0);
+    msg()->bcast(host0, sizeof(host0), 0);
+    int nremote = (strcmp(host, host0) == 0) ? 0 : 1;
+    msg()->sum(nremote);
+    shared_ = (nremote == 0);
+  }
+
+  // node 0 creates the file with its final size
+  if (me() == 0) {
+    const int fd = restart ? open(filename_, O_RDWR) :
+                             open(filename_, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+      throw FileOperationFailed(errno_string("DistArray4_MMapFile::init() -- could not open the file").c_str(),
+                                __FILE__, __LINE__, filename_,
+                                restart ? FileOperationFailed::OpenRW : FileOperationFailed::OpenW);
+    if (!restart && ftruncate(fd, size_) != 0) {
+      const std::string errmsg = errno_string("DistArray4_MMapFile::init() -- could not resize the file");
+      close(fd);
+      throw FileOperationFailed(errmsg.c_str(), __FILE__, __LINE__, filename_,
+                                FileOperationFailed::Write);
+    }
+    close(fd);
+  }
+  // others open it in activate()
+  if (shared_)
+    msg()->sync();
+}
+
+void
+DistArray4_MMapFile::activate()
+{
+  if (active()) return;
+
+  if (is_avail(0, 0) && size_ > 0) {
+    const int fd = open(filename_, O_RDWR);
+    if (fd == -1)
+      throw FileOperationFailed(errno_string("DistArray4_MMapFile::activate() -- could not open the file").c_str(),
+                                __FILE__, __LINE__, filename_, FileOperationFailed::OpenRW);
+    void* addr = mmap(0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const std::string errmsg = errno_string("DistArray4_MMapFile::activate() -- mmap failed");
+    close(fd); // the mapping remains valid
+    if (addr == MAP_FAILED)
+      throw FileOperationFailed(errmsg.c_str(), __FILE__, __LINE__, filename_,
+                                FileOperationFailed::Other);
+    data_ = static_cast<char*>(addr);
+    last_ij_ = -1;
+    nsequential_ = 0;
+    advice_ = MADV_NORMAL;
+  }
+  DistArray4::activate();
+  if (classdebug() > 0)
+    ExEnv::out0() << indent << "mapped file=" << filename_ << " size=" << size_ << endl;
+}
+
+void
+DistArray4_MMapFile::deactivate()
+{
+  if (!active()) return;
+
+  if (data_ != 0) {
+    munmap(data_, size_);
+    data_ = 0;
+  }
+  DistArray4::deactivate();
+  if (classdebug() > 0)
+    ExEnv::out0() << indent << "unmapped file=" << filename_ << endl;
+}
+
+void
+DistArray4_MMapFile::advise(off_t offset, size_t size, int advice) const
+{
+  static const off_t pagesize = sysconf(_SC_PAGESIZE);
+  const off_t start = offset - offset % pagesize;
+  const off_t fence = std::min((off_t)(offset + size), (off_t)size_);
+  if (fence > start)
+    madvise(data_ + start, fence - start, advice); // only a hint, failure is harmless
+}
+
+void
+DistArray4_MMapFile::record_access(int ij) const
+{
+  const long last = last_ij_.exchange(ij);
+  if (ij == last) // another operator type of the same pair
+    return;
+  int nseq = nsequential_;
+  if (ij == last + 1)
+    nseq = std::max(nseq, 0) + 1;
+  else
+    nseq = std::min(nseq, 0) - 1;
+  nseq = std::max(-pattern_threshold, std::min(pattern_threshold, nseq));
+  nsequential_ = nseq;
+
+  int advice = advice_;
+  if (nseq == pattern_threshold && advice != MADV_SEQUENTIAL)
+    advice = MADV_SEQUENTIAL;
+  else if (nseq == -pattern_threshold && advice != MADV_RANDOM)
+    advice = MADV_RANDOM;
+  else
+    return;
+  if (advice_.exchange(advice) != advice)
+    madvise(data_, size_, advice);
+}
+
+void
+DistArray4_MMapFile::store_pair_block(int i, int j, tbint_type oper_type, const double *data)
+{
+  MPQC_ASSERT(this->active());  //make sure we are active
+  if (!is_avail(i,j))
+    throw ProgrammingError("DistArray4_MMapFile::store_pair_block -- this task has no access to the file",
+                           __FILE__,__LINE__);
+
+  const off_t off = offset(ij_index(i,j), oper_type);
+  if (classdebug() > 0)
+    ExEnv::out0() << indent << "storing block: file=" << filename_ << " i,j=" << i << "," << j << " oper_type=" << oper_type << " offset=" << off << endl;
+  std::memcpy(data_ + off, data, blksize());
+}
+
+void
+DistArray4_MMapFile::store_pair_subblock(int i, int j, tbint_type oper_type,
+                                         int xstart, int xfence, int ystart, int yfence,
+                                         const double *buf)
+{
+  MPQC_ASSERT(this->active());  //make sure we are active
+  if (!is_avail(i,j))
+    throw ProgrammingError("DistArray4_MMapFile::store_pair_subblock -- this task has no access to the file",
+                           __FILE__,__LINE__);
+
+  const int xsize = xfence - xstart;
+  const int ysize = yfence - ystart;
+  double* dst = reinterpret_cast<double*>(data_ + offset(ij_index(i,j), oper_type)) + (size_t)xstart*ny() + ystart;
+  for(int x=0; x<xsize; ++x, dst+=ny(), buf+=ysize)
+    std::copy(buf, buf + ysize, dst);
+}
+
+const double *
+DistArray4_MMapFile::retrieve_pair_block(int i, int j, tbint_type oper_type,
+                                         double* buf) const
+{
+  if (not this->active()) { //make sure we are active
+    std::ostringstream oss;
+    oss << "DistArray4_MMapFile::retrieve_pair_block -- file " << this->filename_ << " is not mapped" << std::endl;
+    ExEnv::outn() << oss.str();
+    throw ProgrammingError(oss.str().c_str(), __FILE__, __LINE__);
+  }
+  if (!is_avail(i, j))
+    throw ProgrammingError("DistArray4_MMapFile::retrieve_pair_block -- this task has no access to the file",
+                           __FILE__,__LINE__);
+
+  const int ij = ij_index(i, j);
+  const off_t off = offset(ij, oper_type);
+  if (classdebug() > 0)
+    ExEnv::out0() << indent << "retrieving block: file=" << filename_
+        << " i,j=" << i << "," << j << " oper_type=" << oper_type << endl;
+
+  record_access(ij);
+  advise(off, blksize(), MADV_WILLNEED);
+  if (ij + 1 < ni()*nj())
+    advise(offset(ij+1, oper_type), blksize(), MADV_WILLNEED);
+
+  const double* ints = reinterpret_cast<const double*>(data_ + off);
+  if (buf == 0)
+    return ints;
+  std::copy(ints, ints + nxy(), buf);
+  return buf;
+}
+
+void
+DistArray4_MMapFile::retrieve_pair_subblock(int i, int j, tbint_type oper_type,
+                                            int xstart, int xfence, int ystart, int yfence,
+                                            double* buf) const
+{
+  MPQC_ASSERT(this->active());  //make sure we are active
+  if (!is_avail(i, j))
+    throw ProgrammingError("DistArray4_MMapFile::retrieve_pair_subblock -- this task has no access to the file",
+                           __FILE__,__LINE__);
+
+  const int xsize = xfence - xstart;
+  const int ysize = yfence - ystart;
+  const double* src = reinterpret_cast<const double*>(data_ + offset(ij_index(i,j), oper_type)) + (size_t)xstart*ny() + ystart;
+  for(int x=0; x<xsize; ++x, src+=ny(), buf+=ysize)
+    std::copy(src, src + ysize, buf);
+}
+
+// Local Variables:
+// mode: c++
+// c-file-style: "CLJ"
+// End:
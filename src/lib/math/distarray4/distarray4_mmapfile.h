@@ -0,0 +1,135 @@
+//
+// distarray4_mmapfile.h
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#ifndef _math_distarray4_distarray4_mmapfile_h
+#define _math_distarray4_distarray4_mmapfile_h
+
+#include <atomic>
+#include <unistd.h>
+#include <util/ref/ref.h>
+#include <util/misc/registry.h>
+#include <math/distarray4/distarray4.h>
+
+namespace sc {
+
+/////////////////////////////////////////////////////////////////////
+/** DistArray4_MMapFile handles transformed integrals stored in a binary
+    file that is mapped into memory with mmap.
+
+    The file layout is the same as that of DistArray4_Node0File. While the
+    object is active the whole file is mapped (shared, read/write), so
+    retrieve_pair_block returns a pointer directly into the mapping
+    (unless the caller provides a buffer) and release_pair_block does nothing.
+    Blocks are stored by copying into the mapping.
+
+    If all tasks run on the same host as task 0, every task maps the file and
+    has access to all blocks; the page cache of the host is then shared by
+    all tasks. Each block is still local to one task only, so that code that
+    splits the work with is_local does not repeat it on every task.
+    Otherwise only task 0 has access, as with DistArray4_Node0File.
+
+    The kernel is advised of the access pattern with madvise: the block that
+    is retrieved and the block of the next ij pair are requested with
+    MADV_WILLNEED, and the mapping as a whole is switched between
+    MADV_SEQUENTIAL and MADV_RANDOM according to whether the recent
+    retrievals followed the order of ij_index.
+*/
+
+class DistArray4_MMapFile: public DistArray4 {
+
+    char *filename_;
+    /// all tasks are on the same host and map the file
+    bool shared_;
+    /// the mapping, valid only while active
+    char* data_;
+    size_t size_;
+
+    // the state of the access pattern heuristic; it is only used to choose
+    // the madvise hints, hence races do not affect correctness
+    mutable std::atomic<long> last_ij_;
+    mutable std::atomic<int> nsequential_;
+    mutable std::atomic<int> advice_;
+
+    // keep track of clones of this object to be able to create unique names
+    typedef Registry<std::string,int,detail::NonsingletonCreationPolicy> ListOfClones;
+    Ref<ListOfClones> clonelist_;
+    void set_clonelist(const Ref<ListOfClones>& cl);
+
+    /// Initialization tasks common to all constructors
+    void init(bool restart);
+    /// the location of the block of oper_type of pair ij in the file (in bytes)
+    off_t offset(int ij, tbint_type oper_type) const {
+      return ((off_t)ij*num_te_types() + oper_type) * (off_t)blksize();
+    }
+    /// calls madvise on the pages that overlap [offset, offset+size)
+    void advise(off_t offset, size_t size, int advice) const;
+    /// updates the access pattern heuristic on retrieval of pair ij
+    void record_access(int ij) const;
+
+  public:
+    DistArray4_MMapFile(const char *filename, int num_te_types, int ni, int nj, int nx, int ny,
+                        DistArray4Storage storage = DistArray4Storage_XY);
+    DistArray4_MMapFile(StateIn&);
+    ~DistArray4_MMapFile();
+    void save_data_state(StateOut&);
+
+    Ref<DistArray4> clone(const DistArray4Dimensions& dim = DistArray4Dimensions::default_dim());
+
+    /// implementation of DistArray4::activate()
+    void activate();
+    /// implementation of DistArray4::deactivate()
+    void deactivate();
+    /// implementation of DistArray4::data_persistent()
+    bool data_persistent() const { return true; }
+
+    void store_pair_block(int i, int j, tbint_type oper_type, const double* ints);
+    void store_pair_subblock(int i, int j, tbint_type oper_type,
+                             int xstart, int xfence, int ystart, int yfence,
+                             const double* ints);
+    /// returns a pointer into the mapping, or buf, if given, after copying the block into it
+    const double* retrieve_pair_block(int i, int j, tbint_type oper_type, double* buf = 0) const;
+    void retrieve_pair_subblock(int i, int j, tbint_type oper_type,
+                                int xstart, int xfence, int ystart, int yfence,
+                                double* buf) const;
+    /// Does nothing: the blocks are owned by the mapping
+    void release_pair_block(int i, int j, tbint_type oper_type) const {}
+
+    /** Is this block stored locally?  If the tasks share the file, the pair
+        blocks are divided round-robin among them, so that loops over the local
+        blocks visit each block once. */
+    bool is_local(int i, int j) const {
+      return shared_ ? (ij_index(i,j) % ntasks() == me()) : (me() == 0);
+    }
+    /// Blocks are available on all tasks if they share the host, else only on node 0
+    bool is_avail(int i, int j) const { return shared_ || (me() == 0);};
+    /// Does this task have access to all the integrals?
+    bool has_access(int proc) const { return shared_ || (proc == 0);};
+};
+
+}
+
+#endif
+
+// Local Variables:
+// mode: c++
+// c-file-style: "CLJ"
+// End:
@@ -26,7 +26,14 @@
 //
 
 #include <cassert>
+#include <cstring>
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <util/misc/consumableresources.h>
 #include <util/misc/scexception.h>
 #include <sys/types.h>
@@ -44,6 +51,239 @@
 using namespace std;
 using namespace sc;
 
+namespace {
+  // like pwrite/pread, but transfer all size bytes; return false on failure
+  bool pwrite_all(int fd, const void* buf, size_t size, off_t offset) {
+    const char* ptr = static_cast<const char*>(buf);
+    while (size > 0) {
+      const ssize_t n = pwrite(fd, ptr, size, offset);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      ptr += n; size -= n; offset += n;
+    }
+    return true;
+  }
+  bool pread_all(int fd, void* buf, size_t size, off_t offset) {
+    char* ptr = static_cast<char*>(buf);
+    while (size > 0) {
+      const ssize_t n = pread(fd, ptr, size, offset);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      ptr += n; size -= n; offset += n;
+    }
+    return true;
+  }
+}
+
+///////////////////////////////////////////////////////////////
+
+/** The background I/O thread of DistArray4_Node0File. Requests are served
+    in the order of submission.  Writes go through a fixed set of write
+    buffers, so that the caller only blocks when all of them are in use.
+    There is one read-ahead slot per operator type; a block that is
+    written while it is being read ahead is discarded. */
+class DistArray4_Node0File::IOThread {
+  public:
+    IOThread(int fd, size_t blksize, int num_te_types, const char* filename);
+    /// waits for all requests to complete
+    ~IOThread();
+
+    /// queues the write of a block at offset
+    void write(off_t offset, const double* data);
+    /// waits for the pending writes to complete
+    void flush();
+    /// discards the read-ahead copy of the block at offset
+    void invalidate(off_t offset);
+    /// starts reading the block of type at offset into its read-ahead slot
+    void prefetch(int type, off_t offset);
+    /// if the block of type at offset has been read ahead, returns its buffer
+    /// (allocated with allocate<double>, now owned by the caller); otherwise returns 0
+    double* take(int type, off_t offset);
+
+  private:
+    static const int nwritebuf = 2;
+    struct Request {
+      bool write;
+      off_t offset;
+      double* buf;
+      int type;
+    };
+    enum SlotState { Empty, Pending, Ready, Stale };
+    struct Slot {
+      SlotState state;
+      off_t offset;
+      double* buf;
+    };
+
+    int fd_;
+    size_t blksize_;
+    std::string filename_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::deque<Request> queue_;
+    std::vector<double*> writebufs_;
+    std::vector<double*> freebufs_;
+    int nwrite_;    // writes queued or in progress
+    std::vector<Slot> slots_;
+    std::string error_;
+    bool stop_;
+    std::thread thread_;
+
+    void run();
+    // throws if an I/O operation has failed; call with mutex_ held
+    void check_error() const;
+    void invalidate_locked(off_t offset);
+};
+
+DistArray4_Node0File::IOThread::IOThread(int fd, size_t blksize, int num_te_types,
+                                         const char* filename) :
+  fd_(fd), blksize_(blksize), filename_(filename), nwrite_(0),
+  slots_(num_te_types), stop_(false)
+{
+  const size_t nxy = blksize_ / sizeof(double);
+  for(int b=0; b<nwritebuf; ++b) {
+    writebufs_.push_back(allocate<double>(nxy));
+    freebufs_.push_back(writebufs_.back());
+  }
+  for(size_t t=0; t<slots_.size(); ++t) {
+    slots_[t].state = Empty;
+    slots_[t].offset = 0;
+    slots_[t].buf = 0;
+  }
+  thread_ = std::thread(&IOThread::run, this);
+}
+
+DistArray4_Node0File::IOThread::~IOThread()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  thread_.join();
+  for(size_t b=0; b<writebufs_.size(); ++b)
+    deallocate(writebufs_[b]);
+  for(size_t t=0; t<slots_.size(); ++t)
+    if (slots_[t].buf) deallocate(slots_[t].buf);
+}
+
+void
+DistArray4_Node0File::IOThread::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_cv_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+    if (queue_.empty()) return; // stop_ is set and all requests are done
+    const Request req = queue_.front();
+    queue_.pop_front();
+    lock.unlock();
+    const bool ok = req.write ? pwrite_all(fd_, req.buf, blksize_, req.offset)
+                              : pread_all(fd_, req.buf, blksize_, req.offset);
+    const int errnum = errno;
+    lock.lock();
+    if (!ok && error_.empty()) {
+      std::ostringstream oss;
+      oss << "DistArray4_Node0File::IOThread -- " << (req.write ? "write" : "read")
+          << " failed: " << strerror(errnum);
+      error_ = oss.str();
+    }
+    if (req.write) {
+      freebufs_.push_back(req.buf);
+      --nwrite_;
+    }
+    else {
+      Slot& slot = slots_[req.type];
+      slot.state = (ok && slot.state == Pending) ? Ready : Empty;
+    }
+    done_cv_.notify_all();
+  }
+}
+
+void
+DistArray4_Node0File::IOThread::check_error() const
+{
+  if (!error_.empty())
+    throw FileOperationFailed(error_.c_str(), __FILE__, __LINE__,
+                              filename_.c_str(), FileOperationFailed::Other);
+}
+
+void
+DistArray4_Node0File::IOThread::invalidate_locked(off_t offset)
+{
+  for(size_t t=0; t<slots_.size(); ++t) {
+    Slot& slot = slots_[t];
+    if (slot.offset != offset) continue;
+    if (slot.state == Pending) slot.state = Stale;
+    else if (slot.state == Ready) slot.state = Empty;
+  }
+}
+
+void
+DistArray4_Node0File::IOThread::invalidate(off_t offset)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  invalidate_locked(offset);
+}
+
+void
+DistArray4_Node0File::IOThread::write(off_t offset, const double* data)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  check_error();
+  invalidate_locked(offset);
+  done_cv_.wait(lock, [this]{ return !freebufs_.empty(); });
+  double* buf = freebufs_.back();
+  freebufs_.pop_back();
+  ++nwrite_;
+  lock.unlock();
+  std::memcpy(buf, data, blksize_);
+  lock.lock();
+  Request req = { true, offset, buf, 0 };
+  queue_.push_back(req);
+  work_cv_.notify_one();
+}
+
+void
+DistArray4_Node0File::IOThread::flush()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this]{ return nwrite_ == 0; });
+  check_error();
+}
+
+void
+DistArray4_Node0File::IOThread::prefetch(int type, off_t offset)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Slot& slot = slots_[type];
+  if (slot.state == Pending || slot.state == Stale) return; // still busy
+  if (slot.state == Ready && slot.offset == offset) return;
+  if (slot.buf == 0) slot.buf = allocate<double>(blksize_ / sizeof(double));
+  slot.state = Pending;
+  slot.offset = offset;
+  Request req = { false, offset, slot.buf, type };
+  queue_.push_back(req);
+  work_cv_.notify_one();
+}
+
+double*
+DistArray4_Node0File::IOThread::take(int type, off_t offset)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  Slot& slot = slots_[type];
+  if (slot.offset != offset) return 0;
+  done_cv_.wait(lock, [&slot]{ return slot.state != Pending; });
+  check_error();
+  if (slot.state != Ready) return 0;
+  double* result = slot.buf;
+  slot.buf = 0;
+  slot.state = Empty;
+  return result;
+}
+
+bool DistArray4_Node0File::async_io_ = true;
+
 ///////////////////////////////////////////////////////////////
 
 static ClassDesc DistArray4_Node0File_cd(
@@ -68,6 +308,7 @@ DistArray4_Node0File::DistArray4_Node0File(StateIn& si) :
 }
 
 DistArray4_Node0File::~DistArray4_Node0File() {
+  delete iothread_;
   for (int i = 0; i < ni(); i++)
     for (int j = 0; j < nj(); j++) {
       if (!is_avail(i, j)) {
@@ -139,6 +380,7 @@ DistArray4_Node0File::clone(const DistArray4Dimensions& dim) {
 void
 DistArray4_Node0File::init(bool restart)
 {
+  iothread_ = 0;
   pairblk_ = new PairBlkInfo[ni()*nj()];
   int i, j, ij;
   for(i=0,ij=0;i<ni();i++)
@@ -209,6 +451,8 @@ DistArray4_Node0File::activate()
   if (me() == 0)
 #endif
     datafile_ = open(filename_, O_RDWR);
+  if (me() == 0 && async_io_ && datafile_ != -1)
+    iothread_ = new IOThread(datafile_, blksize(), num_te_types(), filename_);
   DistArray4::activate();
   if (classdebug() > 0)
     ExEnv::out0() << indent << "opened file=" << filename_ << " datafile=" << datafile_ << endl;
@@ -219,6 +463,11 @@ DistArray4_Node0File::deactivate()
 {
   if (!active()) return;
 
+  if (iothread_) {
+    iothread_->flush();
+    delete iothread_;
+    iothread_ = 0;
+  }
 #if CREATE_FILE_ON_NODE0_ONLY
   if (me() == 0)
 #endif
@@ -240,22 +489,15 @@ DistArray4_Node0File::store_pair_block(int i, int j, tbint_type oper_type, const
   const int ij = ij_index(i,j);
   const PairBlkInfo* pb = &pairblk_[ij];
 
-  // first, seek
   const off_t offset = pb->offset_ + (off_t)oper_type*blksize();
   if (classdebug() > 0)
     ExEnv::out0() << indent << "storing block: file=" << filename_ << " i,j=" << i << "," << j << " oper_type=" << oper_type << " offset=" << offset << endl;
-  const off_t result_offset = lseek(datafile_,offset,SEEK_SET);
-  if (offset == static_cast<off_t>(-1) || result_offset != offset) {
-    std::ostringstream oss;
-    oss << "DistArray4_Node0File::store_pair_block() -- lseek failed: " << strerror(errno);
-    throw FileOperationFailed(oss.str().c_str(),
-                                __FILE__, __LINE__,
-                                filename_, FileOperationFailed::Other);
+  if (iothread_) {
+    iothread_->write(offset, data);
+    return;
   }
 
-  // then, write
-  ssize_t wrote_this_much = write(datafile_, data, blksize());
-  if (wrote_this_much != blksize()) {
+  if (!pwrite_all(datafile_, data, blksize(), offset)) {
     const char* errormsg = strerror(errno);
     ExEnv::out0() << "DistArray4_Node0File::store_pair_block(): " << errormsg << std::endl;
     throw FileOperationFailed("DistArray4_Node0File::store_pair_block() -- write failed",
@@ -289,31 +531,24 @@ DistArray4_Node0File::store_pair_subblock(int i, int j, tbint_type oper_type,
   off_t offset = pb->offset_ +
           (off_t)oper_type*blksize() +
           (off_t)(xstart*ny() + ystart)*sizeof(double);
+  // the queued writes may include this block
+  if (iothread_) {
+    iothread_->flush();
+    iothread_->invalidate(pb->offset_ + (off_t)oper_type*blksize());
+  }
   ssize_t wrote_this_much = 0;
   while (wrote_this_much < bufsize) {
-    // first, seek
     if (classdebug() > 0)
       ExEnv::out0() << indent << "storing block: file=" << filename_ << " i,j=" << i << "," << j << " oper_type=" << oper_type
                     << " offset=" << offset << " batchsize=" << batchsize << endl;
-    const off_t result_offset = lseek(datafile_,offset,SEEK_SET);
-    if (offset == static_cast<off_t>(-1) || result_offset != offset) {
-      std::ostringstream oss;
-      oss << "DistArray4_Node0File::store_pair_block() -- lseek failed: " << strerror(errno);
-      throw FileOperationFailed(oss.str().c_str(),
-                                __FILE__, __LINE__,
-                                filename_, FileOperationFailed::Other);
-    }
-
-    // then, write
-    const ssize_t amount = write(datafile_, buf, batchsize);
-    wrote_this_much += amount;
-    if (amount != batchsize) {
+    if (!pwrite_all(datafile_, buf, batchsize, offset)) {
       const char* errormsg = strerror(errno);
       ExEnv::out0() << "DistArray4_Node0File::store_pair_block(): " << errormsg << std::endl;
       throw FileOperationFailed("DistArray4_Node0File::store_pair_block() -- write failed",
                                 __FILE__, __LINE__,
                                 filename_, FileOperationFailed::Write);
     }
+    wrote_this_much += batchsize;
     offset += stridesize;
     buf += batchsize/sizeof(double);
   }
@@ -344,35 +579,42 @@ const double * DistArray4_Node0File::retrieve_pair_block(int i, int j,
       ExEnv::out0() << indent << "retrieving block: file=" << filename_
           << " i,j=" << i << "," << j << " oper_type=" << oper_type << endl;
 
-    off_t offset = pb->offset_ + (off_t)oper_type*blksize();
-    off_t result_offset = lseek(datafile_, offset, SEEK_SET);
-    if (offset == (off_t)-1 || result_offset != offset) {
-      std::ostringstream oss;
-      oss << "DistArray4_Node0File::store_pair_block() -- lseek failed: " << strerror(errno);
-      throw FileOperationFailed(oss.str().c_str(),
-          __FILE__,
-          __LINE__,
-          filename_,
-          FileOperationFailed::Other);
+    const off_t offset = pb->offset_ + (off_t)oper_type*blksize();
+    double* prefetched = 0;
+    if (iothread_) {
+      iothread_->flush();
+      prefetched = iothread_->take(oper_type, offset);
     }
+    const bool read_ahead = (prefetched != 0);
     if (buf != 0) {
       pb->ints_[oper_type] = buf;
       pb->manage_[oper_type] = false;
+      if (prefetched != 0) {
+        std::copy(prefetched, prefetched + nxy(), buf);
+        deallocate(prefetched);
+      }
+    }
+    else if (read_ahead) { // hand over the read-ahead buffer
+      pb->ints_[oper_type] = prefetched;
+      pb->manage_[oper_type] = true;
     }
     else {
       pb->ints_[oper_type] = allocate<double>(nxy());
       pb->manage_[oper_type] = true;
     }
-    ssize_t read_this_much = read(datafile_, pb->ints_[oper_type], blksize());
-    if (read_this_much != blksize()) {
+    if (!read_ahead && !pread_all(datafile_, pb->ints_[oper_type], blksize(), offset)) {
       std::ostringstream oss;
-      oss << "DistArray4_Node0File::store_pair_block() -- read failed: " << strerror(errno);
+      oss << "DistArray4_Node0File::retrieve_pair_block() -- read failed: " << strerror(errno);
       throw FileOperationFailed(oss.str().c_str(),
           __FILE__,
           __LINE__,
           filename_,
           FileOperationFailed::Read);
     }
+
+    // read ahead the block of the next pair
+    if (iothread_ && ij + 1 < ni()*nj())
+      iothread_->prefetch(oper_type, pairblk_[ij+1].offset_ + (off_t)oper_type*blksize());
   }
   else { // data is already available
     if (buf != 0 && buf != pb->ints_[oper_type]) // may need to copy
@@ -435,33 +677,23 @@ DistArray4_Node0File::retrieve_pair_subblock(int i, int j, tbint_type oper_type,
   // therefore need to read in again
   if (pb->ints_[oper_type] == 0 || pb->manage_[oper_type] == false) {
 
-    off_t offset = pb->offset_ + (off_t)oper_type*blksize() +
-                   (off_t)(xstart*ny() + ystart)*sizeof(double);
-    read_lock->lock();
-    off_t result_offset = lseek(datafile_, offset, SEEK_SET);
-    if (offset == (off_t)-1 || result_offset != offset) {
-      std::ostringstream oss;
-      oss << "DistArray4_Node0File::retrieve_pair_block() -- lseek failed: " << strerror(errno);
-      read_lock->unlock();
-      throw FileOperationFailed(oss.str().c_str(),
-          __FILE__,
-          __LINE__,
-          filename_,
-          FileOperationFailed::Other);
-    }
+    const off_t offset = pb->offset_ + (off_t)oper_type*blksize() +
+                         (off_t)(xstart*ny() + ystart)*sizeof(double);
+    if (iothread_)
+      iothread_->flush();
 
     // do not assume that there is enough memory -- use static scratch and lock, if necessary
     size_t readbuf_size = contiguous ? bufsize : ((xsize-1) * ny() + ysize) * sizeof(double);
     void* readbuf = buf;
     if (!contiguous) {
+      read_lock->lock();
       readbuf = scratch.buffer(readbuf_size);
     }
 
-    const ssize_t read_this_much = read(datafile_, readbuf, readbuf_size);
-    if (read_this_much != readbuf_size) {
+    if (!pread_all(datafile_, readbuf, readbuf_size, offset)) {
       std::ostringstream oss;
       oss << "DistArray4_Node0File::retrieve_pair_subblock() -- read failed: " << strerror(errno);
-      read_lock->unlock();
+      if (!contiguous) read_lock->unlock();
       throw FileOperationFailed(oss.str().c_str(),
                                 __FILE__,
                                 __LINE__,
@@ -476,8 +708,8 @@ DistArray4_Node0File::retrieve_pair_subblock(int i, int j, tbint_type oper_type,
       for(int x=0; x<xsize; ++x, srcbuf+=ny(), outbuf+=ysize) {
         std::copy(srcbuf, srcbuf + ysize, outbuf);
       }
+      read_lock->unlock();
     }
-    read_lock->unlock();
   }
   else { // data is already available
     double* outbuf = buf;
@@ -47,6 +47,14 @@ namespace sc {
     The ordering of integrals in blocks is not specified
     to avoid having to reorder integrals
     Each pair block has size of num_te_types*nbasis1*nbasis2
+
+    All file access uses pread/pwrite, hence does not depend on the file position.
+    Unless disabled with set_async_io(), while the object is active node 0 runs
+    a background I/O thread: store_pair_block copies the block into one of two
+    write buffers and returns while the thread writes it, and retrieve_pair_block
+    reads ahead the block of the next ij pair (in the order of ij_index) for the
+    same operator type.  Pending writes are completed before any data is read
+    from the file.
 */
 
 class DistArray4_Node0File: public DistArray4 {
@@ -54,6 +62,10 @@ class DistArray4_Node0File: public DistArray4 {
     char *filename_;
     int datafile_;
 
+    class IOThread;
+    IOThread* iothread_;
+    static bool async_io_;
+
     // keep track of clones of this object to be able to create unique names
     typedef Registry<std::string,int,detail::NonsingletonCreationPolicy> ListOfClones;
     Ref<ListOfClones> clonelist_;
@@ -102,6 +114,10 @@ class DistArray4_Node0File: public DistArray4 {
     /// Releases an ij pair block of integrals
     void release_pair_block(int i, int j, tbint_type oper_type) const;
 
+    /// Use the background I/O thread in the objects activated from now on (default: true)
+    static void set_async_io(bool a) { async_io_ = a; }
+    static bool async_io() { return async_io_; }
+
     /// Is this block stored locally?
     bool is_local(int i, int j) const { return (me() == 0);};
     /// In this implementation blocks are available only on node 0
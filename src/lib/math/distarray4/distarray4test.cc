@@ -0,0 +1,105 @@
+//
+// distarray4test.cc
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <util/keyval/keyval.h>
+#include <util/misc/consumableresources.h>
+#include <math/distarray4/distarray4_compressed.h>
+
+using namespace std;
+using namespace sc;
+
+namespace {
+  void check(bool ok, const char* what) {
+    if (!ok) {
+      cerr << "distarray4test: " << what << " failed" << endl;
+      exit(1);
+    }
+  }
+
+  double integral(int i, int j, int x, int y) {
+    return 0.5 * exp(-0.1 * (i + j + x + y)) * ((x + y) % 2 ? -1.0 : 1.0);
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  // the memory limit is below the uncompressed size of the array, but above
+  // the estimated size of the compressed array
+  const size_t limit = 1500000;
+  Ref<AssignedKeyVal> akv = new AssignedKeyVal;
+  akv->assign("memory", "1500000");
+  ConsumableResources::set_default_instance(new ConsumableResources(akv));
+
+  const int ni = 8, nj = 8, nx = 64, ny = 64;
+  const double tolerance = 1.0e-6;
+  const size_t uncompressed = (size_t)ni * nj * nx * ny * sizeof(double);
+  const size_t estimate = (size_t)ni * nj
+                        * DistArray4_Compressed::estimated_block_size(nx * ny, tolerance);
+  cout << "uncompressed size = " << uncompressed << endl;
+  cout << "estimated size    = " << estimate << endl;
+  check(uncompressed > limit, "uncompressed size above the limit");
+  check(estimate <= limit, "estimated size within the limit");
+
+  Ref<DistArray4_Compressed> array = new DistArray4_Compressed(1, ni, nj, nx, ny, tolerance);
+  array->activate();
+  vector<double> block(nx * ny);
+  for (int i = 0; i < ni; ++i)
+    for (int j = 0; j < nj; ++j) {
+      for (int x = 0, xy = 0; x < nx; ++x)
+        for (int y = 0; y < ny; ++y, ++xy)
+          block[xy] = integral(i, j, x, y);
+      array->store_pair_block(i, j, 0, &block[0]);
+    }
+  cout << "compressed size   = " << array->compressed_size() << endl;
+  check(array->compressed_size() <= estimate, "compressed size within the estimate");
+  check(ConsumableResources::get_default_instance()->memory() == limit - array->compressed_size(),
+        "compressed blocks charged to the memory");
+
+  double maxerror = 0.0;
+  for (int i = 0; i < ni; ++i)
+    for (int j = 0; j < nj; ++j) {
+      const double* ints = array->retrieve_pair_block(i, j, 0);
+      for (int x = 0, xy = 0; x < nx; ++x)
+        for (int y = 0; y < ny; ++y, ++xy)
+          maxerror = max(maxerror, fabs(ints[xy] - integral(i, j, x, y)));
+      array->release_pair_block(i, j, 0);
+    }
+  cout << "max error         = " << maxerror << endl;
+  check(maxerror <= tolerance, "retrieved integrals within the tolerance");
+
+  array->deactivate();
+  array = 0;
+  check(ConsumableResources::get_default_instance()->memory() == limit,
+        "memory released with the array");
+
+  return 0;
+}
+
+// Local Variables:
+// mode: c++
+// c-file-style: "CLJ"
+// End:
@@ -31,6 +31,8 @@
 #include <math/distarray4/distarray4.h>
 #include <math/distarray4/distarray4_node0file.h>
 #include <math/distarray4/distarray4_memgrp.h>
+#include <math/distarray4/distarray4_mmapfile.h>
+#include <math/distarray4/distarray4_compressed.h>
 #include <math/distarray4/distarray4_mpiio.h>
 
 namespace sc {
@@ -38,6 +40,8 @@ namespace sc {
 ForceLink<DistArray4_MemoryGrp> math_distarray4_force_link_a_;
 ForceLink<DistArray4_Node0File> math_distarray4_force_link_b_;
 ForceLink<DistArray4_MPIIO>     math_distarray4_force_link_c_;
+ForceLink<DistArray4_MMapFile>  math_distarray4_force_link_d_;
+ForceLink<DistArray4_Compressed> math_distarray4_force_link_e_;
 
 }
 
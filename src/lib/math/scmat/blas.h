@@ -42,6 +42,14 @@ extern void F77_DGEMM(const char* transa, const char* transb, const blasint* nro
                       const double* beta,
                       double* C, const blasint* ldc);
 
+/** solves op(A) X = alpha B (side = 'L') or X op(A) = alpha B (side = 'R') in Fortran,
+ * where A is triangular; B is overwritten by X.
+ */
+extern void F77_DTRSM(const char* side, const char* uplo, const char* transa,
+                      const char* diag, const blasint* m, const blasint* n,
+                      const double* alpha, const double* A, const blasint* lda,
+                      double* B, const blasint* ldb);
+
 extern void F77_DGEMV(const char* trans, const blasint* m, const blasint* n, const double* alpha,
                       const double* A, const blasint* lda, const double* X, const blasint* incX,
                       const double* beta, double* Y, const blasint* incY);
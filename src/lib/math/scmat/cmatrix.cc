@@ -1008,6 +1008,73 @@ cmat_schmidt_tol(double **C, double *S, int nrow, int ncol,
   return northog;
 }
 
+/*
+ * Like cmat_diag (with matz = 1), but uses LAPACK's divide and conquer
+ * solver, DSYEVD.  The eigenvalues are in ascending order.  Returns the
+ * info value of DSYEVD; if it is nonzero evals and evecs are undefined.
+ */
+int
+cmat_diag_lapack(double**atri, double*evals, double**evecs, int n)
+{
+  if (n == 0) return 0;
+
+  // a is symmetric, so the Fortran order is the same
+  double *a = new double[n*n];
+  cmat_unpack_symmetric(a, atri, n);
+
+  const char jobz_V = 'V';
+  const char uplo_U = 'U';
+  const blasint nn = n;
+  blasint lwork = -1;
+  blasint liwork = -1;
+  blasint info;
+  double optlwork;
+  blasint optliwork;
+  F77_DSYEVD(&jobz_V, &uplo_U, &nn, a, &nn, evals,
+             &optlwork, &lwork, &optliwork, &liwork, &info);
+  if (info) {
+    delete[] a;
+    return info;
+  }
+  lwork = (blasint)optlwork;
+  liwork = optliwork;
+  double *work = new double[lwork];
+  blasint *iwork = new blasint[liwork];
+  F77_DSYEVD(&jobz_V, &uplo_U, &nn, a, &nn, evals,
+             work, &lwork, iwork, &liwork, &info);
+
+  if (!info) {
+    // the eigenvectors are the columns of a in Fortran order
+    int ij=0;
+    for (int i=0; i<n; i++) {
+      for (int j=0; j<n; j++, ++ij) {
+        evecs[j][i] = a[ij];
+      }
+    }
+  }
+
+  delete[] a;
+  delete[] work;
+  delete[] iwork;
+
+  return info;
+}
+
+/*
+ * Copies the symmetric matrix a, in triangular storage, to the square
+ * matrix sq, stored by rows.
+ */
+void
+cmat_unpack_symmetric(double*sq, double**a, int n)
+{
+  int i,j;
+  for (i=0; i<n; i++) {
+    for (j=0; j<=i; j++) {
+      sq[i*n+j] = sq[j*n+i] = a[i][j];
+    }
+  }
+}
+
 void
 cmat_eigensystem(/*const*/ double**atri, /*const*/ double**stri, double*evals, double**evecs, int n,
                  int matz)
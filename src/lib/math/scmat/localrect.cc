@@ -26,12 +26,14 @@
 //
 
 #include <math.h>
+#include <vector>
 
 #include <util/misc/formio.h>
 #include <util/misc/consumableresources.h>
 #include <util/keyval/keyval.h>
 #include <math/scmat/local.h>
 #include <math/scmat/cmatrix.h>
+#include <math/scmat/blas.h>
 #include <math/scmat/elemop.h>
 
 using namespace std;
@@ -372,11 +374,9 @@ LocalSCMatrix::accumulate_product_rr(SCMatrix*a,SCMatrix*b)
       abort();
     }
 
-  cmat_mxm(la->rows, 0,
-           lb->rows, 0,
-           rows, 0,
-           nrow(), la->ncol(), this->ncol(),
-           1);
+  C_DGEMM('n', 'n', nrow(), this->ncol(), la->ncol(),
+          1.0, la->block->data, la->ncol(), lb->block->data, lb->ncol(),
+          1.0, block->data, this->ncol());
 }
 
 // does the outer product a x b.  this must have rowdim() == a->dim() and
@@ -427,22 +427,13 @@ LocalSCMatrix::accumulate_product_rs(SCMatrix*a,SymmSCMatrix*b)
       abort();
     }
 
-  double **cd = rows;
-  double **ad = la->rows;
-  double **bd = lb->rows;
   int ni = a->rowdim().n();
   int njk = b->dim().n();
-  int i, j, k;
-  for (i=0; i<ni; i++) {
-      for (j=0; j<njk; j++) {
-          for (k=0; k<=j; k++) {
-              cd[i][k] += ad[i][j]*bd[j][k];
-            }
-          for (; k<njk; k++) {
-              cd[i][k] += ad[i][j]*bd[k][j];
-            }
-        }
-    }
+  if (ni == 0 || njk == 0) return;
+  std::vector<double> bsq(njk*njk);
+  cmat_unpack_symmetric(&bsq[0], lb->rows, njk);
+  C_DGEMM('n', 'n', ni, njk, njk, 1.0, la->block->data, njk,
+          &bsq[0], njk, 1.0, block->data, njk);
 }
 
 void
@@ -27,17 +27,17 @@
 
 #include <math.h>
 #include <algorithm>
+#include <vector>
 
 #include <util/misc/formio.h>
 #include <util/keyval/keyval.h>
 #include <math/scmat/local.h>
 #include <math/scmat/cmatrix.h>
+#include <math/scmat/blas.h>
 #include <math/scmat/elemop.h>
 #include <math/scmat/offset.h>
 #include <math/scmat/predicate.h>
 
-#include <math/scmat/mops.h>
-
 using namespace std;
 using namespace sc;
 
@@ -56,6 +56,48 @@ init_symm_rows(double *data, int n)
   return r;
 }
 
+// adds the lower triangle of the square matrix sq to a
+static void
+accumulate_lower(double **a, const double *sq, int n)
+{
+  for (int i=0; i<n; i++) {
+      for (int j=0; j<=i; j++) {
+          a[i][j] += sq[i*n+j];
+        }
+    }
+}
+
+// a (+)= c * diag(b) * transpose(c), where c is (na,nb) and stored by
+// rows in contiguous memory
+static void
+transform_diagonal(double **a, int na, const double *b, int nb,
+                   const double *c, int add)
+{
+  if (na == 0) return;
+  std::vector<double> cb(c, c + na*nb);
+  for (int i=0; i<na; i++) {
+      for (int k=0; k<nb; k++) {
+          cb[i*nb+k] *= b[k];
+        }
+    }
+  std::vector<double> res(na*na, 0.0);
+  C_DGEMM('n', 't', na, na, nb, 1.0, &cb[0], nb, c, nb, 0.0, &res[0], na);
+  if (!add) {
+      for (int i=0; i<na; i++)
+          for (int j=0; j<=i; j++)
+              a[i][j] = 0.0;
+    }
+  accumulate_lower(a, &res[0], na);
+}
+
+// diagonalizes a with LAPACK, falling back to cmat_diag if that fails
+static void
+diag(double **a, double *evals, double **evecs, int n)
+{
+  if (cmat_diag_lapack(a, evals, evecs, n))
+    cmat_diag(a, evals, evecs, n, 1, 1.0e-15);
+}
+
 LocalSymmSCMatrix::LocalSymmSCMatrix(const RefSCDimension&a,
                                      LocalSCMatrixKit *kit):
   SymmSCMatrix(a,kit),
@@ -396,7 +438,7 @@ LocalSymmSCMatrix::gen_invert_this(double condition_number_threshold)
   double *evals = new double[n()];
   double **evecs = cmat_new_square_matrix(n());
 
-  cmat_diag(rows,evals,evecs,n(),1,1.0e-15);
+  diag(rows,evals,evecs,n());
   const double sigma_max = * std::max_element(evals, evals+n(), abs_less<double>());
   const double sigma_min_threshold = sigma_max / condition_number_threshold;
   for (int i=0; i < n(); i++) {
@@ -406,7 +448,7 @@ LocalSymmSCMatrix::gen_invert_this(double condition_number_threshold)
       evals[i] = 0;
   }
 
-  cmat_transform_diagonal_matrix(rows, n(), evals, n(), evecs, 0);
+  transform_diagonal(rows, n(), evals, n(), evecs[0], 0);
 
   delete[] evals;
   cmat_delete_matrix(evecs);
@@ -446,7 +488,7 @@ LocalSymmSCMatrix::diagonalize(DiagSCMatrix*a,SCMatrix*b)
       eigvecs = lb->rows;
     }
 
-  cmat_diag(rows,eigvals,eigvecs,n(),1,1.0e-15);
+  diag(rows,eigvals,eigvecs,n());
 
   if (!la) delete[] eigvals;
   if (!lb) cmat_delete_matrix(eigvecs);
@@ -510,7 +552,13 @@ LocalSymmSCMatrix::accumulate_symmetric_product(SCMatrix*a)
       abort();
     }
 
-  cmat_symmetric_mxm(rows,n(),la->rows,la->ncol(),1);
+  int n = dim().n();
+  int nc = la->ncol();
+  if (n == 0 || nc == 0) return;
+  std::vector<double> res(n*n);
+  C_DGEMM('n', 't', n, n, nc, 1.0, la->block->data, nc,
+          la->block->data, nc, 0.0, &res[0], n);
+  accumulate_lower(rows, &res[0], n);
 }
 
 // computes this += a + a.t
@@ -569,8 +617,6 @@ void
 LocalSymmSCMatrix::accumulate_transform(SCMatrix*a,SymmSCMatrix*b,
                                        SCMatrix::Transform t)
 {
-  int i,j,k;
-  int ii,jj;
   int nc, nr;
 
   // do the necessary castdowns
@@ -602,80 +648,26 @@ LocalSymmSCMatrix::accumulate_transform(SCMatrix*a,SymmSCMatrix*b,
   if (nr==0 || nc==0)
     return;
 
-  int nproc = messagegrp()->n();
-
-  double **ablock = cmat_new_square_matrix(D1);
-  double **bblock = cmat_new_square_matrix(D1);
-  double **cblock = cmat_new_square_matrix(D1);
-
-  double **temp = cmat_new_rect_matrix(D1,nc);
-
-  for (i=0; i < nr; i += D1) {
-      int ni = nr-i;
-      if (ni > D1) ni = D1;
-
-      memset(temp[0], 0, sizeof(double)*D1*nc);
-
-      for (j=0; j < nc; j+= D1) {
-          int nj = nc-j;
-          if (nj > D1) nj = D1;
-
-          for (k=0; k < nc; k += D1) {
-
-              int nk = nc-k;
-              if (nk > D1) nk = D1;
-
-              if (t == SCMatrix::NormalTransform)
-                  copy_block(ablock, la->rows, i, ni, k, nk);
-              else
-                  copy_trans_block(ablock, la->rows, i, ni, k, nk);
+  std::vector<double> bsq(nc*nc);
+  cmat_unpack_symmetric(&bsq[0], lb->rows, nc);
 
-              copy_sym_block(bblock, lb->rows, j, nj, k, nk);
-              copy_block(cblock, temp, 0, ni, j, nj);
-              mult_block(ablock, bblock, cblock, ni, nj, nk);
-              return_block(temp, cblock, 0, ni, j, nj);
-            }
-        }
-
-      // now do ab * a~
-      for (j=0; j <= i; j+= D1) {
-          int nj = nr-j;
-          if (nj > D1) nj = D1;
-
-          memset(cblock[0], 0, sizeof(double)*D1*D1);
-
-          for (k=0; k < nc; k += D1) {
-
-              int nk = nc-k;
-              if (nk > D1) nk = D1;
-
-              copy_block(ablock, temp, 0, ni, k, nk);
-              if (t == SCMatrix::NormalTransform)
-                  copy_block(bblock, la->rows, j, nj, k, nk);
-              else
-                  copy_trans_block(bblock, la->rows, j, nj, k, nk);
-
-              mult_block(ablock, bblock, cblock, ni, nj, nk);
-            }
-
-          // copy cblock(i,j) into result
-          if (j==i) {
-              for (ii=0; ii < ni; ii++)
-                  for (jj=0; jj <= ii; jj++)
-                      rows[i+ii][j+jj] += cblock[ii][jj];
-            } else {
-                for (ii=0; ii < ni; ii++)
-                    for (jj=0; jj < nj; jj++)
-                        rows[i+ii][j+jj] += cblock[ii][jj];
-              }
-        }
-    }
-
-  cmat_delete_matrix(temp);
+  // temp = op(a) * b, and then this += temp * transpose(op(a))
+  std::vector<double> temp(nr*nc);
+  std::vector<double> res(nr*nr);
+  const double *adat = la->block->data;
+  if (t == SCMatrix::NormalTransform) {
+    C_DGEMM('n', 'n', nr, nc, nc, 1.0, adat, nc, &bsq[0], nc,
+            0.0, &temp[0], nc);
+    C_DGEMM('n', 't', nr, nr, nc, 1.0, &temp[0], nc, adat, nc,
+            0.0, &res[0], nr);
+  } else {
+    C_DGEMM('t', 'n', nr, nc, nc, 1.0, adat, nr, &bsq[0], nc,
+            0.0, &temp[0], nc);
+    C_DGEMM('n', 'n', nr, nr, nc, 1.0, &temp[0], nc, adat, nr,
+            0.0, &res[0], nr);
+  }
 
-  cmat_delete_matrix(ablock);
-  cmat_delete_matrix(bblock);
-  cmat_delete_matrix(cblock);
+  accumulate_lower(rows, &res[0], nr);
 }
 
 // this += a * b * transpose(a)
@@ -698,7 +690,7 @@ LocalSymmSCMatrix::accumulate_transform(SCMatrix*a,DiagSCMatrix*b,
       abort();
     }
 
-  cmat_transform_diagonal_matrix(rows,n(),lb->block->data,lb->n(),la->rows,1);
+  transform_diagonal(rows,n(),lb->block->data,lb->n(),la->block->data,1);
 }
 
 void
@@ -31,6 +31,7 @@
 #include <util/keyval/keyval.h>
 #include <math/scmat/local.h>
 #include <math/scmat/cmatrix.h>
+#include <math/scmat/blas.h>
 #include <math/scmat/elemop.h>
 
 using namespace std;
@@ -115,11 +116,8 @@ LocalSCVector::accumulate_product_rv(SCMatrix*a,SCVector*b)
       abort();
     }
 
-  cmat_mxm(la->rows, 0,
-           &(lb->block->data), 1,
-           &(block->data), 1,
-           n(), la->ncol(), 1,
-           1);
+  C_DGEMM('n', 'n', n(), 1, la->ncol(), 1.0, la->block->data, la->ncol(),
+          lb->block->data, 1, 1.0, block->data, 1);
 }
 
 void
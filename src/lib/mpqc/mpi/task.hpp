@@ -2,103 +2,189 @@
 #define MPQC_MPI_TASK_HPP
 
 #include "mpqc/mpi.hpp"
+#include "mpqc/omp.hpp"
+#include "mpqc/range.hpp"
 #include "mpqc/utility/mutex.hpp"
 
+#include <atomic>
+#include <iterator>
+#include <stdint.h>
+#include <util/misc/assert.h>
+
 #ifdef HAVE_ARMCI
 extern "C" {
 #include <armci.h>
 }
 #endif
 
-#if (defined HAVE_MPI) && !(defined HAVE_ARMCI)
-#error mpqc::MPI::Task requires ARMCI if using MPI
+#if (defined HAVE_MPI) && !(defined HAVE_ARMCI) && (MPI_VERSION < 3)
+#error mpqc::MPI::Task requires ARMCI or MPI-3 RMA if using MPI
 #endif
 
 namespace mpqc {
 namespace MPI {
 
-    /// Distributed task
+    /// Distributed task counter.
+    /// Tasks are numbered 0, 1, ... in the order they are handed out.
+    /// The global counter lives on rank 0; each process takes chunks of
+    /// consecutive tasks from it (ARMCI fetch-and-add or, without ARMCI,
+    /// MPI-3 passive-target MPI_Fetch_and_op) and serves its threads
+    /// from a process-local atomic, so that only one remote operation and
+    /// one lock per chunk are needed.
     /// @ingroup CoreMPI
     struct Task : boost::noncopyable {
 
-        typedef int T;
+        typedef int64_t T;
 
         /// Construct new task
-        /// @warning NOT threadsafe
-        explicit Task(const MPI::Comm &comm)
-            : comm_(comm), data_(0)
+        /// @param chunk number of tasks taken from the global counter at a time,
+        /// by default the number of threads
+        /// @warning NOT threadsafe, collective
+        explicit Task(const MPI::Comm &comm, int chunk = 0)
+            : comm_(comm),
+              chunk_((chunk > 0) ? chunk : omp::max_threads())
         {
+            MPQC_ASSERT(chunk_ <= max_chunk);
 #ifdef HAVE_ARMCI
             MPQC_ASSERT(comm == MPI_COMM_WORLD);
             ARMCI_Init();
             data_.resize(comm_.size());
-            ARMCI_Malloc(&data_[0], sizeof(T));
+            ARMCI_Malloc(&data_[0], sizeof(long));
+#elif (defined HAVE_MPI)
+            MPI_Win_allocate((comm_.rank() == 0) ? sizeof(int64_t) : 0,
+                             sizeof(int64_t), MPI_INFO_NULL, comm_,
+                             &data_, &win_);
+            MPI_Win_lock_all(0, win_);
 #endif
             reset(0);
         }
 
         /// Destructor
-        /// @warning NOT threadsafe
+        /// @warning NOT threadsafe, collective
         ~Task() {
 #ifdef HAVE_ARMCI
             ARMCI_Free(data_[comm_.rank()]);
+#elif (defined HAVE_MPI)
+            MPI_Win_unlock_all(win_);
+            MPI_Win_free(&win_);
 #endif
         }
 
         /// Reset task
+        /// @warning NOT threadsafe, collective
         void reset(const T &value = T(0)) {
             mutex::global::lock();
 #ifdef HAVE_ARMCI
             comm_.barrier();
             if (comm_.rank() == 0) {
-                ARMCI_PutValueInt(value, this->value(), 0);
+                ARMCI_PutValueLong(value, this->value(), 0);
                 ARMCI_Fence(0);
             }
             comm_.barrier();
+#elif (defined HAVE_MPI)
+            comm_.barrier();
+            if (comm_.rank() == 0) {
+                int64_t v = value;
+                MPI_Accumulate(&v, 1, MPI_INT64_T, 0, 0, 1, MPI_INT64_T,
+                               MPI_REPLACE, win_);
+                MPI_Win_flush(0, win_);
+            }
+            comm_.barrier();
 #else
-            data_ = 0;
+            data_ = value;
 #endif
+            // the local chunk is empty
+            local_ = pack(0, chunk_);
             mutex::global::unlock();
         }
 
         /// Get next task
         T operator++(int) {
-            int next;
-            mutex::global::lock();
-#ifdef HAVE_ARMCI
-            ARMCI_Rmw(ARMCI_FETCH_AND_ADD, &next, this->value(), 1, 0);
-#else
-            next = this->data_++;
-#endif
-            mutex::global::unlock();
-            return next;
+            while (true) {
+                const uint64_t s = local_.fetch_add(1);
+                if (taken(s) < uint64_t(chunk_))
+                    return begin(s) + taken(s);
+                // the chunk is used up: the first thread to get here takes the next one
+                boost::mutex::scoped_lock lock(refill_mutex_);
+                if (taken(local_.load()) < uint64_t(chunk_))
+                    continue; // another thread did
+                local_.store(pack(fetch_add(chunk_), 0));
+            }
         }
 
         /// Get next task range
-        mpqc::range next(range r, int block = 1) {            
-            int i = block*((*this)++);
+        mpqc::range next(range r, int block = 1) {
+            T i = block*((*this)++);
             return (r & mpqc::range(i, i+block));
         }
 
+        /// Get the iterator to the next task in [begin,end), or end if none left.
+        /// Random-access iterators are advanced in constant time.
         template<typename Iterator>
         Iterator next(Iterator begin, Iterator end) {
-            Iterator it = begin;
-            int n = (*this)++;
-            for (int i = 0; i < n; ++i) {
-                if (it == end) break;
-                ++it;
-            }
-            return it;
+            typedef typename std::iterator_traits<Iterator>::iterator_category category;
+            return advance(begin, end, (*this)++, category());
         }
 
     private:
 
+        // local_ holds the first task of the current chunk in the high bits
+        // and the number of tasks taken from it in the low bits. Threads
+        // that increment it after the chunk is used up cannot reach the
+        // high bits as long as chunk_ + (number of threads) < 2^taken_bits.
+        static const int taken_bits = 24;
+        static const int max_chunk = 1 << 16;
+        static uint64_t pack(T begin, int taken) {
+            return (uint64_t(begin) << taken_bits) | uint64_t(taken);
+        }
+        static T begin(uint64_t s) { return T(s >> taken_bits); }
+        static uint64_t taken(uint64_t s) { return s & ((uint64_t(1) << taken_bits) - 1); }
+
+        template<typename Iterator>
+        static Iterator advance(Iterator begin, Iterator end, T n,
+                                std::random_access_iterator_tag) {
+            return (n < T(end - begin)) ? begin + n : end;
+        }
+
+        template<typename Iterator, typename Category>
+        static Iterator advance(Iterator it, Iterator end, T n, Category) {
+            for (T i = 0; i < n && it != end; ++i) ++it;
+            return it;
+        }
+
+        /// fetch-and-add on the global counter
+        T fetch_add(int n) {
+            T next;
+            mutex::global::lock();
+#ifdef HAVE_ARMCI
+            long v;
+            ARMCI_Rmw(ARMCI_FETCH_AND_ADD_LONG, &v, this->value(), n, 0);
+            next = v;
+#elif (defined HAVE_MPI)
+            int64_t inc = n, v;
+            MPI_Fetch_and_op(&inc, &v, MPI_INT64_T, 0, 0, MPI_SUM, win_);
+            MPI_Win_flush(0, win_);
+            next = v;
+#else
+            next = data_;
+            data_ += n;
+#endif
+            mutex::global::unlock();
+            return next;
+        }
+
         MPI::Comm comm_;
+        const int chunk_;
+        std::atomic<uint64_t> local_;
+        boost::mutex refill_mutex_;
 #ifdef HAVE_ARMCI
         std::vector< void* > data_;
-        T* value() {
-            return (T*)data_[0];
+        long* value() {
+            return (long*)data_[0];
         }
+#elif (defined HAVE_MPI)
+        int64_t* data_;
+        MPI_Win win_;
 #else
         T data_;
 #endif
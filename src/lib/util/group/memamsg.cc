@@ -272,7 +272,7 @@ ActiveMsgMemoryGrp::sum_reduction(double *data, distsize_t doffset, size_t dsize
   MemoryIter i(data, offsets_, n());
   for (i.begin(offset, size); i.ready(); i.next()) {
       if (i.node() == me()) {
-          const int chunkdsize = i.size()/sizeof(double);
+          const size_t chunkdsize = i.size()/sizeof(double);
           double *chunkdata = (double*) &data_[i.offset()];
           double *tmp = (double*) i.data();
           PRINTF(("%d: summing %d doubles from 0x%x to 0x%x\n",
@@ -49,6 +49,36 @@ namespace sc {
 
 static const int dbufsize = 32768;
 
+// MPI counts are int, so retrieve and replace transfers are split into
+// messages of at most this many bytes.  Messages between a pair of nodes
+// with the same tag arrive in order.
+static const long max_mpi_nbyte = 1L<<30;
+
+static void
+send_chunked(const void *data, long nbyte, int node, int tag, MPI_Comm comm)
+{
+  const char *cdata = static_cast<const char*>(data);
+  do {
+      int n = (nbyte > max_mpi_nbyte) ? (int)max_mpi_nbyte : (int)nbyte;
+      MPI_Send(const_cast<char*>(cdata),n,MPI_BYTE,node,tag,comm);
+      cdata += n;
+      nbyte -= n;
+    } while (nbyte > 0);
+}
+
+static void
+recv_chunked(void *data, long nbyte, int node, int tag, MPI_Comm comm)
+{
+  char *cdata = static_cast<char*>(data);
+  MPI_Status status;
+  do {
+      int n = (nbyte > max_mpi_nbyte) ? (int)max_mpi_nbyte : (int)nbyte;
+      MPI_Recv(cdata,n,MPI_BYTE,node,tag,comm,&status);
+      cdata += n;
+      nbyte -= n;
+    } while (nbyte > 0);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // The MTMPIThread class
 
@@ -133,15 +163,15 @@ MTMPIThread::run_one()
       nreq_recd_++;
       if (req.lock())
           mem_->obtain_local_lock(req.offset(), req.offset()+req.size());
-      MPI_Send(&mem_->data_[req.offset()],req.size(),MPI_BYTE,
-               req.node(),rtag,mem_->comp_comm_);
+      send_chunked(&mem_->data_[req.offset()],req.size(),
+                   req.node(),rtag,mem_->comp_comm_);
       break;
   case MemoryDataRequest::Replace:
       nreq_recd_++;
       // May be able to get rid of this MPI_Send - MLL
       MPI_Send(&tag_,1,MPI_INT,req.node(),rtag,mem_->comp_comm_);
-      MPI_Recv(&mem_->data_[req.offset()],req.size(),MPI_BYTE,
-               req.node(),tag_,mem_->comm_comm_,&status);
+      recv_chunked(&mem_->data_[req.offset()],req.size(),
+                   req.node(),tag_,mem_->comm_comm_);
       if (req.lock())
           mem_->release_local_lock(req.offset(), req.offset()+req.size());
       break;
@@ -319,8 +349,7 @@ MTMPIMemoryGrp::retrieve_data(void *data, int node, long offset, long size,
   MPI_Send(req.data(),req.nbytes(),MPI_BYTE,node,req_tag_,comm_comm_);
 
   // receive the data
-  MPI_Status status;
-  MPI_Recv(data,size,MPI_BYTE,node,tag,comp_comm_,&status);
+  recv_chunked(data,size,node,tag,comp_comm_);
 }
 
 void
@@ -344,7 +373,7 @@ MTMPIMemoryGrp::replace_data(void *data, int node, long offset, long size,
   MPI_Recv(&rtag,1,MPI_INT,node,tag,comp_comm_,&status);
 
   // send the data
-  MPI_Send(data,size,MPI_BYTE,node,rtag,comm_comm_);
+  send_chunked(data,size,node,rtag,comm_comm_);
 }
 
 void
@@ -389,9 +418,9 @@ MTMPIMemoryGrp::sum_data(double *data, int node, long offset, long size)
 //  int rtag;
 //  MPI_Recv(&rtag,1,MPI_INT,node,tag,comm_,&status);
 
-  int dsize = size/sizeof(double);
-  int dremain = dsize;
-  int dcurrent = 0;
+  long dsize = size/sizeof(double);
+  long dremain = dsize;
+  long dcurrent = 0;
   while(dremain>0) {
       int dchunksize = dbufsize;
       if (dremain < dchunksize) dchunksize = dremain;
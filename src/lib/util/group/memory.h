@@ -158,7 +158,7 @@ class MemoryGrp: public DescribedClass {
     /// Returns the global offset to this node's memory.
     distsize_t localoffset() { return offsets_[me_]; }
     /// Returns the amount of memory residing on node.
-    int size(int node)
+    size_t size(int node)
         { return distsize_to_size(offsets_[node+1] - offsets_[node]); }
     /// Returns the global offset to node's memory.
     distsize_t offset(int node) { return offsets_[node]; }
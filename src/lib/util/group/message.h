@@ -124,11 +124,11 @@ class MessageGrp: public DescribedClass {
       private:
         int sender_;
         int type_;
-        int nbyte_;
+        size_t nbyte_;
       public:
         int sender() const { return sender_; }
         int type() const { return type_; }
-        int nbyte() const { return nbyte_; }
+        size_t nbyte() const { return nbyte_; }
     };
     enum { AnyType = -1 };
     enum { AnySender = -1 };
@@ -167,10 +167,28 @@ class MessageGrp: public DescribedClass {
     void set_type(MessageInfo *info,int type) {
       if (info) info->type_ = type;
     }
-    void set_nbyte(MessageInfo *info,int nbyte) {
+    void set_nbyte(MessageInfo *info,size_t nbyte) {
       if (info) info->nbyte_ = nbyte;
     }
 
+    /** @name Chunked Raw Members
+        The typed blocking send, receive and broadcast members use these
+        to pass messages of any size to the raw members, which take an
+        int byte count.  Messages larger than 1 GB are split into several
+        raw messages; the receiver must use the same kind of member.  A
+        receive from any sender (or of any type) takes the remaining
+        pieces from the sender (and type) of the first one. */
+    //@{
+    void chunked_send(int target, const void* data, size_t nbyte);
+    void chunked_recv(int sender, void* data, size_t nbyte,
+                      MessageInfo *info=0);
+    void chunked_sendt(int target, int type, const void* data, size_t nbyte,
+                       bool rcvrdy=false);
+    void chunked_recvt(int sender, int type, void* data, size_t nbyte,
+                       MessageInfo *info=0);
+    void chunked_bcast(void* data, size_t nbyte, int from);
+    //@}
+
     void set_id(MessageHandle *handle,void *id) {
       handle->id_ = id;
     }
@@ -236,15 +254,15 @@ class MessageGrp: public DescribedClass {
         @param ndata the number of data.
     */
     //@{
-    virtual void send(int target, const double* data, int ndata);
-    virtual void send(int target, const unsigned int* data, int ndata);
-    virtual void send(int target, const int* data, int ndata);
-    virtual void send(int target, const char* data, int nbyte);
-    virtual void send(int target, const unsigned char* data, int nbyte);
-    virtual void send(int target, const signed char* data, int nbyte);
-    virtual void send(int target, const short* data, int ndata);
-    virtual void send(int target, const long* data, int ndata);
-    virtual void send(int target, const float* data, int ndata);
+    virtual void send(int target, const double* data, long ndata);
+    virtual void send(int target, const unsigned int* data, long ndata);
+    virtual void send(int target, const int* data, long ndata);
+    virtual void send(int target, const char* data, long nbyte);
+    virtual void send(int target, const unsigned char* data, long nbyte);
+    virtual void send(int target, const signed char* data, long nbyte);
+    virtual void send(int target, const short* data, long ndata);
+    virtual void send(int target, const long* data, long ndata);
+    virtual void send(int target, const float* data, long ndata);
     /// This sends a single double datum.
     void send(int target, double data) { send(target,&data,1); }
     /// This sends a single integer datum.
@@ -260,23 +278,23 @@ class MessageGrp: public DescribedClass {
         @param ndata the number of data.
     */
     //@{
-    virtual void sendt(int target, int type, const double* data, int ndata,
+    virtual void sendt(int target, int type, const double* data, long ndata,
                        bool rcvrdy=false);
-    virtual void sendt(int target, int type, const unsigned int* data, int ndata,
+    virtual void sendt(int target, int type, const unsigned int* data, long ndata,
                        bool rcvrdy=false);
-    virtual void sendt(int target, int type, const int* data, int ndata,
+    virtual void sendt(int target, int type, const int* data, long ndata,
                        bool rcvrdy=false);
-    virtual void sendt(int target, int type, const char* data, int nbyte,
+    virtual void sendt(int target, int type, const char* data, long nbyte,
                        bool rcvrdy=false);
-    virtual void sendt(int target, int type, const unsigned char* data, int nbyte,
+    virtual void sendt(int target, int type, const unsigned char* data, long nbyte,
                        bool rcvrdy=false);
-    virtual void sendt(int target, int type, const signed char* data, int nbyte,
+    virtual void sendt(int target, int type, const signed char* data, long nbyte,
                        bool rcvrdy=false);
-    virtual void sendt(int target, int type, const short* data, int ndata,
+    virtual void sendt(int target, int type, const short* data, long ndata,
                        bool rcvrdy=false);
-    virtual void sendt(int target, int type, const long* data, int ndata,
+    virtual void sendt(int target, int type, const long* data, long ndata,
                        bool rcvrdy=false);
-    virtual void sendt(int target, int type, const float* data, int ndata,
+    virtual void sendt(int target, int type, const float* data, long ndata,
                        bool rcvrdy=false);
     /// This sends a single double datum.
     void sendt(int target, int type, double data,
@@ -294,15 +312,15 @@ class MessageGrp: public DescribedClass {
         @param ndata the number of data.
      */
     //@{
-    virtual void recv(int sender, double* data, int ndata);
-    virtual void recv(int sender, unsigned int* data, int ndata);
-    virtual void recv(int sender, int* data, int ndata);
-    virtual void recv(int sender, char* data, int nbyte);
-    virtual void recv(int sender, unsigned char* data, int nbyte);
-    virtual void recv(int sender, signed char* data, int nbyte);
-    virtual void recv(int sender, short* data, int ndata);
-    virtual void recv(int sender, long* data, int ndata);
-    virtual void recv(int sender, float* data, int ndata);
+    virtual void recv(int sender, double* data, long ndata);
+    virtual void recv(int sender, unsigned int* data, long ndata);
+    virtual void recv(int sender, int* data, long ndata);
+    virtual void recv(int sender, char* data, long nbyte);
+    virtual void recv(int sender, unsigned char* data, long nbyte);
+    virtual void recv(int sender, signed char* data, long nbyte);
+    virtual void recv(int sender, short* data, long ndata);
+    virtual void recv(int sender, long* data, long ndata);
+    virtual void recv(int sender, float* data, long ndata);
     /// This receives a single double datum.
     void recv(int sender, double& data) { recv(sender,&data,1); }
     /// This receives a single integer datum.
@@ -318,15 +336,15 @@ class MessageGrp: public DescribedClass {
         @param ndata the number of data.
      */
     //@{
-    virtual void recvt(int sender, int type, double* data, int ndata);
-    virtual void recvt(int sender, int type, unsigned int* data, int ndata);
-    virtual void recvt(int sender, int type, int* data, int ndata);
-    virtual void recvt(int sender, int type, char* data, int nbyte);
-    virtual void recvt(int sender, int type, unsigned char* data, int nbyte);
-    virtual void recvt(int sender, int type, signed char* data, int nbyte);
-    virtual void recvt(int sender, int type, short* data, int ndata);
-    virtual void recvt(int sender, int type, long* data, int ndata);
-    virtual void recvt(int sender, int type, float* data, int ndata);
+    virtual void recvt(int sender, int type, double* data, long ndata);
+    virtual void recvt(int sender, int type, unsigned int* data, long ndata);
+    virtual void recvt(int sender, int type, int* data, long ndata);
+    virtual void recvt(int sender, int type, char* data, long nbyte);
+    virtual void recvt(int sender, int type, unsigned char* data, long nbyte);
+    virtual void recvt(int sender, int type, signed char* data, long nbyte);
+    virtual void recvt(int sender, int type, short* data, long ndata);
+    virtual void recvt(int sender, int type, long* data, long ndata);
+    virtual void recvt(int sender, int type, float* data, long ndata);
     /// This receives a single double datum.
     void recvt(int sender, int type, double& data) {
       recvt(sender,type,&data,1);
@@ -470,15 +488,15 @@ class MessageGrp: public DescribedClass {
     /** @name Broadcast Members
         Do broadcasts of various types of data. */
     //@{
-    virtual void bcast(double* data, int ndata, int from = 0);
-    virtual void bcast(unsigned int* data, int ndata, int from = 0);
-    virtual void bcast(int* data, int ndata, int from = 0);
-    virtual void bcast(char* data, int nbyte, int from = 0);
-    virtual void bcast(unsigned char* data, int nbyte, int from = 0);
-    virtual void bcast(signed char* data, int nbyte, int from = 0);
-    virtual void bcast(short* data, int ndata, int from = 0);
-    virtual void bcast(long* data, int ndata, int from = 0);
-    virtual void bcast(float* data, int ndata, int from = 0);
+    virtual void bcast(double* data, long ndata, int from = 0);
+    virtual void bcast(unsigned int* data, long ndata, int from = 0);
+    virtual void bcast(int* data, long ndata, int from = 0);
+    virtual void bcast(char* data, long nbyte, int from = 0);
+    virtual void bcast(unsigned char* data, long nbyte, int from = 0);
+    virtual void bcast(signed char* data, long nbyte, int from = 0);
+    virtual void bcast(short* data, long ndata, int from = 0);
+    virtual void bcast(long* data, long ndata, int from = 0);
+    virtual void bcast(float* data, long ndata, int from = 0);
     virtual void raw_bcast(void* data, int nbyte, int from = 0);
     void bcast(double& data, int from = 0) { bcast(&data, 1, from); }
     void bcast(int& data, int from = 0) { bcast(&data, 1, from); }
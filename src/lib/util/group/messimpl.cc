@@ -27,6 +27,8 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 #include <util/misc/formio.h>
 #include <util/misc/exenv.h>
 
@@ -310,205 +312,286 @@ MessageGrp::initialize(int me, int n)
   this->dereference();
 }
 
+// Chunked raw routines
+
+// the largest message passed to the raw routines
+static const size_t max_raw_nbyte = 1UL<<30;
+
+void
+MessageGrp::chunked_send(int target, const void* data, size_t nbyte)
+{
+  const char *cdata = static_cast<const char*>(data);
+  do {
+      int n = static_cast<int>(std::min(nbyte, max_raw_nbyte));
+      raw_send(target, cdata, n);
+      cdata += n;
+      nbyte -= n;
+    } while (nbyte > 0);
+}
+
+void
+MessageGrp::chunked_recv(int sender, void* data, size_t nbyte,
+                         MessageInfo *info)
+{
+  char *cdata = static_cast<char*>(data);
+  const size_t total = nbyte;
+  MessageInfo chunkinfo;
+  do {
+      int n = static_cast<int>(std::min(nbyte, max_raw_nbyte));
+      raw_recv(sender, cdata, n, &chunkinfo);
+      sender = chunkinfo.sender();
+      cdata += n;
+      nbyte -= n;
+    } while (nbyte > 0);
+  set_sender(info, chunkinfo.sender());
+  set_type(info, chunkinfo.type());
+  set_nbyte(info, total);
+}
+
+void
+MessageGrp::chunked_sendt(int target, int type, const void* data,
+                          size_t nbyte, bool rcvrdy)
+{
+  const char *cdata = static_cast<const char*>(data);
+  do {
+      int n = static_cast<int>(std::min(nbyte, max_raw_nbyte));
+      raw_sendt(target, type, cdata, n, rcvrdy);
+      cdata += n;
+      nbyte -= n;
+    } while (nbyte > 0);
+}
+
+void
+MessageGrp::chunked_recvt(int sender, int type, void* data, size_t nbyte,
+                          MessageInfo *info)
+{
+  char *cdata = static_cast<char*>(data);
+  const size_t total = nbyte;
+  MessageInfo chunkinfo;
+  do {
+      int n = static_cast<int>(std::min(nbyte, max_raw_nbyte));
+      raw_recvt(sender, type, cdata, n, &chunkinfo);
+      sender = chunkinfo.sender();
+      type = chunkinfo.type();
+      cdata += n;
+      nbyte -= n;
+    } while (nbyte > 0);
+  set_sender(info, chunkinfo.sender());
+  set_type(info, chunkinfo.type());
+  set_nbyte(info, total);
+}
+
+void
+MessageGrp::chunked_bcast(void* data, size_t nbyte, int from)
+{
+  char *cdata = static_cast<char*>(data);
+  do {
+      int n = static_cast<int>(std::min(nbyte, max_raw_nbyte));
+      raw_bcast(cdata, n, from);
+      cdata += n;
+      nbyte -= n;
+    } while (nbyte > 0);
+}
+
 // Sequential send routines
 
 void
-MessageGrp::send(int target, const double* data, int ndata)
+MessageGrp::send(int target, const double* data, long ndata)
 {
-  raw_send(target, data, ndata*sizeof(double));
+  chunked_send(target, data, ndata*sizeof(double));
 }
 void
-MessageGrp::send(int target, const short* data, int ndata)
+MessageGrp::send(int target, const short* data, long ndata)
 {
-  raw_send(target, data, ndata*sizeof(short));
+  chunked_send(target, data, ndata*sizeof(short));
 }
 void
-MessageGrp::send(int target, const long* data, int ndata)
+MessageGrp::send(int target, const long* data, long ndata)
 {
-  raw_send(target, data, ndata*sizeof(long));
+  chunked_send(target, data, ndata*sizeof(long));
 }
 void
-MessageGrp::send(int target, const float* data, int ndata)
+MessageGrp::send(int target, const float* data, long ndata)
 {
-  raw_send(target, data, ndata*sizeof(float));
+  chunked_send(target, data, ndata*sizeof(float));
 }
 void
-MessageGrp::send(int target, const unsigned int* data, int ndata)
+MessageGrp::send(int target, const unsigned int* data, long ndata)
 {
-  raw_send(target, data, ndata*sizeof(int));
+  chunked_send(target, data, ndata*sizeof(int));
 }
 void
-MessageGrp::send(int target, const int* data, int ndata)
+MessageGrp::send(int target, const int* data, long ndata)
 {
-  raw_send(target, data, ndata*sizeof(int));
+  chunked_send(target, data, ndata*sizeof(int));
 }
 void
-MessageGrp::send(int target, const char* data, int ndata)
+MessageGrp::send(int target, const char* data, long ndata)
 {
-  raw_send(target, data, ndata);
+  chunked_send(target, data, ndata);
 }
 void
-MessageGrp::send(int target, const unsigned char* data, int ndata)
+MessageGrp::send(int target, const unsigned char* data, long ndata)
 {
-  raw_send(target, data, ndata);
+  chunked_send(target, data, ndata);
 }
 void
-MessageGrp::send(int target, const signed char* data, int ndata)
+MessageGrp::send(int target, const signed char* data, long ndata)
 {
-  raw_send(target, data, ndata);
+  chunked_send(target, data, ndata);
 }
 
 // Sequential receive routines
 
 void
-MessageGrp::recv(int sender, double* data, int ndata)
+MessageGrp::recv(int sender, double* data, long ndata)
 {
-  raw_recv(sender, data, ndata*sizeof(double));
+  chunked_recv(sender, data, ndata*sizeof(double));
 }
 void
-MessageGrp::recv(int sender, short* data, int ndata)
+MessageGrp::recv(int sender, short* data, long ndata)
 {
-  raw_recv(sender, data, ndata*sizeof(short));
+  chunked_recv(sender, data, ndata*sizeof(short));
 }
 void
-MessageGrp::recv(int sender, long* data, int ndata)
+MessageGrp::recv(int sender, long* data, long ndata)
 {
-  raw_recv(sender, data, ndata*sizeof(long));
+  chunked_recv(sender, data, ndata*sizeof(long));
 }
 void
-MessageGrp::recv(int sender, float* data, int ndata)
+MessageGrp::recv(int sender, float* data, long ndata)
 {
-  raw_recv(sender, data, ndata*sizeof(float));
+  chunked_recv(sender, data, ndata*sizeof(float));
 }
 void
-MessageGrp::recv(int sender, unsigned int* data, int ndata)
+MessageGrp::recv(int sender, unsigned int* data, long ndata)
 {
-  raw_recv(sender, data, ndata*sizeof(int));
+  chunked_recv(sender, data, ndata*sizeof(int));
 }
 void
-MessageGrp::recv(int sender, int* data, int ndata)
+MessageGrp::recv(int sender, int* data, long ndata)
 {
-  raw_recv(sender, data, ndata*sizeof(int));
+  chunked_recv(sender, data, ndata*sizeof(int));
 }
 void
-MessageGrp::recv(int sender, char* data, int ndata)
+MessageGrp::recv(int sender, char* data, long ndata)
 {
-  raw_recv(sender, data, ndata);
+  chunked_recv(sender, data, ndata);
 }
 void
-MessageGrp::recv(int sender, unsigned char* data, int ndata)
+MessageGrp::recv(int sender, unsigned char* data, long ndata)
 {
-  raw_recv(sender, data, ndata);
+  chunked_recv(sender, data, ndata);
 }
 void
-MessageGrp::recv(int sender, signed char* data, int ndata)
+MessageGrp::recv(int sender, signed char* data, long ndata)
 {
-  raw_recv(sender, data, ndata);
+  chunked_recv(sender, data, ndata);
 }
 
 // Typed send routines
 
 void
-MessageGrp::sendt(int target, int type, const double* data, int ndata,
+MessageGrp::sendt(int target, int type, const double* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata*sizeof(double),rcvrdy);
+  chunked_sendt(target, type, data, ndata*sizeof(double),rcvrdy);
 }
 void
-MessageGrp::sendt(int target, int type, const short* data, int ndata,
+MessageGrp::sendt(int target, int type, const short* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata*sizeof(short),rcvrdy);
+  chunked_sendt(target, type, data, ndata*sizeof(short),rcvrdy);
 }
 void
-MessageGrp::sendt(int target, int type, const long* data, int ndata,
+MessageGrp::sendt(int target, int type, const long* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata*sizeof(long),rcvrdy);
+  chunked_sendt(target, type, data, ndata*sizeof(long),rcvrdy);
 }
 void
-MessageGrp::sendt(int target, int type, const float* data, int ndata,
+MessageGrp::sendt(int target, int type, const float* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata*sizeof(float),rcvrdy);
+  chunked_sendt(target, type, data, ndata*sizeof(float),rcvrdy);
 }
 void
-MessageGrp::sendt(int target, int type, const unsigned int* data, int ndata,
+MessageGrp::sendt(int target, int type, const unsigned int* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata*sizeof(int),rcvrdy);
+  chunked_sendt(target, type, data, ndata*sizeof(int),rcvrdy);
 }
 void
-MessageGrp::sendt(int target, int type, const int* data, int ndata,
+MessageGrp::sendt(int target, int type, const int* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata*sizeof(int),rcvrdy);
+  chunked_sendt(target, type, data, ndata*sizeof(int),rcvrdy);
 }
 void
-MessageGrp::sendt(int target, int type, const char* data, int ndata,
+MessageGrp::sendt(int target, int type, const char* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata, rcvrdy);
+  chunked_sendt(target, type, data, ndata, rcvrdy);
 }
 void
-MessageGrp::sendt(int target, int type, const unsigned char* data, int ndata,
+MessageGrp::sendt(int target, int type, const unsigned char* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata, rcvrdy);
+  chunked_sendt(target, type, data, ndata, rcvrdy);
 }
 void
-MessageGrp::sendt(int target, int type, const signed char* data, int ndata,
+MessageGrp::sendt(int target, int type, const signed char* data, long ndata,
                   bool rcvrdy)
 {
-  raw_sendt(target, type, data, ndata, rcvrdy);
+  chunked_sendt(target, type, data, ndata, rcvrdy);
 }
 
 // Typed receive routines
 
 void
-MessageGrp::recvt(int sender, int type, double* data, int ndata)
+MessageGrp::recvt(int sender, int type, double* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata*sizeof(double));
+  chunked_recvt(sender, type, data, ndata*sizeof(double));
 }
 void
-MessageGrp::recvt(int sender, int type, short* data, int ndata)
+MessageGrp::recvt(int sender, int type, short* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata*sizeof(short));
+  chunked_recvt(sender, type, data, ndata*sizeof(short));
 }
 void
-MessageGrp::recvt(int sender, int type, long* data, int ndata)
+MessageGrp::recvt(int sender, int type, long* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata*sizeof(long));
+  chunked_recvt(sender, type, data, ndata*sizeof(long));
 }
 void
-MessageGrp::recvt(int sender, int type, float* data, int ndata)
+MessageGrp::recvt(int sender, int type, float* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata*sizeof(float));
+  chunked_recvt(sender, type, data, ndata*sizeof(float));
 }
 void
-MessageGrp::recvt(int sender, int type, unsigned int* data, int ndata)
+MessageGrp::recvt(int sender, int type, unsigned int* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata*sizeof(int));
+  chunked_recvt(sender, type, data, ndata*sizeof(int));
 }
 void
-MessageGrp::recvt(int sender, int type, int* data, int ndata)
+MessageGrp::recvt(int sender, int type, int* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata*sizeof(int));
+  chunked_recvt(sender, type, data, ndata*sizeof(int));
 }
 void
-MessageGrp::recvt(int sender, int type, char* data, int ndata)
+MessageGrp::recvt(int sender, int type, char* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata);
+  chunked_recvt(sender, type, data, ndata);
 }
 void
-MessageGrp::recvt(int sender, int type, unsigned char* data, int ndata)
+MessageGrp::recvt(int sender, int type, unsigned char* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata);
+  chunked_recvt(sender, type, data, ndata);
 }
 void
-MessageGrp::recvt(int sender, int type, signed char* data, int ndata)
+MessageGrp::recvt(int sender, int type, signed char* data, long ndata)
 {
-  raw_recvt(sender, type, data, ndata);
+  chunked_recvt(sender, type, data, ndata);
 }
 
 // Nonblocking typed send routines
@@ -637,49 +720,49 @@ MessageGrp::nb_recvt(int sender, int type, signed char* data, int ndata,
 // Broadcast operations
 
 void
-MessageGrp::bcast(double*data, int ndata, int from)
+MessageGrp::bcast(double*data, long ndata, int from)
 {
-  raw_bcast(data, ndata*sizeof(double), from);
+  chunked_bcast(data, ndata*sizeof(double), from);
 }
 void
-MessageGrp::bcast(short*data, int ndata, int from)
+MessageGrp::bcast(short*data, long ndata, int from)
 {
-  raw_bcast(data, ndata*sizeof(short), from);
+  chunked_bcast(data, ndata*sizeof(short), from);
 }
 void
-MessageGrp::bcast(long*data, int ndata, int from)
+MessageGrp::bcast(long*data, long ndata, int from)
 {
-  raw_bcast(data, ndata*sizeof(long), from);
+  chunked_bcast(data, ndata*sizeof(long), from);
 }
 void
-MessageGrp::bcast(float*data, int ndata, int from)
+MessageGrp::bcast(float*data, long ndata, int from)
 {
-  raw_bcast(data, ndata*sizeof(float), from);
+  chunked_bcast(data, ndata*sizeof(float), from);
 }
 void
-MessageGrp::bcast(unsigned int*data, int ndata, int from)
+MessageGrp::bcast(unsigned int*data, long ndata, int from)
 {
-  raw_bcast(data, ndata*sizeof(int), from);
+  chunked_bcast(data, ndata*sizeof(int), from);
 }
 void
-MessageGrp::bcast(int*data, int ndata, int from)
+MessageGrp::bcast(int*data, long ndata, int from)
 {
-  raw_bcast(data, ndata*sizeof(int), from);
+  chunked_bcast(data, ndata*sizeof(int), from);
 }
 void
-MessageGrp::bcast(char*data, int ndata, int from)
+MessageGrp::bcast(char*data, long ndata, int from)
 {
-  raw_bcast(data, ndata, from);
+  chunked_bcast(data, ndata, from);
 }
 void
-MessageGrp::bcast(unsigned char*data, int ndata, int from)
+MessageGrp::bcast(unsigned char*data, long ndata, int from)
 {
-  raw_bcast(data, ndata, from);
+  chunked_bcast(data, ndata, from);
 }
 void
-MessageGrp::bcast(signed char*data, int ndata, int from)
+MessageGrp::bcast(signed char*data, long ndata, int from)
 {
-  raw_bcast(data, ndata, from);
+  chunked_bcast(data, ndata, from);
 }
 
 // Global classdesc indices
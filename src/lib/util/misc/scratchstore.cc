@@ -0,0 +1,166 @@
+//
+// scratchstore.cc
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#include <stdlib.h>
+
+#include <util/misc/exenv.h>
+#include <util/misc/scratchstore.h>
+
+using namespace std;
+using namespace sc;
+
+// the size of a task header, a block header, or an end record
+static const size_t header_size = 2*sizeof(int);
+
+ScratchTaskStore::ScratchTaskStore(const std::string &filename, size_t maxsize):
+  filename_(filename),
+  maxsize_(maxsize),
+  size_(0),
+  full_(false),
+  bad_(false)
+{
+  next_[0] = next_[1] = -1;
+  file_ = fopen(filename_.c_str(), "w+b");
+  if (file_ == 0) bad_ = true;
+}
+
+ScratchTaskStore::~ScratchTaskStore()
+{
+  if (file_ != 0) {
+      fclose(file_);
+      remove(filename_.c_str());
+    }
+}
+
+void
+ScratchTaskStore::write(const void *data, size_t size)
+{
+  if (bad_) return;
+  if (fwrite(data, 1, size, file_) != size) bad_ = true;
+  size_ += size;
+}
+
+void
+ScratchTaskStore::read(void *data, size_t size)
+{
+  if (fread(data, 1, size, file_) != size) {
+      ExEnv::errn() << "ScratchTaskStore: could not read from "
+                    << filename_ << endl;
+      abort();
+    }
+}
+
+void
+ScratchTaskStore::read_header()
+{
+  read(next_, header_size);
+}
+
+bool
+ScratchTaskStore::begin_task(int S, int R)
+{
+  if (full()) return false;
+  if (size_ + 2*header_size > maxsize_) {
+      full_ = true;
+      return false;
+    }
+  int SR[2];
+  SR[0] = S;
+  SR[1] = R;
+  write(SR, header_size);
+  tasks_.push_back(S);
+  tasks_.push_back(R);
+  return true;
+}
+
+void
+ScratchTaskStore::put(int P, int Q, const double *buf, size_t n)
+{
+  if (full()) return;
+  // room for the end record of the task is always kept
+  if (size_ + 2*header_size + n*sizeof(double) > maxsize_) {
+      full_ = true;
+      return;
+    }
+  int PQ[2];
+  PQ[0] = P;
+  PQ[1] = Q;
+  write(PQ, header_size);
+  write(buf, n*sizeof(double));
+}
+
+void
+ScratchTaskStore::end_task()
+{
+  int end[2];
+  end[0] = end[1] = -1;
+  write(end, header_size);
+}
+
+void
+ScratchTaskStore::finish_writing()
+{
+  if (!bad_ && fflush(file_) != 0) bad_ = true;
+  full_ = true;
+}
+
+void
+ScratchTaskStore::rewind()
+{
+  if (fseek(file_, 0, SEEK_SET) != 0) {
+      ExEnv::errn() << "ScratchTaskStore: could not rewind "
+                    << filename_ << endl;
+      abort();
+    }
+}
+
+void
+ScratchTaskStore::begin_read_task()
+{
+  int SR[2];
+  read(SR, header_size);
+  read_header();
+}
+
+void
+ScratchTaskStore::get(double *buf, size_t n)
+{
+  read(buf, n*sizeof(double));
+  read_header();
+}
+
+void
+ScratchTaskStore::end_read_task()
+{
+  if (!next_is(-1,-1)) {
+      ExEnv::errn() << "ScratchTaskStore: stored blocks of a task"
+                    << " were not all read from " << filename_ << endl;
+      abort();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+// Local Variables:
+// mode: c++
+// c-file-style: "CLJ-CONDENSED"
+// End:
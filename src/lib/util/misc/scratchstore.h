@@ -0,0 +1,115 @@
+//
+// scratchstore.h
+//
+// This file is part of the SC Toolkit.
+//
+// The SC Toolkit is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// The SC Toolkit is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public License
+// along with the SC Toolkit; see the file COPYING.LIB.  If not, write to
+// the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// The U.S. Government is granted a limited license as per AL 91-7.
+//
+
+#ifndef _util_misc_scratchstore_h
+#define _util_misc_scratchstore_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+/** ScratchTaskStore keeps blocks of doubles produced by one thread in a
+    local scratch file, so that later passes over the same tasks can read
+    them back instead of recomputing them; e.g. the passes over the AO
+    integral shell quartets of a multipass integral transform.
+
+    A task is labeled by a pair of indices (S,R) and holds blocks labeled
+    by pairs of indices (P,Q).  The blocks of a task are written in the
+    order they are computed and are followed by an end record.  Once the
+    size limit is reached no more blocks are written, so the last task may
+    be stored only in part; the caller must recompute its remaining blocks
+    when it is replayed. */
+class ScratchTaskStore {
+  private:
+    std::string filename_;
+    FILE *file_;
+    size_t maxsize_;
+    size_t size_;
+    bool full_;
+    bool bad_;
+    // S, R of each stored task
+    std::vector<int> tasks_;
+    // the header of the next block to be read
+    int next_[2];
+
+    void write(const void *data, size_t size);
+    void read(void *data, size_t size);
+    void read_header();
+
+  public:
+    /** Creates the scratch file filename.  At most maxsize bytes
+        will be written to it. */
+    ScratchTaskStore(const std::string &filename, size_t maxsize);
+    /// Closes and removes the scratch file.
+    ~ScratchTaskStore();
+
+    /// Returns true if no more tasks can be stored.
+    bool full() const { return full_ || bad_; }
+    /// Returns true if the scratch file could not be written.
+    bool bad() const { return bad_; }
+    /// The number of bytes written.
+    size_t size() const { return size_; }
+
+    /** Begins storing the blocks of task (S,R).  Returns
+        false if the store is full, in which case nothing is written. */
+    bool begin_task(int S, int R);
+    /** Stores the n doubles of block (P,Q) for the current task.
+        Does nothing once the store is full. */
+    void put(int P, int Q, const double *buf, size_t n);
+    /// Ends the current task.
+    void end_task();
+    /** Flushes the scratch file.  Afterwards the stored tasks can be
+        read back. */
+    void finish_writing();
+
+    /// The number of stored tasks.
+    int ntask() const { return tasks_.size()/2; }
+    /// The S index of stored task i.
+    int task_S(int i) const { return tasks_[2*i]; }
+    /// The R index of stored task i.
+    int task_R(int i) const { return tasks_[2*i+1]; }
+
+    /// Positions the file at the first stored task.
+    void rewind();
+    /// Begins reading the next stored task.
+    void begin_read_task();
+    /// Returns true if (P,Q) is the next stored block of this task.
+    bool next_is(int P, int Q) const { return next_[0] == P && next_[1] == Q; }
+    /// Reads the n doubles of the next stored block into buf.
+    void get(double *buf, size_t n);
+    /** Ends reading the current task.  All of its stored blocks must
+        have been read. */
+    void end_read_task();
+};
+
+}
+
+#endif
+
+// //////////////////////////////////////////////////////////////////////////
+
+// Local Variables:
+// mode: c++
+// c-file-style: "CLJ-CONDENSED"
+// End: